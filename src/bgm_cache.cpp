@@ -0,0 +1,127 @@
+#include <spdlog/spdlog.h>
+
+#include "bgm_cache.hpp"
+#include "vfs.hpp"
+
+// Tracks aren't played until someone asks for them, so there's no need to start caching them before that
+BGMCache BGMFiles(0);
+
+BGMCache::~BGMCache()
+{
+	{
+		std::lock_guard lock(mtx);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	if (worker.joinable())
+		worker.join();
+}
+
+bool BGMCache::find(const std::filesystem::path& path, Entry* entry)
+{
+	auto key = VirtualFileSystem::Key(path);
+
+	std::lock_guard lock(mtx);
+	auto it = index.find(key);
+	if (it == index.end())
+	{
+		misses++;
+		return false;
+	}
+
+	lru.splice(lru.begin(), lru, it->second);
+	*entry = it->second->entry;
+	hits++;
+	return true;
+}
+
+void BGMCache::prefetch(const std::filesystem::path& path)
+{
+	auto key = VirtualFileSystem::Key(path);
+	{
+		std::lock_guard lock(mtx);
+		if (!maxSize || index.contains(key) || !queued.insert(key).second)
+			return;
+
+		queue.push_back(path);
+
+		if (!worker.joinable())
+			worker = std::thread(&BGMCache::workerLoop, this);
+	}
+	wake.notify_one();
+}
+
+void BGMCache::setMaxSize(size_t size)
+{
+	std::lock_guard lock(mtx);
+	maxSize = size;
+	evict();
+}
+
+size_t BGMCache::getMaxSize() const
+{
+	std::lock_guard lock(mtx);
+	return maxSize;
+}
+
+BGMCache::Stats BGMCache::getStats() const
+{
+	std::lock_guard lock(mtx);
+	return { hits, misses, prefetches, bytesResident, maxSize };
+}
+
+void BGMCache::workerLoop()
+{
+	while (true)
+	{
+		std::filesystem::path path;
+		{
+			std::unique_lock lock(mtx);
+			wake.wait(lock, [&] { return stopping || !queue.empty(); });
+			if (stopping)
+				return;
+
+			path = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		auto key = VirtualFileSystem::Key(path);
+
+		Entry entry;
+		entry.owner = ModFiles.open(path, &entry.data, &entry.size);
+		if (!entry.owner)
+			spdlog::warn("BGMCache: unable to open {}", path.string());
+
+		// Mapping alone doesn't read anything in, fault every page in now so playback doesn't have to
+		volatile uint8_t sink = 0;
+		for (size_t i = 0; entry.owner && i < entry.size; i += 4096)
+			sink = sink + entry.data[i];
+
+		std::lock_guard lock(mtx);
+		queued.erase(key);
+
+		if (!entry.owner || entry.size > maxSize || index.contains(key))
+		{
+			if (entry.owner && entry.size > maxSize)
+				spdlog::info("BGMCache: {} ({}MB) doesn't fit in the cache", path.string(), entry.size / (1024 * 1024));
+			continue;
+		}
+
+		bytesResident += entry.size;
+		lru.push_front({ key, std::move(entry) });
+		index[key] = lru.begin();
+		prefetches++;
+		evict();
+	}
+}
+
+void BGMCache::evict()
+{
+	while (bytesResident > maxSize && !lru.empty())
+	{
+		bytesResident -= lru.back().entry.size;
+		index.erase(lru.back().key);
+		lru.pop_back();
+	}
+}
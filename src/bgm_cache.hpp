@@ -0,0 +1,90 @@
+// Cache of compressed BGM files
+// Keeps recently played tracks & the ones we expect to play next (eg. the next CD switcher track) in memory, so
+// changing tracks doesn't have to wait on the drive. Files are mapped through ModFiles & read in on a background thread,
+// decoders then stream from the mapped data (see PcmStream::OpenFromMemory).
+//
+// Least recently used tracks are dropped once the byte budget is reached, anything still being played is kept alive
+// by the decoder holding onto its entry.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+class BGMCache
+{
+public:
+	struct Entry
+	{
+		std::shared_ptr<const void> owner; // keeps data mapped
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+	};
+
+	struct Stats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t prefetches = 0; // files read in by the background thread
+		size_t bytesResident = 0;
+		size_t maxSize = 0;
+	};
+
+	explicit BGMCache(size_t maxSize) : maxSize(maxSize) {}
+	~BGMCache();
+
+	BGMCache(const BGMCache&) = delete;
+	BGMCache& operator=(const BGMCache&) = delete;
+
+	// Only returns files that were already read in, callers should fall back to the file system & prefetch() it otherwise
+	bool find(const std::filesystem::path& path, Entry* entry);
+
+	// Queues the file to be read in on the background thread, does nothing if it's cached or queued already
+	void prefetch(const std::filesystem::path& path);
+
+	// 0 disables the cache
+	void setMaxSize(size_t size);
+	size_t getMaxSize() const;
+
+	Stats getStats() const;
+
+private:
+	struct Node
+	{
+		std::string key;
+		Entry entry;
+	};
+
+	size_t maxSize;
+	size_t bytesResident = 0;
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t prefetches = 0;
+
+	std::list<Node> lru; // most recently used first
+	std::unordered_map<std::string, std::list<Node>::iterator> index;
+
+	std::deque<std::filesystem::path> queue;
+	std::unordered_set<std::string> queued;
+	bool stopping = false;
+	std::thread worker;
+
+	mutable std::mutex mtx;
+	std::condition_variable wake;
+
+	void workerLoop();
+	void evict(); // caller holds mtx
+};
+
+// Shared by every decoder that can stream from memory
+extern BGMCache BGMFiles;
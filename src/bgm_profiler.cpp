@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#include <spdlog/spdlog.h>
+
+#include "bgm_profiler.hpp"
+
+BGMDecodeProfiler BGMProfiler;
+
+const char* BGMDecodeProfiler::FormatName(int format)
+{
+	static const char* names[FormatCount] = { "FLAC", "Opus" };
+	return (format >= 0 && format < FormatCount) ? names[format] : "unknown";
+}
+
+static double Milliseconds(uint64_t nanoseconds)
+{
+	return double(nanoseconds) / 1000000.0;
+}
+
+static double MBps(uint64_t bytes, uint64_t nanoseconds)
+{
+	if (!nanoseconds)
+		return 0;
+	return (double(bytes) / (1024 * 1024)) / (double(nanoseconds) / 1000000000.0);
+}
+
+double BGMDecodeProfiler::Track::decodeMBps() const
+{
+	return MBps(pcmBytes, decodeNanoseconds);
+}
+
+double BGMDecodeProfiler::FormatStats::decodeMBps() const
+{
+	return MBps(pcmBytes, decodeNanoseconds);
+}
+
+void BGMDecodeProfiler::setThresholds(const Thresholds& value)
+{
+	std::lock_guard lock(mtx);
+	thresholds = value;
+}
+
+void BGMDecodeProfiler::record(Track track)
+{
+	// Tracks closed right after opening haven't decoded enough for their speed to mean anything
+	const uint64_t minDecodedBytes = 1024 * 1024;
+
+	Thresholds limits;
+	{
+		std::lock_guard lock(mtx);
+		limits = thresholds;
+	}
+
+	track.warnings = 0;
+	if (limits.decodeMBps > 0 && track.pcmBytes >= minDecodedBytes && track.decodeMBps() < limits.decodeMBps)
+	{
+		track.warnings |= SlowDecode;
+		spdlog::warn("BGMDecodeProfiler: {} decoded at {:.1f}MB/s, below BGMDecodeWarnMBps ({})", track.name, track.decodeMBps(), limits.decodeMBps);
+	}
+	if (limits.firstReadMs > 0 && Milliseconds(track.firstReadNanoseconds) > limits.firstReadMs)
+	{
+		track.warnings |= SlowFirstRead;
+		spdlog::warn("BGMDecodeProfiler: {} took {:.1f}ms to first audio, above BGMFirstReadWarnMs ({})", track.name, Milliseconds(track.firstReadNanoseconds), limits.firstReadMs);
+	}
+	if (limits.loopSeekMs > 0 && Milliseconds(track.loopSeekMaxNanoseconds) > limits.loopSeekMs)
+	{
+		track.warnings |= SlowLoopSeek;
+		spdlog::warn("BGMDecodeProfiler: {} took {:.1f}ms to seek to its loop start, above BGMLoopSeekWarnMs ({})", track.name, Milliseconds(track.loopSeekMaxNanoseconds), limits.loopSeekMs);
+	}
+
+	spdlog::debug("BGMDecodeProfiler: {} ({}) {:.1f}MB/s, {:.1f}ms to first audio, {} loop seeks (max {:.1f}ms), {}KB held",
+		track.name, FormatName(track.format), track.decodeMBps(), Milliseconds(track.firstReadNanoseconds),
+		track.loopSeeks, Milliseconds(track.loopSeekMaxNanoseconds), track.memoryBytes / 1024);
+
+	std::lock_guard lock(mtx);
+
+	if (track.format < FormatCount)
+	{
+		auto& stats = formats[track.format];
+		stats.tracks++;
+		stats.pcmBytes += track.pcmBytes;
+		stats.decodeNanoseconds += track.decodeNanoseconds;
+		stats.firstReadMaxNanoseconds = std::max<uint64_t>(stats.firstReadMaxNanoseconds, track.firstReadNanoseconds);
+		stats.loopSeeks += track.loopSeeks;
+		stats.loopSeekMaxNanoseconds = std::max<uint64_t>(stats.loopSeekMaxNanoseconds, track.loopSeekMaxNanoseconds);
+		stats.memoryPeakBytes = std::max<uint64_t>(stats.memoryPeakBytes, track.memoryBytes);
+		if (track.warnings)
+			stats.warnings++;
+	}
+
+	if (recentCount == 0)
+		return;
+
+	tracks.push_front(std::move(track));
+	if (tracks.size() > recentCount)
+		tracks.pop_back();
+}
+
+std::vector<BGMDecodeProfiler::Track> BGMDecodeProfiler::recent() const
+{
+	std::lock_guard lock(mtx);
+	return std::vector<Track>(tracks.begin(), tracks.end());
+}
+
+BGMDecodeProfiler::FormatStats BGMDecodeProfiler::stats(Format format) const
+{
+	std::lock_guard lock(mtx);
+	return format < FormatCount ? formats[format] : FormatStats{};
+}
+
+void BGMDecodeProfiler::reset()
+{
+	std::lock_guard lock(mtx);
+	tracks.clear();
+	for (auto& stats : formats)
+		stats = FormatStats{};
+}
+
+// One row per format with an empty track column, followed by a row for each recent track
+bool BGMDecodeProfiler::writeCsv(const std::filesystem::path& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		spdlog::error("BGMDecodeProfiler: failed to write profile to {}", path.string());
+		return false;
+	}
+
+	file << std::fixed << "format,track,tracks,decoded_bytes,decode_ms,decode_mbps,first_read_ms,loop_seeks,loop_seek_max_ms,memory_bytes,warnings\n";
+
+	for (int i = 0; i < FormatCount; i++)
+	{
+		FormatStats format = stats(Format(i));
+		file << FormatName(i) << ",," << format.tracks << ',' << format.pcmBytes
+			<< ',' << std::setprecision(3) << Milliseconds(format.decodeNanoseconds)
+			<< ',' << std::setprecision(2) << format.decodeMBps()
+			<< ',' << std::setprecision(3) << Milliseconds(format.firstReadMaxNanoseconds)
+			<< ',' << format.loopSeeks
+			<< ',' << std::setprecision(3) << Milliseconds(format.loopSeekMaxNanoseconds)
+			<< ',' << format.memoryPeakBytes << ',' << format.warnings << '\n';
+	}
+
+	for (const auto& track : recent())
+	{
+		file << FormatName(track.format) << ",\"" << track.name << "\",1," << track.pcmBytes
+			<< ',' << std::setprecision(3) << Milliseconds(track.decodeNanoseconds)
+			<< ',' << std::setprecision(2) << track.decodeMBps()
+			<< ',' << std::setprecision(3) << Milliseconds(track.firstReadNanoseconds)
+			<< ',' << track.loopSeeks
+			<< ',' << std::setprecision(3) << Milliseconds(track.loopSeekMaxNanoseconds)
+			<< ',' << track.memoryBytes << ',' << track.warnings << '\n';
+	}
+
+	return true;
+}
@@ -0,0 +1,97 @@
+// BGM decode profiler
+// Keeps what each of our decoders cost while a track was open: how fast it decoded, how much memory it held, how long the
+// game waited for the first audio after opening it (ie. after a CD switcher track change) & how long loop seeks took.
+// Totals are kept per format along with the most recent tracks, & tracks that go past the [Audio] warning thresholds
+// get logged so a slow encode or format can be spotted without having to watch the overlay.
+//
+// Decoders fill in a Track while open (see PcmStream) & hand it to record() when closed, from any thread.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class BGMDecodeProfiler
+{
+public:
+	enum Format
+	{
+		FLAC,
+		Opus,
+		FormatCount
+	};
+
+	static const char* FormatName(int format);
+
+	enum Warning
+	{
+		SlowDecode = 1 << 0,
+		SlowFirstRead = 1 << 1,
+		SlowLoopSeek = 1 << 2
+	};
+
+	struct Track
+	{
+		std::string name;
+		Format format = FLAC;
+		uint64_t pcmBytes = 0;          // decoded audio handed to the game, loop head copies included
+		uint64_t decodeNanoseconds = 0; // decode thread busy time, not counting waits on a full ring
+		uint64_t firstReadNanoseconds = 0; // open until the first Read that returned audio, 0 if never read
+		uint64_t loopSeeks = 0;
+		uint64_t loopSeekMaxNanoseconds = 0;
+		uint64_t memoryBytes = 0;       // ring, loop head & decoder buffers, including the compressed file if held in memory
+		int warnings = 0;
+
+		double decodeMBps() const;
+	};
+
+	struct FormatStats
+	{
+		uint64_t tracks = 0;
+		uint64_t pcmBytes = 0;
+		uint64_t decodeNanoseconds = 0;
+		uint64_t firstReadMaxNanoseconds = 0;
+		uint64_t loopSeeks = 0;
+		uint64_t loopSeekMaxNanoseconds = 0;
+		uint64_t memoryPeakBytes = 0;
+		uint64_t warnings = 0; // tracks that went over any threshold
+
+		double decodeMBps() const;
+	};
+
+	// 0 disables that warning, CustomWaveFileHook sets them from the BGM*Warn* settings
+	struct Thresholds
+	{
+		float decodeMBps = 0.0f;
+		int firstReadMs = 0;
+		int loopSeekMs = 0;
+	};
+
+	explicit BGMDecodeProfiler(size_t recentCount = 32) : recentCount(recentCount) {}
+
+	void setThresholds(const Thresholds& value);
+
+	// Checks the track against the thresholds & logs any it went over
+	void record(Track track);
+
+	// Most recent first
+	std::vector<Track> recent() const;
+	FormatStats stats(Format format) const;
+	void reset();
+
+	bool writeCsv(const std::filesystem::path& path) const;
+
+private:
+	size_t recentCount;
+
+	mutable std::mutex mtx;
+	Thresholds thresholds;
+	std::deque<Track> tracks;
+	FormatStats formats[FormatCount];
+};
+
+extern BGMDecodeProfiler BGMProfiler;
@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <bit>
+#include <unordered_map>
+
+#include <spdlog/spdlog.h>
+
+#include "bgm_tracks.hpp"
+#include "vfs.hpp"
+
+BGMTrackTable BGMTracks;
+
+namespace
+{
+	// Same folding as VirtualFileSystem keys, Windows paths are case-insensitive
+	char Fold(char c)
+	{
+#ifdef _WIN32
+		if (c >= 'A' && c <= 'Z')
+			return c - 'A' + 'a';
+#endif
+		return c;
+	}
+
+	// Appends part's segments to id with '/' between them, skipping empty & "." ones
+	bool AppendPath(std::string_view part, char* id, size_t* length, size_t* lastSegment)
+	{
+		if (part.empty())
+			return true;
+
+		// Absolute & drive relative paths aren't relative to the working directory
+		if (part.front() == '/' || part.front() == '\\' || part.find(':') != std::string_view::npos)
+			return false;
+
+		size_t pos = 0;
+		while (pos <= part.size())
+		{
+			size_t end = part.find_first_of("/\\", pos);
+			if (end == std::string_view::npos)
+				end = part.size();
+			std::string_view segment = part.substr(pos, end - pos);
+			pos = end + 1;
+
+			if (segment.empty() || segment == ".")
+				continue;
+			if (segment == "..")
+				return false;
+
+			size_t len = *length;
+			if (len + (len ? 1 : 0) + segment.size() > BGMTrackTable::MaxIdLength)
+				return false;
+
+			if (len)
+				id[len++] = '/';
+			*lastSegment = len;
+			for (char c : segment)
+				id[len++] = Fold(c);
+			*length = len;
+		}
+		return true;
+	}
+
+	bool IsExtension(const std::filesystem::path& path, std::string_view extension)
+	{
+		auto ext = path.extension().string();
+		return std::equal(ext.begin(), ext.end(), extension.begin(), extension.end(),
+			[](char a, char b) { return ::tolower((unsigned char)a) == b; });
+	}
+}
+
+bool BGMTrackTable::MakeId(std::string_view directory, std::string_view path, char (&id)[MaxIdLength], size_t* length)
+{
+	size_t len = 0;
+	size_t lastSegment = 0;
+	if (!AppendPath(directory, id, &len, &lastSegment) || !AppendPath(path, id, &len, &lastSegment))
+		return false;
+
+	// Drop the extension, a leading dot is part of the name
+	for (size_t i = len; i > lastSegment + 1; i--)
+	{
+		if (id[i - 1] == '.')
+		{
+			len = i - 1;
+			break;
+		}
+	}
+
+	*length = len;
+	return len > 0;
+}
+
+uint64_t BGMTrackTable::HashId(std::string_view id)
+{
+	// FNV-1a
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (char c : id)
+	{
+		hash ^= uint8_t(c);
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+void BGMTrackTable::build(const std::vector<std::filesystem::path>& directories)
+{
+	// Read the generation first, a change that lands while we're listing then gets picked up by the next update()
+	builtGeneration = ModFiles.generation();
+
+	if (&directories != &this->directories)
+		this->directories = directories;
+	roots.clear();
+	tracks.clear();
+
+	char id[MaxIdLength];
+	size_t length = 0;
+	size_t lastSegment = 0;
+	std::unordered_map<std::string, size_t> indices;
+
+	for (const auto& directory : this->directories)
+	{
+		auto directoryString = directory.string();
+		length = 0;
+		if (!AppendPath(directoryString, id, &length, &lastSegment))
+		{
+			spdlog::warn("BGMTrackTable: {} isn't relative to the game folder, skipping", directoryString);
+			continue;
+		}
+		roots.emplace_back(id, length);
+
+		for (const auto& file : ModFiles.list(directory, true))
+		{
+			auto relative = file.lexically_relative(directory);
+			if (relative.empty() || !MakeId(directoryString, relative.string(), id, &length))
+				continue;
+
+			auto [it, inserted] = indices.try_emplace(std::string(id, length), tracks.size());
+			if (inserted)
+				tracks.push_back(Track{ it->first });
+
+			// First file found wins if names only differ by case
+			Track& track = tracks[it->second];
+			std::string* type = nullptr;
+			if (IsExtension(file, ".flac"))
+				type = &track.flac;
+			else if (IsExtension(file, ".opus"))
+				type = &track.opus;
+			else if (IsExtension(file, ".wav"))
+				type = &track.wav;
+
+			if (type && type->empty())
+				*type = file.string();
+		}
+	}
+
+	size_t capacity = std::bit_ceil(std::max<size_t>(tracks.size() * 2, 16));
+	slots.assign(capacity, Slot{});
+
+	size_t mask = capacity - 1;
+	for (uint32_t i = 0; i < tracks.size(); i++)
+	{
+		uint64_t hash = HashId(tracks[i].id);
+		for (size_t slot = size_t(hash) & mask;; slot = (slot + 1) & mask)
+		{
+			if (slots[slot].track == 0)
+			{
+				slots[slot] = { hash, i + 1 };
+				break;
+			}
+		}
+	}
+}
+
+bool BGMTrackTable::update()
+{
+	if (ModFiles.generation() == builtGeneration)
+		return false;
+
+	build(directories);
+	spdlog::info("BGMTrackTable: BGM folders changed, {} tracks available", tracks.size());
+	return true;
+}
+
+void BGMTrackTable::rescan() const
+{
+	for (const auto& directory : directories)
+		ModFiles.invalidate(directory);
+}
+
+const BGMTrackTable::Track* BGMTrackTable::lookup(std::string_view id, uint64_t hash) const
+{
+	if (slots.empty())
+		return nullptr;
+
+	size_t mask = slots.size() - 1;
+	for (size_t slot = size_t(hash) & mask;; slot = (slot + 1) & mask)
+	{
+		if (slots[slot].track == 0)
+			return nullptr;
+
+		const Track& track = tracks[slots[slot].track - 1];
+		if (slots[slot].hash == hash && track.id == id)
+			return &track;
+	}
+}
+
+bool BGMTrackTable::find(std::string_view directory, std::string_view path, const Track** track) const
+{
+	char id[MaxIdLength];
+	size_t length = 0;
+	if (!MakeId(directory, path, id, &length))
+		return false;
+
+	std::string_view trackId(id, length);
+	bool covered = std::any_of(roots.begin(), roots.end(), [&](const std::string& root) {
+		return root.empty() || (trackId.size() > root.size() && trackId.starts_with(root) && trackId[root.size()] == '/');
+	});
+	if (!covered)
+		return false;
+
+	*track = lookup(trackId, HashId(trackId));
+	return true;
+}
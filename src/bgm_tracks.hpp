@@ -0,0 +1,70 @@
+// BGM track table
+// Every file under the BGM folders, grouped by track ID (folder + name without extension), so working out which
+// replacement to play when the game creates a music stream is one hash lookup instead of building .flac/.opus/.wav paths
+// & checking each against ModFiles. Lookups don't allocate.
+//
+// Built from ModFiles, so it only touches the disk when the folders get (re)scanned. update() rebuilds it whenever the
+// ModFiles generation changed (ie. the watcher saw a change with WatchModFiles set), rescan() re-reads the folders on request.
+//
+// Paths are looked up the way the game names them: relative to the working directory, either separator, any case on
+// Windows. Absolute paths & anything outside the scanned folders aren't covered, callers have to probe those themselves.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class BGMTrackTable
+{
+public:
+	// Longest track ID that can be looked up, longer paths aren't covered
+	constexpr static size_t MaxIdLength = 512;
+
+	struct Track
+	{
+		std::string id;
+		std::string flac, opus, wav; // files to hand the game, empty if the track has none of that type
+	};
+
+	// Scans the folders (relative to the working directory, eg. "Sound") through ModFiles
+	void build(const std::vector<std::filesystem::path>& directories);
+
+	// Rebuilds if ModFiles changed since the last build, returns true if it did
+	bool update();
+
+	// Re-reads the folders from disk, for when they aren't being watched. Picked up by the next update()
+	void rescan() const;
+
+	// Looks up directory/path with any extension. Returns false if that isn't covered by the table, otherwise true
+	// with *track set to the track or nullptr if there's no file with that name
+	bool find(std::string_view directory, std::string_view path, const Track** track) const;
+
+	// Writes the track ID for directory/path into id (not null terminated), false if it's absolute, goes up a level or is too long
+	static bool MakeId(std::string_view directory, std::string_view path, char (&id)[MaxIdLength], size_t* length);
+	static uint64_t HashId(std::string_view id);
+
+	size_t size() const { return tracks.size(); }
+
+private:
+	// Open addressing with linear probing, sized to stay under 50% load
+	struct Slot
+	{
+		uint64_t hash;
+		uint32_t track; // index + 1 into tracks, 0 = empty slot
+	};
+
+	std::vector<std::filesystem::path> directories;
+	std::vector<std::string> roots; // track ID prefix of each directory, what find() counts as covered
+	std::vector<Slot> slots;
+	std::vector<Track> tracks;
+	uint64_t builtGeneration = 0;
+
+	const Track* lookup(std::string_view id, uint64_t hash) const;
+};
+
+// Folders BGMLoaderHook plays replacements from
+extern BGMTrackTable BGMTracks;
@@ -0,0 +1,438 @@
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cd_switcher.hpp"
+#include "pcm_convert.hpp"
+#include "plugin.hpp"
+#include "wave_file.hpp"
+
+class CDSwitcherFile : public CWaveFile
+{
+public:
+	CDSwitcherFile();
+	~CDSwitcherFile();
+	HRESULT Open(LPSTR strFileName, WAVEFORMATEX* pwfx, DWORD dwFlags);
+	HRESULT OpenFromMemory(BYTE* pbData, ULONG ulDataSize, WAVEFORMATEX* pwfx, DWORD dwFlags);
+	HRESULT Close();
+	HRESULT Read(BYTE* pBuffer, DWORD dwSizeToRead, DWORD* pdwSizeRead);
+	HRESULT Write(UINT nSizeToWrite, BYTE* pbSrcData, UINT* pnSizeWrote);
+	int GetSize();
+	HRESULT ResetFile();
+
+	bool SwitchTo(const std::string& file);
+	void SetNeighbours(const std::vector<std::string>& files);
+
+private:
+	struct Track
+	{
+		std::string file;
+		std::unique_ptr<CWaveFile> wave;
+	};
+
+	WAVEFORMATEX m_format;
+	DWORD m_flags;
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+
+	Track m_current;
+	Track m_fadeOut; // empty unless crossfading
+	uint64_t m_fadePos;
+	uint64_t m_fadeLength;
+	std::vector<BYTE> m_fadeBuffer;
+
+	// Opened & buffering, waiting to be switched to
+	std::vector<Track> m_ready;
+	std::vector<std::string> m_wanted;
+	std::vector<std::string> m_failed; // not retried until they stop being wanted
+	std::vector<std::unique_ptr<CWaveFile>> m_closing;
+
+	// Tracks Read is reading from outside the lock, nothing closes or resets these until it's done
+	const CWaveFile* m_readingIn;
+	const CWaveFile* m_readingOut;
+
+	std::thread m_worker;
+	bool m_stopping;
+
+	void WorkerThread();
+	bool HasTrack(const std::string& file) const;
+	const std::string* NextToOpen() const;
+	bool Matches(const CWaveFile* wave) const;
+	bool IsReading(const CWaveFile* wave) const { return wave && (wave == m_readingIn || wave == m_readingOut); }
+	void FinishFade();
+
+	static std::unique_ptr<CWaveFile> OpenTrack(const std::string& file, DWORD dwFlags);
+};
+
+namespace
+{
+	// Stream the game is playing, only ever one BGM stream at a time
+	std::mutex ActiveMutex;
+	CDSwitcherFile* Active = nullptr;
+	std::vector<std::string> Neighbours;
+}
+
+CDSwitcherFile::CDSwitcherFile() : m_format{}, m_flags(0), m_fadePos(0), m_fadeLength(0), m_readingIn(nullptr), m_readingOut(nullptr),
+	m_stopping(false)
+{
+	m_pwfx_4 = NULL;
+}
+
+CDSwitcherFile::~CDSwitcherFile()
+{
+	Close();
+}
+
+std::unique_ptr<CWaveFile> CDSwitcherFile::OpenTrack(const std::string& file, DWORD dwFlags)
+{
+	std::string extension = std::filesystem::path(file).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	std::unique_ptr<CWaveFile> wave;
+	if (extension == ".flac")
+		wave.reset(CreateFLACFile());
+	else if (extension == ".opus")
+		wave.reset(CreateOpusFile());
+	else
+		return nullptr;
+
+	if (FAILED(wave->Open(const_cast<LPSTR>(file.c_str()), NULL, dwFlags)) || !wave->m_pwfx_4)
+	{
+		spdlog::error("CDSwitcherFile: failed to open {}", file);
+		return nullptr;
+	}
+	return wave;
+}
+
+HRESULT CDSwitcherFile::Open(LPSTR strFileName, WAVEFORMATEX* pwfx, DWORD dwFlags)
+{
+	// Track the game asked for is opened right away like any other stream, neighbours get opened afterwards
+	m_current = { strFileName, OpenTrack(strFileName, dwFlags) };
+	if (!m_current.wave)
+		return E_FAIL;
+
+	m_flags = dwFlags;
+	m_format = *m_current.wave->m_pwfx_4;
+	m_pwfx_4 = &m_format;
+	m_stopping = false;
+	m_worker = std::thread(&CDSwitcherFile::WorkerThread, this);
+
+	std::lock_guard lock(ActiveMutex);
+	Active = this;
+	SetNeighbours(Neighbours);
+	return S_OK;
+}
+
+HRESULT CDSwitcherFile::OpenFromMemory(BYTE* pbData, ULONG ulDataSize, WAVEFORMATEX* pwfx, DWORD dwFlags)
+{
+	return E_NOTIMPL;
+}
+
+HRESULT CDSwitcherFile::Close()
+{
+	{
+		std::lock_guard lock(ActiveMutex);
+		if (Active == this)
+			Active = nullptr;
+	}
+
+	if (m_worker.joinable())
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopping = true;
+		}
+		m_cv.notify_all();
+		m_worker.join();
+	}
+
+	// Worker is gone, nothing else touches these now
+	m_current = {};
+	m_fadeOut = {};
+	m_ready.clear();
+	m_closing.clear();
+	m_wanted.clear();
+	m_failed.clear();
+	m_fadeBuffer.clear();
+	m_fadePos = m_fadeLength = 0;
+	m_pwfx_4 = NULL;
+	return S_OK;
+}
+
+HRESULT CDSwitcherFile::Read(BYTE* pBuffer, DWORD dwSizeToRead, DWORD* pdwSizeRead)
+{
+	// Decoders block while their ring is empty, so they're read outside the lock & SwitchTo/SetNeighbours never wait on them
+	std::unique_lock lock(m_mutex);
+	if (!m_current.wave)
+		return E_FAIL;
+
+	CWaveFile* in = m_current.wave.get();
+	CWaveFile* out = m_fadeOut.wave.get();
+	m_readingIn = in;
+	m_readingOut = out;
+	lock.unlock();
+
+	// While fading, read the same amount from both tracks, whichever comes up short (ended) is padded with silence
+	const DWORD blockAlign = m_format.nBlockAlign;
+	const DWORD size = out ? dwSizeToRead / blockAlign * blockAlign : dwSizeToRead;
+
+	DWORD readIn = 0;
+	HRESULT hr = in->Read(pBuffer, size, &readIn);
+
+	DWORD readOut = 0;
+	if (out)
+	{
+		if (FAILED(hr))
+			readIn = 0;
+		memset(pBuffer + readIn, 0, size - readIn);
+
+		if (m_fadeBuffer.size() < size)
+			m_fadeBuffer.resize(size);
+		if (FAILED(out->Read(m_fadeBuffer.data(), size, &readOut)))
+			readOut = 0;
+		memset(m_fadeBuffer.data() + readOut, 0, size - readOut);
+		hr = S_OK;
+	}
+
+	lock.lock();
+	m_readingIn = m_readingOut = nullptr;
+	if (!m_closing.empty())
+		m_cv.notify_all();
+
+	// SwitchTo may have changed which track is which meanwhile, mix by what they are now
+	auto readOf = [&](const Track& track, BYTE** data, DWORD* read) {
+		if (!track.wave || (track.wave.get() != in && track.wave.get() != out))
+			return false;
+		*data = track.wave.get() == in ? pBuffer : m_fadeBuffer.data();
+		*read = track.wave.get() == in ? readIn : readOut;
+		return true;
+	};
+
+	BYTE* toData = nullptr;
+	BYTE* fromData = nullptr;
+	DWORD readTo = 0, readFrom = 0;
+	if (!readOf(m_current, &toData, &readTo) || !readOf(m_fadeOut, &fromData, &readFrom))
+	{
+		// No fade, or a track that wasn't read is part of it now: pass on the playing track (or the one that was playing
+		// when the read started) as is, the fade then starts from the next read
+		if (toData && toData != pBuffer)
+		{
+			memcpy(pBuffer, toData, readTo);
+			readIn = readTo;
+		}
+		if (pdwSizeRead)
+			*pdwSizeRead = readIn;
+		return hr;
+	}
+
+	const size_t frames = size / blockAlign;
+	PcmConvert::Crossfade((const int16_t*)fromData, (const int16_t*)toData, (int16_t*)pBuffer, frames, m_format.nChannels,
+		m_fadePos, m_fadeLength);
+
+	// Outgoing track only counts for the part of this read that was still fading
+	DWORD fadeBytes = DWORD(std::min<uint64_t>(frames, m_fadeLength - std::min<uint64_t>(m_fadePos, m_fadeLength)) * blockAlign);
+	m_fadePos += frames;
+	if (m_fadePos >= m_fadeLength)
+		FinishFade();
+
+	if (pdwSizeRead)
+		*pdwSizeRead = std::max<DWORD>(readTo, std::min<DWORD>(readFrom, fadeBytes));
+	return S_OK;
+}
+
+HRESULT CDSwitcherFile::Write(UINT nSizeToWrite, BYTE* pbSrcData, UINT* pnSizeWrote)
+{
+	OutputDebugString("Negatory on the CDSwitcherFile::Write");
+	return 0;
+}
+
+int CDSwitcherFile::GetSize()
+{
+	std::lock_guard lock(m_mutex);
+	return m_current.wave ? m_current.wave->GetSize() : 0;
+}
+
+HRESULT CDSwitcherFile::ResetFile()
+{
+	std::lock_guard lock(m_mutex);
+	if (!m_current.wave)
+		return E_FAIL;
+
+	// Game restarting the stream cuts any fade short
+	if (m_fadeOut.wave)
+		FinishFade();
+	return m_current.wave->ResetFile();
+}
+
+bool CDSwitcherFile::Matches(const CWaveFile* wave) const
+{
+	// Game's DirectSound buffer was made for the first track, anything going into it has to be the same format
+	const WAVEFORMATEX* format = wave->m_pwfx_4;
+	return format && format->nChannels == m_format.nChannels && format->nSamplesPerSec == m_format.nSamplesPerSec &&
+		format->wBitsPerSample == 16 && m_format.wBitsPerSample == 16;
+}
+
+bool CDSwitcherFile::SwitchTo(const std::string& file)
+{
+	std::unique_lock lock(m_mutex);
+	if (!m_current.wave || file == m_current.file)
+		return false;
+
+	// Going back to the track that's still fading out, reverse the fade from where it got to
+	if (m_fadeOut.wave && file == m_fadeOut.file)
+	{
+		std::swap(m_current, m_fadeOut);
+		m_fadePos = m_fadeLength - std::min<uint64_t>(m_fadePos, m_fadeLength);
+		return true;
+	}
+
+	auto it = std::find_if(m_ready.begin(), m_ready.end(), [&](const Track& track) { return track.file == file; });
+	if (it == m_ready.end())
+		return false;
+
+	if (!Matches(it->wave.get()))
+	{
+		spdlog::info("CDSwitcherFile: {} has a different format to the playing stream, restarting playback", file);
+		return false;
+	}
+
+	// Switching again mid-fade drops the track that was already on its way out
+	if (m_fadeOut.wave)
+		m_closing.push_back(std::move(m_fadeOut.wave));
+
+	m_fadeOut = std::move(m_current);
+	m_current = std::move(*it);
+	m_ready.erase(it);
+
+	m_fadePos = 0;
+	m_fadeLength = uint64_t(m_format.nSamplesPerSec) * std::max<int>(Settings::CDSwitcherCrossfadeMs, 0) / 1000;
+	if (m_fadeLength == 0)
+		FinishFade();
+
+	lock.unlock();
+	m_cv.notify_all();
+	return true;
+}
+
+void CDSwitcherFile::FinishFade()
+{
+	// Outgoing track goes back to the start & stays opened if it's a neighbour now, so switching back is instant too
+	Track track = std::move(m_fadeOut);
+	m_fadeOut = {};
+	m_fadePos = m_fadeLength = 0;
+
+	// One that Read is still busy with can't be reset, it gets closed & reopened instead if it's wanted
+	if (std::find(m_wanted.begin(), m_wanted.end(), track.file) != m_wanted.end() && !HasTrack(track.file) &&
+		!IsReading(track.wave.get()))
+	{
+		track.wave->ResetFile();
+		m_ready.push_back(std::move(track));
+	}
+	else
+		m_closing.push_back(std::move(track.wave));
+
+	m_cv.notify_all();
+}
+
+void CDSwitcherFile::SetNeighbours(const std::vector<std::string>& files)
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_wanted = files;
+
+		for (auto it = m_ready.begin(); it != m_ready.end();)
+		{
+			if (std::find(m_wanted.begin(), m_wanted.end(), it->file) == m_wanted.end())
+			{
+				m_closing.push_back(std::move(it->wave));
+				it = m_ready.erase(it);
+			}
+			else
+				++it;
+		}
+
+		std::erase_if(m_failed, [&](const std::string& file) { return std::find(m_wanted.begin(), m_wanted.end(), file) == m_wanted.end(); });
+	}
+	m_cv.notify_all();
+}
+
+bool CDSwitcherFile::HasTrack(const std::string& file) const
+{
+	return file == m_current.file || (m_fadeOut.wave && file == m_fadeOut.file) ||
+		std::any_of(m_ready.begin(), m_ready.end(), [&](const Track& track) { return track.file == file; });
+}
+
+const std::string* CDSwitcherFile::NextToOpen() const
+{
+	for (const auto& file : m_wanted)
+		if (!HasTrack(file) && std::find(m_failed.begin(), m_failed.end(), file) == m_failed.end())
+			return &file;
+	return nullptr;
+}
+
+void CDSwitcherFile::WorkerThread()
+{
+	std::unique_lock lock(m_mutex);
+	while (true)
+	{
+		auto closable = [&] {
+			return std::find_if(m_closing.begin(), m_closing.end(), [&](const auto& wave) { return !IsReading(wave.get()); });
+		};
+		m_cv.wait(lock, [&] { return m_stopping || closable() != m_closing.end() || NextToOpen(); });
+		if (m_stopping)
+			break;
+
+		// Closing joins the decoder's thread, keep that out of the lock too
+		if (auto it = closable(); it != m_closing.end())
+		{
+			auto wave = std::move(*it);
+			m_closing.erase(it);
+			lock.unlock();
+			wave.reset();
+			lock.lock();
+			continue;
+		}
+
+		std::string file = *NextToOpen();
+		lock.unlock();
+		auto wave = OpenTrack(file, m_flags);
+		lock.lock();
+
+		if (!wave)
+			m_failed.push_back(file);
+		else if (std::find(m_wanted.begin(), m_wanted.end(), file) != m_wanted.end() && !HasTrack(file) && !m_stopping)
+			m_ready.push_back({ file, std::move(wave) });
+		else
+			m_closing.push_back(std::move(wave));
+	}
+}
+
+namespace CDSwitcherStream
+{
+	bool SwitchTo(const std::string& file)
+	{
+		std::lock_guard lock(ActiveMutex);
+		return Active && Active->SwitchTo(file);
+	}
+
+	void SetNeighbours(const std::vector<std::string>& files)
+	{
+		std::lock_guard lock(ActiveMutex);
+		Neighbours = files;
+		if (Active)
+			Active->SetNeighbours(files);
+	}
+}
+
+CWaveFile* CreateCDSwitcherFile()
+{
+	return new CDSwitcherFile();
+}
@@ -0,0 +1,24 @@
+// CD switcher stream
+// When the CD switcher plays one of our formats (FLAC/Opus), the game gets a CDSwitcherFile wrapping the decoder instead
+// of the decoder itself. It keeps the tracks around the playing one in the list opened too, with their decode threads
+// already filling their rings, so changing track only means reading from a different decoder. The game's stream keeps
+// going the whole time & the two tracks get crossfaded sample-accurately over Settings::CDSwitcherCrossfadeMs.
+//
+// Decoders are opened & closed on a worker thread owned by the stream, the game thread never waits on them. Reads from
+// the decoders happen outside the stream's lock too, so a switch never waits behind a decoder that's waiting on its ring.
+// Switches that can't happen in place (no stream playing, track not opened yet, different format from the game's
+// stream, or a type we don't decode) return false, the CD switcher then restarts playback through adxPlay.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace CDSwitcherStream
+{
+	// Game thread, crossfades the playing stream over to file (a path BGMLoaderHook would hand the game)
+	bool SwitchTo(const std::string& file);
+
+	// Files the CD switcher could move to next, kept opened by the playing stream or the next one created
+	void SetNeighbours(const std::vector<std::string>& files);
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <numeric>
+
+#include "cd_tracklist.hpp"
+
+void CDTrackList::assign(std::vector<Track> tracks, bool shuffle, uint32_t seed)
+{
+	this->tracks = std::move(tracks);
+	this->shuffle = shuffle;
+	rng.seed(seed);
+
+	order.resize(this->tracks.size());
+	std::iota(order.begin(), order.end(), 0);
+	if (shuffle)
+		std::shuffle(order.begin(), order.end(), rng);
+
+	slotOf.resize(order.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+		slotOf[order[i]] = i;
+
+	drawNextOrder();
+	history.clear();
+	slot = 0;
+}
+
+void CDTrackList::drawNextOrder()
+{
+	nextOrder = order;
+	if (!shuffle || order.size() < 2)
+		return;
+
+	std::shuffle(nextOrder.begin(), nextOrder.end(), rng);
+
+	// Don't play the same track twice in a row across the wrap
+	if (nextOrder.front() == order.back())
+	{
+		size_t other = std::uniform_int_distribution<size_t>(1, nextOrder.size() - 1)(rng);
+		std::swap(nextOrder.front(), nextOrder[other]);
+	}
+}
+
+void CDTrackList::pushHistory()
+{
+	history.push_back(order[slot]);
+	if (history.size() > MaxHistory)
+		history.pop_front();
+}
+
+size_t CDTrackList::previousSlot() const
+{
+	return slot > 0 ? slot - 1 : order.size() - 1;
+}
+
+const CDTrackList::Track& CDTrackList::peekNext() const
+{
+	if (slot + 1 < order.size())
+		return tracks[order[slot + 1]];
+	return tracks[nextOrder.front()];
+}
+
+const CDTrackList::Track& CDTrackList::peekPrevious() const
+{
+	if (!history.empty())
+		return tracks[history.back()];
+	return tracks[order[previousSlot()]];
+}
+
+void CDTrackList::next()
+{
+	if (tracks.empty())
+		return;
+
+	pushHistory();
+	if (slot + 1 < order.size())
+	{
+		slot++;
+		return;
+	}
+
+	// Wrapped around, start the lap that was drawn ahead & draw the one after it
+	if (shuffle)
+	{
+		order = nextOrder;
+		for (uint32_t i = 0; i < order.size(); i++)
+			slotOf[order[i]] = i;
+		drawNextOrder();
+	}
+	slot = 0;
+}
+
+void CDTrackList::previous()
+{
+	if (tracks.empty())
+		return;
+
+	// Going back doesn't add to the history, otherwise pressing it twice would just bounce between two tracks
+	if (!history.empty())
+	{
+		slot = slotOf[history.back()];
+		history.pop_back();
+	}
+	else
+		slot = previousSlot();
+}
+
+void CDTrackList::select(size_t position)
+{
+	if (tracks.empty())
+		return;
+
+	if (position >= order.size())
+		position = 0;
+
+	if (position != slot)
+	{
+		pushHistory();
+		slot = position;
+	}
+}
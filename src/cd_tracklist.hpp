@@ -0,0 +1,63 @@
+// CD switcher track list
+// Tracks stay in the order they were read from [CDTracks], what gets played follows a separate play order over them.
+// With shuffle the play order is reshuffled every time the list wraps around, & the order for the following lap is
+// drawn ahead of time so the track after the last one is already known (CDSwitcherFile opens it in advance).
+//
+// Moving back goes through the history of what was actually played first, so going back after a wrap or a jump
+// (eg. the game picking the race track) returns to the track that was playing before, rather than the previous slot.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+class CDTrackList
+{
+public:
+	// History kept for previous(), oldest entries are dropped past this
+	constexpr static size_t MaxHistory = 64;
+
+	struct Track
+	{
+		std::string path; // as given in the INI, relative to the game or Sound folder
+		std::string name;
+	};
+
+	// Starts over at the first slot, with no history
+	void assign(std::vector<Track> tracks, bool shuffle, uint32_t seed);
+
+	bool empty() const { return tracks.empty(); }
+	size_t size() const { return tracks.size(); }
+
+	// Slot in the play order that's playing, what the title display & the games sel_bgm_kind_buf use
+	size_t position() const { return slot; }
+	const Track& current() const { return tracks[order[slot]]; }
+
+	// Tracks that next()/previous() would move to, without moving
+	const Track& peekNext() const;
+	const Track& peekPrevious() const;
+
+	void next();
+	void previous();
+
+	// Jumps straight to a slot, out of range slots go to the first one
+	void select(size_t position);
+
+private:
+	std::vector<Track> tracks;
+	std::vector<uint32_t> order;     // play order, indices into tracks
+	std::vector<uint32_t> nextOrder; // order the next lap will use
+	std::vector<uint32_t> slotOf;    // inverse of order
+	std::deque<uint32_t> history;    // tracks played before the current one, most recent last
+	size_t slot = 0;
+	bool shuffle = false;
+	std::mt19937 rng;
+
+	void drawNextOrder();
+	void pushHistory();
+	size_t previousSlot() const;
+};
@@ -14,6 +14,11 @@ void InitExceptionHandler(); // hooks_exceptions.cpp
 // (otherwise the constant force stays active and the wheel is stuck)
 namespace FFB { void Shutdown(); }
 
+// Stops the texture dump writer thread without blocking on the loader lock
+namespace Textures { void Shutdown(bool processTerminating); } // hooks_textures.cpp
+
+namespace TraceLog { void Init(const std::filesystem::path& path); void Shutdown(bool processTerminating); } // trace_log.cpp
+
 namespace Module
 {
 	constexpr std::string_view TargetFilename = "OR2006C2C.exe";
@@ -24,6 +29,7 @@ namespace Module
 	constexpr std::string_view OverlayIniFileName = "OutRun2006Tweaks.overlay.ini";
 	constexpr std::string_view BindingsIniFileName = "OutRun2006Tweaks.input.ini";
 	constexpr std::string_view LogFileName = "OutRun2006Tweaks.log";
+	constexpr std::string_view TraceFileName = "OutRun2006Tweaks.trace";
 
 	void init()
 	{
@@ -39,6 +45,7 @@ namespace Module
 		// Setup Log & INI paths, always located next to the DLL instead of the EXE
 		auto dllParent = DllPath.parent_path();
 		LogPath = dllParent / LogFileName;
+		TracePath = dllParent / TraceFileName;
 		IniPath = dllParent / IniFileName;
 		UserIniPath = dllParent / UserIniFileName;
 		LodIniPath = dllParent / LodIniFileName;
@@ -80,6 +87,12 @@ namespace Settings
 		spdlog::info(" - AllowHorn: {}", AllowHorn);
 		spdlog::info(" - AllowWAV: {}", AllowWAV);
 		spdlog::info(" - AllowFLAC: {}", AllowFLAC);
+		spdlog::info(" - AllowOpus: {}", AllowOpus);
+		spdlog::info(" - BGMCacheMB: {}", BGMCacheMB);
+		spdlog::info(" - ProfileBGMDecode: {}", ProfileBGMDecode);
+		spdlog::info(" - BGMDecodeWarnMBps: {}", BGMDecodeWarnMBps);
+		spdlog::info(" - BGMFirstReadWarnMs: {}", BGMFirstReadWarnMs);
+		spdlog::info(" - BGMLoopSeekWarnMs: {}", BGMLoopSeekWarnMs);
 
 		spdlog::info(" - CDSwitcherEnable: {}", CDSwitcherEnable);
 		spdlog::info(" - CDSwitcherDisplayTitle: {}", CDSwitcherDisplayTitle);
@@ -89,6 +102,8 @@ namespace Settings
 		spdlog::info(" - CDSwitcherTitlePositionX: {}", CDSwitcherTitlePositionX);
 		spdlog::info(" - CDSwitcherTitlePositionY: {}", CDSwitcherTitlePositionY);
 		spdlog::info(" - CDSwitcherShuffleTracks: {}", CDSwitcherShuffleTracks);
+		spdlog::info(" - CDSwitcherPreloadTracks: {}", CDSwitcherPreloadTracks);
+		spdlog::info(" - CDSwitcherCrossfadeMs: {}", CDSwitcherCrossfadeMs);
 		spdlog::info(" - CDSwitcherTrackNext: {}", CDSwitcherTrackNext);
 		spdlog::info(" - CDSwitcherTrackPrevious: {}", CDSwitcherTrackPrevious);
 
@@ -112,7 +127,14 @@ namespace Settings
 		spdlog::info(" - UITextureReplacement: {}", UITextureReplacement);
 		spdlog::info(" - UITextureExtract: {}", UITextureExtract);
 		spdlog::info(" - EnableTextureCache: {}", EnableTextureCache);
+		spdlog::info(" - TextureCacheThreads: {}", TextureCacheThreads);
+		spdlog::info(" - TextureCacheBudgetMB: {}", TextureCacheBudgetMB);
+		spdlog::info(" - TextureHashCache: {}", TextureHashCache);
+		spdlog::info(" - GenerateTextureMipmaps: {}", GenerateTextureMipmaps);
+		spdlog::info(" - TextureMipmapFilter: {}", TextureMipmapFilter);
 		spdlog::info(" - UseNewTextureAllocator: {}", UseNewTextureAllocator);
+		spdlog::info(" - ShareReplacementTextures: {}", ShareReplacementTextures);
+		spdlog::info(" - ProfileTextureLoads: {}", ProfileTextureLoads);
 
 		spdlog::info(" - UseNewInput: {}", UseNewInput);
 		spdlog::info(" - SteeringDeadZone: {}", SteeringDeadZone);
@@ -147,6 +169,7 @@ namespace Settings
 		spdlog::info(" - FFBTireSlip: {}", FFBTireSlip);
 		spdlog::info(" - FFBWheelTorqueNm: {}", FFBWheelTorqueNm);
 		spdlog::info(" - FFBInvertForce: {}", FFBInvertForce);
+		spdlog::info(" - FFBDiagnosticLog: {}", FFBDiagnosticLog);
 
 		spdlog::info(" - EnableHollyCourse2: {}", EnableHollyCourse2);
 		spdlog::info(" - SkipIntroLogos: {}", SkipIntroLogos);
@@ -159,6 +182,9 @@ namespace Settings
 		spdlog::info(" - RandomHighwayAnimSets: {}", RandomHighwayAnimSets);
 		spdlog::info(" - DemonwareServerOverride: {}", DemonwareServerOverride);
 		spdlog::info(" - ProtectLoginData: {}", ProtectLoginData);
+		spdlog::info(" - TraceLogEnabled: {}", TraceLogEnabled);
+		spdlog::info(" - ModFileManifest: {}", ModFileManifest);
+		spdlog::info(" - WatchModFiles: {}", WatchModFiles);
 
 		spdlog::info(" - OverlayEnabled: {}", OverlayEnabled);
 
@@ -205,6 +231,13 @@ namespace Settings
 		AllowHorn = ini.Get("Audio", "AllowHorn", AllowHorn);
 		AllowWAV = ini.Get("Audio", "AllowWAV", AllowWAV);
 		AllowFLAC = ini.Get("Audio", "AllowFLAC", AllowFLAC);
+		AllowOpus = ini.Get("Audio", "AllowOpus", AllowOpus);
+		BGMCacheMB = ini.Get("Audio", "BGMCacheMB", BGMCacheMB);
+		BGMCacheMB = std::clamp(BGMCacheMB, 0, 512);
+		ProfileBGMDecode = ini.Get("Audio", "ProfileBGMDecode", ProfileBGMDecode);
+		BGMDecodeWarnMBps = ini.Get("Audio", "BGMDecodeWarnMBps", BGMDecodeWarnMBps);
+		BGMFirstReadWarnMs = ini.Get("Audio", "BGMFirstReadWarnMs", BGMFirstReadWarnMs);
+		BGMLoopSeekWarnMs = ini.Get("Audio", "BGMLoopSeekWarnMs", BGMLoopSeekWarnMs);
 
 		CDSwitcherEnable = ini.Get("CDSwitcher", "SwitcherEnable", CDSwitcherEnable);
 		CDSwitcherDisplayTitle = ini.Get("CDSwitcher", "SwitcherDisplayTitle", CDSwitcherDisplayTitle);
@@ -215,6 +248,9 @@ namespace Settings
 		CDSwitcherTitlePositionX = ini.Get("CDSwitcher", "SwitcherTitlePositionX", CDSwitcherTitlePositionX);
 		CDSwitcherTitlePositionY = ini.Get("CDSwitcher", "SwitcherTitlePositionY", CDSwitcherTitlePositionY);
 		CDSwitcherShuffleTracks = ini.Get("CDSwitcher", "SwitcherShuffleTracks", CDSwitcherShuffleTracks);
+		CDSwitcherPreloadTracks = ini.Get("CDSwitcher", "SwitcherPreloadTracks", CDSwitcherPreloadTracks);
+		CDSwitcherCrossfadeMs = ini.Get("CDSwitcher", "SwitcherCrossfadeMs", CDSwitcherCrossfadeMs);
+		CDSwitcherCrossfadeMs = std::clamp(CDSwitcherCrossfadeMs, 0, 10000);
 		CDSwitcherTrackNext = ini.Get("CDSwitcher", "TrackNext", CDSwitcherTrackNext);
 		CDSwitcherTrackPrevious = ini.Get("CDSwitcher", "TrackPrevious", CDSwitcherTrackPrevious);
 
@@ -243,7 +279,16 @@ namespace Settings
 		UITextureReplacement = ini.Get("Graphics", "UITextureReplacement", UITextureReplacement);
 		UITextureExtract = ini.Get("Graphics", "UITextureExtract", UITextureExtract);
 		EnableTextureCache = ini.Get("Graphics", "EnableTextureCache", EnableTextureCache);
+		TextureCacheThreads = ini.Get("Graphics", "TextureCacheThreads", TextureCacheThreads);
+		TextureCacheThreads = std::clamp(TextureCacheThreads, 0, 32);
+		TextureCacheBudgetMB = ini.Get("Graphics", "TextureCacheBudgetMB", TextureCacheBudgetMB);
+		TextureCacheBudgetMB = std::clamp(TextureCacheBudgetMB, 0, 3072);
+		TextureHashCache = ini.Get("Graphics", "TextureHashCache", TextureHashCache);
+		GenerateTextureMipmaps = ini.Get("Graphics", "GenerateTextureMipmaps", GenerateTextureMipmaps);
+		TextureMipmapFilter = ini.Get("Graphics", "TextureMipmapFilter", TextureMipmapFilter);
 		UseNewTextureAllocator = ini.Get("Graphics", "UseNewTextureAllocator", UseNewTextureAllocator);
+		ShareReplacementTextures = ini.Get("Graphics", "ShareReplacementTextures", ShareReplacementTextures);
+		ProfileTextureLoads = ini.Get("Graphics", "ProfileTextureLoads", ProfileTextureLoads);
 
 		UseNewInput = ini.Get("Controls", "UseNewInput", UseNewInput);
 		SteeringDeadZone = ini.Get("Controls", "SteeringDeadZone", SteeringDeadZone);
@@ -361,6 +406,9 @@ namespace Settings
 		RandomHighwayAnimSets = ini.Get("Misc", "RandomHighwayAnimSets", RandomHighwayAnimSets);
 		DemonwareServerOverride = ini.Get("Misc", "DemonwareServerOverride", DemonwareServerOverride);
 		ProtectLoginData = ini.Get("Misc", "ProtectLoginData", ProtectLoginData);
+		TraceLogEnabled = ini.Get("Misc", "TraceLog", TraceLogEnabled);
+		ModFileManifest = ini.Get("Misc", "ModFileManifest", ModFileManifest);
+		WatchModFiles = ini.Get("Misc", "WatchModFiles", WatchModFiles);
 
 		OverlayEnabled = ini.Get("Overlay", "Enabled", OverlayEnabled);
 
@@ -423,6 +471,9 @@ void Plugin_Init()
 
 	Settings::to_log();
 
+	if (Settings::TraceLogEnabled)
+		TraceLog::Init(Module::TracePath);
+
 	Game::StartupTime = std::chrono::system_clock::now();
 
 	// Create save folder if it doesn't exist, otherwise game will have issues writing savegame...
@@ -465,6 +516,10 @@ BOOL APIENTRY DllMain(HMODULE hModule, int ul_reason_for_call, LPVOID lpReserved
 		// Stop all haptic effects before unloading -- prevents the wheel
 		// from staying stuck at the last force level after game exit.
 		FFB::Shutdown();
+
+		bool processTerminating = lpReserved != nullptr; // rather than us being unloaded
+		Textures::Shutdown(processTerminating);
+		TraceLog::Shutdown(processTerminating);
 		proxy::on_detach();
 	}
 
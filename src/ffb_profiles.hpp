@@ -0,0 +1,112 @@
+// Per-wheel force feedback capability profiles
+// Wheels differ in what FFB traffic they can take: the older Logitech wheels (G25/G27/DFGT/Momo)
+// choke if DIEP_START is sent with every update, and gear/belt-driven ones can't resolve small
+// magnitude steps that direct drive bases can. Update rate isn't part of a profile, the output
+// stage only sends from the game's 60 Hz tick, well under what any of these wheels can take.
+// Profiles are matched by USB VID/PID (from DIPROP_VIDPID) in FFB::DeferredInit, and the
+// output stage in hooks_dinputffb.cpp uses them to limit what it sends to the device.
+
+#pragma once
+
+#include <cstdint>
+
+namespace FFBProfiles
+{
+	struct WheelProfile
+	{
+		uint16_t vid;
+		uint16_t pid;              // 0 = matches any product from this vendor
+		const char* name;
+		long minMagnitudeDelta;    // smallest change (DI units, +/-10000) worth sending
+		uint32_t paramFlags;       // DIEP_* flags passed to SetParameters for magnitude updates
+	};
+
+	// Flags kept as plain values so this header doesn't need dinput.h
+	constexpr uint32_t Param_TypeSpecific = 0x00000100; // DIEP_TYPESPECIFICPARAMS
+	constexpr uint32_t Param_Start = 0x20000000;        // DIEP_START
+
+	constexpr uint32_t Params_Restart = Param_TypeSpecific | Param_Start;
+	constexpr uint32_t Params_UpdateOnly = Param_TypeSpecific; // effect is started once after creation
+
+	constexpr uint16_t VID_Logitech = 0x046D;
+	constexpr uint16_t VID_Thrustmaster = 0x044F;
+	constexpr uint16_t VID_Fanatec = 0x0EB7;
+	constexpr uint16_t VID_Moza = 0x346E;
+	constexpr uint16_t VID_Simagic = 0x0483;
+	constexpr uint16_t VID_Simucube = 0x16D0; // MCS Electronics, sublicensed to lots of hobby devices, so never matched vendor-wide
+
+	// Used when no entry matches the device, matches the behaviour from before profiles existed
+	inline constexpr WheelProfile DefaultProfile =
+		{ 0, 0, "Generic FFB device", 15, Params_Restart };
+
+	// Specific products first, vendor-wide fallbacks (pid = 0) after them
+	inline constexpr WheelProfile Profiles[] =
+	{
+		// Logitech gear-driven wheels
+		// G29/G920/G923 drivers need DIEP_START with every update or the force stops being applied
+		{ VID_Logitech, 0xC24F, "Logitech G29", 20, Params_Restart },
+		{ VID_Logitech, 0xC262, "Logitech G920", 20, Params_Restart },
+		{ VID_Logitech, 0xC266, "Logitech G923 (PlayStation)", 20, Params_Restart },
+		{ VID_Logitech, 0xC26E, "Logitech G923 (Xbox)", 20, Params_Restart },
+		{ VID_Logitech, 0xC268, "Logitech G PRO (PlayStation)", 10, Params_Restart },
+		{ VID_Logitech, 0xC272, "Logitech G PRO (Xbox)", 10, Params_Restart },
+
+		// Older Logitech wheels choke on repeated DIEP_START, start the effect once and only update params
+		{ VID_Logitech, 0xC29B, "Logitech G27", 40, Params_UpdateOnly },
+		{ VID_Logitech, 0xC299, "Logitech G25", 40, Params_UpdateOnly },
+		{ VID_Logitech, 0xC29A, "Logitech Driving Force GT", 40, Params_UpdateOnly },
+		{ VID_Logitech, 0xC298, "Logitech Driving Force Pro", 40, Params_UpdateOnly },
+		{ VID_Logitech, 0xC294, "Logitech Driving Force", 40, Params_UpdateOnly },
+		{ VID_Logitech, 0xC295, "Logitech MOMO Force", 40, Params_UpdateOnly },
+		{ VID_Logitech, 0xCA03, "Logitech MOMO Racing", 40, Params_UpdateOnly },
+
+		// Thrustmaster belt-driven wheels
+		{ VID_Thrustmaster, 0xB66E, "Thrustmaster T300RS", 15, Params_Restart },
+		{ VID_Thrustmaster, 0xB66F, "Thrustmaster T300RS (PS4)", 15, Params_Restart },
+		{ VID_Thrustmaster, 0xB66D, "Thrustmaster T300RS (PS4 mode)", 15, Params_Restart },
+		{ VID_Thrustmaster, 0xB669, "Thrustmaster TX", 15, Params_Restart },
+		{ VID_Thrustmaster, 0xB696, "Thrustmaster T248", 20, Params_Restart },
+		{ VID_Thrustmaster, 0xB692, "Thrustmaster TS-XW", 15, Params_Restart },
+		{ VID_Thrustmaster, 0xB689, "Thrustmaster TS-PC", 15, Params_Restart },
+		{ VID_Thrustmaster, 0xB677, "Thrustmaster T150", 30, Params_Restart },
+		{ VID_Thrustmaster, 0xB67F, "Thrustmaster TMX", 30, Params_Restart },
+		{ VID_Thrustmaster, 0, "Thrustmaster (unknown model)", 20, Params_Restart },
+
+		// Fanatec bases
+		{ VID_Fanatec, 0x0001, "Fanatec ClubSport V2", 15, Params_Restart },
+		{ VID_Fanatec, 0x0004, "Fanatec ClubSport V2.5", 15, Params_Restart },
+		{ VID_Fanatec, 0x0005, "Fanatec CSL Elite (PS4)", 15, Params_Restart },
+		{ VID_Fanatec, 0x0E03, "Fanatec CSL Elite", 15, Params_Restart },
+		{ VID_Fanatec, 0x0006, "Fanatec Podium DD1", 10, Params_Restart },
+		{ VID_Fanatec, 0x0007, "Fanatec Podium DD2", 10, Params_Restart },
+		{ VID_Fanatec, 0x0020, "Fanatec CSL DD / GT DD Pro", 10, Params_Restart },
+		{ VID_Fanatec, 0, "Fanatec (unknown model)", 15, Params_Restart },
+
+		// Direct drive bases, fine enough to make use of small magnitude changes
+		{ VID_Moza, 0, "Moza Racing", 10, Params_Restart },
+		{ VID_Simagic, 0x0522, "Simagic", 10, Params_Restart },
+		{ VID_Simucube, 0x0D5A, "Simucube 1", 10, Params_Restart },
+		{ VID_Simucube, 0x0D61, "Simucube 2 Sport", 10, Params_Restart },
+		{ VID_Simucube, 0x0D60, "Simucube 2 Pro", 10, Params_Restart },
+		{ VID_Simucube, 0x0D5F, "Simucube 2 Ultimate", 10, Params_Restart },
+	};
+
+	// Returns the best profile for the VID/PID pair, falling back to DefaultProfile
+	inline const WheelProfile& Find(uint16_t vid, uint16_t pid)
+	{
+		const WheelProfile* vendorMatch = nullptr;
+		for (const auto& profile : Profiles)
+		{
+			if (profile.vid != vid)
+				continue;
+
+			if (profile.pid == pid)
+				return profile;
+
+			if (profile.pid == 0 && !vendorMatch)
+				vendorMatch = &profile;
+		}
+
+		return vendorMatch ? *vendorMatch : DefaultProfile;
+	}
+}
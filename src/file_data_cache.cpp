@@ -0,0 +1,206 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+#include <spdlog/spdlog.h>
+#include <xxhash.h>
+
+#include "file_data_cache.hpp"
+
+FileDataCache::FileDataCache(size_t maxCacheSize)
+	: maxSize(maxCacheSize)
+{
+}
+
+bool FileDataCache::isCacheable(const std::filesystem::path& filename)
+{
+	auto extension = filename.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(),
+		[](unsigned char c) { return std::tolower(c); });
+
+	return extension == ".dds";
+}
+
+uint64_t FileDataCache::HashPath(const std::filesystem::path& filename)
+{
+	// Paths all come from the same directory scan, so they're spelled consistently & hashing the native string is enough
+	const auto& native = filename.native();
+	return XXH64(native.data(), native.size() * sizeof(native[0]), 0);
+}
+
+std::shared_ptr<const MappedView> FileDataCache::lookup(Shard& shard, uint64_t key) const
+{
+	std::shared_lock lock(shard.mtx);
+	auto it = shard.index.find(key);
+	if (it == shard.index.end())
+		return nullptr;
+
+	Slot& slot = shard.slots[it->second];
+	slot.referenced.store(1, std::memory_order_relaxed);
+	return slot.view;
+}
+
+std::shared_ptr<const MappedView> FileDataCache::cacheFile(const std::filesystem::path& filename)
+{
+	if (!isCacheable(filename))
+		return nullptr;
+
+	uint64_t key = HashPath(filename);
+	Shard& shard = shardFor(key);
+	if (auto view = lookup(shard, key))
+		return view;
+
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		spdlog::warn("FileDataCache: unable to open file {}", filename.string());
+		return nullptr;
+	}
+
+	auto view = std::make_shared<const MappedView>(file.mapAll());
+	if (!view->valid())
+	{
+		spdlog::warn("FileDataCache: unable to map file {}", filename.string());
+		return nullptr;
+	}
+
+	// Too big to keep around, hand the view out uncached so it's unmapped as soon as the caller drops it
+	if (view->size() > getMaxSize())
+	{
+		spdlog::warn("FileDataCache: {} exceeds maximum cache size, not caching it", filename.string());
+		return view;
+	}
+
+	{
+		std::unique_lock lock(shard.mtx);
+
+		// Another thread may have cached it while we were mapping
+		auto it = shard.index.find(key);
+		if (it != shard.index.end())
+		{
+			Slot& slot = shard.slots[it->second];
+			slot.referenced.store(1, std::memory_order_relaxed);
+			return slot.view;
+		}
+
+		size_t slotIdx;
+		if (!shard.freeSlots.empty())
+		{
+			slotIdx = shard.freeSlots.back();
+			shard.freeSlots.pop_back();
+		}
+		else
+		{
+			slotIdx = shard.slots.size();
+			shard.slots.emplace_back();
+		}
+
+		// New entries start unreferenced, so files that are only read once (eg. prefetched but never used) go first
+		Slot& slot = shard.slots[slotIdx];
+		slot.key = key;
+		slot.view = view;
+		slot.referenced.store(0, std::memory_order_relaxed);
+		shard.index[key] = slotIdx;
+		totalBytes += view->size();
+	}
+
+	// Room may have to come from any shard, so this shard's lock is let go first & eviction only ever holds one at a time
+	// The new entry can't be evicted on the way, we still hold its view
+	evict();
+	return view;
+}
+
+std::shared_ptr<const MappedView> FileDataCache::getFileData(const std::filesystem::path& filename)
+{
+	uint64_t key = HashPath(filename);
+	if (auto view = lookup(shardFor(key), key))
+	{
+		hits.fetch_add(1, std::memory_order_relaxed);
+		return view;
+	}
+
+#ifdef _DEBUG
+	std::string msg = "Cache miss: " + filename.string() + "\n";
+	OutputDebugStringA(msg.c_str());
+#endif
+
+	auto start = std::chrono::steady_clock::now();
+	auto view = cacheFile(filename);
+	auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+	misses.fetch_add(1, std::memory_order_relaxed);
+	stallNanoseconds.fetch_add(uint64_t(elapsed.count()), std::memory_order_relaxed);
+	return view;
+}
+
+// Caller holds the shard's exclusive lock
+// Moves the shard's hand round at most once, taking out the first entry that's neither referenced nor pinned
+bool FileDataCache::evictOne(Shard& shard)
+{
+	for (size_t step = 0; step < shard.slots.size(); step++)
+	{
+		shard.hand = (shard.hand + 1) % shard.slots.size();
+		Slot& slot = shard.slots[shard.hand];
+		if (!slot.view)
+			continue;
+
+		if (slot.referenced.exchange(0, std::memory_order_relaxed))
+			continue;
+
+		// Only the cache holds slot.view while we have the exclusive lock, unless someone outside is still using it
+		if (slot.view.use_count() > 1)
+			continue;
+
+		totalBytes -= slot.view->size();
+		shard.index.erase(slot.key);
+		slot.view.reset();
+		shard.freeSlots.push_back(shard.hand);
+		evictions.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+// Takes one entry at a time from each shard in turn until the whole cache is back under budget, like a single CLOCK hand
+// going over every shard. A fruitless visit still clears that shard's reference bits, so two rounds of them in a row
+// means everything left is pinned and we give up until the next insert.
+void FileDataCache::evict()
+{
+	size_t fruitless = 0;
+	while (fruitless < ShardCount * 2 && totalBytes.load(std::memory_order_relaxed) > maxSize.load(std::memory_order_relaxed))
+	{
+		Shard& shard = shards[evictShard.fetch_add(1, std::memory_order_relaxed) % ShardCount];
+		std::unique_lock lock(shard.mtx);
+		fruitless = evictOne(shard) ? 0 : fruitless + 1;
+	}
+}
+
+size_t FileDataCache::getCacheSize() const
+{
+	return totalBytes.load(std::memory_order_relaxed);
+}
+
+void FileDataCache::setMaxSize(size_t maxCacheSize)
+{
+	maxSize = maxCacheSize;
+	evict();
+}
+
+FileDataCache::Stats FileDataCache::getStats() const
+{
+	Stats stats;
+	stats.hits = hits.load(std::memory_order_relaxed);
+	stats.misses = misses.load(std::memory_order_relaxed);
+	stats.evictions = evictions.load(std::memory_order_relaxed);
+	stats.stallNanoseconds = stallNanoseconds.load(std::memory_order_relaxed);
+	stats.bytesResident = getCacheSize();
+	stats.maxSize = getMaxSize();
+	return stats;
+}
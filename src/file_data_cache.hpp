@@ -0,0 +1,95 @@
+// Cache of memory mapped replacement texture files
+// Replacement textures are mapped rather than read into buffers, D3DX then reads them straight from the OS file cache.
+// The byte budget limits how much address space the mapped views can take up, since we only have 2-4GB of it to work with.
+//
+// Split into shards keyed by a 64-bit hash of the path, so prefetch threads & the game thread rarely contend on the same lock.
+// Lookups only take a shard's shared lock and mark the entry with an atomic reference bit,
+// eviction uses CLOCK (second chance) instead of maintaining an LRU list on every hit.
+// The budget is for the whole cache, not per shard: one byte counter covers every shard & eviction moves on to the next
+// shard after each entry it takes out, so files that happen to hash into the same shard can still use all of it.
+//
+// The size limit can be changed at any time (see MemoryBudget), shrinking it evicts straight away.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+class FileDataCache
+{
+public:
+	struct Stats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;          // getFileData calls that had to map the file themselves
+		uint64_t evictions = 0;
+		uint64_t stallNanoseconds = 0; // time getFileData spent mapping files on a miss
+		size_t bytesResident = 0;
+		size_t maxSize = 0;
+	};
+
+	explicit FileDataCache(size_t maxCacheSize);
+
+	static bool isCacheable(const std::filesystem::path& filename);
+
+	// Maps the file into the cache, returns the view (or nullptr on failure)
+	// Files bigger than the whole budget are still mapped & returned, just not kept in the cache
+	std::shared_ptr<const MappedView> cacheFile(const std::filesystem::path& filename);
+
+	// Returned view stays mapped as long as the caller holds onto it, even if evicted from the cache meanwhile
+	// Entries that are still held outside the cache (eg. while D3D creates a texture from them) are pinned & skipped by eviction
+	std::shared_ptr<const MappedView> getFileData(const std::filesystem::path& filename);
+
+	size_t getCacheSize() const;
+
+	size_t getMaxSize() const { return maxSize.load(std::memory_order_relaxed); }
+	void setMaxSize(size_t maxCacheSize);
+
+	Stats getStats() const;
+
+private:
+	static constexpr size_t ShardCount = 16;
+
+	struct Slot
+	{
+		uint64_t key = 0;
+		std::shared_ptr<const MappedView> view; // nullptr = free slot
+		std::atomic<uint8_t> referenced = 0;
+	};
+
+	struct Shard
+	{
+		mutable std::shared_mutex mtx;
+		std::unordered_map<uint64_t, size_t> index; // key -> slot
+		std::deque<Slot> slots;                     // deque so slots don't move while readers hold a shared lock
+		std::vector<size_t> freeSlots;
+		size_t hand = 0;
+	};
+
+	std::atomic<size_t> maxSize;
+	std::atomic<size_t> totalBytes = 0; // across all shards, only changed under the owning shard's exclusive lock
+	std::atomic<size_t> evictShard = 0; // next shard eviction looks at
+
+	std::atomic<uint64_t> hits = 0;
+	std::atomic<uint64_t> misses = 0;
+	std::atomic<uint64_t> evictions = 0;
+	std::atomic<uint64_t> stallNanoseconds = 0;
+	std::array<Shard, ShardCount> shards;
+
+	static uint64_t HashPath(const std::filesystem::path& filename);
+	Shard& shardFor(uint64_t key) { return shards[(key >> 32) % ShardCount]; }
+
+	std::shared_ptr<const MappedView> lookup(Shard& shard, uint64_t key) const;
+	bool evictOne(Shard& shard);
+	void evict();
+};
@@ -0,0 +1,374 @@
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include <FLAC/stream_decoder.h>
+
+#include "pcm_convert.hpp"
+#include "pcm_stream.hpp"
+#include "resampler.hpp"
+
+// Streams the file from disk or decodes it from memory, loops seek using the files seek table
+// 44.1/48kHz 16-bit files are interleaved straight into the ring, anything else is converted to float, resampled if needed
+// & dithered down to 16-bit. Loop tags & seeks are in the files own samples, & get converted to the output rate.
+class FLACStream : public PcmStream
+{
+public:
+    FLACStream();
+    ~FLACStream();
+    bool Open(const char* fileName) override;
+    bool OpenFromMemory(const uint8_t* data, size_t size) override;
+    void Close() override;
+
+protected:
+    bool DecodeBlock() override;
+    bool EndOfStream() override;
+    bool SeekToSample(uint64_t sample) override;
+    size_t DecoderMemory() const override;
+
+private:
+    FLAC__StreamDecoder* m_pDecoder;
+
+    // Compressed file being decoded when opened from memory
+    const uint8_t* m_memData;
+    size_t m_memSize;
+    size_t m_memPos;
+
+    // Only touched by the decode thread once it's started
+    std::vector<uint8_t> m_frameBuffer;
+    PcmConvert::InterleaveFunc m_interleave; // picked for the streams format in MetadataCallback
+
+    // Set in MetadataCallback when the stream isn't 44.1/48kHz 16-bit
+    bool m_convert;
+    bool m_resampling;
+    unsigned m_bitsPerSample;
+    StreamResampler m_resampler;
+    std::vector<float> m_floatBuffer;
+    std::vector<float> m_resampled;
+    uint64_t m_outputPos;       // output sample the next converted block starts at
+    uint64_t m_skipOutputUntil; // seek target, resampler output before it is preroll
+    bool m_flushed;             // resampler was given the end of the stream
+
+    WaveLoopTags m_loopTags;
+
+    // FLAC callbacks
+    static FLAC__StreamDecoderWriteStatus WriteCallback(const FLAC__StreamDecoder* decoder, const FLAC__Frame* frame, const FLAC__int32* const buffer[], void* client_data);
+    static void MetadataCallback(const FLAC__StreamDecoder* decoder, const FLAC__StreamMetadata* metadata, void* client_data);
+    static void ErrorCallback(const FLAC__StreamDecoder* decoder, FLAC__StreamDecoderErrorStatus status, void* client_data);
+
+    // Stream callbacks for OpenFromMemory
+    static FLAC__StreamDecoderReadStatus MemReadCallback(const FLAC__StreamDecoder* decoder, FLAC__byte buffer[], size_t* bytes, void* client_data);
+    static FLAC__StreamDecoderSeekStatus MemSeekCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64 absolute_byte_offset, void* client_data);
+    static FLAC__StreamDecoderTellStatus MemTellCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64* absolute_byte_offset, void* client_data);
+    static FLAC__StreamDecoderLengthStatus MemLengthCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64* stream_length, void* client_data);
+    static FLAC__bool MemEofCallback(const FLAC__StreamDecoder* decoder, void* client_data);
+
+    // Helper functions
+    bool CreateDecoder();
+    void FreeDecoder();
+    bool ReadMetadata();
+    bool ConvertBlock(const float* pcm, size_t frames);
+    bool DeliverOutput(const float* pcm, size_t frames);
+};
+
+FLACStream::FLACStream() : PcmStream(BGMDecodeProfiler::FLAC), m_pDecoder(nullptr), m_memData(nullptr), m_memSize(0), m_memPos(0), m_interleave(nullptr),
+    m_convert(false), m_resampling(false), m_bitsPerSample(0), m_outputPos(0), m_skipOutputUntil(0), m_flushed(false)
+{
+}
+
+FLACStream::~FLACStream()
+{
+    Close();
+}
+
+bool FLACStream::Open(const char* fileName)
+{
+    if (CreateDecoder() &&
+        FLAC__stream_decoder_init_file(m_pDecoder, fileName, WriteCallback, MetadataCallback, ErrorCallback, this) == FLAC__STREAM_DECODER_INIT_STATUS_OK &&
+        ReadMetadata())
+        return true;
+
+    Close();
+    return false;
+}
+
+bool FLACStream::OpenFromMemory(const uint8_t* data, size_t size)
+{
+    if (!data || !size || !CreateDecoder())
+    {
+        Close();
+        return false;
+    }
+
+    m_memData = data;
+    m_memSize = size;
+    m_memPos = 0;
+
+    if (FLAC__stream_decoder_init_stream(m_pDecoder, MemReadCallback, MemSeekCallback, MemTellCallback, MemLengthCallback, MemEofCallback,
+        WriteCallback, MetadataCallback, ErrorCallback, this) == FLAC__STREAM_DECODER_INIT_STATUS_OK && ReadMetadata())
+        return true;
+
+    Close();
+    return false;
+}
+
+bool FLACStream::CreateDecoder()
+{
+    // Anything left over from an earlier open, the profile BeginProfile set up is kept
+    FreeDecoder();
+
+    m_pDecoder = FLAC__stream_decoder_new();
+    if (m_pDecoder == nullptr)
+        return false;
+
+    // Set up callbacks
+    FLAC__stream_decoder_set_metadata_ignore_all(m_pDecoder);
+    FLAC__stream_decoder_set_metadata_respond(m_pDecoder, FLAC__METADATA_TYPE_STREAMINFO);
+    FLAC__stream_decoder_set_metadata_respond(m_pDecoder, FLAC__METADATA_TYPE_VORBIS_COMMENT);
+    return true;
+}
+
+bool FLACStream::ReadMetadata()
+{
+    // Game needs the format right away, audio itself gets decoded on our thread
+    if (!FLAC__stream_decoder_process_until_end_of_metadata(m_pDecoder) || (!m_convert && !m_interleave))
+        return false;
+
+    uint64_t loopStart, loopEnd;
+    if (m_loopTags.resolve(&loopStart, &loopEnd))
+    {
+        if (m_resampling)
+        {
+            loopStart = m_resampler.toOutput(loopStart);
+            loopEnd = m_resampler.toOutput(loopEnd);
+        }
+        SetLoop(loopStart, loopEnd);
+    }
+
+    return StartDecoding();
+}
+
+void FLACStream::Close()
+{
+    StopDecoding();
+    FreeDecoder();
+}
+
+void FLACStream::FreeDecoder()
+{
+    if (m_pDecoder)
+    {
+        FLAC__stream_decoder_finish(m_pDecoder);
+        FLAC__stream_decoder_delete(m_pDecoder);
+        m_pDecoder = nullptr;
+    }
+
+    m_memData = nullptr;
+    m_memSize = m_memPos = 0;
+    m_loopTags = {};
+
+    m_interleave = nullptr;
+    m_convert = m_resampling = m_flushed = false;
+    m_outputPos = m_skipOutputUntil = 0;
+}
+
+bool FLACStream::DecodeBlock()
+{
+    // Resampler holds back the last few frames until it knows nothing comes after them
+    if (m_resampling && !m_flushed && FLAC__stream_decoder_get_state(m_pDecoder) == FLAC__STREAM_DECODER_END_OF_STREAM)
+    {
+        m_flushed = true;
+        m_resampled.clear();
+        m_resampler.finish(m_resampled);
+        return DeliverOutput(m_resampled.data(), m_resampled.size() / m_format.channels);
+    }
+
+    return FLAC__stream_decoder_process_single(m_pDecoder);
+}
+
+bool FLACStream::EndOfStream()
+{
+    return FLAC__stream_decoder_get_state(m_pDecoder) == FLAC__STREAM_DECODER_END_OF_STREAM && (!m_resampling || m_flushed);
+}
+
+bool FLACStream::SeekToSample(uint64_t sample)
+{
+    uint64_t inputSample = sample;
+    if (m_convert)
+    {
+        m_flushed = false;
+        m_outputPos = m_skipOutputUntil = sample;
+        if (m_resampling)
+        {
+            // Start far enough back for the filter to only see real audio by the time it reaches the target
+            inputSample = m_resampler.toInput(sample);
+            inputSample -= std::min<uint64_t>(inputSample, m_resampler.preroll());
+            m_outputPos = m_resampler.reset(inputSample);
+        }
+    }
+
+    // Decoder writes the audio from the target onward before this returns
+    if (FLAC__stream_decoder_seek_absolute(m_pDecoder, inputSample))
+        return true;
+
+    // Decoder is left in a seek error state otherwise
+    FLAC__stream_decoder_flush(m_pDecoder);
+    return false;
+}
+
+size_t FLACStream::DecoderMemory() const
+{
+    // libFLAC's own buffers aren't exposed, these are the big ones anyway
+    return m_frameBuffer.capacity() + (m_floatBuffer.capacity() + m_resampled.capacity()) * sizeof(float) + m_memSize;
+}
+
+bool FLACStream::ConvertBlock(const float* pcm, size_t frames)
+{
+    if (!m_resampling)
+        return DeliverOutput(pcm, frames);
+
+    m_resampled.clear();
+    m_resampler.process(pcm, frames, m_resampled);
+    return DeliverOutput(m_resampled.data(), m_resampled.size() / m_format.channels);
+}
+
+bool FLACStream::DeliverOutput(const float* pcm, size_t frames)
+{
+    const uint64_t first = m_outputPos;
+    m_outputPos += frames;
+
+    size_t skip = first < m_skipOutputUntil ? size_t(std::min<uint64_t>(frames, m_skipOutputUntil - first)) : 0;
+    if (skip == frames)
+        return true;
+
+    return DeliverFloat(pcm + skip * m_format.channels, frames - skip);
+}
+
+FLAC__StreamDecoderWriteStatus FLACStream::WriteCallback(const FLAC__StreamDecoder* decoder, const FLAC__Frame* frame, const FLAC__int32* const buffer[], void* client_data)
+{
+    FLACStream* pThis = static_cast<FLACStream*>(client_data);
+
+    // Conversion was picked for the format in STREAMINFO, frames aren't allowed to differ from it
+    if (!pThis->m_format.channels || frame->header.channels != pThis->m_format.channels || frame->header.bits_per_sample != pThis->m_bitsPerSample)
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+    const unsigned blocksize = frame->header.blocksize;
+    if (pThis->m_convert)
+    {
+        const size_t samples = size_t(blocksize) * frame->header.channels;
+        if (pThis->m_floatBuffer.size() < samples)
+            pThis->m_floatBuffer.resize(samples);
+
+        PcmConvert::PlanarToFloat(buffer, frame->header.channels, pThis->m_floatBuffer.data(), blocksize, frame->header.bits_per_sample);
+        if (!pThis->ConvertBlock(pThis->m_floatBuffer.data(), blocksize))
+            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
+
+    const size_t totalBytes = size_t(blocksize) * pThis->m_format.blockAlign;
+    if (pThis->m_frameBuffer.size() < totalBytes)
+        pThis->m_frameBuffer.resize(totalBytes);
+
+    pThis->m_interleave(buffer, frame->header.channels, pThis->m_frameBuffer.data(), blocksize);
+
+    if (!pThis->Deliver(pThis->m_frameBuffer.data(), blocksize))
+        return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void FLACStream::MetadataCallback(const FLAC__StreamDecoder* decoder, const FLAC__StreamMetadata* metadata, void* client_data)
+{
+    FLACStream* pThis = static_cast<FLACStream*>(client_data);
+
+    if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
+    {
+        const auto& info = metadata->data.stream_info;
+        const unsigned outputRate = OutputRateFor(info.sample_rate);
+        pThis->m_bitsPerSample = info.bits_per_sample;
+        pThis->m_resampling = outputRate != info.sample_rate;
+        pThis->m_convert = pThis->m_resampling || info.bits_per_sample != 16;
+
+        if (!pThis->m_convert)
+        {
+            pThis->SetFormat(info.channels, info.sample_rate, info.bits_per_sample, size_t(info.max_blocksize) * 2);
+            pThis->m_frameBuffer.resize(size_t(info.max_blocksize) * pThis->m_format.blockAlign);
+            pThis->m_interleave = PcmConvert::Select(info.channels, info.bits_per_sample);
+            return;
+        }
+
+        // Resampler can hand out a little more than a block at once, from the frames it held back
+        size_t maxOutput = size_t(uint64_t(info.max_blocksize + RESAMPLER_TAPS * 4) * outputRate / info.sample_rate);
+        pThis->SetFormat(info.channels, outputRate, 16, maxOutput * 2);
+        pThis->m_floatBuffer.resize(size_t(info.max_blocksize) * info.channels);
+        if (pThis->m_resampling)
+            pThis->m_resampler.init(info.channels, info.sample_rate, outputRate);
+
+        spdlog::info("FLACStream: converting {}Hz {}-bit to {}Hz 16-bit", info.sample_rate, info.bits_per_sample, outputRate);
+    }
+    else if (metadata->type == FLAC__METADATA_TYPE_VORBIS_COMMENT)
+    {
+        for (unsigned int i = 0; i < metadata->data.vorbis_comment.num_comments; i++)
+        {
+            const char* tag = (const char*)metadata->data.vorbis_comment.comments[i].entry;
+            unsigned int length = metadata->data.vorbis_comment.comments[i].length;
+            spdlog::debug("FLAC comment: size {}, {}", length, std::string_view(tag, length));
+
+            pThis->m_loopTags.parse(tag, length);
+        }
+    }
+}
+
+void FLACStream::ErrorCallback(const FLAC__StreamDecoder* decoder, FLAC__StreamDecoderErrorStatus status, void* client_data)
+{
+    spdlog::debug("FLACStream: decoding error: {}", FLAC__StreamDecoderErrorStatusString[status]);
+}
+
+FLAC__StreamDecoderReadStatus FLACStream::MemReadCallback(const FLAC__StreamDecoder* decoder, FLAC__byte buffer[], size_t* bytes, void* client_data)
+{
+    FLACStream* pThis = static_cast<FLACStream*>(client_data);
+
+    size_t toRead = std::min<size_t>(*bytes, pThis->m_memSize - pThis->m_memPos);
+    *bytes = toRead;
+    if (!toRead)
+        return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+
+    memcpy(buffer, pThis->m_memData + pThis->m_memPos, toRead);
+    pThis->m_memPos += toRead;
+    return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+}
+
+FLAC__StreamDecoderSeekStatus FLACStream::MemSeekCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64 absolute_byte_offset, void* client_data)
+{
+    FLACStream* pThis = static_cast<FLACStream*>(client_data);
+    if (absolute_byte_offset > pThis->m_memSize)
+        return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
+
+    pThis->m_memPos = size_t(absolute_byte_offset);
+    return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+FLAC__StreamDecoderTellStatus FLACStream::MemTellCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64* absolute_byte_offset, void* client_data)
+{
+    *absolute_byte_offset = static_cast<FLACStream*>(client_data)->m_memPos;
+    return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+FLAC__StreamDecoderLengthStatus FLACStream::MemLengthCallback(const FLAC__StreamDecoder* decoder, FLAC__uint64* stream_length, void* client_data)
+{
+    *stream_length = static_cast<FLACStream*>(client_data)->m_memSize;
+    return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+FLAC__bool FLACStream::MemEofCallback(const FLAC__StreamDecoder* decoder, void* client_data)
+{
+    FLACStream* pThis = static_cast<FLACStream*>(client_data);
+    return pThis->m_memPos >= pThis->m_memSize;
+}
+
+std::unique_ptr<PcmStream> CreateFLACStream()
+{
+    return std::make_unique<FLACStream>();
+}
@@ -1,13 +1,80 @@
 #include "hook_mgr.hpp"
 #include "plugin.hpp"
 #include "game_addrs.hpp"
+#include "vfs.hpp"
+#include "bgm_cache.hpp"
+#include "bgm_profiler.hpp"
+#include "bgm_tracks.hpp"
+#include "cd_switcher.hpp"
+#include "cd_tracklist.hpp"
+#include "pixel_convert.hpp"
+#include "wave_file.hpp"
 #include <mmiscapi.h>
 #include <fstream>
 #include <algorithm>
 #include <random>
+#include <imgui.h>
+#include "overlay/overlay.hpp"
 
 std::string BGMOverridePath;
 
+// Finds the track for directory/path (any extension), answered from BGMTracks for anything inside the Sound folder
+// Paths outside of it are probed through ModFiles like they used to be, with the result written into fallback
+static const BGMTrackTable::Track* FindBGM(std::string_view directory, std::string_view path, BGMTrackTable::Track& fallback)
+{
+	const BGMTrackTable::Track* track = nullptr;
+	if (BGMTracks.find(directory, path, &track))
+		return track;
+
+	std::filesystem::path fileName = directory.empty() ? std::filesystem::path(path) : std::filesystem::path(directory) / path;
+	bool exists = ModFiles.exists(fileName);
+
+	fallback = {};
+	auto probe = [&](std::string& type, const char* extension) {
+		std::filesystem::path typeName = fileName;
+		if (ModFiles.exists(typeName.replace_extension(extension)))
+		{
+			type = typeName.string();
+			exists = true;
+		}
+	};
+	probe(fallback.flac, ".flac");
+	probe(fallback.opus, ".opus");
+	probe(fallback.wav, ".wav");
+
+	return exists ? &fallback : nullptr;
+}
+
+// Our decoder's file for a track (FLAC/Opus, picked the same way BGMLoaderHook does), empty if it'd play some other type
+static std::string ResolveCustomBGM(const std::string& path)
+{
+	BGMTrackTable::Track fallback;
+	const BGMTrackTable::Track* track = FindBGM({}, path, fallback);
+	if (!track)
+		track = FindBGM(".\\Sound", path, fallback);
+	if (!track)
+		return {};
+
+	if (Settings::AllowFLAC && !track->flac.empty())
+		return track->flac;
+	if (Settings::AllowOpus && !track->opus.empty())
+		return track->opus;
+	return {};
+}
+
+// Has BGMFiles start reading in a track we expect to play soon, resolving its path the same way BGMLoaderHook will
+void PrefetchBGM(const std::string& path)
+{
+	if ((!Settings::AllowFLAC && !Settings::AllowOpus) || BGMFiles.getMaxSize() == 0)
+		return;
+
+	BGMTracks.update();
+
+	std::string file = ResolveCustomBGM(path);
+	if (!file.empty())
+		BGMFiles.prefetch(file);
+}
+
 class BGMLoaderHook : public Hook
 {
 	// Hook games BGM loader to check the type of the audio file being loaded
@@ -21,51 +88,66 @@ class BGMLoaderHook : public Hook
 	inline static SafetyHookMid hook = {};
 	static void destination(safetyhook::Context& ctx)
 	{
-		std::filesystem::path strWaveFileName = *(const char**)(ctx.esp + 0x54);
-		if (!BGMOverridePath.empty())
+		// Runs right as a race starts, so everything here comes from BGMTracks without allocating or touching the disk
+		// (unless the BGM folder changed since the last stream, or the track lives outside of it)
+		BGMTracks.update();
+
+		BGMTrackTable::Track fallback;
+		const BGMTrackTable::Track* track = nullptr;
+		const bool cdSwitcherTrack = !BGMOverridePath.empty();
+		if (cdSwitcherTrack)
 		{
-			if (!std::filesystem::exists(BGMOverridePath))
-				BGMOverridePath = ".\\Sound\\" + BGMOverridePath;
+			// CD switcher tracks can be given relative to the game folder or to Sound
+			const char* directory = "";
+			track = FindBGM({}, BGMOverridePath, fallback);
+			if (!track)
+			{
+				directory = ".\\Sound\\";
+				track = FindBGM(".\\Sound", BGMOverridePath, fallback);
+			}
 
-			if (std::filesystem::exists(BGMOverridePath))
+			if (track)
 			{
-				strcpy_s(CurWavFilePath, BGMOverridePath.c_str());
+				strcpy_s(CurWavFilePath, directory);
+				strcat_s(CurWavFilePath, BGMOverridePath.c_str());
 				*(const char**)(ctx.esp + 0x54) = CurWavFilePath;
-				strWaveFileName = BGMOverridePath;
 			}
 			BGMOverridePath.clear();
 		}
-
-		// If a .wav file exists with the same filename, let's try checking that file instead
-		std::filesystem::path fileNameAsWav = strWaveFileName;
-		fileNameAsWav = fileNameAsWav.replace_extension(".wav");
-		std::filesystem::path fileNameAsFlac = strWaveFileName;
-		fileNameAsFlac = fileNameAsFlac.replace_extension(".flac");
-
-		enum class WaveFileType
-		{
-			WAV = 1,
-			FLAC = 2,
-			OGG = 3
-		};
+		else
+			track = FindBGM({}, *(const char**)(ctx.esp + 0x54), fallback);
 
 		// Normally hardcoded to 3/OGG, but changing to 1/WAV allows using CWaveFile
-		// 2/FLAC is checked for by our hooks_flac.cpp code
+		// 2/FLAC & 4/Opus are checked for by CustomWaveFileHook
 		WaveFileType waveFileType = WaveFileType(ctx.eax);
-		if (Settings::AllowFLAC && std::filesystem::exists(fileNameAsFlac))
+		const std::string* replacement = nullptr;
+		if (track)
 		{
-			waveFileType = WaveFileType::FLAC;
-
-			// Switch the file game is trying to load to the flac instead
-			strcpy_s(CurWavFilePath, fileNameAsFlac.string().c_str());
-			*(const char**)(ctx.esp + 0x54) = CurWavFilePath;
+			if (Settings::AllowFLAC && !track->flac.empty())
+			{
+				waveFileType = WaveFileType::FLAC;
+				replacement = &track->flac;
+			}
+			else if (Settings::AllowOpus && !track->opus.empty())
+			{
+				waveFileType = WaveFileType::Opus;
+				replacement = &track->opus;
+			}
+			else if (Settings::AllowWAV && !track->wav.empty())
+			{
+				waveFileType = WaveFileType::WAV;
+				replacement = &track->wav;
+			}
 		}
-		else if (Settings::AllowWAV && std::filesystem::exists(fileNameAsWav))
-		{
-			waveFileType = WaveFileType::WAV;
 
-			// Switch the file game is trying to load to the wav instead
-			strcpy_s(CurWavFilePath, fileNameAsWav.string().c_str());
+		// CD switcher tracks get wrapped so later track changes can crossfade without restarting the stream
+		if (cdSwitcherTrack && Settings::CDSwitcherPreloadTracks && (waveFileType == WaveFileType::FLAC || waveFileType == WaveFileType::Opus))
+			waveFileType = WaveFileType::CDSwitcher;
+
+		// Switch the file game is trying to load over to the replacement
+		if (replacement)
+		{
+			strcpy_s(CurWavFilePath, replacement->c_str());
 			*(const char**)(ctx.esp + 0x54) = CurWavFilePath;
 		}
 		ctx.eax = int(waveFileType);
@@ -79,11 +161,16 @@ public:
 
 	bool validate() override
 	{
-		return (Settings::AllowWAV || Settings::AllowFLAC || Settings::CDSwitcherEnable);
+		return (Settings::AllowWAV || Settings::AllowFLAC || Settings::AllowOpus || Settings::CDSwitcherEnable);
 	}
 
 	bool apply() override
 	{
+		// Checked for every track the game streams, answer those from memory instead of hitting the disk
+		ModFiles.mountDirectory("Sound", 0, {}, Settings::WatchModFiles);
+		BGMTracks.build({ "Sound" });
+		spdlog::info("BGMLoaderHook: {} tracks in Sound folder", BGMTracks.size());
+
 		hook = safetyhook::create_mid(Module::exe_ptr(CSoundManager__CreateStreaming_HookAddr), destination);
 		return !!hook;
 	}
@@ -92,6 +179,160 @@ public:
 };
 BGMLoaderHook BGMLoaderHook::instance;
 
+class CustomWaveFileHook : public Hook
+{
+	// Creates our own CWaveFile decoders for the types BGMLoaderHook picked, game only knows how to make WAV/OGG ones
+	inline static SafetyHookMid hook = {};
+	static void destination(safetyhook::Context& ctx)
+	{
+		CWaveFile* file = nullptr;
+		if (ctx.eax == int(WaveFileType::FLAC))
+			file = CreateFLACFile();
+		else if (ctx.eax == int(WaveFileType::Opus))
+			file = CreateOpusFile();
+		else if (ctx.eax == int(WaveFileType::CDSwitcher))
+			file = CreateCDSwitcherFile();
+
+		if (file)
+		{
+			ctx.eax = (uintptr_t)file;
+
+			ctx.eip = 0x412008; // the code we hook heads toward end of function, move it back to the file loading part
+		}
+	}
+
+public:
+	std::string_view description() override
+	{
+		return "CustomWaveFileHook";
+	}
+
+	bool validate() override
+	{
+		return Settings::AllowFLAC || Settings::AllowOpus;
+	}
+
+	bool apply() override
+	{
+		hook = safetyhook::create_mid(Module::exe_ptr(0x120F4), destination);
+		BGMFiles.setMaxSize(size_t(Settings::BGMCacheMB) * 1024 * 1024);
+		BGMProfiler.setThresholds({ Settings::BGMDecodeWarnMBps, Settings::BGMFirstReadWarnMs, Settings::BGMLoopSeekWarnMs });
+		spdlog::info("CustomWaveFileHook: using {} sample conversion", PixelConvert::LevelName(PixelConvert::CurrentLevel()));
+		return !!hook;
+	}
+
+	static CustomWaveFileHook instance;
+};
+CustomWaveFileHook CustomWaveFileHook::instance;
+
+class BGMDecodeProfileWindow : public OverlayWindow
+{
+public:
+	void init() override {}
+	void render(bool overlayEnabled) override
+	{
+		if (!overlayEnabled || !Game::BGMProfilerEnabled)
+			return;
+
+		if (ImGui::Begin("BGM Decode Profiler", &Game::BGMProfilerEnabled, ImGuiWindowFlags_AlwaysAutoResize))
+		{
+			ImGui::Checkbox("Profiling enabled", &Settings::ProfileBGMDecode);
+			ImGui::SameLine();
+			if (ImGui::Button("Reset"))
+				BGMProfiler.reset();
+			ImGui::SameLine();
+			if (ImGui::Button("Export CSV"))
+			{
+				auto path = Module::LogPath.parent_path() / "bgm_decode_profile.csv";
+				if (BGMProfiler.writeCsv(path))
+					spdlog::info("BGMDecodeProfiler: exported to {}", path.string());
+			}
+			ImGui::Text("Tracks are added once they stop playing, profiling applies from the next track opened");
+
+			const ImGuiTableFlags tableFlags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+			if (ImGui::BeginTable("BGMFormats", 7, tableFlags))
+			{
+				ImGui::TableSetupColumn("Format");
+				ImGui::TableSetupColumn("Tracks");
+				ImGui::TableSetupColumn("MB/s");
+				ImGui::TableSetupColumn("max first read ms");
+				ImGui::TableSetupColumn("max loop seek ms");
+				ImGui::TableSetupColumn("peak KB");
+				ImGui::TableSetupColumn("warnings");
+				ImGui::TableHeadersRow();
+
+				for (int i = 0; i < BGMDecodeProfiler::FormatCount; i++)
+				{
+					auto stats = BGMProfiler.stats(BGMDecodeProfiler::Format(i));
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextUnformatted(BGMDecodeProfiler::FormatName(i));
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", (unsigned long long)stats.tracks);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", stats.decodeMBps());
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", double(stats.firstReadMaxNanoseconds) / 1000000.0);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", double(stats.loopSeekMaxNanoseconds) / 1000000.0);
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", (unsigned long long)(stats.memoryPeakBytes / 1024));
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", (unsigned long long)stats.warnings);
+				}
+
+				ImGui::EndTable();
+			}
+
+			auto tracks = BGMProfiler.recent();
+			if (!tracks.empty())
+			{
+				ImGui::Separator();
+				ImGui::Text("Recent tracks (over a threshold in red)");
+
+				if (ImGui::BeginTable("BGMTracks", 6, tableFlags | ImGuiTableFlags_ScrollY, ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 12)))
+				{
+					ImGui::TableSetupScrollFreeze(0, 1);
+					ImGui::TableSetupColumn("Track");
+					ImGui::TableSetupColumn("MB/s");
+					ImGui::TableSetupColumn("first read ms");
+					ImGui::TableSetupColumn("loop seeks");
+					ImGui::TableSetupColumn("max loop seek ms");
+					ImGui::TableSetupColumn("KB");
+					ImGui::TableHeadersRow();
+
+					const ImVec4 warnColor(1.0f, 0.4f, 0.4f, 1.0f);
+					auto cell = [&](bool warn, const char* fmt, auto value) {
+						ImGui::TableNextColumn();
+						if (warn)
+							ImGui::TextColored(warnColor, fmt, value);
+						else
+							ImGui::Text(fmt, value);
+					};
+
+					for (const auto& track : tracks)
+					{
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
+						ImGui::Text("%s (%s)", track.name.c_str(), BGMDecodeProfiler::FormatName(track.format));
+						cell(track.warnings & BGMDecodeProfiler::SlowDecode, "%.1f", track.decodeMBps());
+						cell(track.warnings & BGMDecodeProfiler::SlowFirstRead, "%.1f", double(track.firstReadNanoseconds) / 1000000.0);
+						cell(false, "%llu", (unsigned long long)track.loopSeeks);
+						cell(track.warnings & BGMDecodeProfiler::SlowLoopSeek, "%.2f", double(track.loopSeekMaxNanoseconds) / 1000000.0);
+						cell(false, "%llu", (unsigned long long)(track.memoryBytes / 1024));
+					}
+
+					ImGui::EndTable();
+				}
+			}
+		}
+		ImGui::End();
+	}
+
+	static BGMDecodeProfileWindow instance;
+};
+BGMDecodeProfileWindow BGMDecodeProfileWindow::instance;
+
 uint32_t ParseButtonCombination(std::string_view combo)
 {
 	int retval = 0;
@@ -124,6 +365,8 @@ class CDSwitcher : public Hook
 	constexpr static float SongTitleFadeBeginSeconds = 0.75;
 	constexpr static int SongTitleFadeBeginFrame = int(SongTitleFadeBeginSeconds * 60.f);
 
+	inline static CDTrackList Tracks;
+
 	inline static int SongTitleDisplayTimer = 0;
 	inline static bool PrevKeyStatePrev = false;
 	inline static bool PrevKeyStateNext = false;
@@ -155,14 +398,16 @@ class CDSwitcher : public Hook
 
 		bool BGMChanged = false;
 
+		// Game can change the selection itself (eg. the radio menu), carry on from whatever it picked
+		if (!Tracks.empty() && size_t(*Game::sel_bgm_kind_buf) != Tracks.position() && size_t(*Game::sel_bgm_kind_buf) < Tracks.size())
+			Tracks.select(*Game::sel_bgm_kind_buf);
+
 		if (KeyStatePrev != PrevKeyStatePrev)
 		{
 			PrevKeyStatePrev = KeyStatePrev;
 			if (KeyStatePrev)
 			{
-				*Game::sel_bgm_kind_buf = *Game::sel_bgm_kind_buf - 1;
-				if (*Game::sel_bgm_kind_buf < 0)
-					*Game::sel_bgm_kind_buf = Settings::CDTracks.size() - 1;
+				Tracks.previous();
 				BGMChanged = true;
 			}
 		}
@@ -171,41 +416,64 @@ class CDSwitcher : public Hook
 			PrevKeyStateNext = KeyStateNext;
 			if (KeyStateNext)
 			{
-				*Game::sel_bgm_kind_buf = *Game::sel_bgm_kind_buf + 1;
-				if (*Game::sel_bgm_kind_buf >= Settings::CDTracks.size())
-					*Game::sel_bgm_kind_buf = 0;
+				Tracks.next();
 				BGMChanged = true;
 			}
 		}
 
-		if (BGMChanged)
+		if (BGMChanged && !Tracks.empty())
+		{
+			PlayCurrent(true);
+			SongTitleDisplayTimer = SongTitleDisplayFrames;
+		}
+	}
+
+	// Crossfades over to the current track if the playing stream has it ready, otherwise restarts the music with it
+	static void PlayCurrent(bool crossfade)
+	{
+		*Game::sel_bgm_kind_buf = int(Tracks.position());
+		BGMTracks.update();
+
+		const auto& track = Tracks.current();
+		std::string file = crossfade && Settings::CDSwitcherPreloadTracks ? ResolveCustomBGM(track.path) : std::string();
+		if (file.empty() || !CDSwitcherStream::SwitchTo(file))
 		{
-			BGMOverridePath = Settings::CDTracks[*Game::sel_bgm_kind_buf].first;
+			BGMOverridePath = track.path;
 			Game::adxPlay(0, 0, 0);
+		}
 
-			SongTitleDisplayTimer = SongTitleDisplayFrames;
+		if (Settings::CDSwitcherPreloadTracks)
+		{
+			std::vector<std::string> neighbours;
+			for (const auto* neighbour : { &Tracks.peekNext(), &Tracks.peekPrevious() })
+			{
+				std::string neighbourFile = ResolveCustomBGM(neighbour->path);
+				if (!neighbourFile.empty() && neighbourFile != file)
+					neighbours.push_back(std::move(neighbourFile));
+			}
+			CDSwitcherStream::SetNeighbours(neighbours);
 		}
+
+		PrefetchBGM(Tracks.peekNext().path);
 	}
 
 	static void __cdecl PettyAutosceneCmdTblAnalysis_adxPlay_dest(int a1, uint32_t bgmIdx, int a3)
 	{
-		if (!Settings::CDTracks.size())
+		if (Tracks.empty())
 		{
 			Game::adxPlay(a1, bgmIdx, a3);
 			return;
 		}
 
-		if (bgmIdx >= Settings::CDTracks.size())
-			bgmIdx = 0;
-
-		BGMOverridePath = Settings::CDTracks[bgmIdx].first;
-		Game::adxPlay(0, 0, 0);
+		// New race, always starts a fresh stream
+		Tracks.select(bgmIdx);
+		PlayCurrent(false);
 	}
 
 public:
 	static void draw(int numUpdates)
 	{
-		if (SongTitleDisplayTimer > 0 && *Game::sel_bgm_kind_buf < Settings::CDTracks.size())
+		if (SongTitleDisplayTimer > 0 && !Tracks.empty())
 		{
 			Game::sprSetFontPriority(4);
 			Game::sprSetPrintFont(Settings::CDSwitcherTitleFont);
@@ -222,8 +490,7 @@ public:
 			}
 			Game::sprSetFontColor(color);
 
-			const auto& song = Settings::CDTracks[*Game::sel_bgm_kind_buf].second;
-			Game::sprPrintf("#%02d. %s", (*Game::sel_bgm_kind_buf) + 1, song.c_str());
+			Game::sprPrintf("#%02d. %s", int(Tracks.position()) + 1, Tracks.current().name.c_str());
 
 			SongTitleDisplayTimer -= numUpdates;
 			if (SongTitleDisplayTimer <= 0)
@@ -252,6 +519,11 @@ public:
 		PadButtonCombo_Next_BitCount = Util::BitCount(PadButtonCombo_Next);
 		PadButtonCombo_Prev_BitCount = Util::BitCount(PadButtonCombo_Prev);
 
+		std::vector<CDTrackList::Track> tracks;
+		for (const auto& [path, name] : Settings::CDTracks)
+			tracks.push_back({ path, name });
+		Tracks.assign(std::move(tracks), Settings::CDSwitcherShuffleTracks, std::random_device{}());
+
 		Memory::VP::InjectHook(Module::exe_ptr(PettyAutosceneCmdTblAnalysis_adxPlay_CallAddr1), PettyAutosceneCmdTblAnalysis_adxPlay_dest, Memory::HookType::Call);
 		Memory::VP::InjectHook(Module::exe_ptr(PettyAutosceneCmdTblAnalysis_adxPlay_CallAddr2), PettyAutosceneCmdTblAnalysis_adxPlay_dest, Memory::HookType::Call);
 
@@ -341,15 +613,6 @@ void CDSwitcher_ReadIni(const std::filesystem::path& iniPath)
 	if (iniTracks.size() <= 0)
 		return;
 
-	if (Settings::CDSwitcherShuffleTracks)
-	{
-		std::random_device rd;
-		std::mt19937 g(rd());
-
-		// Use std::shuffle to shuffle the vector
-		std::shuffle(iniTracks.begin(), iniTracks.end(), g);
-	}
-
 	// replace old tracklist with the one from this INI
 	// (if user had specified tracks in user.ini they likely meant to replace the defaults)
 	Settings::CDTracks = iniTracks;
@@ -4,6 +4,7 @@
 //          rumble strip, gear shift, road texture, tire slip.
 // Uses IDirectInputEffect::SetParameters with DIEP_START for reliable
 // real-time updates on all wheel drivers (SDL3 Haptic doesn't work with Moza/DD wheels).
+// Deadband and SetParameters flags are tuned per wheel via ffb_profiles.hpp.
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
@@ -21,6 +22,8 @@
 #include "game_addrs.hpp"
 #include "game.hpp"
 #include "telemetry.hpp"
+#include "ffb_profiles.hpp"
+#include "trace_log.hpp"
 
 // External vibration data from hooks_forcefeedback.cpp
 extern float VibrationLeftMotor;
@@ -341,12 +344,73 @@ namespace FFB
 	static int warmupFrames = 0;
 	static const int WARMUP_THRESHOLD = 30; // ~0.5 sec at 60Hz
 
+	// Capability profile of the connected wheel, picked by VID/PID in DeferredInit
+	static const FFBProfiles::WheelProfile* profile = &FFBProfiles::DefaultProfile;
+	static bool constantForceSupported = true; // cleared if the driver lists its effects & constant force isn't one of them
+
+	// ---------- Wheel profile detection ----------
+
+	struct ReportedEffects
+	{
+		bool any = false;
+		bool constantForce = false;
+	};
+
+	static BOOL CALLBACK EnumEffectsCallback(LPCDIEFFECTINFOA info, LPVOID ctx)
+	{
+		auto* reported = static_cast<ReportedEffects*>(ctx);
+		reported->any = true;
+		if (IsEqualGUID(info->guid, GUID_ConstantForce))
+			reported->constantForce = true;
+		return DIENUM_CONTINUE;
+	}
+
+	static void DetectProfile()
+	{
+		DIPROPDWORD vidpid = {};
+		vidpid.diph.dwSize = sizeof(DIPROPDWORD);
+		vidpid.diph.dwHeaderSize = sizeof(DIPROPHEADER);
+		vidpid.diph.dwObj = 0;
+		vidpid.diph.dwHow = DIPH_DEVICE;
+
+		uint16_t vid = 0;
+		uint16_t pid = 0;
+		if (SUCCEEDED(ffbDevice->GetProperty(DIPROP_VIDPID, &vidpid.diph)))
+		{
+			vid = LOWORD(vidpid.dwData);
+			pid = HIWORD(vidpid.dwData);
+		}
+		else
+		{
+			spdlog::warn("FFB: Unable to read VID/PID from device, using generic profile");
+		}
+
+		profile = &FFBProfiles::Find(vid, pid);
+
+		// Constant force is the only effect the output stage creates, some drivers list nothing at all so only trust a non-empty list
+		ReportedEffects reported;
+		if (SUCCEEDED(ffbDevice->EnumEffects(EnumEffectsCallback, &reported, DIEFT_ALL)) && reported.any)
+			constantForceSupported = reported.constantForce;
+		else
+			constantForceSupported = true;
+
+		spdlog::info("FFB: Device {:04X}:{:04X} using profile '{}' (min delta {}, {})",
+			vid, pid, profile->name, profile->minMagnitudeDelta,
+			(profile->paramFlags & DIEP_START) ? "restart per update" : "start once");
+	}
+
 	// ---------- DirectInput FFB helpers ----------
 
 	static bool CreateConstantForceEffect()
 	{
 		if (!ffbDevice) return false;
 
+		if (!constantForceSupported)
+		{
+			spdlog::error("FFB: Device '{}' doesn't support constant force effects", profile->name);
+			return false;
+		}
+
 		// Mirror the test bench (FfbTestService.cs) exactly:
 		// Single axis (X = steering), cartesian, infinite duration, gain from INI
 		DWORD axes[1] = { DIJOFS_X };
@@ -378,6 +442,10 @@ namespace FFB
 			return false;
 		}
 
+		// Profiles that don't restart the effect on every update need it started once here
+		if (!(profile->paramFlags & DIEP_START))
+			constantForceEffect->Start(1, 0);
+
 		spdlog::info("FFB: Constant force effect created (gain: {}%)",
 			(int)(Settings::FFBGlobalStrength * 100.0f));
 		return true;
@@ -397,11 +465,14 @@ namespace FFB
 
 		HRESULT hr = E_FAIL;
 
+		// G29/G923 need DIEP_START with each update, older Logitech wheels choke on it
+		// The profile picked in DeferredInit decides which one we use
+		const DWORD paramFlags = profile->paramFlags;
+
 		// Try existing effect first
 		if (constantForceEffect)
 		{
-			hr = constantForceEffect->SetParameters(
-				&eff, DIEP_TYPESPECIFICPARAMS | DIEP_START);
+			hr = constantForceEffect->SetParameters(&eff, paramFlags);
 		}
 
 		// If handle is invalid (E_HANDLE / 0x80070006), the device was re-acquired
@@ -418,8 +489,7 @@ namespace FFB
 			if (CreateConstantForceEffect())
 			{
 				// Set the magnitude on the freshly created effect
-				hr = constantForceEffect->SetParameters(
-					&eff, DIEP_TYPESPECIFICPARAMS | DIEP_START);
+				hr = constantForceEffect->SetParameters(&eff, paramFlags);
 				spdlog::info("FFB: Recreated constant force effect after handle loss");
 			}
 			else
@@ -431,8 +501,11 @@ namespace FFB
 		else if (hr == DIERR_INPUTLOST || hr == DIERR_NOTACQUIRED)
 		{
 			ffbDevice->Acquire();
-			hr = constantForceEffect->SetParameters(
-				&eff, DIEP_TYPESPECIFICPARAMS | DIEP_START);
+			hr = constantForceEffect->SetParameters(&eff, paramFlags);
+
+			// Re-acquiring stops any playing effects
+			if (!(paramFlags & DIEP_START))
+				constantForceEffect->Start(1, 0);
 		}
 
 		prevConstantLevel = cf.lMagnitude;
@@ -525,6 +598,8 @@ namespace FFB
 			ffbDevice->Acquire();
 		}
 
+		DetectProfile();
+
 		// Disable autocenter
 		DIPROPDWORD dipdw = {};
 		dipdw.diph.dwSize = sizeof(DIPROPDWORD);
@@ -873,14 +948,21 @@ namespace FFB
 				diMagnitude = prevConstantLevel + ((slewDelta > 0) ? maxSlew : -maxSlew);
 
 			// Deadband: skip updating if the level barely changed.
+			// The deadband comes from the wheel profile, crash impulses skip it.
+			// Skipped updates aren't lost: prevConstantLevel only tracks what was actually sent.
 			LONG delta = std::abs(diMagnitude - prevConstantLevel);
-			if (delta > 15 || crashImpulseTimer > 80)
+			if (delta > profile->minMagnitudeDelta || crashImpulseTimer > 80)
 			{
 				SetConstantForce(diMagnitude);
 			}
 		}
 
-		// Diagnostic logging: every 2 seconds
+		// Diagnostics: full rate to the binary trace, plus a text summary every 2 seconds if FFBDiagnosticLog is set
+		TRACE("FFB: spd={:.3f} lat={:.2f} smoothLat={:.2f} steer={:.3f} constLvl={} warmup={}",
+			speed, lateralForce1 + lateralForce2, smoothedLateral, steeringAngle,
+			(int)prevConstantLevel, warmupFrames);
+
+		if (Settings::FFBDiagnosticLog)
 		{
 			static DWORD lastDiagTime = 0;
 			DWORD now = GetTickCount();
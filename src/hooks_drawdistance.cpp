@@ -1,6 +1,7 @@
 #include "hook_mgr.hpp"
 #include "plugin.hpp"
 #include "game_addrs.hpp"
+#include "trace_log.hpp"
 #include <array>
 #include <bitset>
 #include <imgui.h>
@@ -448,6 +449,8 @@ class DrawDistanceIncrease : public Hook
 				maxDrawDistance = min(maxDrawDistance, 80);
 		}
 
+		int totalNodes = 0;
+
 		NumObjects = *(int*)(ctx.esp + 0x18);
 		for (int ObjectNum = 0; ObjectNum < NumObjects; ObjectNum++)
 		{
@@ -503,12 +506,16 @@ class DrawDistanceIncrease : public Hook
 				}
 			}
 
+			totalNodes += int(cur - CollisionNodeIdxArray);
 			*cur = 0xFFFF;
 
 			Game::DrawObject_Internal(xmtSetShifted | ObjectNum, 0, CollisionNodeIdxArray, a4, a5, 0);
 
 			v11++;
 		}
+
+		TRACE("DrawDistance: stage={} cs={}/{} maxDist={} objects={} nodes={}",
+			*Game::stg_stage_num, CsLengthNum, CsMaxLength, maxDrawDistance, NumObjects, totalNodes);
 	}
 
 public:
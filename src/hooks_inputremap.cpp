@@ -16,6 +16,7 @@
 #include "hook_mgr.hpp"
 #include "plugin.hpp"
 #include "game_addrs.hpp"
+#include "trace_log.hpp"
 
 // Defined in Proxy.cpp — the real IDirectInput8A before our filtering wrapper
 extern IDirectInput8A* g_RealDirectInput8;
@@ -397,10 +398,11 @@ namespace DInputRemap
 		if (hpattern.cooldownFrames > 0)
 			hpattern.cooldownFrames--;
 
-		// Diagnostic: log POV state and ALL button presses (first 60 seconds)
+		// Diagnostic: log POV state and ALL button presses (first 60 seconds), the trace gets them for the whole session
 		static DWORD diagStartTick = 0;
 		if (diagStartTick == 0) diagStartTick = tick;
-		if (primary.device && (tick - diagStartTick) < 60000)
+		bool logDiag = (tick - diagStartTick) < 60000;
+		if (primary.device && (logDiag || TraceLog::Enabled.load(std::memory_order_relaxed)))
 		{
 			// Log POV changes (all 4 POV hats)
 			for (int p = 0; p < 4; p++)
@@ -409,7 +411,10 @@ namespace DInputRemap
 				DWORD prevPov = primary.previousState.rgdwPOV[p];
 				if (pov != prevPov)
 				{
-					spdlog::info("DInputRemap: POV[{}] changed: {} -> {} (0x{:08X} -> 0x{:08X})",
+					if (logDiag)
+						spdlog::info("DInputRemap: POV[{}] changed: {} -> {} (0x{:08X} -> 0x{:08X})",
+							p, prevPov, pov, prevPov, pov);
+					TRACE("DInputRemap: POV[{}] changed: {} -> {} (0x{:08X} -> 0x{:08X})",
 						p, prevPov, pov, prevPov, pov);
 				}
 			}
@@ -418,7 +423,9 @@ namespace DInputRemap
 			{
 				if ((primary.currentState.rgbButtons[i] & 0x80) && !(primary.previousState.rgbButtons[i] & 0x80))
 				{
-					spdlog::info("DInputRemap: Button {} pressed on primary device", i);
+					if (logDiag)
+						spdlog::info("DInputRemap: Button {} pressed on primary device", i);
+					TRACE("DInputRemap: Button {} pressed on primary device", i);
 				}
 			}
 		}
@@ -1,14 +1,33 @@
 #include "hook_mgr.hpp"
 #include "plugin.hpp"
 #include "game_addrs.hpp"
+#include "file_data_cache.hpp"
+#include "mapped_file.hpp"
+#include "memory_budget.hpp"
+#include "mip_builder.hpp"
+#include "pixel_convert.hpp"
+#include "texture_dumper.hpp"
+#include "texture_hash_cache.hpp"
+#include "texture_pack.hpp"
+#include "texture_prefetch.hpp"
+#include "texture_profiler.hpp"
+#include "texture_registry.hpp"
+#include "texture_resolver.hpp"
+#include "thread_pool.hpp"
+#include "vfs.hpp"
+#include "overlay/overlay.hpp"
 #include <fstream>
+#include <imgui.h>
+#include <json/json.h>
 #include <xxhash.h>
 #include <d3d9.h>
+#include <winioctl.h>
 #include <ddraw.h>
-#include <unordered_set>
 #include <array>
 
-#define MAX_TEXTURE_CACHE_SIZE_MB (1024 + 256)
+// Bounds for the automatic cache budget, see MemoryBudget::Compute
+#define MIN_TEXTURE_CACHE_SIZE_MB 64
+#define MAX_TEXTURE_CACHE_SIZE_MB 2048
 
 #define DDS_MAGIC 0x20534444  // "DDS "
 struct DDS_FILE
@@ -128,6 +147,80 @@ size_t D3DXGetFormatSize(D3DFORMAT fmt, size_t width = 1, size_t height = 1)
 #define D3DX_FILTER_SRGB_OUT             0x00400000
 #define D3DX_FILTER_SRGB                 0x00600000
 
+// Mip chain generated for the replacement texture HandleTexture just passed to the game
+// Picked up by D3DXCreateTextureFromFileInMemoryEx_Custom when it gets called with that same data
+static std::shared_ptr<const MipBuilder::MipChain> PendingMipChain;
+static const void* PendingMipChainSource = nullptr;
+
+static SharedTextureRegistry<IDirect3DTexture9> SharedTextures;
+
+// Only has a texture in progress when Settings::ProfileTextureLoads is set, the timers below do nothing otherwise
+static TextureLoadProfiler LoadProfiler;
+
+// Attached to shared textures through SetPrivateData, D3D releases it when the texture gets destroyed
+class SharedTextureSentinel : public IUnknown
+{
+public:
+	SharedTextureSentinel(uint64_t key, IDirect3DTexture9* texture) : key(key), texture(texture) {}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+	{
+		if (riid == __uuidof(IUnknown))
+		{
+			*ppvObject = this;
+			AddRef();
+			return S_OK;
+		}
+		*ppvObject = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override
+	{
+		return ++refCount;
+	}
+
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG count = --refCount;
+		if (count == 0)
+		{
+			SharedTextures.remove(key, texture);
+			delete this;
+		}
+		return count;
+	}
+
+	// {7E1A4C52-3B0D-4F7A-9C61-2D8E5B9A0F13}
+	static constexpr GUID Guid = { 0x7e1a4c52, 0x3b0d, 0x4f7a, { 0x9c, 0x61, 0x2d, 0x8e, 0x5b, 0x9a, 0x0f, 0x13 } };
+
+private:
+	std::atomic<ULONG> refCount = 1;
+	uint64_t key;
+	IDirect3DTexture9* texture;
+};
+
+// Apply filtering modes (just the ones used by C2C)
+// Sampler states belong to stage 0 rather than the texture, so this only sets what the stage uses until the game changes it
+void ApplyFilterStates(IDirect3DDevice9* pDevice, DWORD Filter, DWORD MipFilter)
+{
+	if (Filter != 0) {
+		if (Filter == D3DX_FILTER_NONE)
+			Filter = D3DTEXF_NONE;
+		else if (Filter == D3DX_FILTER_LINEAR)
+			Filter = D3DTEXF_LINEAR;
+		pDevice->SetSamplerState(0, D3DSAMP_MINFILTER, Filter);
+		pDevice->SetSamplerState(0, D3DSAMP_MAGFILTER, Filter);
+	}
+	if (MipFilter != 0) {
+		if (MipFilter == D3DX_FILTER_NONE)
+			MipFilter = D3DTEXF_NONE;
+		else if (MipFilter == D3DX_FILTER_LINEAR)
+			MipFilter = D3DTEXF_LINEAR;
+		pDevice->SetSamplerState(0, D3DSAMP_MIPFILTER, MipFilter);
+	}
+}
+
 // Simplified version of D3DXCreateTextureFromFileInMemoryEx which allows loading textures much faster
 HRESULT D3DXCreateTextureFromFileInMemoryEx_Custom(
 	IDirect3DDevice9* pDevice,
@@ -162,6 +255,14 @@ HRESULT D3DXCreateTextureFromFileInMemoryEx_Custom(
 	if (Height > header->data.dwHeight)
 		Height = header->data.dwHeight;
 
+	std::shared_ptr<const MipBuilder::MipChain> mipChain;
+	if (PendingMipChain && PendingMipChainSource == pData)
+	{
+		mipChain = std::move(PendingMipChain);
+		PendingMipChainSource = nullptr;
+	}
+
+	UINT requestedMipLevels = MipLevels;
 	MipLevels = (MipLevels != D3DX_DEFAULT) ? MipLevels : header->data.dwMipMapCount;
 	if (MipLevels > header->data.dwMipMapCount)
 		MipLevels = header->data.dwMipMapCount;
@@ -171,6 +272,19 @@ HRESULT D3DXCreateTextureFromFileInMemoryEx_Custom(
 	if (MipLevels == 0)
 		MipLevels = 1; 
 
+	// Use the generated chain if the caller didn't ask for a single level & is loading the texture at full size
+	if (mipChain && requestedMipLevels != 1 && mipChain->width == Width && mipChain->height == Height)
+	{
+		if (requestedMipLevels == D3DX_DEFAULT || requestedMipLevels == 0)
+			MipLevels = mipChain->levelCount;
+		else
+			MipLevels = min(requestedMipLevels, mipChain->levelCount);
+	}
+	else
+	{
+		mipChain.reset();
+	}
+
 	D3DFORMAT format_orig = GetD3DFormatFromPixelFormat(header->data.ddpfPixelFormat);
 	if (format_orig == D3DFMT_UNKNOWN)
 		return E_FAIL;
@@ -184,23 +298,29 @@ HRESULT D3DXCreateTextureFromFileInMemoryEx_Custom(
 #endif
 
 	// Create the texture
-	HRESULT hr = pDevice->CreateTexture(
-		Width,
-		Height,
-		MipLevels,
-		Usage,
-		format_present,
-		Pool,
-		ppTexture,
-		nullptr
-	);
+	HRESULT hr;
+	{
+		TextureLoadProfiler::Scope timer(LoadProfiler, TextureLoadProfiler::Create);
+		hr = pDevice->CreateTexture(
+			Width,
+			Height,
+			MipLevels,
+			Usage,
+			format_present,
+			Pool,
+			ppTexture,
+			nullptr
+		);
+	}
 
 	if (FAILED(hr))
 		return hr;
 
+	TextureLoadProfiler::Scope timer(LoadProfiler, TextureLoadProfiler::Convert);
+
 	// Lock the texture and copy data
 	D3DLOCKED_RECT lockedRect;
-	uint8_t* srcData = const_cast<uint8_t*>(data) + sizeof(DDS_FILE);
+	const uint8_t* srcData = data + sizeof(DDS_FILE);
 	for (UINT mipLevel = 0; mipLevel < MipLevels; ++mipLevel)
 	{
 		hr = (*ppTexture)->LockRect(mipLevel, &lockedRect, nullptr, D3DLOCK_DISCARD);
@@ -215,26 +335,30 @@ HRESULT D3DXCreateTextureFromFileInMemoryEx_Custom(
 		UINT mipHeight = max(1U, Height >> mipLevel);
 		size_t mipSize = D3DXGetFormatSize(format_present, mipWidth, mipHeight);
 
+		// Chain only gets made for textures without mips, so every level past the first comes from it
+		if (mipChain && mipLevel > 0)
+			srcData = mipChain->level(mipLevel);
+
+		// Rows in the locked surface can be padded out past the DDS row size, only copy as one block if they match
+		bool isCompressed = format_present == D3DFMT_DXT1 || format_present == D3DFMT_DXT3 || format_present == D3DFMT_DXT5;
+		size_t rowCount = isCompressed ? (mipHeight + 3) / 4 : mipHeight;
+		size_t rowSize = mipSize / rowCount;
+		uint8_t* destData = static_cast<uint8_t*>(lockedRect.pBits);
+
 		if (format_orig == D3DFMT_A8B8G8R8)
 		{
 			// Convert A8B8G8R8 to A8R8G8B8
-			uint8_t* destData = static_cast<uint8_t*>(lockedRect.pBits);
-			for (UINT y = 0; y < mipHeight; ++y) {
-				for (UINT x = 0; x < mipWidth; ++x) {
-					uint8_t b = srcData[4 * (y * mipWidth + x)];
-					uint8_t g = srcData[4 * (y * mipWidth + x) + 1];
-					uint8_t r = srcData[4 * (y * mipWidth + x) + 2];
-					uint8_t a = srcData[4 * (y * mipWidth + x) + 3];
-					destData[4 * (y * mipWidth + x)] = r;
-					destData[4 * (y * mipWidth + x) + 1] = g;
-					destData[4 * (y * mipWidth + x) + 2] = b;
-					destData[4 * (y * mipWidth + x) + 3] = a;
-				}
-			}
+			PixelConvert::ConvertRows(PixelConvert::SwapRedBlue, srcData, rowSize, destData, size_t(lockedRect.Pitch), mipWidth, rowCount);
 		}
-		else {
+		else if (size_t(lockedRect.Pitch) == rowSize)
+		{
 			// Copy image data to the texture directly
-			memcpy(lockedRect.pBits, srcData, mipSize);
+			memcpy(destData, srcData, mipSize);
+		}
+		else
+		{
+			for (size_t y = 0; y < rowCount; y++)
+				memcpy(destData + y * lockedRect.Pitch, srcData + y * rowSize, rowSize);
 		}
 
 		(*ppTexture)->UnlockRect(mipLevel);
@@ -243,192 +367,27 @@ HRESULT D3DXCreateTextureFromFileInMemoryEx_Custom(
 		srcData += mipSize;
 	}
 
-	// Apply filtering modes (just the ones used by C2C)
-	// TODO: this likely isn't applying filtering properly, we probably need to gen mipmaps & use D3DXFilterTexture...
-
-	if (Filter != 0) {
-		if (Filter == D3DX_FILTER_NONE)
-			Filter = D3DTEXF_NONE;
-		else if (Filter == D3DX_FILTER_LINEAR)
-			Filter = D3DTEXF_LINEAR;
-		pDevice->SetSamplerState(0, D3DSAMP_MINFILTER, Filter);
-		pDevice->SetSamplerState(0, D3DSAMP_MAGFILTER, Filter);
-	}
-	if (MipFilter != 0) {
-		if (MipFilter == D3DX_FILTER_NONE)
-			MipFilter = D3DTEXF_NONE;
-		else if (MipFilter == D3DX_FILTER_LINEAR)
-			MipFilter = D3DTEXF_LINEAR;
-		pDevice->SetSamplerState(0, D3DSAMP_MIPFILTER, MipFilter);
-	}
-
+	ApplyFilterStates(pDevice, Filter, MipFilter);
 	return S_OK;
 }
 
-class FileDataCache
-{
-private:
-	struct CacheEntry
-	{
-		std::vector<uint8_t> data;
-		std::list<std::filesystem::path>::iterator lru_iterator;
-	};
-
-	std::size_t max_cache_size;
-	std::size_t current_cache_size;
-	std::unordered_map<std::filesystem::path, CacheEntry> cache;
-	std::list<std::filesystem::path> lru_list;
-
-	void evict()
-	{
-		while (!lru_list.empty() && current_cache_size > max_cache_size)
-		{
-			std::filesystem::path lru_file = lru_list.back();
-			current_cache_size -= cache[lru_file].data.size();
-			cache.erase(lru_file);
-			lru_list.pop_back();
-		}
-	}
-
-	std::mutex mtx1;
-	std::mutex mtx2;
-	std::mutex mtx3;
-
-public:
-	FileDataCache(std::size_t maxCacheSize) : max_cache_size(maxCacheSize), current_cache_size(0) {}
-
-	void cacheFolder(std::filesystem::path folder)
-	{
-		if (std::filesystem::exists(folder))
-			for (const auto& entry : std::filesystem::directory_iterator(folder))
-				if (entry.is_regular_file())
-					cacheFile(entry.path());
-	}
-
-	void cacheFile(std::filesystem::path filename)
-	{
-		auto extension = filename.extension().string();
-		std::transform(extension.begin(), extension.end(), extension.begin(),
-			[](unsigned char c) { return std::tolower(c); });
-
-		if (extension != ".dds")
-			return;
-
-		std::lock_guard _(mtx1);
-
-		if (cache.find(filename) != cache.end())
-		{
-			// File is already cached, move it to the front of LRU list
-			lru_list.erase(cache[filename].lru_iterator);
-			lru_list.push_front(filename);
-			cache[filename].lru_iterator = lru_list.begin();
-			return;
-		}
-
-		std::ifstream file(filename, std::ios::binary | std::ios::ate);
-		if (!file)
-		{
-			throw std::runtime_error("Unable to open file: " + filename.string());
-		}
-
-		std::streamsize size = file.tellg();
-		file.seekg(0, std::ios::beg);
-
-		std::vector<uint8_t> buffer(size);
-		if (!file.read(reinterpret_cast<char*>(buffer.data()), size))
-		{
-			throw std::runtime_error("Error reading file: " + filename.string());
-		}		
-		else
-		{
-			current_cache_size += size;
-			evict();
-
-			if (size > max_cache_size)
-				throw std::runtime_error("File size exceeds maximum cache size");
-
-			lru_list.push_front(filename);
-			cache[filename] = { std::move(buffer), lru_list.begin() };
-		}
-	}
-
-	const uint8_t* getFileData(std::filesystem::path filename, size_t* size)
-	{
-		std::lock_guard _(mtx2);
-		auto it = cache.find(filename);
-		if (it == cache.end())
-		{
-#ifdef _DEBUG
-			std::string msg = "Cache miss: " + filename.string() + "\n";
-			OutputDebugStringA(msg.c_str());
-#endif
-			cacheFile(filename);
-			it = cache.find(filename);
-			if (it == cache.end())
-				return nullptr;
-		}
-
-		// Move the accessed file to the front of the LRU list
-		lru_list.erase(it->second.lru_iterator);
-		lru_list.push_front(filename);
-		it->second.lru_iterator = lru_list.begin();
-
-		if (size)
-			*size = it->second.data.size();
-
-		return it->second.data.data();
-	}
-
-	std::size_t getCacheSize() const
-	{
-		return current_cache_size;
-	}
-};
-
-// QnD file entry cache class, so we don't have to run std::filesystem::exists for every texture
-// Probably not that much benefit since OS should have the directory cached anyway, but reducing OS calls should always help
-class DirectoryFileCache
-{
-public:
-	DirectoryFileCache() {}
-	explicit DirectoryFileCache(const std::filesystem::path& directory)
-		: directoryPath(directory)
-	{
-		scanDirectory();
-	}
-
-	bool exists(const std::filesystem::path& filename) const
-	{
-		return fileSet.find(filename) != fileSet.end();
-	}
-
-	void refresh()
-	{
-		fileSet.clear();
-		scanDirectory();
-	}
-
-private:
-	std::filesystem::path directoryPath;
-	std::unordered_set<std::filesystem::path> fileSet;
-
-	void scanDirectory()
-	{
-		if (!std::filesystem::exists(directoryPath))
-			return;
-
-		for (const auto& entry : std::filesystem::recursive_directory_iterator(directoryPath))
-			if (entry.is_regular_file() || entry.is_directory())
-				fileSet.insert(entry.path());
-	}
-};
-
 class TextureReplacement : public Hook
 {
+	friend class TextureCacheStatsWindow;
+	friend class TextureLoadProfileWindow;
+
 	inline static std::filesystem::path XmtDumpPath;
 	inline static std::filesystem::path XmtLoadPath;
-	inline static DirectoryFileCache FileSystem;
-	inline static FileDataCache FileData = FileDataCache(MAX_TEXTURE_CACHE_SIZE_MB * 1024 * 1024);
+	inline static uint64_t ResolverGeneration = 0; // ModFiles generation the resolver was built at
+	inline static TextureDumpWriter Dumper;
+	inline static FileDataCache FileData = FileDataCache(MIN_TEXTURE_CACHE_SIZE_MB * 1024 * 1024);
+	inline static MemoryBudget::AddressSpace LastAddressSpace;
+	inline static std::atomic<uint64_t> PrefetchWaitNanoseconds = 0;
+	inline static std::filesystem::path CacheStatsPath;
+	inline static std::filesystem::path LoadProfilePath; // without extension, exported as both .json & .csv
+	inline static std::vector<std::unique_ptr<TexPack::TexturePack>> TexturePacks;
+	inline static TextureResolver Resolver;
+	inline static TextureHashCache HashCache;
 
 	// Remappings for FXT modded sprites, so we can point them toward the vanilla versions
 	inline static std::unordered_map<uint32_t, std::tuple<uint32_t, int, int>> FxtHashRemappings =
@@ -461,6 +420,7 @@ class TextureReplacement : public Hook
 	//
 	inline static int CurrentTextureIdx = 0;
 	inline static std::filesystem::path CurrentXstsetFilename;
+	inline static uint32_t CurrentXstsetHash = 0;
 	inline static int CurrentXstsetIndex = 0;
 
 	inline static std::unordered_map<int, std::pair<float, float>> sprite_scales;
@@ -588,18 +548,107 @@ class TextureReplacement : public Hook
 		if (CurrentXstsetFilename != xstsetFilename)
 		{
 			CurrentXstsetFilename = xstsetFilename; // sprite xstset filename
+			CurrentXstsetHash = TexPack::HashName(CurrentXstsetFilename.filename().stem().string());
 			CurrentXstsetIndex = (int)(ctx.eax); // index into xstset array
 			CurrentTextureIdx = 0;
 		}
 	};
 
 	inline static const char* padType = nullptr;
+	inline static uint32_t padTypeHash = 0;
 
-	static void HandleTexture(void** ppSrcData, UINT* pSrcDataSize, std::filesystem::path texturePackName, bool isUITexture)
+	inline static std::shared_ptr<const void> ActiveReplacement;
+	inline static MipBuilder::MipCache MipChains;
+
+	// Content hash of the replacement HandleTexture just passed to the game, used to find it in SharedTextures
+	inline static uint64_t PendingShareKey = 0;
+	inline static const void* PendingShareSource = nullptr;
+	inline static std::unordered_map<uint64_t, uint64_t> ContentKeys; // source stamp -> content hash, only touched by the game thread
+
+	// Replacements are only hashed the first time they're used, or again after the file changes
+	static uint64_t ReplacementContentKey(const TextureResolver::Source* source, const uint8_t* data, size_t size)
+	{
+		const auto& path = source->file.empty() ? source->pack->path() : source->file;
+		auto info = ModFiles.stat(path);
+		struct
+		{
+			uint64_t offset;
+			uint64_t size;
+			int64_t writeTime;
+		} stamp = { source->file.empty() ? source->entry->offset : 0, info ? info->size : 0, info ? info->writeTime : 0 };
+
+		const auto& name = path.native();
+		uint64_t stampKey = XXH64(&stamp, sizeof(stamp), XXH64(name.data(), name.size() * sizeof(name[0]), 0));
+
+		auto [it, inserted] = ContentKeys.try_emplace(stampKey, 0);
+		if (inserted)
+			it->second = XXH3_64bits(data, size);
+		return it->second;
+	}
+
+	// Key for the texture the game is about to create from pSrcData, 0 if it shouldn't be shared
+	static uint64_t SharedTextureKey(const void* pSrcData, UINT Width, UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey)
+	{
+		if (!PendingShareKey || PendingShareSource != pSrcData)
+			return 0;
+
+		PendingShareSource = nullptr;
+
+		SharedTextureParams params = { PendingShareKey, Width, Height, MipLevels, Usage, uint32_t(Format), uint32_t(Pool), Filter, MipFilter, ColorKey };
+		return params.key();
+	}
+
+	static void RegisterSharedTexture(uint64_t key, IDirect3DTexture9* texture, size_t bytes)
+	{
+		// D3D holds onto the sentinel until the texture is destroyed, then its Release() takes the texture back out of the registry
+		auto* sentinel = new SharedTextureSentinel(key, texture);
+		if (SUCCEEDED(texture->SetPrivateData(SharedTextureSentinel::Guid, sentinel, sizeof(IUnknown*), D3DSPD_IUNKNOWN)))
+			SharedTextures.insert(key, texture, bytes);
+		sentinel->Release();
+	}
+
+	// Uncompressed 32bpp textures that don't have any mips of their own
+	static bool NeedsMipChain(const uint8_t* file, size_t fileSize, uint32_t* width, uint32_t* height)
+	{
+		if (fileSize < sizeof(DDS_FILE))
+			return false;
+
+		const DDS_FILE* dds = (const DDS_FILE*)file;
+		if (dds->magic != DDS_MAGIC || dds->data.dwMipMapCount > 1)
+			return false;
+
+		D3DFORMAT format = GetD3DFormatFromPixelFormat(dds->data.ddpfPixelFormat);
+		if (format != D3DFMT_A8R8G8B8 && format != D3DFMT_A8B8G8R8)
+			return false;
+
+		*width = dds->data.dwWidth;
+		*height = dds->data.dwHeight;
+		return (*width > 1 || *height > 1) && fileSize >= sizeof(DDS_FILE) + size_t(*width) * *height * 4;
+	}
+
+	// Mip chains are built on the prefetch pool when there is one, HandleTexture helps out while it waits for them
+	static void MipParallelFor(size_t count, const std::function<void(size_t)>& func)
+	{
+		if (PrefetchPool)
+			PrefetchPool->parallelFor(count, func);
+		else
+			for (size_t i = 0; i < count; i++)
+				func(i);
+	}
+
+	// setHash is TexPack::HashName of the texturePackName stem, kept updated alongside the Current*setFilename vars
+	static void HandleTexture(void** ppSrcData, UINT* pSrcDataSize, const std::filesystem::path& texturePackName, uint32_t setHash, bool isUITexture)
 	{
 		if (!*ppSrcData || !*pSrcDataSize) [[unlikely]]
 			return;
 
+		LoadProfiler.commit();
+
+		ActiveReplacement.reset();
+		PendingMipChain.reset();
+		PendingMipChainSource = nullptr;
+		PendingShareSource = nullptr;
+
 		bool allowReplacement = isUITexture ? Settings::UITextureReplacement : Settings::SceneTextureReplacement;
 		bool allowExtract = isUITexture ? Settings::UITextureExtract : Settings::SceneTextureExtract;
 
@@ -609,7 +658,15 @@ class TextureReplacement : public Hook
 
 		int width = header->data.dwWidth;
 		int height = header->data.dwHeight;
-		auto hash = XXH32(*ppSrcData, *pSrcDataSize, 0);
+
+		auto hashStart = std::chrono::steady_clock::now();
+		auto hash = Settings::TextureHashCache ? HashCache.hash(*ppSrcData, *pSrcDataSize) : XXH32(*ppSrcData, *pSrcDataSize, 0);
+
+		if (Settings::ProfileTextureLoads) [[unlikely]]
+		{
+			LoadProfiler.begin(texturePackName.filename().stem().string(), std::format("{}_{:X}_{}x{}", CurrentTextureIdx, hash, width, height));
+			LoadProfiler.add(TextureLoadProfiler::Hash, TextureLoadProfiler::Since(hashStart));
+		}
 
 		// Remap some modified FXT textures to their original hashes
 		if (FxtHashRemappings.count(hash)) [[unlikely]]
@@ -628,118 +685,192 @@ class TextureReplacement : public Hook
 			{
 				auto type = (Game::ForcedPadType != Game::GamepadType::None) ? Game::ForcedPadType : Game::CurrentPadType;
 				if (type != Game::GamepadType::PC)
+				{
 					padType = Game::PadTypes[int(type)];
+					padTypeHash = TexPack::HashName(padType);
+				}
 			}
 
 			usePadDirectory = padType != nullptr;
 		}
 
-		std::string ddsName = std::format("{:X}_{}x{}.dds", hash, width, height);
-		std::string ddsNameIndexed = std::format("{}_{}", CurrentTextureIdx++, ddsName);
+		int textureIdx = CurrentTextureIdx++;
 
 		if (allowReplacement)
 		{
-			std::filesystem::path path_load;
-			if (usePadDirectory) [[unlikely]]
+			const uint8_t* file = nullptr;
+			size_t fileSize = 0;
+			std::shared_ptr<const void> fileOwner;
+
+			const TextureResolver::Source* source;
 			{
-				if (!FileSystem.exists(path_load))
-					path_load = XmtLoadPath / texturePackName.filename().stem() / padType / ddsNameIndexed;
-				if (!FileSystem.exists(path_load))
-					path_load = XmtLoadPath / texturePackName.filename().stem() / padType / ddsName;
-				if (!FileSystem.exists(path_load))
-					path_load = XmtLoadPath / padType / texturePackName.filename().stem() / ddsNameIndexed;
-				if (!FileSystem.exists(path_load))
-					path_load = XmtLoadPath / padType / texturePackName.filename().stem() / ddsName;
-				if (!FileSystem.exists(path_load))
-					path_load = XmtLoadPath / padType / ddsNameIndexed;
-				if (!FileSystem.exists(path_load))
-					path_load = XmtLoadPath / padType / ddsName;
+				TextureLoadProfiler::Scope timer(LoadProfiler, TextureLoadProfiler::Probe);
+				source = Resolver.find(hash, width, height, textureIdx, setHash, usePadDirectory ? padTypeHash : 0);
 			}
 
-			if (!FileSystem.exists(path_load))
-				path_load = XmtLoadPath / texturePackName.filename().stem() / ddsNameIndexed;
-			if (!FileSystem.exists(path_load))
-				path_load = XmtLoadPath / texturePackName.filename().stem() / ddsName;
-			if (!FileSystem.exists(path_load))
-				path_load = XmtLoadPath / ddsNameIndexed;
-			if (!FileSystem.exists(path_load))
-				path_load = XmtLoadPath / ddsName;
+			if (source)
+			{
+				if (!source->file.empty())
+				{
+					WaitForPrefetch(source->file);
+
+					TextureLoadProfiler::Scope timer(LoadProfiler, TextureLoadProfiler::Read);
+					if (auto view = FileData.getFileData(source->file))
+					{
+						file = view->data();
+						fileSize = view->size();
+						fileOwner = view;
+					}
+				}
+				else
+				{
+					TextureLoadProfiler::Scope timer(LoadProfiler, TextureLoadProfiler::Read);
+					fileOwner = source->pack->read(*source->entry, &file, &fileSize);
+				}
+			}
 
-			if (FileSystem.exists(path_load))
+			if (fileOwner && fileSize >= sizeof(DDS_FILE))
 			{
-				size_t size = 0;
-				const uint8_t* file = FileData.getFileData(path_load, &size);
-				if (file)
+				const DDS_FILE* newhead = (const DDS_FILE*)file;
+				if (newhead->magic == DDS_MAGIC)
 				{
-					const DDS_FILE* newhead = (const DDS_FILE*)file;
-					if (newhead->magic == DDS_MAGIC)
+					if (isUITexture)
 					{
-						if (isUITexture)
-						{
-							// Calc the scaling ratio of new texture vs old one, to use in put_sprite funcs later
-							float ratio_width = float(newhead->data.dwWidth) / float(header->data.dwWidth);
-							float ratio_height = float(newhead->data.dwHeight) / float(header->data.dwHeight);
+						// Calc the scaling ratio of new texture vs old one, to use in put_sprite funcs later
+						float ratio_width = float(newhead->data.dwWidth) / float(header->data.dwWidth);
+						float ratio_height = float(newhead->data.dwHeight) / float(header->data.dwHeight);
 
-							int curTextureNum = *Module::exe_ptr<int>(0x55B25C);
-							sprite_scales[(CurrentXstsetIndex << 16) | curTextureNum] = { ratio_width, ratio_height };
-						}
+						int curTextureNum = *Module::exe_ptr<int>(0x55B25C);
+						sprite_scales[(CurrentXstsetIndex << 16) | curTextureNum] = { ratio_width, ratio_height };
+					}
 
-						// Replace header in the old data in case some game code tries reading it...
-						memcpy(*ppSrcData, file, sizeof(DDS_FILE));
+					// Replace header in the old data in case some game code tries reading it...
+					memcpy(*ppSrcData, file, sizeof(DDS_FILE));
 
-						// Update pointers to our new texture
-						*ppSrcData = (void*)file;
-						*pSrcDataSize = size;
+					// Update pointers to our new texture
+					*ppSrcData = (void*)file;
+					*pSrcDataSize = UINT(fileSize);
 
-						// Don't dump texture if we've loaded in new one
-						allowExtract = false;
+					// Keep it alive while the game creates the texture from it, a prefetch thread could evict it from the cache meanwhile
+					ActiveReplacement = fileOwner;
+
+					if (Settings::ShareReplacementTextures)
+					{
+						TextureLoadProfiler::Scope timer(LoadProfiler, TextureLoadProfiler::Hash);
+						PendingShareKey = ReplacementContentKey(source, file, fileSize);
+						PendingShareSource = file;
 					}
+
+					if (!isUITexture && Settings::GenerateTextureMipmaps && Settings::UseNewTextureAllocator)
+					{
+						uint32_t mipWidth, mipHeight;
+						if (NeedsMipChain(file, fileSize, &mipWidth, &mipHeight))
+						{
+							TextureLoadProfiler::Scope timer(LoadProfiler, TextureLoadProfiler::Convert);
+							// Keyed on the contents, same as PrefetchFile's key for a loose file
+							uint64_t key = ReplacementContentKey(source, file, fileSize);
+							PendingMipChain = MipChains.get(key, file + sizeof(DDS_FILE), mipWidth, mipHeight, MipParallelFor);
+							PendingMipChainSource = file;
+						}
+					}
+
+					// Don't dump texture if we've loaded in new one
+					allowExtract = false;
 				}
 			}
 		}
 
+		LoadProfiler.addBytes(*pSrcDataSize);
+
 		if (allowExtract) [[unlikely]]
 		{
-			auto path_dump = XmtDumpPath / texturePackName.filename().stem();
-			if (!FileSystem.exists(path_dump))
-				std::filesystem::create_directories(path_dump);
+			std::string ddsName = std::format("{:X}_{}x{}.dds", hash, width, height);
+			std::string ddsNameIndexed = std::format("{}_{}", textureIdx, ddsName);
 
-			path_dump = path_dump / ddsNameIndexed;
-			if (!FileSystem.exists(path_dump))
+			// Name contains the hash & size, so an existing entry means this exact texture was already dumped
+			auto path_dump = XmtDumpPath / texturePackName.filename().stem() / ddsNameIndexed;
+			if (!ModFiles.exists(path_dump))
 			{
-				std::ofstream file(path_dump, std::ios::binary);
-				if (file)
-				{
-					file.write((const char*)*ppSrcData, *pSrcDataSize);
-					FileSystem.refresh();
-				}
+				ModFiles.insert(path_dump, *pSrcDataSize);
+				Dumper.queue(path_dump, *ppSrcData, *pSrcDataSize);
 			}
 		}
 	}
 
+	// Texture creation for both allocators, hands out the existing texture if this replacement was already loaded with the same parameters
+	static HRESULT CreateTexture_Custom(LPDIRECT3DDEVICE9 pDevice, void* pSrcData, UINT SrcDataSize, UINT Width, UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, LPDIRECT3DTEXTURE9* ppTexture)
+	{
+		// Our allocator doesn't apply color keys, so there's none to tell apart
+		uint64_t shareKey = SharedTextureKey(pSrcData, Width, Height, MipLevels, Usage, Format, Pool, Filter, MipFilter, 0);
+		if (shareKey && ppTexture)
+		{
+			if (auto* texture = SharedTextures.acquire(shareKey))
+			{
+				// Same sampler states a fresh load would've left behind
+				ApplyFilterStates(pDevice, Filter, MipFilter);
+				*ppTexture = texture;
+				LoadProfiler.commit();
+				return S_OK;
+			}
+		}
+
+		HRESULT hr = D3DXCreateTextureFromFileInMemoryEx_Custom(pDevice, pSrcData, SrcDataSize, Width, Height, MipLevels, Usage, Format, Pool, Filter, MipFilter, ppTexture);
+		if (shareKey && SUCCEEDED(hr))
+			RegisterSharedTexture(shareKey, *ppTexture, SrcDataSize - sizeof(DDS_FILE));
+
+		LoadProfiler.commit();
+		return hr;
+	}
+	static HRESULT CreateTexture_Orig(LPDIRECT3DDEVICE9 pDevice, void* pSrcData, UINT SrcDataSize, UINT Width, UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey, struct D3DXIMAGE_INFO* pSrcInfo, PALETTEENTRY* pPalette, LPDIRECT3DTEXTURE9* ppTexture)
+	{
+		// We've no way to fill these in for a shared texture
+		uint64_t shareKey = (pSrcInfo || pPalette) ? 0 : SharedTextureKey(pSrcData, Width, Height, MipLevels, Usage, Format, Pool, Filter, MipFilter, ColorKey);
+		if (shareKey && ppTexture)
+		{
+			if (auto* texture = SharedTextures.acquire(shareKey))
+			{
+				*ppTexture = texture;
+				LoadProfiler.commit();
+				return S_OK;
+			}
+		}
+
+		HRESULT hr;
+		{
+			TextureLoadProfiler::Scope timer(LoadProfiler, TextureLoadProfiler::Create);
+			hr = D3DXCreateTextureFromFileInMemoryEx.stdcall<HRESULT>(pDevice, pSrcData, SrcDataSize, Width, Height, MipLevels, Usage, Format, Pool, Filter, MipFilter, ColorKey, pSrcInfo, pPalette, ppTexture);
+		}
+
+		if (shareKey && SUCCEEDED(hr))
+			RegisterSharedTexture(shareKey, *ppTexture, SrcDataSize - sizeof(DDS_FILE));
+
+		LoadProfiler.commit();
+		return hr;
+	}
+
 	// Two versions of the func depending on Settings::UseNewTextureAllocator, to reduce branching
 	inline static SafetyHookInline D3DXCreateTextureFromFileInMemory = {};
 	static HRESULT __stdcall D3DXCreateTextureFromFileInMemory_Custom_dest(LPDIRECT3DDEVICE9 pDevice, void* pSrcData, UINT SrcDataSize, LPDIRECT3DTEXTURE9* ppTexture)
 	{
 		if (pSrcData && SrcDataSize)
 		{
-			HandleTexture(&pSrcData, &SrcDataSize, CurrentXstsetFilename, true);
+			HandleTexture(&pSrcData, &SrcDataSize, CurrentXstsetFilename, CurrentXstsetHash, true);
 		}
 
 		// Call D3DXCreateTextureFromFileInMemoryEx instead of D3DXCreateTextureFromFileInMemory, so we can specify no mipmaps
 		// Should prevent D3D from trying to generate mipmaps, reducing load times of non-mipped UI textures quite a bit
-		return D3DXCreateTextureFromFileInMemoryEx_Custom(pDevice, pSrcData, SrcDataSize, D3DX_DEFAULT, D3DX_DEFAULT, 1, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, 1, 3, ppTexture);
+		return CreateTexture_Custom(pDevice, pSrcData, SrcDataSize, D3DX_DEFAULT, D3DX_DEFAULT, 1, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, 1, 3, ppTexture);
 	}
 	static HRESULT __stdcall D3DXCreateTextureFromFileInMemory_Orig_dest(LPDIRECT3DDEVICE9 pDevice, void* pSrcData, UINT SrcDataSize, LPDIRECT3DTEXTURE9* ppTexture)
 	{
 		if (pSrcData && SrcDataSize)
 		{
-			HandleTexture(&pSrcData, &SrcDataSize, CurrentXstsetFilename, true);
+			HandleTexture(&pSrcData, &SrcDataSize, CurrentXstsetFilename, CurrentXstsetHash, true);
 		}
 
 		// Call D3DXCreateTextureFromFileInMemoryEx instead of D3DXCreateTextureFromFileInMemory, so we can specify no mipmaps
 		// Should prevent D3D from trying to generate mipmaps, reducing load times of non-mipped UI textures quite a bit
-		return D3DXCreateTextureFromFileInMemoryEx.stdcall<HRESULT>(pDevice, pSrcData, SrcDataSize, D3DX_DEFAULT, D3DX_DEFAULT, 1, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, 1, 3, 0, nullptr, nullptr, ppTexture);
+		return CreateTexture_Orig(pDevice, pSrcData, SrcDataSize, D3DX_DEFAULT, D3DX_DEFAULT, 1, 0, D3DFMT_UNKNOWN, D3DPOOL_MANAGED, 1, 3, 0, nullptr, nullptr, ppTexture);
 	}
 
 	//
@@ -747,6 +878,7 @@ class TextureReplacement : public Hook
 	//
 
 	inline static std::filesystem::path CurrentXmtsetFilename;
+	inline static uint32_t CurrentXmtsetHash = 0;
 	inline static const char* PrevXmtName = nullptr;
 
 	// Two versions of the func depending on Settings::UseNewTextureAllocator, to reduce branching
@@ -755,19 +887,19 @@ class TextureReplacement : public Hook
 	{
 		if ((Settings::SceneTextureReplacement || Settings::SceneTextureExtract) && pSrcData && SrcDataSize)
 		{
-			HandleTexture(&pSrcData, &SrcDataSize, CurrentXmtsetFilename, false);
+			HandleTexture(&pSrcData, &SrcDataSize, CurrentXmtsetFilename, CurrentXmtsetHash, false);
 		}
 
-		return D3DXCreateTextureFromFileInMemoryEx_Custom(pDevice, pSrcData, SrcDataSize, Width, Height, MipLevels, Usage, Format, Pool, Filter, MipFilter, ppTexture);
+		return CreateTexture_Custom(pDevice, pSrcData, SrcDataSize, Width, Height, MipLevels, Usage, Format, Pool, Filter, MipFilter, ppTexture);
 	}
 	static HRESULT __stdcall D3DXCreateTextureFromFileInMemoryEx_Orig_dest(LPDIRECT3DDEVICE9 pDevice, void* pSrcData, UINT SrcDataSize, UINT Width, UINT Height, UINT MipLevels, DWORD Usage, D3DFORMAT Format, D3DPOOL Pool, DWORD Filter, DWORD MipFilter, D3DCOLOR ColorKey, struct D3DXIMAGE_INFO* pSrcInfo, PALETTEENTRY* pPalette, LPDIRECT3DTEXTURE9* ppTexture)
 	{
 		if ((Settings::SceneTextureReplacement || Settings::SceneTextureExtract) && pSrcData && SrcDataSize)
 		{
-			HandleTexture(&pSrcData, &SrcDataSize, CurrentXmtsetFilename, false);
+			HandleTexture(&pSrcData, &SrcDataSize, CurrentXmtsetFilename, CurrentXmtsetHash, false);
 		}
 
-		return D3DXCreateTextureFromFileInMemoryEx.stdcall<HRESULT>(pDevice, pSrcData, SrcDataSize, Width, Height, MipLevels, Usage, Format, Pool, Filter, MipFilter, ColorKey, pSrcInfo, pPalette, ppTexture);
+		return CreateTexture_Orig(pDevice, pSrcData, SrcDataSize, Width, Height, MipLevels, Usage, Format, Pool, Filter, MipFilter, ColorKey, pSrcInfo, pPalette, ppTexture);
 	}
 
 	inline static SafetyHookInline D3DXCreateCubeTextureFromFileInMemoryEx = {};
@@ -775,62 +907,219 @@ class TextureReplacement : public Hook
 	{
 		if ((Settings::SceneTextureReplacement || Settings::SceneTextureExtract) && pSrcData && SrcDataSize)
 		{
-			HandleTexture(&pSrcData, &SrcDataSize, CurrentXmtsetFilename, false);
+			HandleTexture(&pSrcData, &SrcDataSize, CurrentXmtsetFilename, CurrentXmtsetHash, false);
 		}
 
 		return D3DXCreateCubeTextureFromFileInMemoryEx.stdcall<HRESULT>(pDevice, pSrcData, SrcDataSize, Size, MipLevels, Usage, Format, Pool, Filter, MipFilter, ColorKey, pSrcInfo, pPalette, ppCubeTexture);
 	}
 
+	// Resizes the file cache to fit the address space we have left, rechecked every time a new xmtset starts loading
+	static void UpdateCacheBudget()
+	{
+		LastAddressSpace = MemoryBudget::Query();
+		if (Settings::TextureCacheBudgetMB > 0)
+			return;
+
+		size_t budget = MemoryBudget::Compute(LastAddressSpace, FileData.getCacheSize(),
+			MIN_TEXTURE_CACHE_SIZE_MB * 1024 * 1024, MAX_TEXTURE_CACHE_SIZE_MB * 1024 * 1024);
+
+		if (budget == FileData.getMaxSize())
+			return;
+
+		spdlog::info("TextureReplacement: cache budget {}MB -> {}MB (free address space {}MB, largest block {}MB, committed {}MB)",
+			FileData.getMaxSize() / (1024 * 1024), budget / (1024 * 1024), LastAddressSpace.free / (1024 * 1024),
+			LastAddressSpace.largestFreeRegion / (1024 * 1024), LastAddressSpace.committed / (1024 * 1024));
+
+		FileData.setMaxSize(budget);
+	}
+
+	static bool WriteCacheStats(const std::filesystem::path& path)
+	{
+		auto stats = FileData.getStats();
+
+		Json::Value root;
+		root["hits"] = Json::UInt64(stats.hits);
+		root["misses"] = Json::UInt64(stats.misses);
+		root["hitRate"] = (stats.hits + stats.misses) ? double(stats.hits) / double(stats.hits + stats.misses) : 0.0;
+		root["evictions"] = Json::UInt64(stats.evictions);
+		root["bytesResident"] = Json::UInt64(stats.bytesResident);
+		root["budgetBytes"] = Json::UInt64(stats.maxSize);
+		root["missStallMs"] = double(stats.stallNanoseconds) / 1000000.0;
+		root["prefetchWaitMs"] = double(PrefetchWaitNanoseconds.load()) / 1000000.0;
+
+		auto shared = SharedTextures.stats();
+		root["sharedTextures"] = Json::UInt64(shared.liveTextures);
+		root["sharedLoads"] = Json::UInt64(shared.sharedLoads);
+		root["sharedBytesSaved"] = Json::UInt64(shared.bytesSaved);
+
+		Json::Value& space = root["addressSpace"];
+		space["totalBytes"] = Json::UInt64(LastAddressSpace.total);
+		space["freeBytes"] = Json::UInt64(LastAddressSpace.free);
+		space["largestFreeRegionBytes"] = Json::UInt64(LastAddressSpace.largestFreeRegion);
+		space["committedBytes"] = Json::UInt64(LastAddressSpace.committed);
+
+		std::ofstream file(path, std::ios::trunc);
+		if (!file)
+		{
+			spdlog::error("TextureReplacement: failed to write cache stats to {}", path.string());
+			return false;
+		}
+
+		Json::StreamWriterBuilder writer;
+		writer["indentation"] = "\t";
+		file << Json::writeString(writer, root) << '\n';
+		return true;
+	}
+
 	inline static SafetyHookInline LoadXmtsetObject = {};
 	static int __cdecl LoadXmtsetObject_dest(char* XmtFileName, int XmtIndex)
 	{
 		if (PrevXmtName != XmtFileName)
 		{
 			CurrentXmtsetFilename = XmtFileName;
+			CurrentXmtsetHash = TexPack::HashName(CurrentXmtsetFilename.filename().stem().string());
 			PrevXmtName = XmtFileName;
 			CurrentTextureIdx = 0;
+
+			UpdateCacheBudget();
+
+			// Pick up replacements that were added/removed while the game was running (only changes if WatchModFiles is set)
+			if (ModFiles.generation() != ResolverGeneration)
+			{
+				ResolverGeneration = ModFiles.generation();
+				Resolver.build(XmtLoadPath, ModFiles.list(XmtLoadPath, true, false), TexturePacks);
+				spdlog::info("TextureReplacement: texture folder changed, {} replacement textures available", Resolver.size());
+			}
 		}
 
 		return LoadXmtsetObject.call<int>(XmtFileName, XmtIndex);
 	}
 
-	inline static std::atomic<bool> isComplete{ true };
-	inline static std::thread cachingThread;
-	static void cacheFolderFiles(const std::filesystem::path& xmtFileName)
+	// Texture prefetch, see texture_prefetch.hpp
+	// Prefetcher is declared first so it's destroyed after the pool, whose destructor still runs the queued tasks
+	inline static std::unique_ptr<TexturePrefetcher> Prefetcher;
+	inline static std::unique_ptr<WorkStealingPool> PrefetchPool;
+
+	// Picks a prefetch worker count for the drive containing path
+	// Drives with a seek penalty (HDDs) only get a couple of threads, since parallel reads there just cause more seeking
+	static int PrefetchThreadCount(const std::filesystem::path& path)
+	{
+		int cores = int(std::thread::hardware_concurrency());
+		int ssdThreads = std::clamp(cores - 1, 2, 8); // leave a core for the game thread
+
+		std::error_code ec;
+		auto absolutePath = std::filesystem::absolute(path, ec);
+		wchar_t volumePath[MAX_PATH];
+		if (ec || !GetVolumePathNameW(absolutePath.c_str(), volumePath, MAX_PATH))
+			return ssdThreads;
+
+		// "C:\" -> "\\.\C:"
+		std::wstring devicePath = L"\\\\.\\" + std::wstring(volumePath);
+		if (devicePath.back() == L'\\')
+			devicePath.pop_back();
+
+		// Zero access rights is enough for IOCTL_STORAGE_QUERY_PROPERTY, and doesn't need admin
+		HANDLE device = CreateFileW(devicePath.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+		if (device == INVALID_HANDLE_VALUE)
+			return ssdThreads;
+
+		STORAGE_PROPERTY_QUERY query = {};
+		query.PropertyId = StorageDeviceSeekPenaltyProperty;
+		query.QueryType = PropertyStandardQuery;
+
+		DEVICE_SEEK_PENALTY_DESCRIPTOR seekPenalty = {};
+		DWORD bytesReturned = 0;
+		BOOL result = DeviceIoControl(device, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query),
+			&seekPenalty, sizeof(seekPenalty), &bytesReturned, nullptr);
+		CloseHandle(device);
+
+		// Network drives & RAM disks may not support the query, treat those like SSDs
+		if (!result || bytesReturned < sizeof(seekPenalty))
+			return ssdThreads;
+
+		if (seekPenalty.IncursSeekPenalty)
+		{
+			spdlog::info("TextureReplacement: {} is on a drive with seek penalty, limiting to 2 threads", path.string());
+			return 2;
+		}
+
+		return ssdThreads;
+	}
+
+	// Called before HandleTexture reads a replacement file
+	static void WaitForPrefetch(const std::filesystem::path& file)
+	{
+		if (!Prefetcher)
+			return;
+
+		uint64_t waited = Prefetcher->wait(file);
+		if (waited)
+		{
+			PrefetchWaitNanoseconds += waited;
+			LoadProfiler.add(TextureLoadProfiler::Wait, waited);
+		}
+	}
+
+	// Runs on a pool thread for every queued file
+	static void PrefetchFile(const std::filesystem::path& file)
 	{
-		auto fileName = xmtFileName.stem();
-		auto folderPath = XmtLoadPath / fileName;
+		// Mapping alone doesn't read anything in, fault the pages in here so the game thread doesn't have to
+		if (auto view = FileData.cacheFile(file))
+		{
+			view->touchPages();
+
+			// Build any missing mips now too, HandleTexture then only needs to load them from the cache
+			uint32_t mipWidth, mipHeight;
+			if (Settings::GenerateTextureMipmaps && Settings::UseNewTextureAllocator &&
+				NeedsMipChain(view->data(), view->size(), &mipWidth, &mipHeight))
+				MipChains.get(XXH3_64bits(view->data(), view->size()), view->data() + sizeof(DDS_FILE), mipWidth, mipHeight, MipParallelFor);
+		}
+	}
+
+	static void QueuePrefetch(const std::filesystem::path& xmtFileName)
+	{
+		auto setName = xmtFileName.stem().string();
+		auto folderPath = XmtLoadPath / setName;
+
+		if (Prefetcher->inFlight(setName) || !ModFiles.isDirectory(folderPath))
+			return;
+
+		std::vector<std::filesystem::path> files;
+		for (auto& file : ModFiles.list(folderPath, false, false))
+			if (FileDataCache::isCacheable(file))
+				files.push_back(std::move(file));
+
+		size_t count = files.size();
+		if (!Prefetcher->queue(setName, std::move(files)))
+			return;
 
 #ifdef _DEBUG
-		std::string msg = "cacheFolderFiles: " + folderPath.string() + "\n";
+		std::string msg = std::format("QueuePrefetch: {} ({} files)\n", folderPath.string(), count);
 		OutputDebugStringA(msg.c_str());
 #endif
-
-		FileData.cacheFolder(folderPath);
-
-		isComplete = true;
 	}
 
 	inline static SafetyHookMid LoadXmtsetObject_Step1 = {};
 	static void __cdecl LoadXmtsetObject_Step1_dest(SafetyHookContext& ctx)
 	{
-		if (!isComplete)
-			return;
-
-		isComplete = false;
-		cachingThread = std::thread(cacheFolderFiles, (const char*)ctx.esi);
-		cachingThread.detach();
+		QueuePrefetch((const char*)ctx.esi);
 	}
 
 	inline static SafetyHookMid LoadXmtsetObject_Step3 = {};
 	static void __cdecl LoadXmtsetObject_Step3_dest(SafetyHookContext& ctx)
 	{
-		if (!isComplete)
-			ctx.eax = 0;
+		// Game is about to load this set, have the pool work on it before any others
+		Prefetcher->prioritize(CurrentXmtsetFilename.stem().string());
 	}
 
 
 public:
+	// DLL_PROCESS_DETACH, stops the dump writer before the static destructors would
+	static void Shutdown(bool processTerminating)
+	{
+		Dumper.shutdown(processTerminating);
+	}
+
 	std::string_view description() override
 	{
 		return "TextureReplacement";
@@ -863,6 +1152,17 @@ public:
 		XmtDumpPath = textureBaseDir / "dump";
 		XmtLoadPath = textureBaseDir / "load";
 
+		MipChains.setDirectory(textureBaseDir / "mipcache");
+		MipChains.setFilter(MipBuilder::ParseFilter(Settings::TextureMipmapFilter));
+
+		if (Settings::TextureHashCache)
+		{
+			std::error_code ec;
+			std::filesystem::create_directories(textureBaseDir, ec);
+			if (!HashCache.open(textureBaseDir / "texture_hashes.bin"))
+				Settings::TextureHashCache = false;
+		}
+
 		// Startup texture cache, causes game to take a while to boot, disabled for now...
 #if 0
 		if (std::filesystem::exists(XmtLoadPath))
@@ -878,7 +1178,58 @@ public:
 		}
 #endif
 
-		FileSystem = DirectoryFileCache(XmtLoadPath);
+		ModFiles.mountDirectory(XmtLoadPath, 1, Settings::ModFileManifest ? textureBaseDir / "load_manifest.bin" : std::filesystem::path(),
+			Settings::WatchModFiles);
+		if (Settings::SceneTextureExtract || Settings::UITextureExtract)
+			ModFiles.mountDirectory(XmtDumpPath, 0);
+
+		// Texture packs inside the load folder, searched in filename order
+		{
+			std::vector<std::filesystem::path> packPaths;
+			for (auto& file : ModFiles.list(XmtLoadPath))
+				if (file.extension() == TexPack::Extension)
+					packPaths.push_back(std::move(file));
+
+			std::sort(packPaths.begin(), packPaths.end());
+			for (const auto& packPath : packPaths)
+			{
+				auto pack = std::make_unique<TexPack::TexturePack>();
+				if (!pack->open(packPath))
+				{
+					spdlog::error("TextureReplacement: failed to open texture pack {}", packPath.string());
+					continue;
+				}
+
+				spdlog::info("TextureReplacement: loaded texture pack {} ({} textures)", packPath.string(), pack->entryCount());
+
+				// Packed files show up underneath the load folder, with any loose file of the same name taking priority
+				std::vector<VirtualFileSystem::ArchiveFile> packFiles;
+				for (uint32_t i = 0; i < pack->entryCount(); i++)
+				{
+					auto entryPath = pack->entryPath(i);
+					if (!entryPath.empty())
+						packFiles.push_back({ std::filesystem::path(entryPath), pack->entries()[i].size, i });
+				}
+
+				const TexPack::TexturePack* packPtr = pack.get();
+				ModFiles.mountArchive(XmtLoadPath, packPath, packFiles, [packPtr](uint32_t entry, const uint8_t** data, size_t* size) {
+					return packPtr->read(packPtr->entries()[entry], data, size);
+				}, 0);
+
+				TexturePacks.push_back(std::move(pack));
+			}
+		}
+
+		ResolverGeneration = ModFiles.generation();
+		Resolver.build(XmtLoadPath, ModFiles.list(XmtLoadPath, true, false), TexturePacks);
+		spdlog::info("TextureReplacement: {} replacement textures available", Resolver.size());
+
+		CacheStatsPath = textureBaseDir / "texture_cache_stats.json";
+		LoadProfilePath = textureBaseDir / "texture_load_profile";
+		if (Settings::TextureCacheBudgetMB > 0)
+			FileData.setMaxSize(size_t(Settings::TextureCacheBudgetMB) * 1024 * 1024);
+		UpdateCacheBudget();
+		spdlog::info("TextureReplacement: texture cache budget {}MB", FileData.getMaxSize() / (1024 * 1024));
 
 		bool ApplyUIHooks = Settings::UITextureReplacement || Settings::UITextureExtract;
 		bool ApplySceneHooks = Settings::SceneTextureReplacement || Settings::SceneTextureExtract;
@@ -889,7 +1240,10 @@ public:
 		if (ApplyUIHooks || ApplySceneHooks)
 		{
 			if (Settings::UseNewTextureAllocator)
+			{
 				D3DXCreateTextureFromFileInMemoryEx = safetyhook::create_inline(Module::exe_ptr(D3DXCreateTextureFromFileInMemoryEx_Addr), D3DXCreateTextureFromFileInMemoryEx_Custom_dest);
+				spdlog::info("TextureReplacement: using {} pixel conversion", PixelConvert::LevelName(PixelConvert::CurrentLevel()));
+			}
 			else
 				D3DXCreateTextureFromFileInMemoryEx = safetyhook::create_inline(Module::exe_ptr(D3DXCreateTextureFromFileInMemoryEx_Addr), D3DXCreateTextureFromFileInMemoryEx_Orig_dest);
 		}
@@ -918,6 +1272,14 @@ public:
 
 			if (Settings::EnableTextureCache)
 			{
+				int numThreads = Settings::TextureCacheThreads;
+				if (numThreads <= 0)
+					numThreads = PrefetchThreadCount(XmtLoadPath);
+
+				PrefetchPool = std::make_unique<WorkStealingPool>(numThreads);
+				Prefetcher = std::make_unique<TexturePrefetcher>(*PrefetchPool, PrefetchFile);
+				spdlog::info("TextureReplacement: texture cache using {} prefetch threads", numThreads);
+
 				LoadXmtsetObject_Step1 = safetyhook::create_mid(Module::exe_ptr(LoadXmtsetObject_Step1_HookAddr), LoadXmtsetObject_Step1_dest);
 				LoadXmtsetObject_Step3 = safetyhook::create_mid(Module::exe_ptr(LoadXmtsetObject_Step3_HookAddr), LoadXmtsetObject_Step3_dest);
 			}
@@ -929,3 +1291,169 @@ public:
 	static TextureReplacement instance;
 };
 TextureReplacement TextureReplacement::instance;
+
+namespace Textures
+{
+	void Shutdown(bool processTerminating)
+	{
+		TextureReplacement::Shutdown(processTerminating);
+	}
+}
+
+class TextureCacheStatsWindow : public OverlayWindow
+{
+public:
+	void init() override {}
+	void render(bool overlayEnabled) override
+	{
+		if (!overlayEnabled || !Game::TextureCacheStatsEnabled)
+			return;
+
+		if (ImGui::Begin("Texture Cache", &Game::TextureCacheStatsEnabled, ImGuiWindowFlags_AlwaysAutoResize))
+		{
+			auto stats = TextureReplacement::FileData.getStats();
+			const auto& space = TextureReplacement::LastAddressSpace;
+			uint64_t lookups = stats.hits + stats.misses;
+
+			ImGui::Text("Hit rate: %.1f%% (%llu hits, %llu misses)", lookups ? 100.0 * double(stats.hits) / double(lookups) : 0.0,
+				(unsigned long long)stats.hits, (unsigned long long)stats.misses);
+			ImGui::Text("Resident: %.1f / %.1f MB%s", double(stats.bytesResident) / (1024 * 1024), double(stats.maxSize) / (1024 * 1024),
+				Settings::TextureCacheBudgetMB > 0 ? " (fixed)" : "");
+			ImGui::Text("Evictions: %llu", (unsigned long long)stats.evictions);
+			ImGui::Text("Load stalls: %.1f ms on misses, %.1f ms waiting for prefetch", double(stats.stallNanoseconds) / 1000000.0,
+				double(TextureReplacement::PrefetchWaitNanoseconds.load()) / 1000000.0);
+
+			if (Settings::ShareReplacementTextures)
+			{
+				auto shared = SharedTextures.stats();
+				ImGui::Text("Shared textures: %zu live, %llu loads reused them (%.1f MB saved)", shared.liveTextures,
+					(unsigned long long)shared.sharedLoads, double(shared.bytesSaved) / (1024 * 1024));
+			}
+
+			ImGui::Separator();
+			ImGui::Text("Address space free: %zu MB of %zu MB", space.free / (1024 * 1024), space.total / (1024 * 1024));
+			ImGui::Text("Largest free block: %zu MB", space.largestFreeRegion / (1024 * 1024));
+			ImGui::Text("Committed: %zu MB", space.committed / (1024 * 1024));
+
+			if (ImGui::Button("Refresh budget"))
+				TextureReplacement::UpdateCacheBudget();
+			ImGui::SameLine();
+			if (ImGui::Button("Save stats"))
+				TextureReplacement::WriteCacheStats(TextureReplacement::CacheStatsPath);
+		}
+		ImGui::End();
+	}
+
+	static TextureCacheStatsWindow instance;
+};
+TextureCacheStatsWindow TextureCacheStatsWindow::instance;
+
+class TextureLoadProfileWindow : public OverlayWindow
+{
+	std::string selectedSet;
+
+public:
+	void init() override {}
+	void render(bool overlayEnabled) override
+	{
+		if (!overlayEnabled || !Game::TextureProfilerEnabled)
+			return;
+
+		if (ImGui::Begin("Texture Load Profiler", &Game::TextureProfilerEnabled, ImGuiWindowFlags_AlwaysAutoResize))
+		{
+			ImGui::Checkbox("Profiling enabled", &Settings::ProfileTextureLoads);
+			ImGui::SameLine();
+			if (ImGui::Button("Reset"))
+			{
+				LoadProfiler.reset();
+				selectedSet.clear();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Export JSON/CSV"))
+			{
+				auto path = TextureReplacement::LoadProfilePath;
+				if (LoadProfiler.writeJson(path.replace_extension(".json")) && LoadProfiler.writeCsv(path.replace_extension(".csv")))
+					spdlog::info("TextureLoadProfiler: exported to {}", TextureReplacement::LoadProfilePath.string());
+			}
+
+			auto sets = LoadProfiler.snapshot();
+			if (sets.empty())
+				ImGui::Text("No textures profiled yet, enable profiling & load a stage");
+
+			// Times in ms, click a package to list its slowest textures below
+			const ImGuiTableFlags tableFlags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingFixedFit;
+			const int numColumns = 4 + TextureLoadProfiler::PhaseCount;
+			if (!sets.empty() && ImGui::BeginTable("LoadProfile", numColumns, tableFlags, ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 16)))
+			{
+				ImGui::TableSetupScrollFreeze(0, 1);
+				ImGui::TableSetupColumn("Package");
+				ImGui::TableSetupColumn("Textures");
+				ImGui::TableSetupColumn("MB");
+				for (int i = 0; i < TextureLoadProfiler::PhaseCount; i++)
+					ImGui::TableSetupColumn(TextureLoadProfiler::PhaseName(i));
+				ImGui::TableSetupColumn("total");
+				ImGui::TableHeadersRow();
+
+				for (const auto& set : sets)
+				{
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					if (ImGui::Selectable(set.name.c_str(), selectedSet == set.name, ImGuiSelectableFlags_SpanAllColumns))
+						selectedSet = set.name;
+					ImGui::TableNextColumn();
+					ImGui::Text("%llu", (unsigned long long)set.textures);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", double(set.bytes) / (1024 * 1024));
+					for (int i = 0; i < TextureLoadProfiler::PhaseCount; i++)
+					{
+						ImGui::TableNextColumn();
+						ImGui::Text("%.1f", double(set.nanoseconds[i]) / 1000000.0);
+					}
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", double(set.total()) / 1000000.0);
+				}
+
+				ImGui::EndTable();
+			}
+
+			auto selected = std::find_if(sets.begin(), sets.end(), [this](const TextureLoadProfiler::SetStats& set) { return set.name == selectedSet; });
+			if (selected != sets.end())
+			{
+				ImGui::Separator();
+				ImGui::Text("Slowest textures in %s", selected->name.c_str());
+
+				if (ImGui::BeginTable("SlowestTextures", 3 + TextureLoadProfiler::PhaseCount, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+				{
+					ImGui::TableSetupColumn("Texture");
+					ImGui::TableSetupColumn("KB");
+					for (int i = 0; i < TextureLoadProfiler::PhaseCount; i++)
+						ImGui::TableSetupColumn(TextureLoadProfiler::PhaseName(i));
+					ImGui::TableSetupColumn("total");
+					ImGui::TableHeadersRow();
+
+					for (const auto& sample : selected->slowest)
+					{
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
+						ImGui::TextUnformatted(sample.name.c_str());
+						ImGui::TableNextColumn();
+						ImGui::Text("%.0f", double(sample.bytes) / 1024);
+						for (int i = 0; i < TextureLoadProfiler::PhaseCount; i++)
+						{
+							ImGui::TableNextColumn();
+							ImGui::Text("%.2f", double(sample.nanoseconds[i]) / 1000000.0);
+						}
+						ImGui::TableNextColumn();
+						ImGui::Text("%.2f", double(sample.total()) / 1000000.0);
+					}
+
+					ImGui::EndTable();
+				}
+			}
+		}
+		ImGui::End();
+	}
+
+	static TextureLoadProfileWindow instance;
+};
+TextureLoadProfileWindow TextureLoadProfileWindow::instance;
@@ -0,0 +1,224 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <utility>
+
+#include "mapped_file.hpp"
+
+MappedView::~MappedView()
+{
+	reset();
+}
+
+MappedView::MappedView(MappedView&& other) noexcept
+	: base(std::exchange(other.base, nullptr)),
+	offsetInView(std::exchange(other.offsetInView, 0)),
+	length(std::exchange(other.length, 0))
+{
+}
+
+MappedView& MappedView::operator=(MappedView&& other) noexcept
+{
+	if (this != &other)
+	{
+		reset();
+		base = std::exchange(other.base, nullptr);
+		offsetInView = std::exchange(other.offsetInView, 0);
+		length = std::exchange(other.length, 0);
+	}
+	return *this;
+}
+
+void MappedView::touchPages() const
+{
+	const volatile uint8_t* bytes = data();
+	if (!bytes || !length)
+		return;
+
+	constexpr size_t PageSize = 4096;
+	uint8_t sum = 0;
+	for (size_t i = 0; i < length; i += PageSize)
+		sum += bytes[i];
+	sum += bytes[length - 1];
+	(void)sum;
+}
+
+void MappedView::reset()
+{
+	if (base)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(base);
+#else
+		munmap(base, offsetInView + length);
+#endif
+	}
+	base = nullptr;
+	offsetInView = 0;
+	length = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+#ifdef _WIN32
+		fileHandle = std::exchange(other.fileHandle, nullptr);
+		mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#else
+		fd = std::exchange(other.fd, -1);
+#endif
+		fileSize = std::exchange(other.fileSize, 0);
+	}
+	return *this;
+}
+
+size_t MappedFile::Granularity()
+{
+	static const size_t granularity = []() -> size_t {
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwAllocationGranularity;
+#else
+		return size_t(sysconf(_SC_PAGESIZE));
+#endif
+	}();
+	return granularity;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::filesystem::path& path)
+{
+	close();
+
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		// Empty files can't be mapped
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	fileSize = uint64_t(size.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	// Views keep their own reference to the mapping, so closing these doesn't invalidate them
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle)
+		CloseHandle(fileHandle);
+
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+	fileSize = 0;
+}
+
+MappedView MappedFile::map(uint64_t offset, size_t length) const
+{
+	MappedView view;
+	if (!mappingHandle || offset >= fileSize)
+		return view;
+
+	if (length > fileSize - offset)
+		length = size_t(fileSize - offset);
+
+	uint64_t alignedOffset = offset - (offset % Granularity());
+	size_t offsetInView = size_t(offset - alignedOffset);
+
+	void* base = MapViewOfFile(mappingHandle, FILE_MAP_READ, DWORD(alignedOffset >> 32), DWORD(alignedOffset & 0xFFFFFFFF),
+		offsetInView + length);
+	if (!base)
+		return view;
+
+	view.base = base;
+	view.offsetInView = offsetInView;
+	view.length = length;
+	return view;
+}
+
+#else
+
+bool MappedFile::open(const std::filesystem::path& path)
+{
+	close();
+
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(file, &st) != 0 || st.st_size == 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	fd = file;
+	fileSize = uint64_t(st.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (fd >= 0)
+		::close(fd);
+
+	fd = -1;
+	fileSize = 0;
+}
+
+MappedView MappedFile::map(uint64_t offset, size_t length) const
+{
+	MappedView view;
+	if (fd < 0 || offset >= fileSize)
+		return view;
+
+	if (length > fileSize - offset)
+		length = size_t(fileSize - offset);
+
+	uint64_t alignedOffset = offset - (offset % Granularity());
+	size_t offsetInView = size_t(offset - alignedOffset);
+
+	void* base = mmap(nullptr, offsetInView + length, PROT_READ, MAP_PRIVATE, fd, off_t(alignedOffset));
+	if (base == MAP_FAILED)
+		return view;
+
+	view.base = base;
+	view.offsetInView = offsetInView;
+	view.length = length;
+	return view;
+}
+
+#endif
@@ -0,0 +1,77 @@
+// Read-only memory mapped files
+// Used to serve texture replacements straight from the OS file cache, instead of reading them into heap buffers first.
+// Views can cover just part of a file, so large files (eg. texture archives) can be mapped in windows
+// without reserving address space for the whole file, which matters for a 32-bit process like ours.
+//
+// Also builds on non-Windows platforms via mmap, so the offline tools can share it.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// A mapped range of a file, unmapped when destroyed
+// Stays valid after the MappedFile it came from is closed
+class MappedView
+{
+public:
+	MappedView() = default;
+	~MappedView();
+
+	MappedView(MappedView&& other) noexcept;
+	MappedView& operator=(MappedView&& other) noexcept;
+	MappedView(const MappedView&) = delete;
+	MappedView& operator=(const MappedView&) = delete;
+
+	const uint8_t* data() const { return base ? static_cast<const uint8_t*>(base) + offsetInView : nullptr; }
+	size_t size() const { return length; }
+	bool valid() const { return base != nullptr; }
+
+	// Reads a byte from every page, so the OS pulls the whole range into memory now instead of on first access
+	void touchPages() const;
+
+private:
+	friend class MappedFile;
+
+	void* base = nullptr;     // start of the mapping, aligned down to the allocation granularity
+	size_t offsetInView = 0;  // offset of the requested range from base
+	size_t length = 0;        // requested length
+
+	void reset();
+};
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { close(); }
+
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::filesystem::path& path);
+	void close();
+
+	bool isOpen() const { return fileSize != 0; }
+	uint64_t size() const { return fileSize; }
+
+	// Maps [offset, offset + length) of the file, length is clamped to the end of the file
+	// Returns an invalid view on failure
+	MappedView map(uint64_t offset, size_t length) const;
+	MappedView mapAll() const { return map(0, size_t(fileSize)); }
+
+	// Offsets passed to the OS have to be a multiple of this, map() takes care of aligning them
+	static size_t Granularity();
+
+private:
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fd = -1;
+#endif
+	uint64_t fileSize = 0;
+};
@@ -0,0 +1,73 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include <algorithm>
+
+#include "memory_budget.hpp"
+
+namespace MemoryBudget
+{
+	// Left free for the game itself: stage loads, D3D9 managed pool copies, driver allocations etc
+	constexpr size_t ReservedAddressSpace = 512 * 1024 * 1024;
+
+	// Once the largest free block drops below this, allocations for big textures/vertex buffers start failing
+	constexpr size_t MinLargestFreeRegion = 256 * 1024 * 1024;
+
+	constexpr size_t Granularity = 16 * 1024 * 1024;
+
+	void AddRegion(AddressSpace& space, RegionState state, size_t size)
+	{
+		if (state == RegionState::Free)
+		{
+			space.free += size;
+			space.largestFreeRegion = std::max(space.largestFreeRegion, size);
+		}
+		else if (state == RegionState::Committed)
+			space.committed += size;
+	}
+
+#ifdef _WIN32
+	AddressSpace Query()
+	{
+		AddressSpace space;
+
+		SYSTEM_INFO sysInfo;
+		GetSystemInfo(&sysInfo);
+
+		auto address = reinterpret_cast<uintptr_t>(sysInfo.lpMinimumApplicationAddress);
+		auto maxAddress = reinterpret_cast<uintptr_t>(sysInfo.lpMaximumApplicationAddress);
+
+		MEMORY_BASIC_INFORMATION info;
+		while (address < maxAddress && VirtualQuery(reinterpret_cast<LPCVOID>(address), &info, sizeof(info)) == sizeof(info))
+		{
+			auto state = info.State == MEM_FREE ? RegionState::Free : info.State == MEM_COMMIT ? RegionState::Committed : RegionState::Reserved;
+			AddRegion(space, state, info.RegionSize);
+
+			address = reinterpret_cast<uintptr_t>(info.BaseAddress) + info.RegionSize;
+		}
+
+		MEMORYSTATUSEX status = { sizeof(status) };
+		if (GlobalMemoryStatusEx(&status))
+			space.total = size_t(status.ullTotalVirtual);
+
+		return space;
+	}
+#endif
+
+	size_t Compute(const AddressSpace& space, size_t cacheBytes, size_t minBudget, size_t maxBudget)
+	{
+		size_t spare = space.free > ReservedAddressSpace ? space.free - ReservedAddressSpace : 0;
+
+		// Let the cache grow into half of whatever is spare, the rest is left for the game to grow into
+		size_t budget = cacheBytes + spare / 2;
+
+		// Address space is getting fragmented, give some back rather than letting the next stage load fail
+		if (space.largestFreeRegion < MinLargestFreeRegion)
+			budget = std::min(budget, cacheBytes - cacheBytes / 4);
+
+		budget = budget / Granularity * Granularity;
+		return std::clamp(budget, minBudget, maxBudget);
+	}
+}
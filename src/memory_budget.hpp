@@ -0,0 +1,30 @@
+// Runtime sizing for the texture file cache
+// We're a 32-bit process sharing 2-4GB of address space with the game, D3D9 & the managed pool copies of every texture,
+// so instead of a fixed cache size we look at how much address space is actually free & let the cache use part of it.
+
+#pragma once
+
+#include <cstddef>
+
+namespace MemoryBudget
+{
+	struct AddressSpace
+	{
+		size_t total = 0;             // user-mode address space available to the process
+		size_t free = 0;              // all free address space
+		size_t largestFreeRegion = 0; // biggest contiguous free block, large D3D allocations need this to stay healthy
+		size_t committed = 0;         // committed by the process (heaps, D3D, mapped views...)
+	};
+
+	enum class RegionState { Free, Reserved, Committed };
+
+	// Adds one region of the address space to the totals, what Query does for each region VirtualQuery returns
+	void AddRegion(AddressSpace& space, RegionState state, size_t size);
+
+	// Walks the process address space with VirtualQuery, takes well under a millisecond
+	AddressSpace Query();
+
+	// Cache size to use given the current address space, cacheBytes is what the cache already holds (already counted as used)
+	// Result is rounded to 16MB so small fluctuations between stages don't keep resizing it
+	size_t Compute(const AddressSpace& space, size_t cacheBytes, size_t minBudget, size_t maxBudget);
+}
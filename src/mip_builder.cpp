@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "mapped_file.hpp"
+#include "mip_builder.hpp"
+
+namespace MipBuilder
+{
+	constexpr uint32_t CacheMagic = 0x5350494D; // "MIPS"
+	constexpr uint16_t CacheVersion = 2; // 2: alpha-weighted color
+	constexpr size_t RowsPerTask = 32;
+
+#pragma pack(push, 1)
+	struct MipCacheHeader
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint16_t headerSize;
+		uint64_t key;
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		uint32_t filter;
+		uint64_t dataSize;
+	};
+	static_assert(sizeof(MipCacheHeader) == 40);
+#pragma pack(pop)
+
+	// sRGB <-> linear tables, the linear -> sRGB one is fine enough that every 8-bit value round-trips
+	constexpr size_t LinearSteps = 16384;
+
+	static const std::array<float, 256>& SrgbToLinear()
+	{
+		static const std::array<float, 256> table = [] {
+			std::array<float, 256> values;
+			for (int i = 0; i < 256; i++)
+			{
+				double c = i / 255.0;
+				values[i] = float(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+			}
+			return values;
+		}();
+		return table;
+	}
+
+	static const std::vector<uint8_t>& LinearToSrgb()
+	{
+		static const std::vector<uint8_t> table = [] {
+			std::vector<uint8_t> values(LinearSteps);
+			for (size_t i = 0; i < LinearSteps; i++)
+			{
+				double l = double(i) / (LinearSteps - 1);
+				double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+				values[i] = uint8_t(std::clamp(std::lround(c * 255.0), 0L, 255L));
+			}
+			return values;
+		}();
+		return table;
+	}
+
+	// Weights for halving a dimension: output pixel x reads source pixels 2x + first .. 2x + first + taps - 1
+	// (or x itself, for a dimension that's already down to 1)
+	struct Kernel
+	{
+		int first;
+		int taps;
+		float weights[8];
+	};
+
+	static double BesselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 32; k++)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	static Kernel MakeKernel(Filter filter)
+	{
+		if (filter == Filter::Box)
+			return { 0, 2, { 0.5f, 0.5f } };
+
+		// Sinc with cutoff at the new Nyquist frequency, windowed over +-4 source pixels
+		constexpr double Pi = 3.14159265358979323846;
+		constexpr double Beta = 4.0;
+		constexpr double HalfWidth = 4.0;
+
+		Kernel kernel = { -3, 8, {} };
+		double total = 0.0;
+		double weights[8];
+		for (int k = 0; k < 8; k++)
+		{
+			double d = (kernel.first + k) - 0.5; // distance from the output pixel center, in source pixels
+			double x = d / 2.0;
+			double sinc = std::sin(Pi * x) / (Pi * x);
+			double r = d / HalfWidth;
+			double window = BesselI0(Beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / BesselI0(Beta);
+			weights[k] = sinc * window;
+			total += weights[k];
+		}
+		for (int k = 0; k < 8; k++)
+			kernel.weights[k] = float(weights[k] / total);
+		return kernel;
+	}
+
+	// Calls func(begin, end) for bands of RowsPerTask rows
+	static void ParallelRows(const ParallelFor& parallelFor, size_t rows, const std::function<void(size_t, size_t)>& func)
+	{
+		size_t tasks = (rows + RowsPerTask - 1) / RowsPerTask;
+		auto band = [&](size_t task) {
+			size_t begin = task * RowsPerTask;
+			func(begin, std::min<size_t>(rows, begin + RowsPerTask));
+		};
+
+		if (parallelFor && tasks > 1)
+			parallelFor(tasks, band);
+		else
+			for (size_t task = 0; task < tasks; task++)
+				band(task);
+	}
+
+	// Source of a downsample, either the 8-bit base texture or a level kept as 16-bit premultiplied linear
+	struct LevelSource
+	{
+		const uint8_t* base = nullptr;
+		const uint16_t* level = nullptr;
+		uint32_t width = 0;
+		uint32_t height = 0;
+
+		// Row y as premultiplied linear floats, 4 per pixel
+		void decodeRow(uint32_t y, float* out) const
+		{
+			if (level)
+			{
+				const uint16_t* in = &level[size_t(y) * width * 4];
+				for (size_t i = 0; i < size_t(width) * 4; i++)
+					out[i] = in[i] * (1.0f / 65535.0f);
+				return;
+			}
+
+			const auto& toLinear = SrgbToLinear();
+			const uint8_t* in = &base[size_t(y) * width * 4];
+			for (size_t i = 0; i < size_t(width) * 4; i += 4)
+			{
+				float alpha = in[i + 3] * (1.0f / 255.0f);
+				out[i + 0] = toLinear[in[i + 0]] * alpha;
+				out[i + 1] = toLinear[in[i + 1]] * alpha;
+				out[i + 2] = toLinear[in[i + 2]] * alpha;
+				out[i + 3] = alpha;
+			}
+		}
+	};
+
+	// Halves src (each dimension independently down to 1) into the 8-bit output level, & into the 16-bit level the next
+	// one gets built from if there is one. Each band of output rows filters the source rows it needs into its own scratch.
+	static void Downsample(const LevelSource& src, uint32_t dstWidth, uint32_t dstHeight, uint8_t* out, uint16_t* next,
+		const Kernel& kernel, const ParallelFor& parallelFor)
+	{
+		static const Kernel Identity = { 0, 1, { 1.0f } };
+		const Kernel& kx = src.width == dstWidth ? Identity : kernel;
+		const Kernel& ky = src.height == dstHeight ? Identity : kernel;
+		int stepX = src.width == dstWidth ? 1 : 2;
+		int stepY = src.height == dstHeight ? 1 : 2;
+		const auto& toSrgb = LinearToSrgb();
+		size_t rowSize = size_t(dstWidth) * 4;
+
+		ParallelRows(parallelFor, dstHeight, [&](size_t begin, size_t end) {
+			// Horizontal pass over every source row the band's vertical taps touch
+			int firstRow = int(begin) * stepY + ky.first;
+			int rowCount = int(end - begin - 1) * stepY + ky.taps;
+			std::vector<float> decoded(size_t(src.width) * 4);
+			std::vector<float> rows(size_t(rowCount) * rowSize);
+			for (int r = 0; r < rowCount; r++)
+			{
+				src.decodeRow(uint32_t(std::clamp(firstRow + r, 0, int(src.height) - 1)), decoded.data());
+				float* row = &rows[size_t(r) * rowSize];
+				for (uint32_t x = 0; x < dstWidth; x++)
+				{
+					float sum[4] = {};
+					for (int k = 0; k < kx.taps; k++)
+					{
+						int sx = std::clamp(int(x) * stepX + kx.first + k, 0, int(src.width) - 1);
+						for (int c = 0; c < 4; c++)
+							sum[c] += decoded[sx * 4 + c] * kx.weights[k];
+					}
+					for (int c = 0; c < 4; c++)
+						row[x * 4 + c] = sum[c];
+				}
+			}
+
+			// Vertical pass, then back to straight alpha for the output
+			std::vector<float> pixel(rowSize);
+			for (size_t y = begin; y < end; y++)
+			{
+				std::fill(pixel.begin(), pixel.end(), 0.0f);
+				for (int k = 0; k < ky.taps; k++)
+				{
+					const float* in = &rows[(size_t(y - begin) * stepY + k) * rowSize];
+					float weight = ky.weights[k];
+					for (size_t i = 0; i < rowSize; i++)
+						pixel[i] += in[i] * weight;
+				}
+
+				uint8_t* outRow = &out[y * rowSize];
+				uint16_t* nextRow = next ? &next[y * rowSize] : nullptr;
+				for (size_t i = 0; i < rowSize; i += 4)
+				{
+					// Kaiser's negative lobes can overshoot, premultiplied color can't be above its alpha
+					float alpha = std::clamp(pixel[i + 3], 0.0f, 1.0f);
+					float color[3];
+					for (int c = 0; c < 3; c++)
+						color[c] = std::clamp(pixel[i + c], 0.0f, alpha);
+
+					if (nextRow)
+					{
+						for (int c = 0; c < 3; c++)
+							nextRow[i + c] = uint16_t(color[c] * 65535.0f + 0.5f);
+						nextRow[i + 3] = uint16_t(alpha * 65535.0f + 0.5f);
+					}
+
+					// Nothing covers a fully transparent texel, so it has no color to speak of either
+					for (int c = 0; c < 3; c++)
+					{
+						float linear = alpha > 0.0f ? std::min<float>(color[c] / alpha, 1.0f) : 0.0f;
+						outRow[i + c] = toSrgb[size_t(linear * (LinearSteps - 1) + 0.5f)];
+					}
+					outRow[i + 3] = uint8_t(alpha * 255.0f + 0.5f);
+				}
+			}
+		});
+	}
+
+	Filter ParseFilter(std::string_view name)
+	{
+		std::string lower(name);
+		std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+		return lower == "box" ? Filter::Box : Filter::Kaiser;
+	}
+
+	uint32_t LevelCount(uint32_t width, uint32_t height)
+	{
+		uint32_t levels = 1;
+		for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+			levels++;
+		return levels;
+	}
+
+	std::vector<uint8_t> BuildChain(const uint8_t* base, uint32_t width, uint32_t height, Filter filter, const ParallelFor& parallelFor)
+	{
+		Kernel kernel = MakeKernel(filter);
+
+		size_t chainSize = 0;
+		for (uint32_t level = 1; level < LevelCount(width, height); level++)
+			chainSize += size_t(std::max(1u, width >> level)) * std::max(1u, height >> level) * 4;
+
+		std::vector<uint8_t> chain(chainSize);
+		std::vector<uint16_t> current, next;
+		LevelSource source = { base, nullptr, width, height };
+		uint8_t* out = chain.data();
+		while (source.width > 1 || source.height > 1)
+		{
+			uint32_t nextWidth = std::max(1u, source.width >> 1);
+			uint32_t nextHeight = std::max(1u, source.height >> 1);
+			bool last = nextWidth == 1 && nextHeight == 1;
+			if (!last)
+				next.resize(size_t(nextWidth) * nextHeight * 4);
+
+			Downsample(source, nextWidth, nextHeight, out, last ? nullptr : next.data(), kernel, parallelFor);
+
+			out += size_t(nextWidth) * nextHeight * 4;
+			std::swap(current, next);
+			source = { nullptr, current.data(), nextWidth, nextHeight };
+		}
+
+		return chain;
+	}
+
+	const uint8_t* MipChain::level(uint32_t index) const
+	{
+		if (index == 0 || index >= levelCount)
+			return nullptr;
+
+		size_t offset = 0;
+		for (uint32_t level = 1; level < index; level++)
+			offset += size_t(std::max(1u, width >> level)) * std::max(1u, height >> level) * 4;
+		return data + offset;
+	}
+
+	std::shared_ptr<const MipChain> MipCache::load(const std::filesystem::path& path, uint64_t key, uint32_t width, uint32_t height) const
+	{
+		MappedFile file;
+		if (!file.open(path) || file.size() < sizeof(MipCacheHeader))
+			return nullptr;
+
+		auto view = std::make_shared<const MappedView>(file.mapAll());
+		if (!view->valid())
+			return nullptr;
+
+		MipCacheHeader header;
+		memcpy(&header, view->data(), sizeof(header));
+		if (header.magic != CacheMagic || header.version != CacheVersion || header.headerSize != sizeof(MipCacheHeader) ||
+			header.key != key || header.width != width || header.height != height || header.filter != uint32_t(filter) ||
+			header.levelCount != LevelCount(width, height) || sizeof(MipCacheHeader) + header.dataSize != view->size())
+			return nullptr;
+
+		auto chain = std::make_shared<MipChain>();
+		chain->width = width;
+		chain->height = height;
+		chain->levelCount = header.levelCount;
+		chain->data = view->data() + sizeof(MipCacheHeader);
+		chain->size = size_t(header.dataSize);
+		chain->owner = view;
+		return chain;
+	}
+
+	void MipCache::save(const std::filesystem::path& path, uint64_t key, uint32_t width, uint32_t height, const std::vector<uint8_t>& data) const
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(path.parent_path(), ec);
+
+		// Prefetch threads & the game thread can both end up building the same chain, write to a temp file so readers never see half of one
+		auto tempPath = path;
+		tempPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+		MipCacheHeader header = { CacheMagic, CacheVersion, sizeof(MipCacheHeader), key, width, height,
+			LevelCount(width, height), uint32_t(filter), data.size() };
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+			if (!out)
+			{
+				spdlog::warn("MipCache: failed to write {}", tempPath.string());
+				out.close();
+				std::filesystem::remove(tempPath, ec);
+				return;
+			}
+		}
+
+		std::filesystem::rename(tempPath, path, ec);
+		if (ec)
+			std::filesystem::remove(tempPath, ec);
+	}
+
+	std::shared_ptr<const MipChain> MipCache::get(uint64_t key, const uint8_t* base, uint32_t width, uint32_t height, const ParallelFor& parallelFor) const
+	{
+		if (!base || width == 0 || height == 0 || (width == 1 && height == 1))
+			return nullptr;
+
+		char name[32];
+		snprintf(name, sizeof(name), "%016llX.mips", (unsigned long long)key);
+		auto path = directory / name;
+
+		if (!directory.empty())
+			if (auto chain = load(path, key, width, height))
+				return chain;
+
+		auto data = std::make_shared<std::vector<uint8_t>>(BuildChain(base, width, height, filter, parallelFor));
+		if (!directory.empty())
+			save(path, key, width, height, *data);
+
+		auto chain = std::make_shared<MipChain>();
+		chain->width = width;
+		chain->height = height;
+		chain->levelCount = LevelCount(width, height);
+		chain->data = data->data();
+		chain->size = data->size();
+		chain->owner = data;
+		return chain;
+	}
+}
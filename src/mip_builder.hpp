@@ -0,0 +1,74 @@
+// Mipmap generation for uncompressed 32bpp replacement textures that don't include their own mips
+// Without mips those textures shimmer in the distance, or push texture creation through D3DX's slow mip generation.
+//
+// Filtering is gamma-correct: color channels are treated as sRGB & filtered in linear space, alpha is filtered as-is.
+// Color is weighted by alpha, so fully transparent texels (usually black or garbage) don't bleed into their neighbours.
+// Each level is downsampled from the previous one, kept as 16-bit premultiplied linear (8 bytes per pixel), bands of
+// rows are spread over parallelFor & each only needs float scratch for the source rows it reads.
+// Building the chain of a 4096x4096 texture takes ~40 MB + ~2.5 MB per thread on top of the output, not ~450 MB of floats.
+//
+// Generated chains are cached on disk by MipCache, so the cost is only paid the first time a texture is seen.
+// Cache file: MipCacheHeader, then levels 1..levelCount-1 tightly packed (level 0 is the source texture itself).
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace MipBuilder
+{
+	enum class Filter : uint32_t
+	{
+		Box = 0,    // 2x2 average
+		Kaiser = 1, // 8-tap Kaiser-windowed sinc, sharper than box without much ringing
+	};
+
+	// Runs func(0..count-1), possibly spread over other threads, & returns once all of them finished
+	// Empty runs everything on the calling thread (eg. WorkStealingPool::parallelFor wrapped in a lambda)
+	using ParallelFor = std::function<void(size_t count, const std::function<void(size_t)>& func)>;
+
+	// Parses "box"/"kaiser", anything else gives Kaiser
+	Filter ParseFilter(std::string_view name);
+
+	// Number of levels in a full chain down to 1x1, including the base level
+	uint32_t LevelCount(uint32_t width, uint32_t height);
+
+	// Builds levels 1..LevelCount-1 from the tightly packed 4-byte pixels in base, with alpha in the 4th byte
+	// Channel order doesn't matter otherwise, output uses the same order
+	std::vector<uint8_t> BuildChain(const uint8_t* base, uint32_t width, uint32_t height, Filter filter, const ParallelFor& parallelFor = {});
+
+	struct MipChain
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t levelCount = 0;
+		const uint8_t* data = nullptr;    // level 1 onwards
+		size_t size = 0;
+		std::shared_ptr<const void> owner; // mapped cache file or the buffer from BuildChain
+
+		// Level 1 and up, level 0 isn't part of the chain
+		const uint8_t* level(uint32_t index) const;
+	};
+
+	class MipCache
+	{
+	public:
+		void setDirectory(const std::filesystem::path& path) { directory = path; }
+		void setFilter(Filter value) { filter = value; }
+
+		// key should change whenever the source texture does (eg. a hash of its contents)
+		// Returns nullptr if the chain couldn't be loaded or built
+		std::shared_ptr<const MipChain> get(uint64_t key, const uint8_t* base, uint32_t width, uint32_t height, const ParallelFor& parallelFor = {}) const;
+
+	private:
+		std::filesystem::path directory;
+		Filter filter = Filter::Kaiser;
+
+		std::shared_ptr<const MipChain> load(const std::filesystem::path& path, uint64_t key, uint32_t width, uint32_t height) const;
+		void save(const std::filesystem::path& path, uint64_t key, uint32_t width, uint32_t height, const std::vector<uint8_t>& data) const;
+	};
+}
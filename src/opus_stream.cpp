@@ -0,0 +1,462 @@
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include <ogg/ogg.h>
+#include <opus.h>
+
+#include "pcm_stream.hpp"
+#include "resampler.hpp"
+
+// Opus always decodes at 48kHz, we hand the game the same rate as its own BGM instead
+#define OPUS_DECODE_RATE 48000
+#define OPUS_OUTPUT_RATE 44100
+// Longest packet Opus allows (120ms)
+#define OPUS_MAX_PACKET_SAMPLES 5760
+// Decoder needs this much audio before a seek target for its output to converge (80ms)
+#define OPUS_PREROLL_SAMPLES 3840
+
+// Ogg Opus files (RFC 7845), mono/stereo only
+// Only decodes from memory, Opus files are small enough to just map. Pages are indexed when opening, so seeking for loops
+// is just a lookup of the page before the target. Loop tags are in 48kHz samples like the rest of Opus, & get converted to the output rate.
+class OpusStream : public PcmStream
+{
+public:
+	OpusStream();
+	~OpusStream();
+	bool OpenFromMemory(const uint8_t* data, size_t size) override;
+	void Close() override;
+
+protected:
+	bool DecodeBlock() override;
+	bool EndOfStream() override;
+	bool SeekToSample(uint64_t sample) override;
+	size_t DecoderMemory() const override;
+
+private:
+	struct Page
+	{
+		size_t offset;
+		size_t headerSize;
+		size_t bodySize;
+		int64_t granule; // -1 if no packet ends on this page
+	};
+
+	struct Packet
+	{
+		unsigned char* data;
+		long bytes;
+		int samples;
+	};
+
+	const uint8_t* m_data;
+	size_t m_size;
+
+	std::vector<Page> m_pages;
+	size_t m_firstAudioPage;
+	size_t m_nextPage;
+
+	ogg_stream_state m_stream;
+	bool m_streamInit;
+	OpusDecoder* m_decoder;
+	int m_channels;
+	int m_preSkip;
+	int64_t m_totalInput; // 48kHz samples in the stream, after pre-skip & end trimming
+
+	// Only touched by the decode thread once it's started
+	int64_t m_inputPos; // 48kHz sample the next decoded packet starts at, pre-skip is negative
+	bool m_inputPosKnown;
+	bool m_resamplerStarted;
+	uint64_t m_outputPos;
+	uint64_t m_skipOutputUntil; // seek target, anything decoded before it is preroll
+	StreamResampler m_resampler;
+	std::vector<Packet> m_packets;
+	std::vector<float> m_decoded;
+	std::vector<float> m_resampled;
+
+	ogg_page GetPage(size_t index) const;
+	bool IndexPages();
+	bool ReadHeaders();
+	bool ParseHead(const ogg_packet& packet);
+	void ParseTags(const ogg_packet& packet);
+	void Rewind(size_t page, bool fromStart);
+	bool Output(const float* pcm, int samples);
+};
+
+OpusStream::OpusStream() : PcmStream(BGMDecodeProfiler::Opus), m_data(nullptr), m_size(0), m_firstAudioPage(0), m_nextPage(0), m_stream{}, m_streamInit(false), m_decoder(nullptr),
+	m_channels(0), m_preSkip(0), m_totalInput(0), m_inputPos(0), m_inputPosKnown(false), m_resamplerStarted(false), m_outputPos(0), m_skipOutputUntil(0)
+{
+}
+
+OpusStream::~OpusStream()
+{
+	Close();
+}
+
+bool OpusStream::OpenFromMemory(const uint8_t* data, size_t size)
+{
+	if (!data || !size)
+		return false;
+
+	m_data = data;
+	m_size = size;
+
+	if (!IndexPages() || !ReadHeaders())
+	{
+		Close();
+		return false;
+	}
+
+	m_decoded.resize(size_t(OPUS_MAX_PACKET_SAMPLES) * m_channels);
+	SetFormat(m_channels, OPUS_OUTPUT_RATE, 16, OPUS_MAX_PACKET_SAMPLES);
+
+	Rewind(m_firstAudioPage, true);
+	m_skipOutputUntil = 0;
+	return StartDecoding();
+}
+
+void OpusStream::Close()
+{
+	StopDecoding();
+
+	if (m_decoder)
+	{
+		opus_decoder_destroy(m_decoder);
+		m_decoder = nullptr;
+	}
+	if (m_streamInit)
+	{
+		ogg_stream_clear(&m_stream);
+		m_streamInit = false;
+	}
+
+	m_data = nullptr;
+	m_size = 0;
+	m_pages.clear();
+	m_firstAudioPage = m_nextPage = 0;
+}
+
+size_t OpusStream::DecoderMemory() const
+{
+	size_t size = m_size + m_pages.capacity() * sizeof(Page) + m_packets.capacity() * sizeof(Packet);
+	size += (m_decoded.capacity() + m_resampled.capacity()) * sizeof(float);
+	if (m_decoder)
+		size += opus_decoder_get_size(m_channels);
+	return size;
+}
+
+ogg_page OpusStream::GetPage(size_t index) const
+{
+	const Page& page = m_pages[index];
+	ogg_page og;
+	og.header = const_cast<unsigned char*>(m_data + page.offset);
+	og.header_len = long(page.headerSize);
+	og.body = og.header + page.headerSize;
+	og.body_len = long(page.bodySize);
+	return og;
+}
+
+bool OpusStream::IndexPages()
+{
+	m_pages.clear();
+
+	int serial = 0;
+	size_t pos = 0;
+	while (pos + 27 <= m_size)
+	{
+		const uint8_t* header = m_data + pos;
+		if (memcmp(header, "OggS", 4) != 0)
+		{
+			// Garbage between pages, skip ahead to the next capture pattern
+			const uint8_t* next = std::search(header + 1, m_data + m_size, "OggS", (const char*)"OggS" + 4);
+			pos = size_t(next - m_data);
+			continue;
+		}
+
+		size_t segments = header[26];
+		size_t headerSize = 27 + segments;
+		if (pos + headerSize > m_size)
+			break;
+
+		size_t bodySize = 0;
+		for (size_t i = 0; i < segments; i++)
+			bodySize += header[27 + i];
+		if (pos + headerSize + bodySize > m_size)
+			break; // truncated file
+
+		Page page = { pos, headerSize, bodySize, -1 };
+		m_pages.push_back(page);
+
+		ogg_page og = GetPage(m_pages.size() - 1);
+		if (m_pages.size() == 1)
+			serial = ogg_page_serialno(&og);
+
+		// Only the first logical stream gets played, chained/multiplexed ones are skipped
+		if (ogg_page_serialno(&og) != serial)
+			m_pages.pop_back();
+		else
+			m_pages.back().granule = ogg_page_granulepos(&og);
+
+		pos += headerSize + bodySize;
+	}
+
+	if (m_pages.empty())
+	{
+		spdlog::error("OpusStream: no Ogg pages found");
+		return false;
+	}
+	return true;
+}
+
+bool OpusStream::ReadHeaders()
+{
+	ogg_page og = GetPage(0);
+	if (ogg_stream_init(&m_stream, ogg_page_serialno(&og)) != 0)
+		return false;
+	m_streamInit = true;
+
+	int headerPackets = 0;
+	for (size_t i = 0; i < m_pages.size() && headerPackets < 2; i++)
+	{
+		og = GetPage(i);
+		ogg_stream_pagein(&m_stream, &og);
+
+		ogg_packet op;
+		while (headerPackets < 2 && ogg_stream_packetout(&m_stream, &op) == 1)
+		{
+			if (headerPackets == 0 && !ParseHead(op))
+				return false;
+			if (headerPackets == 1)
+				ParseTags(op);
+			headerPackets++;
+		}
+
+		// Tags always finish their page, audio starts on the next one
+		m_firstAudioPage = i + 1;
+	}
+
+	if (headerPackets < 2)
+	{
+		spdlog::error("OpusStream: missing Opus headers");
+		return false;
+	}
+
+	// Last granule position gives the length, minus what gets trimmed at either end
+	m_totalInput = 0;
+	for (size_t i = m_pages.size(); i-- > m_firstAudioPage;)
+	{
+		if (m_pages[i].granule != -1)
+		{
+			m_totalInput = std::max<int64_t>(m_pages[i].granule - m_preSkip, 0);
+			break;
+		}
+	}
+	return true;
+}
+
+bool OpusStream::ParseHead(const ogg_packet& packet)
+{
+	const unsigned char* data = packet.packet;
+	if (packet.bytes < 19 || memcmp(data, "OpusHead", 8) != 0 || (data[8] & 0xF0) != 0)
+	{
+		spdlog::error("OpusStream: not an Opus stream");
+		return false;
+	}
+
+	m_channels = data[9];
+	m_preSkip = data[10] | (data[11] << 8);
+	int16_t gain = int16_t(data[16] | (data[17] << 8));
+	int mappingFamily = data[18];
+	if (mappingFamily != 0 || m_channels < 1 || m_channels > 2)
+	{
+		spdlog::error("OpusStream: unsupported channel mapping {} ({} channels)", mappingFamily, m_channels);
+		return false;
+	}
+
+	int error = 0;
+	m_decoder = opus_decoder_create(OPUS_DECODE_RATE, m_channels, &error);
+	if (!m_decoder)
+	{
+		spdlog::error("OpusStream: failed to create decoder ({})", opus_strerror(error));
+		return false;
+	}
+	if (gain)
+		opus_decoder_ctl(m_decoder, OPUS_SET_GAIN(gain));
+
+	// Needed for converting the loop tags too
+	m_resampler.init(m_channels, OPUS_DECODE_RATE, OPUS_OUTPUT_RATE);
+
+	return true;
+}
+
+void OpusStream::ParseTags(const ogg_packet& packet)
+{
+	const unsigned char* data = packet.packet;
+	const unsigned char* end = data + packet.bytes;
+	auto readU32 = [&](uint32_t* value)
+	{
+		if (end - data < 4)
+			return false;
+		*value = data[0] | (data[1] << 8) | (data[2] << 16) | (uint32_t(data[3]) << 24);
+		data += 4;
+		return true;
+	};
+
+	uint32_t length = 0;
+	uint32_t count = 0;
+	if (packet.bytes < 8 || memcmp(data, "OpusTags", 8) != 0)
+		return;
+	data += 8;
+	if (!readU32(&length) || uint32_t(end - data) < length)
+		return;
+	data += length; // vendor string
+	if (!readU32(&count))
+		return;
+
+	WaveLoopTags tags;
+	for (uint32_t i = 0; i < count && readU32(&length) && uint32_t(end - data) >= length; i++)
+	{
+		spdlog::debug("Opus comment: size {}, {}", length, std::string_view((const char*)data, length));
+		tags.parse((const char*)data, length);
+		data += length;
+	}
+
+	uint64_t loopStart, loopEnd;
+	if (tags.resolve(&loopStart, &loopEnd))
+		SetLoop(m_resampler.toOutput(loopStart), m_resampler.toOutput(loopEnd));
+}
+
+void OpusStream::Rewind(size_t page, bool fromStart)
+{
+	ogg_stream_reset(&m_stream);
+	opus_decoder_ctl(m_decoder, OPUS_RESET_STATE);
+
+	m_nextPage = page;
+	m_inputPos = -m_preSkip;
+	m_inputPosKnown = fromStart;
+	m_resamplerStarted = false;
+}
+
+bool OpusStream::EndOfStream()
+{
+	return m_nextPage >= m_pages.size();
+}
+
+bool OpusStream::SeekToSample(uint64_t sample)
+{
+	int64_t target = int64_t(m_resampler.toInput(sample));
+	if (target >= m_totalInput)
+		return false;
+
+	// Start from the last page that ends far enough before the target for the decoder to settle, anything it decodes
+	// before the target gets dropped
+	int64_t preroll = target - OPUS_PREROLL_SAMPLES - m_resampler.preroll();
+	size_t startPage = 0;
+	for (size_t i = m_firstAudioPage; i < m_pages.size(); i++)
+	{
+		if (m_pages[i].granule == -1)
+			continue;
+		if (m_pages[i].granule - m_preSkip > preroll)
+			break;
+		startPage = i;
+	}
+
+	if (startPage)
+		Rewind(startPage, false);
+	else
+		Rewind(m_firstAudioPage, true);
+
+	m_skipOutputUntil = sample;
+	return true;
+}
+
+bool OpusStream::DecodeBlock()
+{
+	const size_t pageIndex = m_nextPage++;
+	ogg_page og = GetPage(pageIndex);
+	if (ogg_stream_pagein(&m_stream, &og) != 0)
+		return true; // corrupt page, skip it
+
+	// Collect the packets finishing on this page first, their durations tell us where the page starts
+	m_packets.clear();
+	int64_t duration = 0;
+	ogg_packet op;
+	int result;
+	while ((result = ogg_stream_packetout(&m_stream, &op)) != 0)
+	{
+		// Holes come from the tail of a packet that started before where we seeked to
+		if (result < 0)
+			continue;
+
+		int samples = opus_packet_get_nb_samples(op.packet, op.bytes, OPUS_DECODE_RATE);
+		m_packets.push_back({ op.packet, op.bytes, samples });
+		duration += std::max<int>(samples, 0);
+	}
+
+	if (m_packets.empty())
+		return true;
+
+	if (!m_inputPosKnown)
+	{
+		if (m_pages[pageIndex].granule == -1)
+			return true;
+
+		m_inputPos = m_pages[pageIndex].granule - m_preSkip - duration;
+		m_inputPosKnown = true;
+	}
+
+	for (const auto& packet : m_packets)
+	{
+		int samples = opus_decode_float(m_decoder, packet.data, packet.bytes, m_decoded.data(), OPUS_MAX_PACKET_SAMPLES, 0);
+		if (samples < 0 && packet.samples > 0)
+		{
+			// Conceal corrupt packets instead of losing our place in the stream
+			spdlog::warn("OpusStream: failed to decode packet ({})", opus_strerror(samples));
+			samples = opus_decode_float(m_decoder, nullptr, 0, m_decoded.data(), std::min<int>(packet.samples, OPUS_MAX_PACKET_SAMPLES), 0);
+		}
+		if (samples < 0)
+			return false;
+
+		if (!Output(m_decoded.data(), samples))
+			return false;
+	}
+	return true;
+}
+
+bool OpusStream::Output(const float* pcm, int samples)
+{
+	// Drop the pre-skip at the start & whatever the last page trims off the end
+	const int64_t begin = m_inputPos;
+	m_inputPos += samples;
+	int64_t from = std::max<int64_t>(begin, 0);
+	int64_t to = std::min<int64_t>(m_inputPos, m_totalInput);
+	if (from >= to)
+		return true;
+
+	if (!m_resamplerStarted)
+	{
+		m_outputPos = m_resampler.reset(uint64_t(from));
+		m_resamplerStarted = true;
+	}
+
+	m_resampled.clear();
+	m_resampler.process(pcm + (from - begin) * m_channels, size_t(to - from), m_resampled);
+	if (to == m_totalInput)
+		m_resampler.finish(m_resampled);
+
+	size_t frames = m_resampled.size() / m_channels;
+	uint64_t first = m_outputPos;
+	m_outputPos += frames;
+
+	size_t skip = first < m_skipOutputUntil ? size_t(std::min<uint64_t>(frames, m_skipOutputUntil - first)) : 0;
+	if (skip == frames)
+		return true;
+
+	return DeliverFloat(m_resampled.data() + skip * m_channels, frames - skip);
+}
+
+std::unique_ptr<PcmStream> CreateOpusStream()
+{
+	return std::make_unique<OpusStream>();
+}
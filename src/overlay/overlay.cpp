@@ -4,6 +4,7 @@
 #include "hook_mgr.hpp"
 #include "plugin.hpp"
 #include "game_addrs.hpp"
+#include "bgm_tracks.hpp"
 #include <imgui.h>
 #include "notifications.hpp"
 #include "resource.h"
@@ -58,6 +59,22 @@ public:
 				if (ImGui::Button("Open Draw Distance Debugger"))
 					Game::DrawDistanceDebugEnabled = true;
 
+			if (Settings::SceneTextureReplacement || Settings::UITextureReplacement)
+				if (ImGui::Button("Open Texture Cache Stats"))
+					Game::TextureCacheStatsEnabled = true;
+
+			if (Settings::SceneTextureReplacement || Settings::SceneTextureExtract || Settings::UITextureReplacement || Settings::UITextureExtract)
+				if (ImGui::Button("Open Texture Load Profiler"))
+					Game::TextureProfilerEnabled = true;
+
+			if (Settings::AllowFLAC || Settings::AllowOpus)
+				if (ImGui::Button("Open BGM Decode Profiler"))
+					Game::BGMProfilerEnabled = true;
+
+			if (Settings::AllowWAV || Settings::AllowFLAC || Settings::AllowOpus || Settings::CDSwitcherEnable)
+				if (ImGui::Button("Rescan BGM Folder"))
+					BGMTracks.rescan();
+
 #ifdef _DEBUG
 			if (ImGui::Button("Open Binding Dialog"))
 				Overlay::IsBindingDialogActive = true;
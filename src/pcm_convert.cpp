@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <immintrin.h>
+
+#include "pcm_convert.hpp"
+#include "pixel_convert.hpp"
+
+// MSVC allows any intrinsics without /arch flags, GCC/clang need each function marked with the instruction set it uses
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+namespace PcmConvert
+{
+	// Kernels for one bit depth: mono, stereo & any other channel count
+	struct Kernels
+	{
+		InterleaveFunc mono;
+		InterleaveFunc stereo;
+		InterleaveFunc multi;
+	};
+
+	// Scalar reference versions, also used for the leftover frames of SIMD ones
+
+	template <int Bytes>
+	static inline void StoreSample(uint8_t* dst, int32_t sample)
+	{
+		if constexpr (Bytes == 2)
+		{
+			int16_t pcm = int16_t(std::clamp(sample, -32768, 32767));
+			memcpy(dst, &pcm, 2);
+		}
+		else if constexpr (Bytes == 3)
+		{
+			dst[0] = uint8_t(sample);
+			dst[1] = uint8_t(sample >> 8);
+			dst[2] = uint8_t(sample >> 16);
+		}
+		else
+		{
+			memcpy(dst, &sample, 4);
+		}
+	}
+
+	// Channels = 0 takes the count from numChannels
+	template <int Channels, int Bytes>
+	static void InterleaveRange(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t begin, size_t end)
+	{
+		const unsigned count = Channels ? Channels : numChannels;
+		dst += begin * count * Bytes;
+		for (size_t i = begin; i < end; i++)
+		{
+			for (unsigned c = 0; c < count; c++)
+			{
+				StoreSample<Bytes>(dst, channels[c][i]);
+				dst += Bytes;
+			}
+		}
+	}
+
+	template <int Channels, int Bytes>
+	static void Interleave_Scalar(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		InterleaveRange<Channels, Bytes>(channels, numChannels, dst, 0, frames);
+	}
+
+	// SSE2
+
+	TARGET_SSE2 static void Mono16_SSE2(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		const int32_t* src = channels[0];
+		size_t i = 0;
+		for (; i + 8 <= frames; i += 8)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), _mm_packs_epi32(a, b));
+		}
+		InterleaveRange<1, 2>(channels, numChannels, dst, i, frames);
+	}
+
+	TARGET_SSE2 static void Stereo16_SSE2(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		const int32_t* left = channels[0];
+		const int32_t* right = channels[1];
+		size_t i = 0;
+		for (; i + 4 <= frames; i += 4)
+		{
+			__m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+			__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+			__m128i lo = _mm_unpacklo_epi32(l, r); // L0 R0 L1 R1
+			__m128i hi = _mm_unpackhi_epi32(l, r); // L2 R2 L3 R3
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packs_epi32(lo, hi));
+		}
+		InterleaveRange<2, 2>(channels, numChannels, dst, i, frames);
+	}
+
+	TARGET_SSE2 static void Stereo32_SSE2(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		const int32_t* left = channels[0];
+		const int32_t* right = channels[1];
+		size_t i = 0;
+		for (; i + 4 <= frames; i += 4)
+		{
+			__m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+			__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 8), _mm_unpacklo_epi32(l, r));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 8 + 16), _mm_unpackhi_epi32(l, r));
+		}
+		InterleaveRange<2, 4>(channels, numChannels, dst, i, frames);
+	}
+
+	static void Mono32_Copy(const int32_t* const* channels, unsigned /*numChannels*/, uint8_t* dst, size_t frames)
+	{
+		if (frames)
+			memcpy(dst, channels[0], frames * 4);
+	}
+
+	// SSSE3, only needed for 24-bit where samples have to be packed down to 3 bytes
+
+	// Drops the top byte of each of the 4 samples, result is in the low 12 bytes
+	TARGET_SSSE3 static inline __m128i Pack24(__m128i samples)
+	{
+		const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+		return _mm_shuffle_epi8(samples, shuffle);
+	}
+
+	// Stores are 16 bytes wide but only advance by 12, so the last group of each loop is left to the scalar version
+	TARGET_SSSE3 static void Mono24_SSSE3(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		const int32_t* src = channels[0];
+		size_t i = 0;
+		for (; i + 8 <= frames; i += 4)
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), Pack24(a));
+		}
+		InterleaveRange<1, 3>(channels, numChannels, dst, i, frames);
+	}
+
+	TARGET_SSSE3 static void Stereo24_SSSE3(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		const int32_t* left = channels[0];
+		const int32_t* right = channels[1];
+		size_t i = 0;
+		for (; i + 8 <= frames; i += 4)
+		{
+			__m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+			__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 6), Pack24(_mm_unpacklo_epi32(l, r)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 6 + 12), Pack24(_mm_unpackhi_epi32(l, r)));
+		}
+		InterleaveRange<2, 3>(channels, numChannels, dst, i, frames);
+	}
+
+	// AVX2
+
+	TARGET_AVX2 static void Mono16_AVX2(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		const int32_t* src = channels[0];
+		size_t i = 0;
+		for (; i + 16 <= frames; i += 16)
+		{
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+			// packs works per 128-bit lane, giving a0-3 b0-3 a4-7 b4-7
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2), packed);
+		}
+		InterleaveRange<1, 2>(channels, numChannels, dst, i, frames);
+	}
+
+	TARGET_AVX2 static void Stereo16_AVX2(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		const int32_t* left = channels[0];
+		const int32_t* right = channels[1];
+		size_t i = 0;
+		for (; i + 8 <= frames; i += 8)
+		{
+			__m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+			__m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+			__m256i lo = _mm256_unpacklo_epi32(l, r); // L0 R0 L1 R1 | L4 R4 L5 R5
+			__m256i hi = _mm256_unpackhi_epi32(l, r); // L2 R2 L3 R3 | L6 R6 L7 R7
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packs_epi32(lo, hi));
+		}
+		InterleaveRange<2, 2>(channels, numChannels, dst, i, frames);
+	}
+
+	TARGET_AVX2 static void Stereo32_AVX2(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames)
+	{
+		const int32_t* left = channels[0];
+		const int32_t* right = channels[1];
+		size_t i = 0;
+		for (; i + 8 <= frames; i += 8)
+		{
+			__m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+			__m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+			__m256i lo = _mm256_unpacklo_epi32(l, r);
+			__m256i hi = _mm256_unpackhi_epi32(l, r);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 8), _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 8 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+		InterleaveRange<2, 4>(channels, numChannels, dst, i, frames);
+	}
+
+	// Indexed by PixelConvert::Level, then by bytes per sample - 2
+	// Levels without a dedicated version of a kernel use the one from the level below
+	static const Kernels KernelTable[][3] = {
+		{
+			{ Interleave_Scalar<1, 2>, Interleave_Scalar<2, 2>, Interleave_Scalar<0, 2> },
+			{ Interleave_Scalar<1, 3>, Interleave_Scalar<2, 3>, Interleave_Scalar<0, 3> },
+			{ Interleave_Scalar<1, 4>, Interleave_Scalar<2, 4>, Interleave_Scalar<0, 4> },
+		},
+		{
+			{ Mono16_SSE2, Stereo16_SSE2, Interleave_Scalar<0, 2> },
+			{ Interleave_Scalar<1, 3>, Interleave_Scalar<2, 3>, Interleave_Scalar<0, 3> },
+			{ Mono32_Copy, Stereo32_SSE2, Interleave_Scalar<0, 4> },
+		},
+		{
+			{ Mono16_SSE2, Stereo16_SSE2, Interleave_Scalar<0, 2> },
+			{ Mono24_SSSE3, Stereo24_SSSE3, Interleave_Scalar<0, 3> },
+			{ Mono32_Copy, Stereo32_SSE2, Interleave_Scalar<0, 4> },
+		},
+		{
+			{ Mono16_AVX2, Stereo16_AVX2, Interleave_Scalar<0, 2> },
+			{ Mono24_SSSE3, Stereo24_SSSE3, Interleave_Scalar<0, 3> },
+			{ Mono32_Copy, Stereo32_AVX2, Interleave_Scalar<0, 4> },
+		},
+	};
+
+	static InterleaveFunc Pick(int level, unsigned numChannels, unsigned bitsPerSample)
+	{
+		if ((bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32) || numChannels == 0)
+			return nullptr;
+
+		const Kernels& kernels = KernelTable[level][bitsPerSample / 8 - 2];
+		if (numChannels == 1)
+			return kernels.mono;
+		if (numChannels == 2)
+			return kernels.stereo;
+		return kernels.multi;
+	}
+
+	InterleaveFunc Select(unsigned numChannels, unsigned bitsPerSample)
+	{
+		return Pick(int(PixelConvert::CurrentLevel()), numChannels, bitsPerSample);
+	}
+
+	InterleaveFunc SelectScalar(unsigned numChannels, unsigned bitsPerSample)
+	{
+		return Pick(int(PixelConvert::Level::Scalar), numChannels, bitsPerSample);
+	}
+
+	void PlanarToFloat(const int32_t* const* channels, unsigned numChannels, float* dst, size_t frames, unsigned bitsPerSample)
+	{
+		// Exact up to 24 bits, simple enough for the compiler to vectorize itself
+		const float scale = 1.0f / float(1u << (bitsPerSample - 1));
+		for (unsigned c = 0; c < numChannels; c++)
+		{
+			const int32_t* src = channels[c];
+			for (size_t i = 0; i < frames; i++)
+				dst[i * numChannels + c] = float(src[i]) * scale;
+		}
+	}
+
+	// Dither
+
+	void DitherState::seed(uint32_t seed)
+	{
+		// xorshift32 must never be 0
+		for (int lane = 0; lane < 8; lane++)
+			lanes[lane] = (seed + uint32_t(lane) * 0x9E3779B9u) | 1;
+	}
+
+	static inline uint32_t XorShift32(uint32_t& x)
+	{
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return x;
+	}
+
+	// Sum of the two 16-bit halves is triangular over 0..2, centered it's -1..1 LSB
+	// Clamps are written the way minps/maxps treat NaN so the SIMD versions match
+	static inline int16_t DitherSample(float sample, uint32_t& lane)
+	{
+		uint32_t random = XorShift32(lane);
+		float noise = float(int32_t((random & 0xFFFF) + (random >> 16))) * (1.0f / 65536.0f) - 1.0f;
+		float value = sample * 32768.0f + noise;
+		value = value > -32768.0f ? value : -32768.0f;
+		value = value < 32767.0f ? value : 32767.0f;
+		return int16_t(lrintf(value));
+	}
+
+	// begin has to be a multiple of 8 so samples keep using the same lane as in the scalar version
+	static void DitherRange(const float* src, int16_t* dst, size_t begin, size_t end, DitherState& state)
+	{
+		for (size_t i = begin; i < end; i++)
+			dst[i] = DitherSample(src[i], state.lanes[i % 8]);
+	}
+
+	static void Dither_Scalar(const float* src, int16_t* dst, size_t samples, DitherState& state)
+	{
+		DitherRange(src, dst, 0, samples, state);
+	}
+
+	TARGET_SSE2 static inline __m128i XorShift32_SSE2(__m128i x)
+	{
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+		return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+	}
+
+	TARGET_SSE2 static inline __m128i DitherSamples_SSE2(const float* src, __m128i random)
+	{
+		const __m128i lowMask = _mm_set1_epi32(0xFFFF);
+		__m128i sum = _mm_add_epi32(_mm_and_si128(random, lowMask), _mm_srli_epi32(random, 16));
+		__m128 noise = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), _mm_set1_ps(1.0f / 65536.0f)), _mm_set1_ps(1.0f));
+		__m128 value = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(32768.0f)), noise);
+		value = _mm_min_ps(_mm_max_ps(value, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+		return _mm_cvtps_epi32(value);
+	}
+
+	TARGET_SSE2 static void Dither_SSE2(const float* src, int16_t* dst, size_t samples, DitherState& state)
+	{
+		__m128i lanesLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state.lanes));
+		__m128i lanesHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state.lanes + 4));
+		size_t i = 0;
+		for (; i + 8 <= samples; i += 8)
+		{
+			lanesLo = XorShift32_SSE2(lanesLo);
+			lanesHi = XorShift32_SSE2(lanesHi);
+			__m128i lo = DitherSamples_SSE2(src + i, lanesLo);
+			__m128i hi = DitherSamples_SSE2(src + i + 4, lanesHi);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(lo, hi));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state.lanes), lanesLo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state.lanes + 4), lanesHi);
+		DitherRange(src, dst, i, samples, state);
+	}
+
+	TARGET_AVX2 static void Dither_AVX2(const float* src, int16_t* dst, size_t samples, DitherState& state)
+	{
+		const __m256i lowMask = _mm256_set1_epi32(0xFFFF);
+		__m256i lanes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state.lanes));
+		size_t i = 0;
+		for (; i + 8 <= samples; i += 8)
+		{
+			lanes = _mm256_xor_si256(lanes, _mm256_slli_epi32(lanes, 13));
+			lanes = _mm256_xor_si256(lanes, _mm256_srli_epi32(lanes, 17));
+			lanes = _mm256_xor_si256(lanes, _mm256_slli_epi32(lanes, 5));
+
+			__m256i sum = _mm256_add_epi32(_mm256_and_si256(lanes, lowMask), _mm256_srli_epi32(lanes, 16));
+			__m256 noise = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(sum), _mm256_set1_ps(1.0f / 65536.0f)), _mm256_set1_ps(1.0f));
+			__m256 value = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), _mm256_set1_ps(32768.0f)), noise);
+			value = _mm256_min_ps(_mm256_max_ps(value, _mm256_set1_ps(-32768.0f)), _mm256_set1_ps(32767.0f));
+			__m256i pcm = _mm256_cvtps_epi32(value);
+
+			__m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(pcm), _mm256_extracti128_si256(pcm, 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(state.lanes), lanes);
+		DitherRange(src, dst, i, samples, state);
+	}
+
+	// Indexed by PixelConvert::Level, SSSE3 has nothing that helps here
+	static const DitherFunc DitherTable[] = { Dither_Scalar, Dither_SSE2, Dither_SSE2, Dither_AVX2 };
+
+	DitherFunc SelectDither()
+	{
+		return DitherTable[int(PixelConvert::CurrentLevel())];
+	}
+
+	DitherFunc SelectDitherScalar()
+	{
+		return DitherTable[int(PixelConvert::Level::Scalar)];
+	}
+
+	void Crossfade(const int16_t* from, const int16_t* to, int16_t* out, size_t frames, unsigned channels, uint64_t position, uint64_t length)
+	{
+		const double halfPi = 1.57079632679489661923;
+
+		size_t i = 0;
+		for (; i < frames && position + i < length; i++)
+		{
+			// Gains follow the frame's position rather than being stepped per call, so the fade is the same however it gets read
+			double t = double(position + i) / double(length);
+			float gainFrom = float(std::cos(t * halfPi));
+			float gainTo = float(std::sin(t * halfPi));
+
+			for (unsigned c = 0; c < channels; c++)
+			{
+				size_t s = i * channels + c;
+				float mixed = from[s] * gainFrom + to[s] * gainTo;
+				out[s] = int16_t(std::lrint(std::clamp(mixed, -32768.0f, 32767.0f)));
+			}
+		}
+
+		if (i < frames && out != to)
+			memcpy(out + i * channels, to + i * channels, (frames - i) * channels * sizeof(int16_t));
+	}
+}
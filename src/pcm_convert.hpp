@@ -0,0 +1,49 @@
+// PCM conversion kernels used by audio decoders
+// Decoders like libFLAC hand out one array of 32-bit samples per channel, these pack them into interleaved
+// little-endian PCM at the streams bit depth. Mono & stereo have SSE2/SSSE3/AVX2 versions, other channel counts use
+// a scalar one. All of them give the exact same output as the scalar versions.
+//
+// Streams that need resampling or have more than 16 bits go through float instead, & get reduced to 16-bit with TPDF
+// dither at the end. The dither kernels have SSE2/AVX2 versions that match the scalar one too.
+// Crossfade (for CD switcher track changes) is scalar only, it only ever runs for a second or two at a time.
+//
+// Uses the same instruction set level as PixelConvert, so PixelConvert::SetLevel affects these too.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace PcmConvert
+{
+	// 16-bit output is saturated, 24 & 32-bit output keeps the low bytes of each sample
+	using InterleaveFunc = void(*)(const int32_t* const* channels, unsigned numChannels, uint8_t* dst, size_t frames);
+
+	// Picks the kernel for a stream, meant to be called once when its format is known
+	// Returns nullptr for bit depths other than 16/24/32
+	InterleaveFunc Select(unsigned numChannels, unsigned bitsPerSample);
+
+	// Scalar version of the same kernel, for comparing against
+	InterleaveFunc SelectScalar(unsigned numChannels, unsigned bitsPerSample);
+
+	// Interleaves to floats scaled to -1..1, any bit depth up to 32
+	void PlanarToFloat(const int32_t* const* channels, unsigned numChannels, float* dst, size_t frames, unsigned bitsPerSample);
+
+	// Dither noise comes from 8 xorshift32 generators, used in turn for each sample so SIMD versions can run them side by side
+	struct DitherState
+	{
+		uint32_t lanes[8];
+
+		void seed(uint32_t seed);
+	};
+
+	// Float samples (-1..1, interleaved or not) to 16-bit with triangular dither of +-1 LSB, saturated
+	using DitherFunc = void(*)(const float* src, int16_t* dst, size_t samples, DitherState& state);
+
+	DitherFunc SelectDither();
+	DitherFunc SelectDitherScalar();
+
+	// Equal power crossfade between two interleaved 16-bit streams, out can be the same buffer as either of them
+	// position is how many frames into the fade the first frame is, frames from length onwards are just copied from to
+	void Crossfade(const int16_t* from, const int16_t* to, int16_t* out, size_t frames, unsigned channels, uint64_t position, uint64_t length);
+}
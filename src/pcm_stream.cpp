@@ -0,0 +1,440 @@
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "pcm_stream.hpp"
+
+// Tag names are case-insensitive, value has to follow the name
+static bool TagIs(const char* tag, size_t tagLength, std::string_view name)
+{
+	if (tagLength <= name.size())
+		return false;
+	for (size_t i = 0; i < name.size(); i++)
+		if (std::toupper((unsigned char)tag[i]) != name[i])
+			return false;
+	return true;
+}
+
+bool WaveLoopTags::parse(const char* tag, size_t tagLength)
+{
+	// Comments aren't null terminated, and stoull would happily read past them
+	auto value = [&](size_t nameLength) { return std::stoull(std::string(tag + nameLength, tagLength - nameLength), nullptr, 10); };
+
+	try
+	{
+		if (TagIs(tag, tagLength, "LOOPSTART="))
+			start = value(10);
+		else if (TagIs(tag, tagLength, "LOOPLENGTH="))
+			length = value(11);
+		else if (TagIs(tag, tagLength, "LOOPEND="))
+			end = value(8);
+		else
+			return false;
+	}
+	catch (const std::exception&)
+	{
+		spdlog::warn("WaveLoopTags: ignoring invalid tag {}", std::string(tag, tagLength));
+	}
+	return true;
+}
+
+bool WaveLoopTags::resolve(uint64_t* loopStart, uint64_t* loopEnd) const
+{
+	std::optional<uint64_t> lastSample = end;
+	if (start.has_value() && length.has_value())
+		lastSample = start.value() + length.value() - 1;
+
+	if (!start.has_value() || !lastSample.has_value() || lastSample.value() <= start.value())
+		return false;
+
+	*loopStart = start.value();
+	*loopEnd = lastSample.value();
+	return true;
+}
+
+PcmStream::PcmStream(BGMDecodeProfiler::Format profileFormat) : m_decodeSample(0), m_readPos(0), m_writePos(0), m_stopping(false), m_resetPending(false), m_finished(false),
+	m_wrapPending(false), m_loopEnabled(false), m_loopStart(0), m_loopEnd(0), m_loopHeadSamples(0), m_loopHeadCaptured(0),
+	m_dither(nullptr), m_profiler(nullptr), m_profileFormat(profileFormat), m_profileWaitNanoseconds(0)
+{
+}
+
+bool PcmStream::Read(uint8_t* buffer, size_t size, size_t* sizeRead)
+{
+	if (m_ring.empty())
+		return false;
+
+	size_t read = 0;
+	{
+		std::unique_lock lock(m_mutex);
+		while (read < size)
+		{
+			size_t available = size_t(m_writePos - m_readPos);
+			if (!available)
+			{
+				if (m_finished || m_stopping)
+					break;
+
+				// Decode thread fell behind, only really happens right after opening/resetting
+				m_cv.wait(lock);
+				continue;
+			}
+
+			size_t toRead = std::min<size_t>(available, size - read);
+			size_t offset = size_t(m_readPos % m_ring.size());
+			size_t first = std::min<size_t>(toRead, m_ring.size() - offset);
+			memcpy(buffer + read, m_ring.data() + offset, first);
+			memcpy(buffer + read + first, m_ring.data(), toRead - first);
+
+			m_readPos += toRead;
+			read += toRead;
+			m_cv.notify_all();
+		}
+	}
+
+	if (m_profiler && read && !m_profile.firstReadNanoseconds)
+		m_profile.firstReadNanoseconds = std::max<uint64_t>(Since(m_profileOpenTime), 1);
+
+	if (sizeRead)
+		*sizeRead = read;
+
+	return true;
+}
+
+void PcmStream::Reset()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_resetPending = true;
+		m_readPos = m_writePos;
+	}
+	m_cv.notify_all();
+}
+
+uint64_t PcmStream::Since(std::chrono::steady_clock::time_point start)
+{
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void PcmStream::BeginProfile(BGMDecodeProfiler* profiler, const char* fileName)
+{
+	m_profiler = profiler;
+	if (!m_profiler)
+		return;
+
+	m_profile = BGMDecodeProfiler::Track{};
+	m_profile.name = std::filesystem::path(fileName).filename().string();
+	m_profile.format = m_profileFormat;
+	m_profileWaitNanoseconds = 0;
+	m_profileOpenTime = std::chrono::steady_clock::now();
+}
+
+void PcmStream::SetFormat(unsigned channels, unsigned sampleRate, unsigned bitsPerSample, size_t ringMinSamples)
+{
+	m_format.channels = channels;
+	m_format.sampleRate = sampleRate;
+	m_format.bitsPerSample = bitsPerSample;
+	m_format.blockAlign = channels * bitsPerSample / 8;
+
+	// Ring holds a fixed amount of audio no matter how long the track is, but always at least a couple of blocks
+	size_t ringSamples = size_t(sampleRate) * WAVE_RING_BUFFER_MS / 1000;
+	ringSamples = std::max<size_t>(ringSamples, ringMinSamples);
+	m_ring.resize(ringSamples * m_format.blockAlign);
+
+	m_dither = PcmConvert::SelectDither();
+	m_ditherState.seed(sampleRate);
+
+	SizeLoopHead();
+}
+
+void PcmStream::SetLoop(uint64_t loopStart, uint64_t loopEnd)
+{
+	spdlog::info("Stream loop: {} - {}", loopStart, loopEnd);
+	m_loopStart = loopStart;
+	m_loopEnd = loopEnd + 1;
+	m_loopEnabled = true;
+
+	SizeLoopHead();
+}
+
+void PcmStream::SizeLoopHead()
+{
+	// Tags can come before or after the format, size the loop head once we know both
+	if (!m_loopEnabled || !m_format.blockAlign || !m_loopHead.empty())
+		return;
+
+	uint64_t headSamples = uint64_t(m_format.sampleRate) * WAVE_LOOP_HEAD_MS / 1000;
+	m_loopHeadSamples = std::min<uint64_t>(headSamples, m_loopEnd - m_loopStart);
+	m_loopHead.resize(size_t(m_loopHeadSamples) * m_format.blockAlign);
+}
+
+bool PcmStream::StartDecoding()
+{
+	if (m_ring.empty())
+		return false;
+
+	m_stopping = m_resetPending = m_finished = false;
+	m_decodeThread = std::thread(&PcmStream::DecodeThread, this);
+	return true;
+}
+
+void PcmStream::StopDecoding()
+{
+	const bool started = m_decodeThread.joinable();
+	if (started)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopping = true;
+		}
+		m_cv.notify_all();
+		m_decodeThread.join();
+	}
+
+	// Decoder hasn't freed anything yet, so its buffers can still be counted. Tracks that failed to open aren't recorded.
+	if (m_profiler && started)
+	{
+		m_profile.memoryBytes = m_ring.size() + m_loopHead.size() + DecoderMemory();
+		m_profiler->record(std::move(m_profile));
+	}
+	m_profile = BGMDecodeProfiler::Track{};
+	m_profiler = nullptr;
+
+	m_ring.clear();
+	m_format = {};
+	m_readPos = m_writePos = 0;
+	m_decodeSample = 0;
+	m_wrapPending = false;
+
+	m_loopEnabled = false;
+	m_loopHead.clear();
+	m_loopHeadSamples = m_loopHeadCaptured = 0;
+
+	m_ditherBuffer.clear();
+}
+
+bool PcmStream::Deliver(const uint8_t* data, uint64_t numSamples)
+{
+	// Anything past the loop end never gets played
+	const uint64_t firstSample = m_decodeSample;
+	if (m_loopEnabled && firstSample + numSamples >= m_loopEnd)
+	{
+		numSamples = firstSample < m_loopEnd ? m_loopEnd - firstSample : 0;
+		m_wrapPending = true;
+	}
+	m_decodeSample = firstSample + numSamples;
+
+	if (m_loopEnabled)
+		CaptureLoopHead(firstSample, data, numSamples);
+
+	if (m_profiler)
+		m_profile.pcmBytes += numSamples * m_format.blockAlign;
+
+	if (!PushDecoded(data, size_t(numSamples * m_format.blockAlign)))
+	{
+		// Closing, stop decoding right away (a reset just drops the data, DecodeThread seeks once the decoder returns)
+		std::lock_guard lock(m_mutex);
+		if (m_stopping)
+			return false;
+	}
+	return true;
+}
+
+bool PcmStream::DeliverFloat(const float* data, uint64_t numSamples)
+{
+	const size_t count = size_t(numSamples) * m_format.channels;
+	if (m_ditherBuffer.size() < count)
+		m_ditherBuffer.resize(count);
+
+	m_dither(data, m_ditherBuffer.data(), count, m_ditherState);
+	return Deliver((const uint8_t*)m_ditherBuffer.data(), numSamples);
+}
+
+unsigned PcmStream::OutputRateFor(unsigned sampleRate)
+{
+	if (sampleRate == 44100 || sampleRate == 48000)
+		return sampleRate;
+
+	// 8/16/24/32/96/192kHz etc
+	return (sampleRate % 8000) == 0 ? 48000 : 44100;
+}
+
+void PcmStream::DecodeThread()
+{
+	while (true)
+	{
+		{
+			std::unique_lock lock(m_mutex);
+			while (!m_stopping && !m_resetPending && m_finished)
+				m_cv.wait(lock);
+
+			if (m_stopping)
+				break;
+
+			if (m_resetPending)
+			{
+				m_resetPending = false;
+				m_finished = false;
+				m_readPos = m_writePos;
+				lock.unlock();
+
+				m_wrapPending = false;
+				m_decodeSample = 0;
+				if (!SeekToSample(0))
+				{
+					lock.lock();
+					m_finished = true;
+					m_cv.notify_all();
+				}
+				continue;
+			}
+		}
+
+		// Time spent waiting on a full ring isn't decoding, PushDecoded keeps track of it
+		std::chrono::steady_clock::time_point decodeStart{};
+		if (m_profiler)
+		{
+			decodeStart = std::chrono::steady_clock::now();
+			m_profileWaitNanoseconds = 0;
+		}
+
+		bool decoded = DecodeNext();
+
+		if (m_profiler)
+		{
+			uint64_t busy = Since(decodeStart);
+			m_profile.decodeNanoseconds += busy - std::min<uint64_t>(busy, m_profileWaitNanoseconds);
+		}
+
+		if (!decoded)
+		{
+			{
+				std::lock_guard lock(m_mutex);
+				m_finished = true;
+			}
+			m_cv.notify_all();
+		}
+	}
+}
+
+bool PcmStream::DecodeNext()
+{
+	if (m_wrapPending)
+		return WrapToLoopStart();
+
+	if (EndOfStream())
+	{
+		// Loop end was past the end of the file, loop from here instead
+		if (m_loopEnabled && m_loopStart < m_decodeSample)
+		{
+			m_wrapPending = true;
+			return true;
+		}
+		return false;
+	}
+
+	return DecodeBlock();
+}
+
+bool PcmStream::WrapToLoopStart()
+{
+	m_wrapPending = false;
+
+	uint64_t target = m_loopStart;
+	if (m_loopHeadSamples && m_loopHeadCaptured == m_loopHeadSamples)
+	{
+		if (!PushDecoded(m_loopHead.data(), m_loopHead.size()))
+			return true; // reset/close, let DecodeThread deal with it
+
+		if (m_profiler)
+			m_profile.pcmBytes += m_loopHead.size();
+
+		target += m_loopHeadSamples;
+	}
+
+	m_decodeSample = target;
+	if (m_loopEnabled && target >= m_loopEnd)
+	{
+		// Saved copy already covers the whole loop
+		m_wrapPending = true;
+		return true;
+	}
+
+	std::chrono::steady_clock::time_point seekStart{};
+	if (m_profiler)
+		seekStart = std::chrono::steady_clock::now();
+
+	bool seeked = SeekToSample(target);
+
+	if (m_profiler)
+	{
+		m_profile.loopSeeks++;
+		m_profile.loopSeekMaxNanoseconds = std::max<uint64_t>(m_profile.loopSeekMaxNanoseconds, Since(seekStart));
+	}
+
+	if (seeked)
+		return true;
+
+	// Fails when we abort it to close too
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_stopping)
+			return false;
+	}
+
+	spdlog::error("PcmStream: failed to seek to loop start {}", target);
+	return false;
+}
+
+// Blocks while the ring is full, returns false if a reset or close came in meanwhile (rest of the data is dropped)
+bool PcmStream::PushDecoded(const uint8_t* data, size_t size)
+{
+	std::unique_lock lock(m_mutex);
+	while (size)
+	{
+		size_t space = m_ring.size() - size_t(m_writePos - m_readPos);
+		if (!space && !m_stopping && !m_resetPending)
+		{
+			if (m_profiler)
+			{
+				auto waitStart = std::chrono::steady_clock::now();
+				m_cv.wait(lock);
+				m_profileWaitNanoseconds += Since(waitStart);
+			}
+			else
+				m_cv.wait(lock);
+			continue;
+		}
+
+		if (m_stopping || m_resetPending)
+			return false;
+
+		size_t toWrite = std::min<size_t>(space, size);
+		size_t offset = size_t(m_writePos % m_ring.size());
+		size_t first = std::min<size_t>(toWrite, m_ring.size() - offset);
+		memcpy(m_ring.data() + offset, data, first);
+		memcpy(m_ring.data(), data + first, toWrite - first);
+
+		m_writePos += toWrite;
+		data += toWrite;
+		size -= toWrite;
+		m_cv.notify_all();
+	}
+	return true;
+}
+
+void PcmStream::CaptureLoopHead(uint64_t firstSample, const uint8_t* data, uint64_t numSamples)
+{
+	uint64_t headEnd = m_loopStart + m_loopHeadSamples;
+	uint64_t captureStart = m_loopStart + m_loopHeadCaptured;
+	if (m_loopHeadCaptured == m_loopHeadSamples || firstSample > captureStart || firstSample + numSamples <= captureStart)
+		return;
+
+	uint64_t count = std::min<uint64_t>(firstSample + numSamples, headEnd) - captureStart;
+	size_t blockAlign = m_format.blockAlign;
+	memcpy(m_loopHead.data() + m_loopHeadCaptured * blockAlign, data + (captureStart - firstSample) * blockAlign, size_t(count * blockAlign));
+	m_loopHeadCaptured += count;
+}
@@ -0,0 +1,159 @@
+// Streaming decode shared by our BGM decoders
+// A decode thread keeps a fixed size ring of PCM filled ahead of Read(), which only copies out of it. Loops are handled
+// on the decode thread too, once it reaches the loop end it queues the saved copy of the loop start & seeks to just past it.
+//
+// Streams always output 44.1/48kHz 16-bit, decoders resample (StreamResampler) & hand anything else to DeliverFloat.
+// Nothing in here needs Windows or the game, CStreamingWaveFile (wave_file.hpp) is what hands a stream to the game.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "bgm_profiler.hpp"
+#include "pcm_convert.hpp"
+
+// Decoded audio kept buffered ahead of the read position
+#define WAVE_RING_BUFFER_MS 2000
+// Audio following the loop start that's kept decoded, so looping doesn't have to wait on a seek
+#define WAVE_LOOP_HEAD_MS 250
+
+// LOOPSTART/LOOPLENGTH/LOOPEND comments, as used by FLAC/Vorbis/Opus tags
+struct WaveLoopTags
+{
+	std::optional<uint64_t> start;
+	std::optional<uint64_t> length;
+	std::optional<uint64_t> end;
+
+	// Returns false if the comment isn't a loop tag
+	bool parse(const char* tag, size_t tagLength);
+
+	// Gives the inclusive loop end, false if the tags don't make a usable loop
+	bool resolve(uint64_t* loopStart, uint64_t* loopEnd) const;
+};
+
+struct PcmFormat
+{
+	unsigned channels = 0;
+	unsigned sampleRate = 0;
+	unsigned bitsPerSample = 0;
+	unsigned blockAlign = 0; // bytes per sample frame
+};
+
+class PcmStream
+{
+public:
+	explicit PcmStream(BGMDecodeProfiler::Format profileFormat);
+	virtual ~PcmStream() = default;
+
+	PcmStream(const PcmStream&) = delete;
+	PcmStream& operator=(const PcmStream&) = delete;
+
+	// Implemented by each decoder, both read the format & loop tags then start decoding
+	// Open streams the file from disk, decoders that can't return false & get the file handed to OpenFromMemory instead
+	virtual bool Open(const char* fileName) { return false; }
+	// data has to stay valid until Close()
+	virtual bool OpenFromMemory(const uint8_t* data, size_t size) = 0;
+	// Stops decoding & frees everything, the stream can be opened again afterwards
+	virtual void Close() = 0;
+
+	// Copies out up to size bytes, waits on the decode thread if nothing is buffered yet
+	// Only reads less at the end of the stream (or if it's closing), false if the stream isn't open
+	bool Read(uint8_t* buffer, size_t size, size_t* sizeRead);
+	// Drops whatever was buffered, decode thread seeks back to the start next time it checks in
+	void Reset();
+
+	bool IsOpen() const { return !m_ring.empty(); }
+	// Valid once opened
+	const PcmFormat& Format() const { return m_format; }
+
+	// Times the track until it's closed & hands it to profiler then, call before opening it. nullptr doesn't profile.
+	void BeginProfile(BGMDecodeProfiler* profiler, const char* fileName);
+
+protected:
+	// Implemented by each decoder, only called from the decode thread once it's started
+	// DecodeBlock decodes the next bit of audio & hands it to Deliver(), returns false on errors
+	virtual bool DecodeBlock() = 0;
+	virtual bool EndOfStream() = 0;
+	// m_decodeSample is already set to the target when this is called, next Deliver() should start from it
+	virtual bool SeekToSample(uint64_t sample) = 0;
+	// Bytes held by the decoder itself, for the profiler
+	virtual size_t DecoderMemory() const { return 0; }
+
+	// Fills in m_format & sizes the ring, ringMinSamples should cover the largest block DecodeBlock can deliver
+	void SetFormat(unsigned channels, unsigned sampleRate, unsigned bitsPerSample, size_t ringMinSamples);
+	// loopEnd is the last sample of the loop, as given by WaveLoopTags::resolve
+	void SetLoop(uint64_t loopStart, uint64_t loopEnd);
+
+	// Once the format is known, starts the decode thread
+	bool StartDecoding();
+	// Stops the decode thread & drops everything buffered, decoders should call this from Close() before freeing their state
+	void StopDecoding();
+
+	// Takes interleaved PCM starting at m_decodeSample, trims it to the loop end & queues it
+	// Returns false if closing, in which case decoding should stop right away
+	bool Deliver(const uint8_t* data, uint64_t numSamples);
+	// Same for interleaved float samples, which get dithered down to 16-bit first (format has to be 16-bit)
+	bool DeliverFloat(const float* data, uint64_t numSamples);
+
+	// Closest rate the game is happy with, 48kHz for rates in its family & 44.1kHz for everything else
+	static unsigned OutputRateFor(unsigned sampleRate);
+
+	PcmFormat m_format;
+	uint64_t m_decodeSample; // decode thread only once it's started
+
+private:
+	// Ring of decoded PCM, positions only ever increase & get wrapped when indexing
+	std::vector<uint8_t> m_ring;
+	uint64_t m_readPos;
+	uint64_t m_writePos;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stopping;
+	bool m_resetPending;
+	bool m_finished; // end of file (without a loop) or decode error
+
+	std::thread m_decodeThread;
+	bool m_wrapPending;
+
+	bool m_loopEnabled;
+	uint64_t m_loopStart;
+	uint64_t m_loopEnd; // one past the last sample of the loop
+
+	// Copy of the audio starting at m_loopStart, filled in as it gets decoded the first time through
+	std::vector<uint8_t> m_loopHead;
+	uint64_t m_loopHeadSamples;
+	uint64_t m_loopHeadCaptured;
+
+	// Decode thread only once it's started
+	PcmConvert::DitherFunc m_dither;
+	PcmConvert::DitherState m_ditherState;
+	std::vector<int16_t> m_ditherBuffer;
+
+	void DecodeThread();
+	bool DecodeNext();
+	bool WrapToLoopStart();
+	bool PushDecoded(const uint8_t* data, size_t size);
+	void SizeLoopHead();
+	void CaptureLoopHead(uint64_t firstSample, const uint8_t* data, uint64_t numSamples);
+
+	// Handed to m_profiler by StopDecoding, nothing reads the clock unless it's set
+	BGMDecodeProfiler* m_profiler;
+	BGMDecodeProfiler::Format m_profileFormat;
+	std::chrono::steady_clock::time_point m_profileOpenTime;
+	uint64_t m_profileWaitNanoseconds; // decode thread only
+	BGMDecodeProfiler::Track m_profile;
+
+	static uint64_t Since(std::chrono::steady_clock::time_point start);
+};
+
+// Our decoders, see flac_stream.cpp & opus_stream.cpp
+std::unique_ptr<PcmStream> CreateFLACStream();
+std::unique_ptr<PcmStream> CreateOpusStream();
@@ -0,0 +1,424 @@
+#include <algorithm>
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+
+#include "pixel_convert.hpp"
+
+// MSVC allows any intrinsics without /arch flags, GCC/clang need each function marked with the instruction set it uses
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+namespace PixelConvert
+{
+	using Convert32Func = void(*)(const uint8_t* src, uint8_t* dst, size_t pixels);
+	using Expand16Func = void(*)(const uint16_t* src, uint8_t* dst, size_t pixels);
+
+	struct Kernels
+	{
+		Convert32Func swapRedBlue;
+		Convert32Func swapRedBlueOpaque;
+		Convert32Func premultiply;
+		Expand16Func expand565;
+		Expand16Func expand4444;
+	};
+
+	// Scalar reference versions, also used for the leftover pixels of SIMD ones
+
+	static void SwapRedBlue_Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		for (size_t i = 0; i < pixels; i++)
+		{
+			uint8_t c0 = src[i * 4 + 0];
+			uint8_t c1 = src[i * 4 + 1];
+			uint8_t c2 = src[i * 4 + 2];
+			uint8_t c3 = src[i * 4 + 3];
+			dst[i * 4 + 0] = c2;
+			dst[i * 4 + 1] = c1;
+			dst[i * 4 + 2] = c0;
+			dst[i * 4 + 3] = c3;
+		}
+	}
+
+	static void SwapRedBlueOpaque_Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		for (size_t i = 0; i < pixels; i++)
+		{
+			uint8_t c0 = src[i * 4 + 0];
+			uint8_t c1 = src[i * 4 + 1];
+			uint8_t c2 = src[i * 4 + 2];
+			dst[i * 4 + 0] = c2;
+			dst[i * 4 + 1] = c1;
+			dst[i * 4 + 2] = c0;
+			dst[i * 4 + 3] = 0xFF;
+		}
+	}
+
+	static inline uint8_t MulDiv255(uint32_t c, uint32_t a)
+	{
+		uint32_t t = c * a + 128;
+		return uint8_t((t + (t >> 8)) >> 8);
+	}
+
+	static void Premultiply_Scalar(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		for (size_t i = 0; i < pixels; i++)
+		{
+			uint8_t a = src[i * 4 + 3];
+			dst[i * 4 + 0] = MulDiv255(src[i * 4 + 0], a);
+			dst[i * 4 + 1] = MulDiv255(src[i * 4 + 1], a);
+			dst[i * 4 + 2] = MulDiv255(src[i * 4 + 2], a);
+			dst[i * 4 + 3] = a;
+		}
+	}
+
+	static void Expand565_Scalar(const uint16_t* src, uint8_t* dst, size_t pixels)
+	{
+		for (size_t i = 0; i < pixels; i++)
+		{
+			uint32_t p = src[i];
+			uint32_t r = (p >> 11) & 0x1F;
+			uint32_t g = (p >> 5) & 0x3F;
+			uint32_t b = p & 0x1F;
+			dst[i * 4 + 0] = uint8_t((b << 3) | (b >> 2));
+			dst[i * 4 + 1] = uint8_t((g << 2) | (g >> 4));
+			dst[i * 4 + 2] = uint8_t((r << 3) | (r >> 2));
+			dst[i * 4 + 3] = 0xFF;
+		}
+	}
+
+	static void Expand4444_Scalar(const uint16_t* src, uint8_t* dst, size_t pixels)
+	{
+		for (size_t i = 0; i < pixels; i++)
+		{
+			uint32_t p = src[i];
+			dst[i * 4 + 0] = uint8_t((p & 0xF) * 0x11);
+			dst[i * 4 + 1] = uint8_t(((p >> 4) & 0xF) * 0x11);
+			dst[i * 4 + 2] = uint8_t(((p >> 8) & 0xF) * 0x11);
+			dst[i * 4 + 3] = uint8_t(((p >> 12) & 0xF) * 0x11);
+		}
+	}
+
+	// SSE2
+
+	TARGET_SSE2 static inline __m128i SwapRedBlue4(__m128i px)
+	{
+		const __m128i agMask = _mm_set1_epi32(int(0xFF00FF00));
+		__m128i ag = _mm_and_si128(px, agMask);
+		__m128i rb = _mm_andnot_si128(agMask, px);
+		rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+		return _mm_or_si128(ag, rb);
+	}
+
+	TARGET_SSE2 static void SwapRedBlue_SSE2(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		size_t i = 0;
+		for (; i + 4 <= pixels; i += 4)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), SwapRedBlue4(px));
+		}
+		SwapRedBlue_Scalar(src + i * 4, dst + i * 4, pixels - i);
+	}
+
+	TARGET_SSE2 static void SwapRedBlueOpaque_SSE2(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+		size_t i = 0;
+		for (; i + 4 <= pixels; i += 4)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(SwapRedBlue4(px), alpha));
+		}
+		SwapRedBlueOpaque_Scalar(src + i * 4, dst + i * 4, pixels - i);
+	}
+
+	// Two pixels worth of 16-bit channels, alpha lane is left as-is
+	TARGET_SSE2 static inline __m128i Premultiply2(__m128i px16)
+	{
+		const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+		const __m128i round = _mm_set1_epi16(128);
+
+		__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		__m128i t = _mm_add_epi16(_mm_mullo_epi16(px16, alpha), round);
+		t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		return _mm_or_si128(_mm_and_si128(alphaLanes, px16), _mm_andnot_si128(alphaLanes, t));
+	}
+
+	TARGET_SSE2 static void Premultiply_SSE2(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for (; i + 4 <= pixels; i += 4)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			__m128i lo = Premultiply2(_mm_unpacklo_epi8(px, zero));
+			__m128i hi = Premultiply2(_mm_unpackhi_epi8(px, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+		}
+		Premultiply_Scalar(src + i * 4, dst + i * 4, pixels - i);
+	}
+
+	// Interleaves 8 pixels of (b | g << 8) & (r | a << 8) 16-bit lanes into BGRA
+	TARGET_SSE2 static inline void StoreBGRA8(uint8_t* dst, __m128i bg, __m128i ra)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(bg, ra));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(bg, ra));
+	}
+
+	TARGET_SSE2 static void Expand565_SSE2(const uint16_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m128i mask5 = _mm_set1_epi16(0x1F);
+		const __m128i mask6 = _mm_set1_epi16(0x3F);
+		const __m128i alpha = _mm_set1_epi16(int16_t(0xFF00));
+		size_t i = 0;
+		for (; i + 8 <= pixels; i += 8)
+		{
+			__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i r = _mm_and_si128(_mm_srli_epi16(p, 11), mask5);
+			__m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+			__m128i b = _mm_and_si128(p, mask5);
+			r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+			g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+			b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+			StoreBGRA8(dst + i * 4, _mm_or_si128(b, _mm_slli_epi16(g, 8)), _mm_or_si128(r, alpha));
+		}
+		Expand565_Scalar(src + i, dst + i * 4, pixels - i);
+	}
+
+	TARGET_SSE2 static void Expand4444_SSE2(const uint16_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m128i mask4 = _mm_set1_epi16(0xF);
+		size_t i = 0;
+		for (; i + 8 <= pixels; i += 8)
+		{
+			__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i b = _mm_and_si128(p, mask4);
+			__m128i g = _mm_and_si128(_mm_srli_epi16(p, 4), mask4);
+			__m128i r = _mm_and_si128(_mm_srli_epi16(p, 8), mask4);
+			__m128i a = _mm_srli_epi16(p, 12);
+			b = _mm_or_si128(b, _mm_slli_epi16(b, 4));
+			g = _mm_or_si128(g, _mm_slli_epi16(g, 4));
+			r = _mm_or_si128(r, _mm_slli_epi16(r, 4));
+			a = _mm_or_si128(a, _mm_slli_epi16(a, 4));
+			StoreBGRA8(dst + i * 4, _mm_or_si128(b, _mm_slli_epi16(g, 8)), _mm_or_si128(r, _mm_slli_epi16(a, 8)));
+		}
+		Expand4444_Scalar(src + i, dst + i * 4, pixels - i);
+	}
+
+	// SSSE3, pshufb does the channel swap in one instruction
+
+	TARGET_SSSE3 static void SwapRedBlue_SSSE3(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		size_t i = 0;
+		for (; i + 4 <= pixels; i += 4)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(px, shuffle));
+		}
+		SwapRedBlue_Scalar(src + i * 4, dst + i * 4, pixels - i);
+	}
+
+	TARGET_SSSE3 static void SwapRedBlueOpaque_SSSE3(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+		size_t i = 0;
+		for (; i + 4 <= pixels; i += 4)
+		{
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(px, shuffle), alpha));
+		}
+		SwapRedBlueOpaque_Scalar(src + i * 4, dst + i * 4, pixels - i);
+	}
+
+	// AVX2
+
+	TARGET_AVX2 static void SwapRedBlue_AVX2(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m256i shuffle = _mm256_setr_epi8(
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		size_t i = 0;
+		for (; i + 8 <= pixels; i += 8)
+		{
+			__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(px, shuffle));
+		}
+		SwapRedBlue_Scalar(src + i * 4, dst + i * 4, pixels - i);
+	}
+
+	TARGET_AVX2 static void SwapRedBlueOpaque_AVX2(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m256i shuffle = _mm256_setr_epi8(
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		const __m256i alpha = _mm256_set1_epi32(int(0xFF000000));
+		size_t i = 0;
+		for (; i + 8 <= pixels; i += 8)
+		{
+			__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(px, shuffle), alpha));
+		}
+		SwapRedBlueOpaque_Scalar(src + i * 4, dst + i * 4, pixels - i);
+	}
+
+	TARGET_AVX2 static inline __m256i Premultiply4(__m256i px16)
+	{
+		const __m256i alphaLanes = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+		const __m256i round = _mm256_set1_epi16(128);
+
+		__m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px16, alpha), round);
+		t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+		return _mm256_blendv_epi8(t, px16, alphaLanes);
+	}
+
+	TARGET_AVX2 static void Premultiply_AVX2(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		size_t i = 0;
+		for (; i + 8 <= pixels; i += 8)
+		{
+			// unpack/pack work within 128-bit lanes, so pixel order comes back out unchanged
+			__m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+			__m256i lo = Premultiply4(_mm256_unpacklo_epi8(px, zero));
+			__m256i hi = Premultiply4(_mm256_unpackhi_epi8(px, zero));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_packus_epi16(lo, hi));
+		}
+		Premultiply_Scalar(src + i * 4, dst + i * 4, pixels - i);
+	}
+
+	// Levels without a dedicated version of a kernel use the one from the level below
+	static const Kernels KernelTable[] = {
+		{ SwapRedBlue_Scalar, SwapRedBlueOpaque_Scalar, Premultiply_Scalar, Expand565_Scalar, Expand4444_Scalar },
+		{ SwapRedBlue_SSE2, SwapRedBlueOpaque_SSE2, Premultiply_SSE2, Expand565_SSE2, Expand4444_SSE2 },
+		{ SwapRedBlue_SSSE3, SwapRedBlueOpaque_SSSE3, Premultiply_SSE2, Expand565_SSE2, Expand4444_SSE2 },
+		{ SwapRedBlue_AVX2, SwapRedBlueOpaque_AVX2, Premultiply_AVX2, Expand565_SSE2, Expand4444_SSE2 },
+	};
+
+	static void CpuId(int leaf, int subleaf, uint32_t regs[4])
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuidex(info, leaf, subleaf);
+		for (int i = 0; i < 4; i++)
+			regs[i] = uint32_t(info[i]);
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	static uint64_t GetXCR0()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (uint64_t(edx) << 32) | eax;
+#endif
+	}
+
+	Level DetectLevel()
+	{
+		uint32_t regs[4];
+		CpuId(0, 0, regs);
+		uint32_t maxLeaf = regs[0];
+
+		CpuId(1, 0, regs);
+		bool sse2 = (regs[3] >> 26) & 1;
+		bool ssse3 = (regs[2] >> 9) & 1;
+		bool osxsave = (regs[2] >> 27) & 1;
+		bool avx = (regs[2] >> 28) & 1;
+
+		// AVX2 also needs the OS to save YMM registers on context switches
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osxsave && avx && (GetXCR0() & 6) == 6)
+		{
+			CpuId(7, 0, regs);
+			avx2 = (regs[1] >> 5) & 1;
+		}
+
+		if (avx2 && ssse3)
+			return Level::AVX2;
+		if (ssse3 && sse2)
+			return Level::SSSE3;
+		if (sse2)
+			return Level::SSE2;
+		return Level::Scalar;
+	}
+
+	const char* LevelName(Level level)
+	{
+		switch (level)
+		{
+		case Level::SSE2: return "SSE2";
+		case Level::SSSE3: return "SSSE3";
+		case Level::AVX2: return "AVX2";
+		default: return "Scalar";
+		}
+	}
+
+	static std::atomic<int> ActiveLevel = -1;
+
+	static const Kernels& Active()
+	{
+		int level = ActiveLevel.load(std::memory_order_relaxed);
+		if (level < 0) [[unlikely]]
+		{
+			level = int(DetectLevel());
+			ActiveLevel.store(level, std::memory_order_relaxed);
+		}
+		return KernelTable[level];
+	}
+
+	void SetLevel(Level level)
+	{
+		ActiveLevel.store(int(std::min(level, DetectLevel())), std::memory_order_relaxed);
+	}
+
+	Level CurrentLevel()
+	{
+		Active();
+		return Level(ActiveLevel.load(std::memory_order_relaxed));
+	}
+
+	void SwapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		Active().swapRedBlue(src, dst, pixels);
+	}
+
+	void SwapRedBlueOpaque(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		Active().swapRedBlueOpaque(src, dst, pixels);
+	}
+
+	void Premultiply(const uint8_t* src, uint8_t* dst, size_t pixels)
+	{
+		Active().premultiply(src, dst, pixels);
+	}
+
+	void Expand565(const uint16_t* src, uint8_t* dst, size_t pixels)
+	{
+		Active().expand565(src, dst, pixels);
+	}
+
+	void Expand4444(const uint16_t* src, uint8_t* dst, size_t pixels)
+	{
+		Active().expand4444(src, dst, pixels);
+	}
+}
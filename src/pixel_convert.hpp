@@ -0,0 +1,50 @@
+// Pixel format conversion kernels used when uploading textures
+// Each conversion has a scalar reference version plus SSE2/SSSE3/AVX2 ones, the best one the CPU supports is picked on first use.
+// SIMD versions give the exact same output as the scalar ones.
+//
+// Formats use D3D naming, so "A8R8G8B8" is B,G,R,A in memory & "A8B8G8R8" is R,G,B,A.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace PixelConvert
+{
+	enum class Level
+	{
+		Scalar,
+		SSE2,
+		SSSE3,
+		AVX2,
+	};
+
+	// Highest level supported by both the CPU & OS
+	Level DetectLevel();
+	const char* LevelName(Level level);
+
+	// Forces kernels to a specific level (clamped to what's supported), mostly useful for comparing against the scalar versions
+	void SetLevel(Level level);
+	Level CurrentLevel();
+
+	// A8B8G8R8 <-> A8R8G8B8 (swaps bytes 0 & 2 of every pixel), src & dst may be the same buffer
+	void SwapRedBlue(const uint8_t* src, uint8_t* dst, size_t pixels);
+
+	// Same as SwapRedBlue, but also sets alpha to 0xFF, for X8B8G8R8 -> A8R8G8B8
+	void SwapRedBlueOpaque(const uint8_t* src, uint8_t* dst, size_t pixels);
+
+	// Multiplies color channels of 8-bit RGBA/BGRA pixels by alpha, rounded the same as (c * a + 127) / 255
+	void Premultiply(const uint8_t* src, uint8_t* dst, size_t pixels);
+
+	// R5G6B5 -> A8R8G8B8 (alpha 0xFF), A4R4G4B4 -> A8R8G8B8, channels are expanded by bit replication
+	void Expand565(const uint16_t* src, uint8_t* dst, size_t pixels);
+	void Expand4444(const uint16_t* src, uint8_t* dst, size_t pixels);
+
+	// Runs a 32bpp conversion over rows with separate pitches, eg. from tightly packed DDS data into a locked surface
+	template <typename Func>
+	void ConvertRows(Func func, const uint8_t* src, size_t srcPitch, uint8_t* dst, size_t dstPitch, size_t width, size_t height)
+	{
+		for (size_t y = 0; y < height; y++)
+			func(src + y * srcPitch, dst + y * dstPitch, width);
+	}
+}
@@ -20,6 +20,7 @@ namespace Module
 	inline std::filesystem::path ExePath{};
 
 	inline std::filesystem::path LogPath{};
+	inline std::filesystem::path TracePath{};
 	inline std::filesystem::path IniPath{};
 	inline std::filesystem::path UserIniPath{};
 	inline std::filesystem::path LodIniPath{};
@@ -70,6 +71,9 @@ namespace Game
 	inline float DeltaTime = (1.f / 60.f);
 
 	inline bool DrawDistanceDebugEnabled = false;
+	inline bool TextureCacheStatsEnabled = false;
+	inline bool TextureProfilerEnabled = false;
+	inline bool BGMProfilerEnabled = false;
 
 	inline GamepadType CurrentPadType = GamepadType::PC;
 	inline GamepadType ForcedPadType = GamepadType::None;
@@ -94,6 +98,12 @@ namespace Settings
 	inline bool AllowHorn = true;
 	inline bool AllowWAV = true;
 	inline bool AllowFLAC = true;
+	inline bool AllowOpus = true;
+	inline int BGMCacheMB = 64;
+	inline bool ProfileBGMDecode = false;
+	inline float BGMDecodeWarnMBps = 2.0f;
+	inline int BGMFirstReadWarnMs = 100;
+	inline int BGMLoopSeekWarnMs = 50;
 
 	inline bool CDSwitcherEnable = false;
 	inline bool CDSwitcherDisplayTitle = true;
@@ -103,6 +113,8 @@ namespace Settings
 	inline int CDSwitcherTitlePositionX = 375;
 	inline int CDSwitcherTitlePositionY = 450;
 	inline bool CDSwitcherShuffleTracks = false;
+	inline bool CDSwitcherPreloadTracks = true;
+	inline int CDSwitcherCrossfadeMs = 1500;
 	inline std::string CDSwitcherTrackNext = "Back";
 	inline std::string CDSwitcherTrackPrevious = "RS+Back";
 
@@ -128,7 +140,14 @@ namespace Settings
 	inline bool UITextureReplacement = true;
 	inline bool UITextureExtract = false;
 	inline bool EnableTextureCache = true;
+	inline int TextureCacheThreads = 0;
+	inline int TextureCacheBudgetMB = 0;
+	inline bool TextureHashCache = false;
+	inline bool GenerateTextureMipmaps = false;
+	inline std::string TextureMipmapFilter = "kaiser";
 	inline bool UseNewTextureAllocator = true;
+	inline bool ShareReplacementTextures = true;
+	inline bool ProfileTextureLoads = false;
 
 	inline bool UseNewInput = false;
 	inline float SteeringDeadZone = 0.2f;
@@ -226,6 +245,9 @@ namespace Settings
 	inline bool RandomHighwayAnimSets = false;
 	inline std::string DemonwareServerOverride = "clarissa.port0.org";
 	inline bool ProtectLoginData = true;
+	inline bool TraceLogEnabled = false;
+	inline bool ModFileManifest = false;
+	inline bool WatchModFiles = false;
 
 	inline bool OverlayEnabled = true;
 
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include <immintrin.h>
+
+#include "pixel_convert.hpp"
+#include "resampler.hpp"
+
+// MSVC allows any intrinsics without /arch flags, GCC/clang need each function marked with the instruction set it uses
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+// Dot products of a filter against interleaved samples, count is taps * channels
+
+// Mono & stereo sum into 8 lanes like the SIMD versions do, then add up each channels lanes in order
+static void DotLanes_Scalar(const float* samples, const float* coeffs, size_t count, unsigned channels, float* out)
+{
+	float acc[8] = {};
+	for (size_t i = 0; i < count; i += 8)
+	{
+		for (int lane = 0; lane < 8; lane++)
+			acc[lane] += samples[i + lane] * coeffs[i + lane];
+	}
+
+	for (unsigned c = 0; c < channels; c++)
+	{
+		float sum = acc[c];
+		for (unsigned lane = c + channels; lane < 8; lane += channels)
+			sum += acc[lane];
+		out[c] = sum;
+	}
+}
+
+// Any other channel count, lanes wouldn't line up with channels
+static void DotMulti_Scalar(const float* samples, const float* coeffs, size_t count, unsigned channels, float* out)
+{
+	for (unsigned c = 0; c < channels; c++)
+	{
+		float sum = 0;
+		for (size_t i = c; i < count; i += channels)
+			sum += samples[i] * coeffs[i];
+		out[c] = sum;
+	}
+}
+
+TARGET_SSE2 static void DotLanes_SSE2(const float* samples, const float* coeffs, size_t count, unsigned channels, float* out)
+{
+	__m128 lo = _mm_setzero_ps();
+	__m128 hi = _mm_setzero_ps();
+	for (size_t i = 0; i < count; i += 8)
+	{
+		lo = _mm_add_ps(lo, _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(coeffs + i)));
+		hi = _mm_add_ps(hi, _mm_mul_ps(_mm_loadu_ps(samples + i + 4), _mm_loadu_ps(coeffs + i + 4)));
+	}
+
+	float acc[8];
+	_mm_storeu_ps(acc, lo);
+	_mm_storeu_ps(acc + 4, hi);
+	for (unsigned c = 0; c < channels; c++)
+	{
+		float sum = acc[c];
+		for (unsigned lane = c + channels; lane < 8; lane += channels)
+			sum += acc[lane];
+		out[c] = sum;
+	}
+}
+
+// Plain mul + add rather than FMA, so the result matches the other versions
+TARGET_AVX2 static void DotLanes_AVX2(const float* samples, const float* coeffs, size_t count, unsigned channels, float* out)
+{
+	__m256 sum8 = _mm256_setzero_ps();
+	for (size_t i = 0; i < count; i += 8)
+		sum8 = _mm256_add_ps(sum8, _mm256_mul_ps(_mm256_loadu_ps(samples + i), _mm256_loadu_ps(coeffs + i)));
+
+	float acc[8];
+	_mm256_storeu_ps(acc, sum8);
+	for (unsigned c = 0; c < channels; c++)
+	{
+		float sum = acc[c];
+		for (unsigned lane = c + channels; lane < 8; lane += channels)
+			sum += acc[lane];
+		out[c] = sum;
+	}
+}
+
+static StreamResampler::DotFunc PickDot(PixelConvert::Level level, unsigned channels)
+{
+	if (channels != 1 && channels != 2)
+		return DotMulti_Scalar;
+
+	switch (level)
+	{
+	case PixelConvert::Level::AVX2:
+		return DotLanes_AVX2;
+	case PixelConvert::Level::SSSE3:
+	case PixelConvert::Level::SSE2:
+		return DotLanes_SSE2;
+	default:
+		return DotLanes_Scalar;
+	}
+}
+
+StreamResampler::DotFunc StreamResampler::SelectDot(unsigned channels)
+{
+	return PickDot(PixelConvert::CurrentLevel(), channels);
+}
+
+StreamResampler::DotFunc StreamResampler::SelectDotScalar(unsigned channels)
+{
+	return PickDot(PixelConvert::Level::Scalar, channels);
+}
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double BesselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 50; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+void StreamResampler::init(unsigned channels, unsigned inRate, unsigned outRate)
+{
+	const double pi = 3.14159265358979323846;
+
+	this->channels = channels;
+	this->inRate = inRate;
+	this->outRate = outRate;
+
+	uint64_t gcd = std::gcd(inRate, outRate);
+	inStep = inRate / gcd;
+	outStep = outRate / gcd;
+	phases = unsigned(std::min<uint64_t>(outStep, RESAMPLER_MAX_PHASES));
+
+	// Downsampling needs a longer filter for the same transition band, relative to the input rate
+	double ratio = std::min<double>(1.0, double(outRate) / double(inRate));
+	taps = unsigned(std::ceil(RESAMPLER_TAPS / ratio / 8.0)) * 8;
+	const double cutoff = 0.45 * ratio; // cycles per input frame, 90% of the lower Nyquist
+	const double half = double(taps / 2);
+	const double windowScale = 1.0 / BesselI0(RESAMPLER_KAISER_BETA);
+
+	bank.assign(size_t(phases) * taps * channels, 0.0f);
+	std::vector<double> coeffs(taps);
+	for (unsigned phase = 0; phase < phases; phase++)
+	{
+		// Tap k reads input frame idx - taps/2 + 1 + k, phase is how far past idx the output position is
+		double frac = double(phase) / double(phases);
+		double sum = 0;
+		for (unsigned k = 0; k < taps; k++)
+		{
+			double t = double(k) - (half - 1.0) - frac;
+			double x = t / half;
+			double window = std::abs(x) < 1.0 ? BesselI0(RESAMPLER_KAISER_BETA * std::sqrt(1.0 - x * x)) * windowScale : 0.0;
+			double sinc = t == 0.0 ? 1.0 : std::sin(2.0 * pi * cutoff * t) / (2.0 * pi * cutoff * t);
+			coeffs[k] = 2.0 * cutoff * sinc * window;
+			sum += coeffs[k];
+		}
+
+		// Each phase gets unity gain at DC, otherwise the phases ripple against each other
+		float* dst = &bank[size_t(phase) * taps * channels];
+		for (unsigned k = 0; k < taps; k++)
+			for (unsigned c = 0; c < channels; c++)
+				dst[k * channels + c] = float(coeffs[k] / sum);
+	}
+
+	dot = SelectDot(channels);
+	reset(0);
+}
+
+int64_t StreamResampler::firstTap(uint64_t output) const
+{
+	return int64_t(output * inStep / outStep) - int64_t(taps / 2) + 1;
+}
+
+uint64_t StreamResampler::reset(uint64_t firstInput)
+{
+	nextOutput = (firstInput * outStep + inStep - 1) / inStep;
+
+	// Silence before the first frame, far enough back for the first outputs filter
+	pendingStart = std::min<int64_t>(firstTap(nextOutput), int64_t(firstInput));
+	pending.assign(size_t(int64_t(firstInput) - pendingStart) * channels, 0.0f);
+	return nextOutput;
+}
+
+void StreamResampler::process(const float* in, size_t frames, std::vector<float>& out)
+{
+	pending.insert(pending.end(), in, in + frames * channels);
+	run(INT64_MAX, out);
+}
+
+void StreamResampler::finish(std::vector<float>& out)
+{
+	const int64_t pendingFrames = int64_t(pending.size() / channels);
+	const int64_t endInput = pendingStart + pendingFrames;
+
+	// Silence after the end for the lookahead, but only make outputs that fall inside the real input
+	pending.resize(pending.size() + size_t(taps) * channels, 0.0f);
+	run(endInput, out);
+	pending.clear();
+	pendingStart = endInput;
+}
+
+void StreamResampler::run(int64_t endInput, std::vector<float>& out)
+{
+	const int64_t pendingFrames = int64_t(pending.size() / channels);
+	const size_t filterSize = size_t(taps) * channels;
+
+	// Upper bound on what can be made, trimmed back afterwards
+	size_t outFrames = 0;
+	size_t base = out.size();
+	out.resize(base + (size_t(pendingFrames * outStep / inStep) + 2) * channels);
+
+	while (true)
+	{
+		uint64_t position = nextOutput * inStep; // in 1/outStep input frames
+		int64_t idx = int64_t(position / outStep);
+		int64_t first = firstTap(nextOutput) - pendingStart;
+		if (idx >= endInput || first + int64_t(taps) > pendingFrames)
+			break;
+
+		unsigned phase = unsigned((position % outStep) * phases / outStep);
+		dot(&pending[size_t(first) * channels], &bank[size_t(phase) * filterSize], filterSize, channels, &out[base + outFrames * channels]);
+		outFrames++;
+		nextOutput++;
+	}
+	out.resize(base + outFrames * channels);
+
+	// Keep what the next output's filter still needs
+	int64_t keepFrom = std::min<int64_t>(firstTap(nextOutput) - pendingStart, pendingFrames);
+	if (keepFrom > 0)
+	{
+		pending.erase(pending.begin(), pending.begin() + size_t(keepFrom) * channels);
+		pendingStart += keepFrom;
+	}
+}
@@ -0,0 +1,75 @@
+// Streaming sample rate converter for decoders whose output rate doesn't match what we hand to the game
+// Polyphase windowed-sinc (Kaiser) filter on interleaved float samples. The filter is cut off a little below the lower of the
+// two Nyquist rates & gets longer when downsampling, so hi-res sources don't alias. Positions are tracked as exact fractions
+// of the input rate, so output frame N always lines up with the same input position no matter where the stream was
+// (re)started from, & matches continuous decoding as long as the restart was at least preroll() frames before it.
+//
+// Mono & stereo use SSE2/AVX2 dot products (same instruction set level as PixelConvert), other channel counts a scalar
+// one. All of them give the exact same output as the scalar version.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Filter taps per phase when the output rate is at least the input rate, downsampling scales this by the ratio
+#define RESAMPLER_TAPS 64
+// Limit on the number of filter phases, rate pairs needing more use the nearest phase below the exact position
+#define RESAMPLER_MAX_PHASES 1024
+// Kaiser window beta, ~90dB stopband
+#define RESAMPLER_KAISER_BETA 8.6
+
+class StreamResampler
+{
+public:
+	using DotFunc = void(*)(const float* samples, const float* coeffs, size_t count, unsigned channels, float* out);
+
+	void init(unsigned channels, unsigned inRate, unsigned outRate);
+
+	// Starts over from input frame firstInput (eg. after a seek), returns the index of the first output frame that'll be produced
+	// Input before firstInput is taken as silence
+	uint64_t reset(uint64_t firstInput);
+
+	// Appends the output frames that can be made from the input so far, the last preroll() or so input frames are held back
+	// until the next call since filtering them needs the frames after
+	void process(const float* in, size_t frames, std::vector<float>& out);
+
+	// Input ended, appends the output frames that were still being held back
+	void finish(std::vector<float>& out);
+
+	unsigned inputRate() const { return inRate; }
+	unsigned outputRate() const { return outRate; }
+
+	// Input frames each output depends on before its position
+	unsigned preroll() const { return taps / 2; }
+
+	// Output frame index for an input frame index, rounded down
+	uint64_t toOutput(uint64_t inputFrame) const { return inputFrame * outRate / inRate; }
+	uint64_t toInput(uint64_t outputFrame) const { return outputFrame * inRate / outRate; }
+
+	// Kernel the resampler picked, & the scalar one it has to match
+	static DotFunc SelectDot(unsigned channels);
+	static DotFunc SelectDotScalar(unsigned channels);
+
+private:
+	unsigned channels = 0;
+	unsigned inRate = 0;
+	unsigned outRate = 0;
+
+	// Rates divided by their GCD, output frame N is at input position N * inStep / outStep
+	uint64_t inStep = 1;
+	uint64_t outStep = 1;
+
+	unsigned taps = 0;   // multiple of 8, so mono & stereo filters are a whole number of AVX2 registers
+	unsigned phases = 0;
+	std::vector<float> bank; // phases * taps coefficients, each repeated for every channel to line up with interleaved input
+	DotFunc dot = nullptr;
+
+	uint64_t nextOutput = 0;  // index of the next output frame
+	int64_t pendingStart = 0; // input frame index of pending[0], can be before the start of the stream
+	std::vector<float> pending;
+
+	int64_t firstTap(uint64_t output) const;
+	void run(int64_t endInput, std::vector<float>& out);
+};
@@ -0,0 +1,157 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+#include "texture_dumper.hpp"
+
+TextureDumpWriter::TextureDumpWriter(size_t maxQueuedBytes)
+	: maxQueuedBytes(maxQueuedBytes)
+{
+}
+
+TextureDumpWriter::~TextureDumpWriter()
+{
+	shutdown();
+}
+
+void TextureDumpWriter::shutdown(bool processTerminating)
+{
+	if (shutDown.exchange(true))
+		return;
+
+	if (processTerminating)
+	{
+		if (writerThread.joinable())
+			writerThread.detach();
+		return;
+	}
+
+	bool exited;
+	{
+		std::unique_lock lock(mtx);
+		stopping = true;
+		wake.notify_all();
+		if (!writerThread.joinable())
+			return;
+
+		// Writer finishes whatever is still queued before exiting, unless that takes too long
+		exited = progress.wait_for(lock, std::chrono::milliseconds(ShutdownTimeoutMs), [&] { return writerExited; });
+		if (!exited)
+		{
+			spdlog::warn("TextureDumpWriter: {} dumps still queued after {}ms, dropping them", jobs.size() + inFlight, ShutdownTimeoutMs);
+			abandoned = true;
+			exited = progress.wait_for(lock, std::chrono::milliseconds(ShutdownTimeoutMs), [&] { return writerExited; });
+		}
+	}
+
+	if (!exited)
+	{
+		spdlog::warn("TextureDumpWriter: writer thread didn't stop, leaving it behind");
+		writerThread.detach();
+		return;
+	}
+
+#ifdef _WIN32
+	// Past our code already, only the loader lock can be holding it up
+	if (WaitForSingleObject(writerThread.native_handle(), 0) != WAIT_OBJECT_0)
+		writerThread.detach();
+	else
+#endif
+		writerThread.join();
+}
+
+void TextureDumpWriter::queue(const std::filesystem::path& path, const void* data, size_t size)
+{
+	Job job = { path, std::vector<uint8_t>(size) };
+	memcpy(job.data.data(), data, size);
+
+	{
+		std::unique_lock lock(mtx);
+		if (stopping)
+			return;
+		if (!writerThread.joinable())
+			writerThread = std::thread(&TextureDumpWriter::writerLoop, this);
+
+		// Always let at least one job through, so a texture larger than the limit can't block forever
+		progress.wait(lock, [&] { return stopping || queuedBytes == 0 || queuedBytes + size <= maxQueuedBytes; });
+		if (stopping)
+			return;
+
+		queuedBytes += size;
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+void TextureDumpWriter::flush()
+{
+	std::unique_lock lock(mtx);
+	progress.wait(lock, [&] { return jobs.empty() && inFlight == 0; });
+}
+
+void TextureDumpWriter::writerLoop()
+{
+	std::deque<Job> batch;
+	while (true)
+	{
+		{
+			std::unique_lock lock(mtx);
+			wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+			if (jobs.empty() || abandoned)
+			{
+				jobs.clear();
+				queuedBytes = inFlight = 0;
+				writerExited = true;
+				progress.notify_all();
+				return;
+			}
+
+			batch.swap(jobs);
+			inFlight = batch.size();
+		}
+
+		for (auto& job : batch)
+		{
+			if (abandoned)
+				break;
+			write(job);
+
+			{
+				std::lock_guard lock(mtx);
+				queuedBytes -= job.data.size();
+				inFlight--;
+			}
+			progress.notify_all();
+		}
+		batch.clear();
+	}
+}
+
+void TextureDumpWriter::write(const Job& job)
+{
+	// Textures from the same set all go into the same folder, only ask the filesystem about it once
+	auto directory = job.path.parent_path();
+	if (createdDirectories.insert(directory).second)
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+		if (ec)
+			spdlog::warn("TextureDumpWriter: failed to create {}: {}", directory.string(), ec.message());
+	}
+
+	std::ofstream file(job.path, std::ios::binary | std::ios::trunc);
+	if (!file.write(reinterpret_cast<const char*>(job.data.data()), std::streamsize(job.data.size())))
+	{
+		spdlog::warn("TextureDumpWriter: failed to write {}", job.path.string());
+		return;
+	}
+
+	written++;
+}
@@ -0,0 +1,73 @@
+// Background writer for texture extraction
+// HandleTexture copies each texture it wants dumped into the queue & carries on, a single writer thread then creates the
+// folders & writes the files. Keeps extraction cheap enough to leave on while playing.
+//
+// The queue holds at most maxQueuedBytes of texture data, queue() blocks once that's reached so a slow drive can't
+// make us run out of address space.
+//
+// shutdown() is called from DLL_PROCESS_DETACH ahead of the static destructors, so the writer thread is never waited on
+// without a time limit while the loader lock is held, or at all once the OS has terminated it.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+class TextureDumpWriter
+{
+public:
+	explicit TextureDumpWriter(size_t maxQueuedBytes = 256 * 1024 * 1024);
+	~TextureDumpWriter();
+
+	TextureDumpWriter(const TextureDumpWriter&) = delete;
+	TextureDumpWriter& operator=(const TextureDumpWriter&) = delete;
+
+	// Caller is expected to have already checked the file doesn't exist, the data is copied before returning
+	void queue(const std::filesystem::path& path, const void* data, size_t size);
+
+	// Waits until everything queued so far has been written
+	void flush();
+
+	// Writes what's still queued & stops the writer thread, waiting at most ShutdownTimeoutMs for it
+	// processTerminating skips all of that, at process exit the thread is already gone (maybe while holding mtx), anything
+	// left unwritten just gets dumped next run. Textures queued afterwards are dropped.
+	void shutdown(bool processTerminating = false);
+
+	uint64_t writtenCount() const { return written; }
+
+	static constexpr int ShutdownTimeoutMs = 2000;
+
+private:
+	struct Job
+	{
+		std::filesystem::path path;
+		std::vector<uint8_t> data;
+	};
+
+	size_t maxQueuedBytes;
+	size_t queuedBytes = 0;
+	size_t inFlight = 0;
+	bool stopping = false;
+	bool writerExited = false;
+	std::atomic<bool> abandoned{ false }; // writer drops the rest of its batch, set when shutdown() runs out of time
+	std::atomic<bool> shutDown{ false };
+	std::atomic<uint64_t> written{ 0 };
+
+	std::mutex mtx;
+	std::condition_variable wake;     // writer waits on this for new jobs
+	std::condition_variable progress; // queue() waits for space, flush() for an empty queue
+	std::deque<Job> jobs;
+	std::thread writerThread;
+
+	std::unordered_set<std::filesystem::path> createdDirectories; // only touched by the writer thread
+
+	void writerLoop();
+	void write(const Job& job);
+};
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+#include <xxhash.h>
+
+#include "texture_hash_cache.hpp"
+
+TextureHashCache::~TextureHashCache()
+{
+	close();
+}
+
+uint32_t TextureHashCache::TextureHashRecord::computeCheck() const
+{
+	return XXH32(this, offsetof(TextureHashRecord, check), 0);
+}
+
+bool TextureHashCache::open(const std::filesystem::path& path)
+{
+	std::lock_guard lock(mtx);
+	if (file.is_open())
+		return true;
+
+	std::error_code ec;
+	uintmax_t fileSize = std::filesystem::file_size(path, ec);
+	uintmax_t validSize = 0;
+
+	if (!ec && fileSize >= sizeof(TextureHashFileHeader))
+	{
+		std::ifstream existing(path, std::ios::binary);
+		TextureHashFileHeader header;
+		if (existing.read(reinterpret_cast<char*>(&header), sizeof(header)) && header.magic == Magic && header.version == Version)
+		{
+			validSize = sizeof(header);
+
+			TextureHashRecord record;
+			while (existing.read(reinterpret_cast<char*>(&record), sizeof(record)) && record.check == record.computeCheck())
+			{
+				table[{ record.key, record.size }] = record.hash;
+				validSize += sizeof(record);
+			}
+		}
+	}
+
+	// Start the file from scratch if it's missing or from another version
+	// Otherwise cut off anything after the last good record (eg. game crashed mid-write), so new records stay readable
+	if (validSize && validSize != fileSize)
+	{
+		spdlog::warn("TextureHashCache: dropping {} damaged bytes from the end of {}", fileSize - validSize, path.string());
+		std::filesystem::resize_file(path, validSize, ec);
+		if (ec)
+			validSize = 0;
+	}
+
+	if (validSize)
+		file.open(path, std::ios::binary | std::ios::app);
+	else
+	{
+		table.clear();
+		file.open(path, std::ios::binary | std::ios::trunc);
+		if (file.is_open())
+		{
+			TextureHashFileHeader header = { Magic, Version };
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.flush();
+		}
+	}
+
+	if (!file)
+	{
+		spdlog::error("TextureHashCache: failed to open {}", path.string());
+		file.close();
+		return false;
+	}
+
+	spdlog::info("TextureHashCache: loaded {} hashes from {}", table.size(), path.string());
+	return true;
+}
+
+void TextureHashCache::close()
+{
+	std::lock_guard lock(mtx);
+	file.close();
+}
+
+uint64_t TextureHashCache::SampleKey(const void* data, size_t size)
+{
+	// DDS header (incl. format & mip count) + 16 blocks spread evenly across the rest, the last one ending at the end of the file
+	constexpr size_t HeaderSize = 128;
+	constexpr size_t BlockCount = 16;
+	constexpr size_t BlockSize = 256;
+
+	uint8_t sample[HeaderSize + BlockCount * BlockSize];
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	size_t headerSize = std::min(size, HeaderSize);
+	memcpy(sample, bytes, headerSize);
+	size_t sampleSize = headerSize;
+
+	if (size > HeaderSize + BlockSize)
+	{
+		size_t span = size - HeaderSize - BlockSize;
+		for (size_t i = 0; i < BlockCount; i++)
+		{
+			size_t offset = HeaderSize + span * i / (BlockCount - 1);
+			memcpy(sample + sampleSize, bytes + offset, BlockSize);
+			sampleSize += BlockSize;
+		}
+	}
+
+	return XXH3_64bits_withSeed(sample, sampleSize, size);
+}
+
+uint32_t TextureHashCache::hash(const void* data, size_t size)
+{
+	if (size < MinSampledSize || size > 0xFFFFFFFF)
+		return XXH32(data, size, 0);
+
+	std::pair<uint64_t, uint32_t> key = { SampleKey(data, size), uint32_t(size) };
+	{
+		std::lock_guard lock(mtx);
+		auto it = table.find(key);
+		if (it != table.end())
+			return it->second;
+	}
+
+	uint32_t fullHash = XXH32(data, size, 0);
+
+	std::lock_guard lock(mtx);
+	if (table.emplace(key, fullHash).second && file.is_open())
+	{
+		TextureHashRecord record = { key.first, key.second, fullHash, 0 };
+		record.check = record.computeCheck();
+		file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+		file.flush();
+	}
+	return fullHash;
+}
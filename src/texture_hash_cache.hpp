@@ -0,0 +1,70 @@
+// Persistent cache of texture content hashes
+// Replacement filenames & texture packs are keyed by XXH32 of the whole DDS file, which for large stage textures means
+// hashing several MB every time they're loaded, even though the games files never change between runs.
+//
+// Instead we compute a cheap key from the DDS header, file size & a handful of sampled blocks (XXH3), and look the full XXH32
+// up in a table saved next to the texture folders. The full hash only gets computed the first time each texture is seen,
+// so existing replacement names & packs keep resolving exactly as before.
+//
+// Table file (little-endian): TextureHashFileHeader, then TextureHashRecord entries appended as new textures are hashed
+// Each record carries its own checksum, loading stops at the first one that doesn't match & cuts the file off there, so a
+// crash mid-write or a damaged file can't hand out wrong hashes.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+class TextureHashCache
+{
+public:
+	~TextureHashCache();
+
+	// Loads existing records & opens the file for appending, returns false if the file couldn't be opened/created
+	bool open(const std::filesystem::path& path);
+	void close();
+
+	// Returns the XXH32 of data, same as XXH32(data, size, 0)
+	uint32_t hash(const void* data, size_t size);
+
+	size_t size() const { return table.size(); }
+
+	// Files smaller than this are always fully hashed, sampling them wouldn't save much & they're more likely to only differ by a few bytes
+	static constexpr size_t MinSampledSize = 64 * 1024;
+
+	static uint64_t SampleKey(const void* data, size_t size);
+
+private:
+	static constexpr uint32_t Magic = 0x48584554; // "TEXH"
+	static constexpr uint32_t Version = 2;
+
+#pragma pack(push, 1)
+	struct TextureHashFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+	};
+
+	struct TextureHashRecord
+	{
+		uint64_t key;
+		uint32_t size;
+		uint32_t hash;
+		uint32_t check; // XXH32 of the fields above
+
+		uint32_t computeCheck() const;
+	};
+#pragma pack(pop)
+
+	struct KeyHash
+	{
+		size_t operator()(const std::pair<uint64_t, uint32_t>& key) const { return size_t(key.first ^ key.second); }
+	};
+
+	std::mutex mtx;
+	std::ofstream file;
+	std::unordered_map<std::pair<uint64_t, uint32_t>, uint32_t, KeyHash> table; // (key, size) -> XXH32
+};
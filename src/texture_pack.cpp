@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <tuple>
+
+#include <miniz.h>
+#include <xxhash.h>
+
+#include "texture_pack.hpp"
+
+namespace TexPack
+{
+	bool TexPackEntry::operator<(const TexPackEntry& rhs) const
+	{
+		return std::tie(hash, setHash, padHash, width, height, index) <
+			std::tie(rhs.hash, rhs.setHash, rhs.padHash, rhs.width, rhs.height, rhs.index);
+	}
+
+	uint32_t HashName(std::string_view name)
+	{
+		if (name.empty())
+			return 0;
+
+		std::string lower(name);
+		std::transform(lower.begin(), lower.end(), lower.begin(),
+			[](unsigned char c) { return std::tolower(c); });
+
+		// 0 is used for "any", make sure a real name never hashes to it
+		uint32_t hash = XXH32(lower.data(), lower.size(), 0);
+		return hash ? hash : 1;
+	}
+
+	static bool ParseHex(std::string_view str, uint32_t* value)
+	{
+		auto result = std::from_chars(str.data(), str.data() + str.size(), *value, 16);
+		return result.ec == std::errc() && result.ptr == str.data() + str.size();
+	}
+
+	static bool ParseInt(std::string_view str, int* value)
+	{
+		auto result = std::from_chars(str.data(), str.data() + str.size(), *value);
+		return result.ec == std::errc() && result.ptr == str.data() + str.size();
+	}
+
+	bool ParseTextureName(std::string_view filename, uint32_t* hash, int* width, int* height, int* index)
+	{
+		if (filename.size() < 4)
+			return false;
+
+		std::string_view extension = filename.substr(filename.size() - 4);
+		if (extension != ".dds" && extension != ".DDS")
+			return false;
+		filename.remove_suffix(4);
+
+		// Split on '_' from the end: [index_]HASH_WxH
+		size_t sizeSep = filename.rfind('_');
+		if (sizeSep == std::string_view::npos)
+			return false;
+
+		std::string_view size = filename.substr(sizeSep + 1);
+		filename = filename.substr(0, sizeSep);
+
+		size_t x = size.find('x');
+		if (x == std::string_view::npos || !ParseInt(size.substr(0, x), width) || !ParseInt(size.substr(x + 1), height))
+			return false;
+
+		size_t hashSep = filename.rfind('_');
+		*index = -1;
+		if (hashSep != std::string_view::npos)
+		{
+			if (!ParseInt(filename.substr(0, hashSep), index) || *index < 0)
+				return false;
+			filename = filename.substr(hashSep + 1);
+		}
+
+		return ParseHex(filename, hash);
+	}
+
+	static bool IsPadDirectory(const std::string& name)
+	{
+		uint32_t nameHash = HashName(name);
+		for (const char* pad : PadDirectories)
+			if (HashName(pad) == nameHash)
+				return true;
+		return false;
+	}
+
+	bool ParseReplacementPath(const std::filesystem::path& relativePath, TextureKey* key)
+	{
+		std::vector<std::string> parts;
+		for (const auto& part : relativePath)
+			parts.push_back(part.string());
+
+		if (parts.empty() || parts.size() > 3)
+			return false;
+
+		*key = {};
+		int width, height, index;
+		if (!ParseTextureName(parts.back(), &key->hash, &width, &height, &index) ||
+			width <= 0 || width > 0xFFFF || height <= 0 || height > 0xFFFF)
+			return false;
+
+		key->width = uint16_t(width);
+		key->height = uint16_t(height);
+		key->index = index;
+
+		for (size_t i = 0; i + 1 < parts.size(); i++)
+		{
+			uint32_t& target = IsPadDirectory(parts[i]) ? key->padHash : key->setHash;
+			if (target != 0)
+				return false;
+			target = HashName(parts[i]);
+		}
+
+		key->padFirst = parts.size() == 3 && IsPadDirectory(parts[0]);
+		return true;
+	}
+
+	bool TexturePack::open(const std::filesystem::path& path)
+	{
+		packPath = path;
+		if (!file.open(path) || file.size() < sizeof(TexPackHeader))
+			return false;
+
+		MappedView headerView = file.map(0, sizeof(TexPackHeader));
+		if (!headerView.valid())
+			return false;
+
+		TexPackHeader head;
+		memcpy(&head, headerView.data(), sizeof(head));
+		if (head.magic != Magic || head.version != Version || head.headerSize != sizeof(TexPackHeader))
+			return false;
+
+		uint64_t indexEnd = sizeof(TexPackHeader) + uint64_t(head.entryCount) * sizeof(TexPackEntry);
+		if (head.pathTableOffset < indexEnd || head.pathTableOffset + head.pathTableSize > file.size())
+			return false;
+
+		indexView = file.map(0, size_t(head.pathTableOffset + head.pathTableSize));
+		if (!indexView.valid())
+			return false;
+
+		header = reinterpret_cast<const TexPackHeader*>(indexView.data());
+		index = reinterpret_cast<const TexPackEntry*>(indexView.data() + sizeof(TexPackHeader));
+
+		// Walk the path table once so entryPath can index into it
+		const uint8_t* table = indexView.data() + head.pathTableOffset;
+		uint64_t pos = 0;
+		pathOffsets.reserve(head.entryCount);
+		for (uint32_t i = 0; i < head.entryCount; i++)
+		{
+			if (pos + sizeof(uint16_t) > head.pathTableSize)
+				break;
+
+			uint16_t length;
+			memcpy(&length, table + pos, sizeof(length));
+			pathOffsets.push_back(uint32_t(pos));
+			pos += sizeof(uint16_t) + length;
+		}
+
+		return true;
+	}
+
+	std::string TexturePack::entryPath(uint32_t entryIdx) const
+	{
+		if (entryIdx >= pathOffsets.size())
+			return {};
+
+		const uint8_t* entry = indexView.data() + header->pathTableOffset + pathOffsets[entryIdx];
+		uint16_t length;
+		memcpy(&length, entry, sizeof(length));
+		if (pathOffsets[entryIdx] + sizeof(uint16_t) + length > header->pathTableSize)
+			return {};
+
+		return std::string(reinterpret_cast<const char*>(entry + sizeof(uint16_t)), length);
+	}
+
+	const TexPackEntry* TexturePack::find(uint32_t hash, int width, int height, int textureIndex, uint32_t setHash, uint32_t padHash) const
+	{
+		if (!index)
+			return nullptr;
+
+		const TexPackEntry* begin = index;
+		const TexPackEntry* end = index + header->entryCount;
+		begin = std::lower_bound(begin, end, hash, [](const TexPackEntry& entry, uint32_t hash) { return entry.hash < hash; });
+		if (begin == end || begin->hash != hash)
+			return nullptr;
+
+		end = std::upper_bound(begin, end, hash, [](uint32_t hash, const TexPackEntry& entry) { return hash < entry.hash; });
+
+		auto findExact = [&](uint32_t set, uint32_t pad, int idx) -> const TexPackEntry* {
+			for (auto* entry = begin; entry != end; entry++)
+				if (entry->setHash == set && entry->padHash == pad && entry->index == idx &&
+					entry->width == width && entry->height == height)
+					return entry;
+			return nullptr;
+		};
+
+		const std::pair<uint32_t, uint32_t> tiers[] = {
+			{ setHash, padHash },
+			{ 0, padHash },
+			{ setHash, 0 },
+			{ 0, 0 },
+		};
+
+		for (size_t tier = padHash ? 0 : 2; tier < std::size(tiers); tier++)
+		{
+			auto [set, pad] = tiers[tier];
+			if (auto* entry = findExact(set, pad, textureIndex))
+				return entry;
+			if (auto* entry = findExact(set, pad, -1))
+				return entry;
+		}
+
+		return nullptr;
+	}
+
+	std::shared_ptr<const void> TexturePack::read(const TexPackEntry& entry, const uint8_t** data, size_t* size) const
+	{
+		if (entry.compression == Compression_None)
+		{
+			auto view = std::make_shared<MappedView>(file.map(entry.offset, entry.storedSize));
+			if (!view->valid() || view->size() != entry.storedSize)
+				return nullptr;
+
+			*data = view->data();
+			*size = view->size();
+			return view;
+		}
+
+		if (entry.compression == Compression_Deflate)
+		{
+			MappedView stored = file.map(entry.offset, entry.storedSize);
+			if (!stored.valid() || stored.size() != entry.storedSize)
+				return nullptr;
+
+			auto buffer = std::make_shared<std::vector<uint8_t>>(entry.size);
+			mz_ulong outSize = entry.size;
+			if (mz_uncompress(buffer->data(), &outSize, stored.data(), mz_ulong(stored.size())) != MZ_OK || outSize != entry.size)
+				return nullptr;
+
+			*data = buffer->data();
+			*size = buffer->size();
+			return buffer;
+		}
+
+		return nullptr;
+	}
+}
@@ -0,0 +1,125 @@
+// Texture pack archives (.texpack)
+// Single file alternative to the loose textures/load/ folder layout, avoids thousands of small file opens & directory scans.
+// Built with tools/texpack, which can also unpack them back into loose files.
+//
+// Layout (little-endian):
+//   TexPackHeader
+//   TexPackEntry[entryCount], sorted by TexPackEntry::operator<
+//   path table: per entry (same order as index) u16 length + relative path chars, used by unpack/list only
+//   entry data, each entry starting on an Alignment boundary so uncompressed entries can be mapped directly
+//
+// Entries are keyed the same way HandleTexture matches loose files: texture XXH32 hash + size, optionally the index
+// the texture was loaded at, the xmtset it belongs to, and pad-type subfolder (for controller prompt textures).
+// Entries with identical data can share the same offset.
+//
+// See docs/file_formats/texpack.bt for an 010 Editor template.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+namespace TexPack
+{
+	constexpr uint32_t Magic = 0x50524F54; // "TORP"
+	constexpr uint16_t Version = 1;
+	constexpr uint32_t Alignment = 4096;
+	constexpr char Extension[] = ".texpack";
+
+	// Pad-type subfolder names, matches Game::PadTypes (duplicated here so tools don't need the game headers)
+	inline constexpr const char* PadDirectories[] = { "PC", "Xbox", "PlayStation", "Switch" };
+
+	enum Compression : uint8_t
+	{
+		Compression_None = 0,
+		Compression_Deflate = 1, // zlib stream via miniz
+	};
+
+#pragma pack(push, 1)
+	struct TexPackHeader
+	{
+		uint32_t magic;
+		uint16_t version;
+		uint16_t headerSize;      // sizeof(TexPackHeader)
+		uint32_t entryCount;
+		uint32_t alignment;
+		uint64_t pathTableOffset;
+		uint64_t pathTableSize;
+	};
+	static_assert(sizeof(TexPackHeader) == 32);
+
+	struct TexPackEntry
+	{
+		uint32_t hash;            // XXH32 of the original texture data, same as the hash in loose filenames
+		uint32_t setHash;         // HashName of the xmtset/xstset stem, 0 = applies to any set
+		uint32_t padHash;         // HashName of the pad-type folder, 0 = not pad specific
+		uint16_t width;
+		uint16_t height;
+		int32_t index;            // texture index inside the set, -1 = matches any index
+		uint8_t compression;
+		uint8_t reserved[3];
+		uint64_t offset;
+		uint32_t storedSize;      // size inside the pack
+		uint32_t size;            // size after decompression
+
+		bool operator<(const TexPackEntry& rhs) const;
+	};
+	static_assert(sizeof(TexPackEntry) == 40);
+#pragma pack(pop)
+
+	// Case-insensitive XXH32 of a set or pad folder name
+	uint32_t HashName(std::string_view name);
+
+	// Parses "[index_]HASH_WxH.dds" filenames, returns false if the name doesn't match
+	bool ParseTextureName(std::string_view filename, uint32_t* hash, int* width, int* height, int* index);
+
+	// Everything that identifies a replacement texture, from either a pack entry or a loose file path
+	struct TextureKey
+	{
+		uint32_t hash;
+		uint32_t setHash;
+		uint32_t padHash;
+		uint16_t width;
+		uint16_t height;
+		int32_t index;
+		bool padFirst = false; // loose file was under padtype/xmtset/ rather than xmtset/padtype/, packs don't keep this
+
+		bool operator==(const TextureKey&) const = default;
+	};
+
+	// Parses a path relative to the load folder, eg. "cs_CS_BEAC_pmt/Xbox/3_1234ABCD_512x512.dds"
+	// Returns false if the filename isn't a texture replacement name, or the folders don't fit the [xmtset/][padtype/] layout
+	bool ParseReplacementPath(const std::filesystem::path& relativePath, TextureKey* key);
+
+	class TexturePack
+	{
+	public:
+		bool open(const std::filesystem::path& path);
+
+		const std::filesystem::path& path() const { return packPath; }
+		uint32_t entryCount() const { return header ? header->entryCount : 0; }
+		const TexPackEntry* entries() const { return index; }
+		std::string entryPath(uint32_t entryIdx) const;
+
+		// Finds the entry HandleTexture would pick for a loose file: set + pad specific first, then pad, then set, then global
+		// Indexed entries are preferred over non-indexed ones at each step
+		const TexPackEntry* find(uint32_t hash, int width, int height, int index, uint32_t setHash, uint32_t padHash) const;
+
+		// Returns an owner keeping the data alive (a mapped view, or a decompressed buffer), or nullptr on failure
+		std::shared_ptr<const void> read(const TexPackEntry& entry, const uint8_t** data, size_t* size) const;
+
+	private:
+		std::filesystem::path packPath;
+		MappedFile file;
+		MappedView indexView;     // header + index + path table, kept mapped for lookups
+		const TexPackHeader* header = nullptr;
+		const TexPackEntry* index = nullptr;
+		std::vector<uint32_t> pathOffsets;
+	};
+}
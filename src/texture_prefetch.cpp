@@ -0,0 +1,146 @@
+#include <chrono>
+#include <exception>
+
+#include <spdlog/spdlog.h>
+#include <xxhash.h>
+
+#include "texture_prefetch.hpp"
+
+TexturePrefetcher::~TexturePrefetcher()
+{
+	std::unique_lock lock(mtx);
+	idle.wait(lock, [this] { return pendingTasks == 0; });
+}
+
+bool TexturePrefetcher::inFlight(const std::string& setName) const
+{
+	std::lock_guard lock(mtx);
+	return sets.contains(setName);
+}
+
+bool TexturePrefetcher::queue(const std::string& setName, std::vector<std::filesystem::path> paths)
+{
+	std::lock_guard lock(mtx);
+
+	if (sets.contains(setName))
+		return false; // still being read in from an earlier load
+
+	std::erase_if(paths, [this](const std::filesystem::path& path) { return files.contains(path.native()); });
+	if (paths.empty())
+		return false;
+
+	auto set = std::make_shared<Set>();
+	set->name = setName;
+	set->group = XXH32(setName.data(), setName.size(), 0) | 1; // group 0 is the pools default group
+	set->remaining = int(paths.size());
+	sets[setName] = set;
+	queuedCount += paths.size();
+	pendingTasks += paths.size();
+
+	for (auto& path : paths)
+	{
+		auto file = std::make_shared<File>();
+		files[path.native()] = file;
+		pool.submit([this, set, file, path = std::move(path)]() { run(path, file, set); }, set->group);
+	}
+	return true;
+}
+
+void TexturePrefetcher::prioritize(const std::string& setName)
+{
+	std::lock_guard lock(mtx);
+	auto it = sets.find(setName);
+	if (it != sets.end())
+		pool.prioritize(it->second->group);
+}
+
+uint64_t TexturePrefetcher::wait(const std::filesystem::path& path)
+{
+	std::shared_ptr<File> file;
+	{
+		std::lock_guard lock(mtx);
+		auto it = files.find(path.native());
+		if (it == files.end())
+			return 0; // never queued, or already read in
+
+		// Pool hasn't started on it yet, reading it ourselves is quicker than waiting for it to come up in the queue
+		int expected = Queued;
+		if (it->second->state.compare_exchange_strong(expected, Claimed) || expected == Claimed)
+		{
+			files.erase(it);
+			claimedCount++;
+			return 0;
+		}
+
+		file = it->second;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	try
+	{
+		file->ready.get();
+	}
+	catch (const std::exception& ex)
+	{
+		// Caller reads it like any file that was never queued
+		spdlog::warn("TexturePrefetcher: prefetching {} failed ({}), reading it directly", path.string(), ex.what());
+	}
+	catch (...)
+	{
+		spdlog::warn("TexturePrefetcher: prefetching {} failed, reading it directly", path.string());
+	}
+	return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+TexturePrefetcher::Stats TexturePrefetcher::stats() const
+{
+	return { queuedCount, prefetchedCount, claimedCount, failedCount };
+}
+
+void TexturePrefetcher::run(const std::filesystem::path& path, const std::shared_ptr<File>& file, const std::shared_ptr<Set>& set)
+{
+	int expected = Queued;
+	if (!file->state.compare_exchange_strong(expected, Reading))
+	{
+		finish(path, file, set); // game thread took it
+		return;
+	}
+
+	// Whatever the read does, the file has to be finished & its waiter woken, or the game thread would wait on it forever
+	std::exception_ptr error;
+	try
+	{
+		read(path);
+	}
+	catch (...)
+	{
+		error = std::current_exception();
+	}
+
+	// Nothing of ours can be touched after finish(), the destructor may be waiting on it
+	(error ? failedCount : prefetchedCount)++;
+	finish(path, file, set);
+	if (error)
+		file->done.set_exception(error);
+	else
+		file->done.set_value();
+}
+
+void TexturePrefetcher::finish(const std::filesystem::path& path, const std::shared_ptr<File>& file, const std::shared_ptr<Set>& set)
+{
+	std::lock_guard lock(mtx);
+
+	auto it = files.find(path.native());
+	if (it != files.end() && it->second == file)
+		files.erase(it);
+
+	if (--set->remaining == 0)
+	{
+		auto setIt = sets.find(set->name);
+		if (setIt != sets.end() && setIt->second == set)
+			sets.erase(setIt);
+	}
+
+	if (--pendingTasks == 0)
+		idle.notify_all();
+}
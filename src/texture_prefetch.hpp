@@ -0,0 +1,98 @@
+// Texture prefetch: when the game starts loading an xmtset, every file inside its load folder is queued on the pool
+// Each file gets its own readiness entry, HandleTexture only waits on the one it's about to use (and only if a pool
+// thread is already reading it, files nobody has started on yet are taken back & read on the game thread instead)
+// Any number of sets can be in flight at once, prioritize() just bumps the set being loaded to the front of the queue
+//
+// What "reading" a file means is up to the ReadFunc, hooks_textures.cpp maps it through FileDataCache & builds its mips.
+// A read that throws only loses the prefetch, the waiter is still woken & reads the file itself.
+// Destroying the prefetcher waits for its tasks still on the pool, so the pool has to outlive it or be destroyed first.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+class TexturePrefetcher
+{
+public:
+	using ReadFunc = std::function<void(const std::filesystem::path&)>;
+
+	TexturePrefetcher(WorkStealingPool& pool, ReadFunc read) : pool(pool), read(std::move(read)) {}
+	~TexturePrefetcher();
+
+	TexturePrefetcher(const TexturePrefetcher&) = delete;
+	TexturePrefetcher& operator=(const TexturePrefetcher&) = delete;
+
+	// Whether files of this set are still queued or being read from an earlier load
+	bool inFlight(const std::string& setName) const;
+
+	// Queues the files of a set, skipping any that are already in flight
+	// Returns false if nothing was queued (set still in flight, or no new files)
+	bool queue(const std::string& setName, std::vector<std::filesystem::path> files);
+
+	// Game is about to load this set, have the pool work on it before any others
+	void prioritize(const std::string& setName);
+
+	// Call before reading a file, returns once it's safe to read: straight away if no pool thread has started on it,
+	// otherwise after that thread is done. Returns how long it waited, in nanoseconds.
+	uint64_t wait(const std::filesystem::path& file);
+
+	struct Stats
+	{
+		uint64_t queued = 0;     // files queued in total
+		uint64_t prefetched = 0; // read by a pool thread
+		uint64_t claimed = 0;    // taken back by wait() before the pool got to them
+		uint64_t failed = 0;     // reads that threw
+	};
+	Stats stats() const;
+
+private:
+	enum State
+	{
+		Queued,
+		Reading,
+		Claimed, // wait() got to it before the pool did
+	};
+
+	struct File
+	{
+		std::atomic<int> state{ Queued };
+		std::promise<void> done;
+		std::shared_future<void> ready = done.get_future().share();
+	};
+
+	struct Set
+	{
+		std::string name;
+		uint32_t group;
+		int remaining = 0; // guarded by mtx
+	};
+
+	WorkStealingPool& pool;
+	ReadFunc read;
+
+	mutable std::mutex mtx;
+	std::condition_variable idle;
+	size_t pendingTasks = 0; // submitted to the pool & not finished yet
+	std::unordered_map<std::string, std::shared_ptr<Set>> sets; // keyed by xmtset filename stem
+	std::unordered_map<std::filesystem::path::string_type, std::shared_ptr<File>> files; // files still queued or being read
+
+	std::atomic<uint64_t> queuedCount{ 0 };
+	std::atomic<uint64_t> prefetchedCount{ 0 };
+	std::atomic<uint64_t> claimedCount{ 0 };
+	std::atomic<uint64_t> failedCount{ 0 };
+
+	void run(const std::filesystem::path& path, const std::shared_ptr<File>& file, const std::shared_ptr<Set>& set);
+	void finish(const std::filesystem::path& path, const std::shared_ptr<File>& file, const std::shared_ptr<Set>& set);
+};
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#include <json/json.h>
+#include <spdlog/spdlog.h>
+
+#include "texture_profiler.hpp"
+
+const char* TextureLoadProfiler::PhaseName(int phase)
+{
+	static const char* names[PhaseCount] = { "read", "hash", "probe", "wait", "convert", "create" };
+	return (phase >= 0 && phase < PhaseCount) ? names[phase] : "unknown";
+}
+
+uint64_t TextureLoadProfiler::Sample::total() const
+{
+	uint64_t sum = 0;
+	for (int i = 0; i < PhaseCount; i++)
+		sum += nanoseconds[i];
+	return sum;
+}
+
+uint64_t TextureLoadProfiler::SetStats::total() const
+{
+	uint64_t sum = 0;
+	for (int i = 0; i < PhaseCount; i++)
+		sum += nanoseconds[i];
+	return sum;
+}
+
+void TextureLoadProfiler::begin(std::string_view set, std::string name)
+{
+	commit();
+
+	currentSet = set;
+
+	current = Sample{};
+	current.name = std::move(name);
+	inProgress = true;
+}
+
+void TextureLoadProfiler::add(Phase phase, uint64_t nanoseconds)
+{
+	if (inProgress && phase < PhaseCount)
+		current.nanoseconds[phase] += nanoseconds;
+}
+
+void TextureLoadProfiler::addBytes(uint64_t bytes)
+{
+	if (inProgress)
+		current.bytes += bytes;
+}
+
+void TextureLoadProfiler::commit()
+{
+	if (!inProgress)
+		return;
+
+	inProgress = false;
+
+	std::lock_guard lock(mtx);
+
+	auto& set = sets[currentSet];
+	if (set.name.empty())
+		set.name = currentSet;
+
+	set.textures++;
+	set.bytes += current.bytes;
+	for (int i = 0; i < PhaseCount; i++)
+		set.nanoseconds[i] += current.nanoseconds[i];
+
+	if (topCount == 0)
+		return;
+
+	// Keep the slowest few, sorted so the fastest of them is the one to drop
+	uint64_t total = current.total();
+	if (set.slowest.size() >= topCount && set.slowest.back().total() >= total)
+		return;
+
+	auto pos = std::find_if(set.slowest.begin(), set.slowest.end(), [total](const Sample& s) { return s.total() < total; });
+	set.slowest.insert(pos, std::move(current));
+	if (set.slowest.size() > topCount)
+		set.slowest.pop_back();
+}
+
+std::vector<TextureLoadProfiler::SetStats> TextureLoadProfiler::snapshot() const
+{
+	std::vector<SetStats> result;
+	{
+		std::lock_guard lock(mtx);
+		result.reserve(sets.size());
+		for (const auto& [name, set] : sets)
+			result.push_back(set);
+	}
+
+	std::sort(result.begin(), result.end(), [](const SetStats& a, const SetStats& b) {
+		uint64_t totalA = a.total(), totalB = b.total();
+		return totalA != totalB ? totalA > totalB : a.name < b.name;
+	});
+	return result;
+}
+
+void TextureLoadProfiler::reset()
+{
+	std::lock_guard lock(mtx);
+	sets.clear();
+}
+
+static double Milliseconds(uint64_t nanoseconds)
+{
+	return double(nanoseconds) / 1000000.0;
+}
+
+bool TextureLoadProfiler::writeJson(const std::filesystem::path& path) const
+{
+	Json::Value root(Json::arrayValue);
+	for (const auto& set : snapshot())
+	{
+		Json::Value entry;
+		entry["set"] = set.name;
+		entry["textures"] = Json::UInt64(set.textures);
+		entry["bytes"] = Json::UInt64(set.bytes);
+		entry["totalMs"] = Milliseconds(set.total());
+		for (int i = 0; i < PhaseCount; i++)
+			entry["phasesMs"][PhaseName(i)] = Milliseconds(set.nanoseconds[i]);
+
+		Json::Value& slowest = entry["slowest"] = Json::Value(Json::arrayValue);
+		for (const auto& sample : set.slowest)
+		{
+			Json::Value file;
+			file["name"] = sample.name;
+			file["bytes"] = Json::UInt64(sample.bytes);
+			file["totalMs"] = Milliseconds(sample.total());
+			for (int i = 0; i < PhaseCount; i++)
+				file["phasesMs"][PhaseName(i)] = Milliseconds(sample.nanoseconds[i]);
+			slowest.append(file);
+		}
+
+		root.append(entry);
+	}
+
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		spdlog::error("TextureLoadProfiler: failed to write profile to {}", path.string());
+		return false;
+	}
+
+	Json::StreamWriterBuilder writer;
+	writer["indentation"] = "\t";
+	file << Json::writeString(writer, root) << '\n';
+	return true;
+}
+
+// One row per package with an empty file column, followed by a row for each of its slowest textures
+bool TextureLoadProfiler::writeCsv(const std::filesystem::path& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		spdlog::error("TextureLoadProfiler: failed to write profile to {}", path.string());
+		return false;
+	}
+
+	file << std::fixed << std::setprecision(3) << "set,file,textures,bytes";
+	for (int i = 0; i < PhaseCount; i++)
+		file << ',' << PhaseName(i) << "_ms";
+	file << ",total_ms\n";
+
+	auto writeRow = [&file](const std::string& set, const std::string& name, uint64_t textures, uint64_t bytes, const uint64_t* nanoseconds, uint64_t total) {
+		file << set << ',' << name << ',' << textures << ',' << bytes;
+		for (int i = 0; i < PhaseCount; i++)
+			file << ',' << Milliseconds(nanoseconds[i]);
+		file << ',' << Milliseconds(total) << '\n';
+	};
+
+	for (const auto& set : snapshot())
+	{
+		writeRow(set.name, "", set.textures, set.bytes, set.nanoseconds, set.total());
+		for (const auto& sample : set.slowest)
+			writeRow(set.name, sample.name, 1, sample.bytes, sample.nanoseconds, sample.total());
+	}
+
+	return true;
+}
@@ -0,0 +1,113 @@
+// Per-xmtset texture load profiler
+// Breaks the time spent on each texture the game loads into phases, & adds them up per texture package so a stuttery stage
+// load can be traced back to disk reads, hashing, conversion etc. The slowest few textures of each package are kept too.
+//
+// The loading thread calls begin() as each texture starts, adds to its phases (directly or through Scope) & then commit().
+// Everything else can be called from any thread.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class TextureLoadProfiler
+{
+public:
+	enum Phase
+	{
+		Read,    // fetching the replacement, from the cache or a texture pack
+		Hash,    // hashing the game texture & replacement
+		Probe,   // looking the replacement up
+		Wait,    // waiting on a prefetch thread that was already reading the file
+		Convert, // pixel conversion, copying into the texture & mip generation
+		Create,  // creating the D3D texture (everything, when using the games own allocator)
+		PhaseCount
+	};
+
+	static const char* PhaseName(int phase);
+
+	struct Sample
+	{
+		std::string name;
+		uint64_t bytes = 0;
+		uint64_t nanoseconds[PhaseCount] = {};
+
+		uint64_t total() const;
+	};
+
+	struct SetStats
+	{
+		std::string name;
+		uint64_t textures = 0;
+		uint64_t bytes = 0;
+		uint64_t nanoseconds[PhaseCount] = {};
+		std::vector<Sample> slowest; // slowest first, at most topCount
+
+		uint64_t total() const;
+	};
+
+	// Adds the time until it goes out of scope to a phase of the texture being loaded
+	class Scope
+	{
+	public:
+		Scope(TextureLoadProfiler& profiler, Phase phase) : profiler(profiler), phase(phase)
+		{
+			if (profiler.active())
+				start = std::chrono::steady_clock::now();
+		}
+		~Scope()
+		{
+			if (profiler.active() && start != std::chrono::steady_clock::time_point{})
+				profiler.add(phase, Since(start));
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		TextureLoadProfiler& profiler;
+		Phase phase;
+		std::chrono::steady_clock::time_point start{};
+	};
+
+	explicit TextureLoadProfiler(size_t topCount = 10) : topCount(topCount) {}
+
+	static uint64_t Since(std::chrono::steady_clock::time_point start)
+	{
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	// Commits any texture still in progress first
+	void begin(std::string_view set, std::string name);
+
+	// Both do nothing when there's no texture in progress, so timers can be left in code paths that aren't always profiled
+	void add(Phase phase, uint64_t nanoseconds);
+	void addBytes(uint64_t bytes);
+
+	void commit();
+	bool active() const { return inProgress; }
+
+	// Sorted by total time, slowest package first
+	std::vector<SetStats> snapshot() const;
+	void reset();
+
+	bool writeJson(const std::filesystem::path& path) const;
+	bool writeCsv(const std::filesystem::path& path) const;
+
+private:
+	size_t topCount;
+
+	// Only touched by the loading thread
+	bool inProgress = false;
+	std::string currentSet;
+	Sample current;
+
+	mutable std::mutex mtx;
+	std::unordered_map<std::string, SetStats> sets;
+};
@@ -0,0 +1,100 @@
+// Shares GPU textures between every load of the same replacement texture
+// Several xmtsets (or several indices inside one) often point at the same replacement file, without this each of them
+// gets its own copy in the managed pool, each with its own system memory backing.
+//
+// Keyed by a hash of the replacement's contents & the parameters it gets created with. The registry doesn't hold a
+// reference itself: every caller gets its own AddRef & the texture goes away once the game has released all of them.
+// Whoever creates the texture has to call remove() when it's destroyed (on D3D9 we attach a sentinel via SetPrivateData).
+//
+// Templated on the texture type so the bookkeeping can be used without D3D, anything with AddRef() works.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include <xxhash.h>
+
+// Everything the game passes to D3DXCreateTextureFromFileInMemoryEx that changes the texture it gets back,
+// two loads of the same replacement only share a texture if all of them match
+struct SharedTextureParams
+{
+	uint64_t contentKey; // hash of the replacement file's contents
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevels;
+	uint32_t usage;
+	uint32_t format;
+	uint32_t pool;
+	uint32_t filter;
+	uint32_t mipFilter;
+	uint32_t colorKey;
+
+	uint64_t key() const
+	{
+		uint64_t values[] = { contentKey, width, height, mipLevels, usage, format, pool, filter, mipFilter, colorKey };
+		return XXH64(values, sizeof(values), 0);
+	}
+};
+
+template <typename Texture>
+class SharedTextureRegistry
+{
+public:
+	struct Stats
+	{
+		size_t liveTextures = 0;  // textures currently registered
+		uint64_t sharedLoads = 0; // loads that were handed an existing texture
+		uint64_t bytesSaved = 0;  // texture data those loads didn't have to upload
+	};
+
+	// Returns the texture registered for key with an extra reference added, or nullptr if there isn't one
+	Texture* acquire(uint64_t key)
+	{
+		std::lock_guard lock(mtx);
+		auto it = textures.find(key);
+		if (it == textures.end())
+			return nullptr;
+
+		it->second.texture->AddRef();
+		sharedLoads++;
+		bytesSaved += it->second.bytes;
+		return it->second.texture;
+	}
+
+	// Registers a newly created texture, size is only used for stats
+	void insert(uint64_t key, Texture* texture, size_t bytes)
+	{
+		std::lock_guard lock(mtx);
+		textures[key] = { texture, bytes };
+	}
+
+	// Texture was destroyed, only removes the entry if it still belongs to that texture
+	void remove(uint64_t key, const Texture* texture)
+	{
+		std::lock_guard lock(mtx);
+		auto it = textures.find(key);
+		if (it != textures.end() && it->second.texture == texture)
+			textures.erase(it);
+	}
+
+	Stats stats() const
+	{
+		std::lock_guard lock(mtx);
+		return { textures.size(), sharedLoads, bytesSaved };
+	}
+
+private:
+	struct Entry
+	{
+		Texture* texture;
+		size_t bytes;
+	};
+
+	mutable std::mutex mtx;
+	std::unordered_map<uint64_t, Entry> textures;
+	uint64_t sharedLoads = 0;
+	uint64_t bytesSaved = 0;
+};
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <bit>
+
+#include "texture_resolver.hpp"
+
+size_t TextureResolver::Mix(uint64_t value)
+{
+	// splitmix64 finalizer
+	value ^= value >> 30;
+	value *= 0xBF58476D1CE4E5B9ull;
+	value ^= value >> 27;
+	value *= 0x94D049BB133111EBull;
+	value ^= value >> 31;
+	return size_t(value);
+}
+
+size_t TextureResolver::HashKey(const TexPack::TextureKey& key)
+{
+	uint64_t a = (uint64_t(key.hash) << 32) | key.setHash;
+	uint64_t b = (uint64_t(key.padHash) << 32) | (uint64_t(key.width) << 16) | key.height;
+	return Mix(a ^ Mix(b ^ uint32_t(key.index)));
+}
+
+void TextureResolver::build(const std::filesystem::path& loadPath, const std::vector<std::filesystem::path>& looseFiles,
+	const std::vector<std::unique_ptr<TexPack::TexturePack>>& packs)
+{
+	std::vector<std::pair<TexPack::TextureKey, Source>> found;
+	found.reserve(looseFiles.size());
+
+	for (const auto& path : looseFiles)
+	{
+		TexPack::TextureKey key;
+		if (!TexPack::ParseReplacementPath(path.lexically_relative(loadPath), &key))
+			continue;
+
+		found.push_back({ key, Source{ path, nullptr, nullptr } });
+	}
+
+	for (const auto& pack : packs)
+	{
+		for (uint32_t i = 0; i < pack->entryCount(); i++)
+		{
+			const TexPack::TexPackEntry& entry = pack->entries()[i];
+			TexPack::TextureKey key = { entry.hash, entry.setHash, entry.padHash, entry.width, entry.height, entry.index };
+			found.push_back({ key, Source{ {}, pack.get(), &entry } });
+		}
+	}
+
+	size_t capacity = std::bit_ceil(std::max<size_t>(found.size() * 2, 16));
+	slots.assign(capacity, Slot{});
+	presence.assign(capacity, 0);
+	sources.clear();
+	sources.reserve(found.size());
+
+	// Insertion order gives the priority, loose files first & then packs in the order they were opened
+	for (auto& [key, source] : found)
+		insert(key, std::move(source));
+}
+
+bool TextureResolver::insert(const TexPack::TextureKey& key, Source&& source)
+{
+	size_t mask = slots.size() - 1;
+	for (size_t i = HashKey(key) & mask;; i = (i + 1) & mask)
+	{
+		if (slots[i].source == 0)
+		{
+			sources.push_back(std::move(source));
+			slots[i] = { key, uint32_t(sources.size()) };
+			break;
+		}
+		if (slots[i].key == key)
+			return false;
+	}
+
+	uint64_t presenceKey = PresenceKey(key.hash, key.width, key.height);
+	for (size_t i = Mix(presenceKey) & mask;; i = (i + 1) & mask)
+	{
+		if (presence[i] == presenceKey)
+			break;
+		if (presence[i] == 0)
+		{
+			presence[i] = presenceKey;
+			break;
+		}
+	}
+	return true;
+}
+
+bool TextureResolver::hasPresence(uint64_t key) const
+{
+	if (presence.empty())
+		return false;
+
+	size_t mask = presence.size() - 1;
+	for (size_t i = Mix(key) & mask;; i = (i + 1) & mask)
+	{
+		if (presence[i] == key)
+			return true;
+		if (presence[i] == 0)
+			return false;
+	}
+}
+
+const TextureResolver::Source* TextureResolver::findExact(const TexPack::TextureKey& key) const
+{
+	size_t mask = slots.size() - 1;
+	for (size_t i = HashKey(key) & mask;; i = (i + 1) & mask)
+	{
+		if (slots[i].source == 0)
+			return nullptr;
+		if (slots[i].key == key)
+			return &sources[slots[i].source - 1];
+	}
+}
+
+const TextureResolver::Source* TextureResolver::find(uint32_t hash, int width, int height, int index, uint32_t setHash, uint32_t padHash) const
+{
+	if (!hasPresence(PresenceKey(hash, width, height)))
+		return nullptr;
+
+	// xmtset/padtype/ & padtype/xmtset/ are the same tier, but the old ladder tried every name in the first before the second
+	const struct
+	{
+		uint32_t set;
+		uint32_t pad;
+		bool padFirst;
+	} tiers[] = {
+		{ setHash, padHash, false },
+		{ setHash, padHash, true },
+		{ 0, padHash, false },
+		{ setHash, 0, false },
+		{ 0, 0, false },
+	};
+
+	for (size_t tier = padHash ? 0 : 3; tier < std::size(tiers); tier++)
+	{
+		auto [set, pad, padFirst] = tiers[tier];
+		TexPack::TextureKey key = { hash, set, pad, uint16_t(width), uint16_t(height), index, padFirst };
+		if (auto* source = findExact(key))
+			return source;
+
+		key.index = -1;
+		if (auto* source = findExact(key))
+			return source;
+	}
+
+	return nullptr;
+}
@@ -0,0 +1,57 @@
+// Maps texture keys straight to their replacement source (loose file or texture pack entry)
+// Built once after scanning the load folder, so HandleTexture doesn't need to build paths/filenames for every texture
+// it sees & probe the filesystem cache down the pad/xmtset/index ladder.
+//
+// Loose files win over pack entries with the same key, earlier packs win over later ones.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "texture_pack.hpp"
+
+class TextureResolver
+{
+public:
+	struct Source
+	{
+		std::filesystem::path file; // loose file, empty if this comes from a pack
+		const TexPack::TexturePack* pack = nullptr;
+		const TexPack::TexPackEntry* entry = nullptr;
+	};
+
+	void build(const std::filesystem::path& loadPath, const std::vector<std::filesystem::path>& looseFiles,
+		const std::vector<std::unique_ptr<TexPack::TexturePack>>& packs);
+
+	// Same precedence as the old loose-file ladder: set + pad, pad, set, then global, with indexed names preferred at each step
+	const Source* find(uint32_t hash, int width, int height, int index, uint32_t setHash, uint32_t padHash) const;
+
+	size_t size() const { return sources.size(); }
+
+private:
+	// Open addressing with linear probing, sized to stay under 50% load
+	struct Slot
+	{
+		TexPack::TextureKey key;
+		uint32_t source; // index + 1 into sources, 0 = empty slot
+	};
+
+	std::vector<Slot> slots;
+	std::vector<uint64_t> presence; // (hash, width, height) of every key, lets textures without replacements bail after one probe
+	std::vector<Source> sources;
+
+	static uint64_t PresenceKey(uint32_t hash, uint32_t width, uint32_t height)
+	{
+		return (uint64_t(hash) << 32) | (uint64_t(width & 0xFFFF) << 16) | (height & 0xFFFF);
+	}
+
+	static size_t Mix(uint64_t value);
+	static size_t HashKey(const TexPack::TextureKey& key);
+
+	bool insert(const TexPack::TextureKey& key, Source&& source);
+	const Source* findExact(const TexPack::TextureKey& key) const;
+	bool hasPresence(uint64_t key) const;
+};
@@ -0,0 +1,171 @@
+#include <algorithm>
+
+#include "thread_pool.hpp"
+
+WorkStealingPool::WorkStealingPool(int numThreads)
+{
+	numThreads = std::max(numThreads, 1);
+
+	for (int i = 0; i < numThreads; i++)
+		workers.emplace_back(std::make_unique<Worker>());
+
+	// Start threads only after every worker exists, since they'll try stealing from each other straight away
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i]->thread = std::thread(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard lock(wakeMtx);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers)
+		if (worker->thread.joinable())
+			worker->thread.join();
+}
+
+void WorkStealingPool::submit(Task task, uint32_t group)
+{
+	if (group != 0 && group == urgentGroup)
+	{
+		std::lock_guard lock(urgentMtx);
+		urgentJobs.push_back({ std::move(task), group });
+	}
+	else
+	{
+		auto& worker = *workers[nextWorker++ % workers.size()];
+		std::lock_guard lock(worker.mtx);
+		worker.jobs.push_back({ std::move(task), group });
+	}
+
+	{
+		std::lock_guard lock(wakeMtx);
+		queued++;
+	}
+	wake.notify_one();
+}
+
+void WorkStealingPool::prioritize(uint32_t group)
+{
+	if (group == 0 || urgentGroup.exchange(group) == group)
+		return;
+
+	std::lock_guard urgentLock(urgentMtx);
+	for (auto& worker : workers)
+	{
+		std::lock_guard lock(worker->mtx);
+		auto it = std::stable_partition(worker->jobs.begin(), worker->jobs.end(),
+			[group](const Job& job) { return job.group != group; });
+
+		std::move(it, worker->jobs.end(), std::back_inserter(urgentJobs));
+		worker->jobs.erase(it, worker->jobs.end());
+	}
+}
+
+void WorkStealingPool::parallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+	if (count == 0)
+		return;
+
+	struct Batch
+	{
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+		size_t count = 0;
+		const std::function<void(size_t)>* func = nullptr;
+		std::mutex mtx;
+		std::condition_variable finished;
+
+		void run()
+		{
+			size_t i;
+			while ((i = next++) < count)
+			{
+				(*func)(i);
+				if (++done == count)
+				{
+					std::lock_guard lock(mtx);
+					finished.notify_all();
+				}
+			}
+		}
+	};
+
+	// Helpers that only get to run after everything's done just find no items left, they never touch func
+	auto batch = std::make_shared<Batch>();
+	batch->count = count;
+	batch->func = &func;
+
+	size_t helpers = std::min(count - 1, workers.size());
+	for (size_t i = 0; i < helpers; i++)
+		submit([batch]() { batch->run(); });
+
+	batch->run();
+
+	std::unique_lock lock(batch->mtx);
+	batch->finished.wait(lock, [&] { return batch->done == count; });
+}
+
+bool WorkStealingPool::popUrgent(Job& job)
+{
+	std::lock_guard lock(urgentMtx);
+	if (urgentJobs.empty())
+		return false;
+
+	job = std::move(urgentJobs.front());
+	urgentJobs.pop_front();
+	return true;
+}
+
+bool WorkStealingPool::popLocal(size_t index, Job& job)
+{
+	auto& worker = *workers[index];
+	std::lock_guard lock(worker.mtx);
+	if (worker.jobs.empty())
+		return false;
+
+	job = std::move(worker.jobs.front());
+	worker.jobs.pop_front();
+	return true;
+}
+
+bool WorkStealingPool::steal(size_t index, Job& job)
+{
+	// Steal from the back, so the owner keeps working through its queue in submission order
+	for (size_t i = 1; i < workers.size(); i++)
+	{
+		auto& victim = *workers[(index + i) % workers.size()];
+		std::unique_lock lock(victim.mtx, std::try_to_lock);
+		if (!lock || victim.jobs.empty())
+			continue;
+
+		job = std::move(victim.jobs.back());
+		victim.jobs.pop_back();
+		return true;
+	}
+	return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index)
+{
+	while (true)
+	{
+		Job job;
+		if (popUrgent(job) || popLocal(index, job) || steal(index, job))
+		{
+			queued--;
+			job.task();
+			continue;
+		}
+
+		std::unique_lock lock(wakeMtx);
+		if (stopping)
+			return;
+
+		// steal() skips queues that are locked, so wake up now & then in case a job was missed
+		wake.wait_for(lock, std::chrono::milliseconds(10), [this] { return stopping || queued > 0; });
+	}
+}
@@ -0,0 +1,72 @@
+// Fixed-size thread pool with per-worker work-stealing queues
+// Tasks are spread round-robin over the worker queues, idle workers steal from the others.
+// Each task carries a group ID (eg. the xmtset it belongs to), prioritize() moves every queued
+// task of that group into a shared urgent queue which all workers check first.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+public:
+	using Task = std::function<void()>;
+
+	explicit WorkStealingPool(int numThreads);
+	~WorkStealingPool();
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	void submit(Task task, uint32_t group = 0);
+
+	// Moves queued tasks of the group ahead of everything else, new tasks for it will also skip the worker queues
+	void prioritize(uint32_t group);
+
+	// Runs func(0..count-1) spread over the pool & the calling thread, returns once all of them finished
+	// The caller works through the items too, so this is safe to call from inside a pool task
+	void parallelFor(size_t count, const std::function<void(size_t)>& func);
+
+	int threadCount() const { return int(workers.size()); }
+	int queuedCount() const { return queued; }
+
+private:
+	struct Job
+	{
+		Task task;
+		uint32_t group;
+	};
+
+	struct Worker
+	{
+		std::mutex mtx;
+		std::deque<Job> jobs;
+		std::thread thread;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	std::mutex urgentMtx;
+	std::deque<Job> urgentJobs;
+	std::atomic<uint32_t> urgentGroup{ 0 };
+
+	std::mutex wakeMtx;
+	std::condition_variable wake;
+	std::atomic<int> queued{ 0 };
+	std::atomic<uint32_t> nextWorker{ 0 };
+	bool stopping = false;
+
+	bool popUrgent(Job& job);
+	bool popLocal(size_t index, Job& job);
+	bool steal(size_t index, Job& job);
+	void workerLoop(size_t index);
+};
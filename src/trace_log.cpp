@@ -0,0 +1,355 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "trace_log.hpp"
+
+namespace TraceLog
+{
+	constexpr size_t RingSize = 256 * 1024; // per thread, must be a power of two
+	constexpr size_t EventAlign = 4;
+	constexpr int DrainIntervalMs = 50;
+	constexpr int ShutdownTimeoutMs = 500; // how long Shutdown waits for the writer thread's last drain
+
+	// Single-producer single-consumer ring, written only by the owning thread & drained by the writer thread
+	// head/tail are free-running byte counters, masked with RingSize to find the position inside data
+	struct ThreadRing
+	{
+		uint32_t threadId = 0;
+		std::unique_ptr<uint8_t[]> data;
+		std::atomic<size_t> head{ 0 };
+		std::atomic<size_t> tail{ 0 };
+		size_t pendingHead = 0;          // producer-only, head after the event being written
+		std::atomic<uint32_t> dropped{ 0 };
+	};
+
+	struct PendingFormat
+	{
+		uint32_t id;
+		const char* format;
+		const char* types;
+	};
+
+	static std::mutex registryMutex;
+	static std::vector<std::unique_ptr<ThreadRing>> rings;
+	static std::vector<PendingFormat> formats; // every format registered so far, written again to each new file
+	static size_t formatsWritten = 0;
+
+	static std::mutex writerMutex; // held while draining, so Shutdown can't race the writer thread
+	static std::ofstream file;
+	static std::thread writerThread;
+	static std::condition_variable writerWake;
+	static std::mutex writerWakeMutex;
+	static std::atomic<bool> writerRunning{ false };
+	static bool writerExited = false; // guarded by writerWakeMutex
+
+	static thread_local ThreadRing* currentRing = nullptr;
+
+#ifdef _WIN32
+	static uint64_t Timestamp()
+	{
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return counter.QuadPart;
+	}
+
+	static uint64_t TimestampFrequency()
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return frequency.QuadPart;
+	}
+
+	static uint32_t ThreadId()
+	{
+		return GetCurrentThreadId();
+	}
+#else
+	// Only for the tests, which run the logger outside of Windows
+	static uint64_t Timestamp()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static uint64_t TimestampFrequency()
+	{
+		return 1000000000;
+	}
+
+	static uint32_t ThreadId()
+	{
+		static std::atomic<uint32_t> nextId{ 1 };
+		return nextId++;
+	}
+#endif
+
+	static ThreadRing* CreateRing()
+	{
+		auto ring = std::make_unique<ThreadRing>();
+		ring->threadId = ThreadId();
+		ring->data = std::make_unique<uint8_t[]>(RingSize);
+
+		std::lock_guard lock(registryMutex);
+		rings.emplace_back(std::move(ring));
+		return rings.back().get();
+	}
+
+	void RegisterFormat(uint32_t id, const char* format, const char* types)
+	{
+		std::lock_guard lock(registryMutex);
+		formats.push_back({ id, format, types });
+	}
+
+	uint8_t* BeginEvent(uint32_t id, size_t argBytes)
+	{
+		ThreadRing* ring = currentRing;
+		if (!ring) [[unlikely]]
+			ring = currentRing = CreateRing();
+
+		size_t needed = (sizeof(EventHeader) + argBytes + (EventAlign - 1)) & ~(EventAlign - 1);
+		size_t head = ring->head.load(std::memory_order_relaxed);
+		size_t tail = ring->tail.load(std::memory_order_acquire);
+
+		size_t pos = head & (RingSize - 1);
+		size_t toEnd = RingSize - pos;
+
+		// Events are never split across the end of the ring, skip the remaining bytes instead
+		size_t total = (toEnd < needed) ? toEnd + needed : needed;
+		if (RingSize - (head - tail) < total)
+		{
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		if (toEnd < needed)
+		{
+			// Wrap marker (id 0), the reader also skips to the start if there's no room for a header
+			if (toEnd >= sizeof(uint32_t))
+				memset(ring->data.get() + pos, 0, sizeof(uint32_t));
+			head += toEnd;
+			pos = 0;
+		}
+
+		EventHeader* header = reinterpret_cast<EventHeader*>(ring->data.get() + pos);
+		header->id = id;
+		header->argBytes = uint16_t(argBytes);
+		header->reserved = 0;
+		header->timestamp = Timestamp();
+
+		ring->pendingHead = head + needed;
+		return ring->data.get() + pos + sizeof(EventHeader);
+	}
+
+	void EndEvent()
+	{
+		ThreadRing* ring = currentRing;
+		ring->head.store(ring->pendingHead, std::memory_order_release);
+	}
+
+	template <typename T>
+	static void WriteValue(std::vector<uint8_t>& out, const T& value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		out.insert(out.end(), bytes, bytes + sizeof(T));
+	}
+
+	static void DrainRing(ThreadRing& ring, std::vector<uint8_t>& staging)
+	{
+		size_t tail = ring.tail.load(std::memory_order_relaxed);
+		size_t head = ring.head.load(std::memory_order_acquire);
+		if (tail == head)
+			return;
+
+		staging.clear();
+		WriteValue(staging, uint8_t(Record_Events));
+		WriteValue(staging, ring.threadId);
+		WriteValue(staging, uint32_t(0)); // byte count, filled in below
+		size_t eventsStart = staging.size();
+
+		while (tail != head)
+		{
+			size_t pos = tail & (RingSize - 1);
+			size_t toEnd = RingSize - pos;
+			if (toEnd < sizeof(EventHeader))
+			{
+				tail += toEnd;
+				continue;
+			}
+
+			const EventHeader* header = reinterpret_cast<const EventHeader*>(ring.data.get() + pos);
+			if (header->id == 0)
+			{
+				tail += toEnd;
+				continue;
+			}
+
+			const uint8_t* eventData = ring.data.get() + pos;
+			size_t eventSize = sizeof(EventHeader) + header->argBytes;
+			staging.insert(staging.end(), eventData, eventData + eventSize);
+
+			tail += (eventSize + (EventAlign - 1)) & ~(EventAlign - 1);
+		}
+
+		ring.tail.store(tail, std::memory_order_release);
+
+		uint32_t byteCount = uint32_t(staging.size() - eventsStart);
+		memcpy(staging.data() + eventsStart - sizeof(uint32_t), &byteCount, sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(staging.data()), staging.size());
+	}
+
+	// Shutdown passes blocking = false if the writer didn't stop cleanly, since a thread killed during process exit may still own one of the locks
+	static void Drain(bool blocking = true)
+	{
+		std::unique_lock writerLock(writerMutex, std::defer_lock);
+		if (blocking)
+			writerLock.lock();
+		else if (!writerLock.try_lock())
+			return;
+
+		if (!file.is_open())
+			return;
+
+		static std::vector<uint8_t> staging;
+
+		std::vector<ThreadRing*> ringsToDrain;
+		{
+			std::unique_lock lock(registryMutex, std::defer_lock);
+			if (blocking)
+				lock.lock();
+			else if (!lock.try_lock())
+				return;
+
+			// A call site can register & emit between this point and the ring drain below, so an events
+			// format record may end up after it in the file, tracedecode reads all formats up front
+			for (; formatsWritten < formats.size(); formatsWritten++)
+			{
+				const auto& fmt = formats[formatsWritten];
+				staging.clear();
+				uint16_t formatLen = uint16_t(strlen(fmt.format));
+				uint16_t typesLen = uint16_t(strlen(fmt.types));
+				WriteValue(staging, uint8_t(Record_Format));
+				WriteValue(staging, fmt.id);
+				WriteValue(staging, formatLen);
+				WriteValue(staging, typesLen);
+				staging.insert(staging.end(), fmt.format, fmt.format + formatLen);
+				staging.insert(staging.end(), fmt.types, fmt.types + typesLen);
+				file.write(reinterpret_cast<const char*>(staging.data()), staging.size());
+			}
+
+			for (const auto& ring : rings)
+				ringsToDrain.push_back(ring.get());
+		}
+
+		for (ThreadRing* ring : ringsToDrain)
+			DrainRing(*ring, staging);
+
+		file.flush();
+	}
+
+	static void WriterThread()
+	{
+		while (writerRunning)
+		{
+			{
+				std::unique_lock lock(writerWakeMutex);
+				writerWake.wait_for(lock, std::chrono::milliseconds(DrainIntervalMs));
+			}
+			Drain();
+		}
+
+		std::lock_guard lock(writerWakeMutex);
+		writerExited = true;
+		writerWake.notify_all();
+	}
+
+	void Init(const std::filesystem::path& path)
+	{
+		if (writerRunning)
+			return;
+
+		file.open(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			spdlog::error("TraceLog: failed to open {} for writing", path.string());
+			return;
+		}
+
+		uint64_t frequency = TimestampFrequency();
+		file.write(reinterpret_cast<const char*>(&FileMagic), sizeof(FileMagic));
+		file.write(reinterpret_cast<const char*>(&FileVersion), sizeof(FileVersion));
+		file.write(reinterpret_cast<const char*>(&frequency), sizeof(frequency));
+
+		{
+			// Call sites only register once, a new file needs all of them again
+			std::lock_guard lock(registryMutex);
+			formatsWritten = 0;
+		}
+
+		writerExited = false;
+		writerRunning = true;
+		writerThread = std::thread(WriterThread);
+		Enabled.store(true);
+
+		spdlog::info("TraceLog: writing binary trace to {}", path.string());
+	}
+
+	void Shutdown(bool processTerminating)
+	{
+		if (!writerRunning)
+			return;
+
+		Enabled.store(false);
+		writerRunning = false;
+
+		// When the process is terminating the OS has already killed the writer thread, possibly while it held one of
+		// our locks, so all that's left is to drain whatever we can without blocking.
+		// Otherwise let it finish its last drain, but only wait so long: if we're called from DllMain the loader lock is
+		// held, & the thread can't fully exit until we return.
+		bool exited = false;
+		if (!processTerminating)
+		{
+			std::unique_lock lock(writerWakeMutex);
+			writerWake.notify_all();
+			exited = writerWake.wait_for(lock, std::chrono::milliseconds(ShutdownTimeoutMs), [] { return writerExited; });
+		}
+
+		if (exited)
+		{
+#ifdef _WIN32
+			// Past our code already, only the loader lock can be holding it up
+			if (WaitForSingleObject(writerThread.native_handle(), 0) != WAIT_OBJECT_0)
+				writerThread.detach();
+			else
+#endif
+				writerThread.join();
+		}
+		else if (writerThread.joinable())
+		{
+			if (!processTerminating)
+				spdlog::warn("TraceLog: writer thread didn't stop within {}ms, leaving it behind", ShutdownTimeoutMs);
+			writerThread.detach();
+		}
+
+		Drain(exited);
+
+		uint32_t totalDropped = 0;
+		for (const auto& ring : rings)
+			totalDropped += ring->dropped.exchange(0);
+		if (totalDropped)
+			spdlog::warn("TraceLog: {} events dropped due to full ring buffers", totalDropped);
+
+		file.close();
+	}
+}
@@ -0,0 +1,176 @@
+// Binary trace logger for hot paths
+// spdlog formats text on the calling thread, which costs microseconds & allocations per call.
+// TRACE() instead pushes a format ID + the raw argument bytes into a per-thread ring buffer,
+// a background thread drains the rings into OutRun2006Tweaks.trace, and formatting only
+// happens offline via tools/tracedecode.
+//
+// Format IDs are computed at compile time from the format string and argument types, each
+// call site registers its format string once on first use so the decoder can look it up.
+// Format strings use the same {} / {:spec} syntax as spdlog.
+//
+// Supported argument types: integers, enums, bool, float, double, const char* (truncated to 255 chars)
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+#include <type_traits>
+
+namespace TraceLog
+{
+	constexpr uint32_t FileMagic = 0x5432524F; // "OR2T"
+	constexpr uint32_t FileVersion = 1;
+
+	enum RecordType : uint8_t
+	{
+		Record_Format = 1, // u32 id, u16 formatLen, u16 typesLen, format chars, type chars
+		Record_Events = 2, // u32 threadId, u32 byteCount, followed by byteCount bytes of events
+	};
+
+	// Header written before each events args
+	struct EventHeader
+	{
+		uint32_t id;
+		uint16_t argBytes;
+		uint16_t reserved;
+		uint64_t timestamp; // QueryPerformanceCounter ticks
+	};
+	static_assert(sizeof(EventHeader) == 16);
+
+	constexpr size_t MaxStringArg = 255;
+
+	constexpr uint32_t Hash(std::string_view str, uint32_t hash = 0x811C9DC5)
+	{
+		for (char c : str)
+		{
+			hash ^= uint8_t(c);
+			hash *= 0x01000193;
+		}
+		return hash;
+	}
+
+	// Type codes stored alongside each format string, used by the decoder to parse args
+	//  b = bool, i/u = 32-bit signed/unsigned, I/U = 64-bit signed/unsigned, f = float, d = double, s = string
+	template <typename T>
+	constexpr char TypeCode()
+	{
+		using U = std::remove_cvref_t<T>;
+		if constexpr (std::is_same_v<U, bool>)
+			return 'b';
+		else if constexpr (std::is_enum_v<U>)
+			return sizeof(U) > 4 ? 'I' : 'i';
+		else if constexpr (std::is_integral_v<U>)
+			return sizeof(U) > 4 ? (std::is_signed_v<U> ? 'I' : 'U') : (std::is_signed_v<U> ? 'i' : 'u');
+		else if constexpr (std::is_same_v<U, float>)
+			return 'f';
+		else if constexpr (std::is_same_v<U, double>)
+			return 'd';
+		else if constexpr (std::is_same_v<std::decay_t<U>, const char*> || std::is_same_v<std::decay_t<U>, char*>)
+			return 's';
+		else
+			static_assert(sizeof(U) == 0, "TRACE: unsupported argument type");
+	}
+
+	template <typename... Args>
+	struct TypeSignature
+	{
+		static constexpr char value[] = { TypeCode<Args>()..., '\0' };
+	};
+
+	template <typename T>
+	inline size_t ArgSize(const T& arg)
+	{
+		constexpr char code = TypeCode<T>();
+		if constexpr (code == 'b')
+			return 1;
+		else if constexpr (code == 'i' || code == 'u' || code == 'f')
+			return 4;
+		else if constexpr (code == 's')
+		{
+			const char* str = arg; // also decays string literals
+			return 1 + (str ? std::min(strlen(str), MaxStringArg) : 0);
+		}
+		else
+			return 8;
+	}
+
+	template <typename T>
+	inline uint8_t* PackArg(uint8_t* out, const T& arg)
+	{
+		constexpr char code = TypeCode<T>();
+		if constexpr (code == 'b')
+		{
+			*out = arg ? 1 : 0;
+			return out + 1;
+		}
+		else if constexpr (code == 'i' || code == 'u')
+		{
+			uint32_t value = uint32_t(arg);
+			memcpy(out, &value, 4);
+			return out + 4;
+		}
+		else if constexpr (code == 'I' || code == 'U')
+		{
+			uint64_t value = uint64_t(arg);
+			memcpy(out, &value, 8);
+			return out + 8;
+		}
+		else if constexpr (code == 'f' || code == 'd')
+		{
+			memcpy(out, &arg, sizeof(arg));
+			return out + sizeof(arg);
+		}
+		else
+		{
+			const char* str = arg;
+			size_t len = str ? std::min(strlen(str), MaxStringArg) : 0;
+			*out = uint8_t(len);
+			if (len)
+				memcpy(out + 1, str, len);
+			return out + 1 + len;
+		}
+	}
+
+	// Runtime toggle, set by Init when the file opens
+	// Checked by every TRACE from any thread, relaxed loads are enough since events only need to stop eventually after Shutdown
+	inline std::atomic<bool> Enabled = false;
+
+	void Init(const std::filesystem::path& path); // opens the trace file & starts the writer thread
+	// Stops the writer thread & drains any pending events on the calling thread before closing the file
+	// processTerminating is for DLL_PROCESS_DETACH at process exit, where the writer thread is already gone
+	void Shutdown(bool processTerminating = false);
+	void RegisterFormat(uint32_t id, const char* format, const char* types);
+
+	// Reserves space in the calling threads ring buffer, returns nullptr if the ring is full (event gets dropped)
+	uint8_t* BeginEvent(uint32_t id, size_t argBytes);
+	void EndEvent();
+
+	template <uint32_t FormatHash, typename... Args>
+	inline void Emit(const char* format, const Args&... args)
+	{
+		// ID 0 is reserved for ring buffer wrap markers
+		constexpr uint32_t id = Hash(TypeSignature<Args...>::value, FormatHash) | 1;
+
+		// Magic static, only takes the registration lock the first time this call site runs
+		static const bool registered = (RegisterFormat(id, format, TypeSignature<Args...>::value), true);
+		(void)registered;
+
+		size_t argBytes = (size_t(0) + ... + ArgSize(args));
+		uint8_t* out = BeginEvent(id, argBytes);
+		if (!out)
+			return;
+
+		((out = PackArg(out, args)), ...);
+		EndEvent();
+	}
+}
+
+#define TRACE(format, ...) \
+	do { \
+		if (TraceLog::Enabled.load(std::memory_order_relaxed)) \
+			TraceLog::Emit<TraceLog::Hash(format)>(format, ##__VA_ARGS__); \
+	} while (0)
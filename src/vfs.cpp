@@ -0,0 +1,909 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "mapped_file.hpp"
+#include "vfs.hpp"
+
+namespace
+{
+	// Key of the directory relative paths are resolved against, read on first use & whenever something is mounted
+	// (before ModFiles, so it's still around while ModFiles shuts its watchers down)
+	std::shared_mutex WorkingDirectoryMutex;
+	std::string WorkingDirectoryKey;
+}
+
+VirtualFileSystem ModFiles;
+
+namespace
+{
+	constexpr uint32_t ManifestMagic = 0x4D534656; // "VFSM"
+	constexpr uint32_t ManifestVersion = 2;
+
+	std::string ToUtf8(const std::filesystem::path& path)
+	{
+		auto str = path.generic_u8string();
+		return std::string(str.begin(), str.end());
+	}
+
+	std::filesystem::path FromUtf8(const std::string& str)
+	{
+		return std::filesystem::path(std::u8string(str.begin(), str.end()));
+	}
+
+	// Windows paths are case-insensitive, ASCII folding covers every name the game & mods actually use
+	std::string Fold(std::string str)
+	{
+#ifdef _WIN32
+		for (auto& c : str)
+			if (c >= 'A' && c <= 'Z')
+				c = c - 'A' + 'a';
+#endif
+		return str;
+	}
+
+	std::string ParentKey(const std::string& key)
+	{
+		auto pos = key.rfind('/');
+		return pos == std::string::npos ? std::string() : key.substr(0, pos);
+	}
+
+	int64_t WriteTime(const std::filesystem::file_time_type& time)
+	{
+		return int64_t(time.time_since_epoch().count());
+	}
+}
+
+struct VirtualFileSystem::Listing
+{
+	struct Child
+	{
+		std::string name; // UTF-8
+		uint64_t size = 0;
+		int64_t writeTime = 0;
+		bool directory = false;
+		bool stamped = false; // size & writeTime were read, rather than the child coming from the manifest
+	};
+
+	struct Directory
+	{
+		int64_t writeTime;
+		std::vector<Child> children;
+	};
+
+	// Keyed by UTF-8 path relative to the scanned directory, "" for the directory itself
+	std::unordered_map<std::string, Directory> directories;
+
+	size_t relisted = 0;
+	size_t fileCount = 0;
+
+	// Directories that are in previous with an unchanged write time reuse its children instead of being listed again
+	// A directory's write time only changes when files are added, removed or renamed, so the manifest only saves names:
+	// files edited in place keep the same name, their size & write time are read again when someone asks (see stat())
+	void walk(const std::filesystem::path& directory, const std::string& relative, const Listing* previous)
+	{
+		std::error_code ec;
+		Directory record;
+		record.writeTime = WriteTime(std::filesystem::last_write_time(directory, ec));
+
+		const Directory* old = nullptr;
+		if (previous && !ec)
+		{
+			auto it = previous->directories.find(relative);
+			if (it != previous->directories.end() && it->second.writeTime == record.writeTime)
+				old = &it->second;
+		}
+
+		if (old)
+			record.children = old->children;
+		else
+		{
+			relisted++;
+			for (const auto& entry : std::filesystem::directory_iterator(directory, ec))
+			{
+				std::error_code entryEc;
+				Child child;
+				child.name = ToUtf8(entry.path().filename());
+				child.directory = entry.is_directory(entryEc);
+				child.size = child.directory ? 0 : uint64_t(entry.file_size(entryEc));
+				child.writeTime = WriteTime(entry.last_write_time(entryEc));
+				child.stamped = true;
+				record.children.push_back(std::move(child));
+			}
+		}
+
+		for (const auto& child : record.children)
+		{
+			if (child.directory)
+				walk(directory / FromUtf8(child.name), relative.empty() ? child.name : relative + "/" + child.name, previous);
+			else
+				fileCount++;
+		}
+
+		directories[relative] = std::move(record);
+	}
+
+	// Manifest file (little-endian): magic, version, root path, directory count,
+	// then per directory: relative path, write time, child count, & per child: name, directory flag
+	// Strings are u32 length + UTF-8 chars
+	bool load(const std::filesystem::path& manifestPath, const std::string& rootKey)
+	{
+		std::ifstream file(manifestPath, std::ios::binary);
+		if (!file)
+			return false;
+
+		std::vector<char> buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		size_t pos = 0;
+
+		auto read = [&](void* out, size_t size) {
+			if (buffer.size() - pos < size)
+				return false;
+			memcpy(out, buffer.data() + pos, size);
+			pos += size;
+			return true;
+		};
+		auto readString = [&](std::string& out) {
+			uint32_t length;
+			if (!read(&length, sizeof(length)) || buffer.size() - pos < length)
+				return false;
+			out.assign(buffer.data() + pos, length);
+			pos += length;
+			return true;
+		};
+
+		uint32_t magic, version, directoryCount;
+		std::string root;
+		if (!read(&magic, sizeof(magic)) || !read(&version, sizeof(version)) || magic != ManifestMagic || version != ManifestVersion)
+			return false;
+		if (!readString(root) || root != rootKey || !read(&directoryCount, sizeof(directoryCount)))
+			return false;
+
+		for (uint32_t i = 0; i < directoryCount; i++)
+		{
+			std::string relative;
+			Directory directory;
+			uint32_t childCount;
+			if (!readString(relative) || !read(&directory.writeTime, sizeof(directory.writeTime)) || !read(&childCount, sizeof(childCount)))
+				return false;
+
+			directory.children.resize(childCount);
+			for (auto& child : directory.children)
+			{
+				uint8_t isDirectory;
+				if (!readString(child.name) || !read(&isDirectory, sizeof(isDirectory)))
+					return false;
+				child.directory = isDirectory != 0;
+			}
+
+			directories[std::move(relative)] = std::move(directory);
+		}
+
+		return true;
+	}
+
+	bool save(const std::filesystem::path& manifestPath, const std::string& rootKey) const
+	{
+		std::string buffer;
+		auto write = [&](const void* data, size_t size) { buffer.append(static_cast<const char*>(data), size); };
+		auto writeString = [&](const std::string& str) {
+			uint32_t length = uint32_t(str.size());
+			write(&length, sizeof(length));
+			buffer += str;
+		};
+
+		uint32_t directoryCount = uint32_t(directories.size());
+		write(&ManifestMagic, sizeof(ManifestMagic));
+		write(&ManifestVersion, sizeof(ManifestVersion));
+		writeString(rootKey);
+		write(&directoryCount, sizeof(directoryCount));
+
+		for (const auto& [relative, directory] : directories)
+		{
+			uint32_t childCount = uint32_t(directory.children.size());
+			writeString(relative);
+			write(&directory.writeTime, sizeof(directory.writeTime));
+			write(&childCount, sizeof(childCount));
+
+			for (const auto& child : directory.children)
+			{
+				uint8_t isDirectory = child.directory ? 1 : 0;
+				writeString(child.name);
+				write(&isDirectory, sizeof(isDirectory));
+			}
+		}
+
+		// Write to a temp file first, so a crash mid-write can't leave a truncated manifest behind
+		auto tempPath = manifestPath;
+		tempPath += ".tmp";
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file || !file.write(buffer.data(), std::streamsize(buffer.size())))
+				return false;
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tempPath, manifestPath, ec);
+		return !ec;
+	}
+};
+
+#ifdef _WIN32
+struct VirtualFileSystem::Watcher
+{
+	std::filesystem::path root;
+	HANDLE directory = INVALID_HANDLE_VALUE;
+	HANDLE changed = nullptr;
+	HANDLE stop = nullptr;
+	std::thread thread;
+
+	~Watcher()
+	{
+		if (stop)
+			SetEvent(stop);
+		if (thread.joinable())
+			thread.join();
+
+		if (directory != INVALID_HANDLE_VALUE)
+			CloseHandle(directory);
+		if (changed)
+			CloseHandle(changed);
+		if (stop)
+			CloseHandle(stop);
+	}
+};
+
+void VirtualFileSystem::watch(const std::filesystem::path& directory)
+{
+	auto watcher = std::make_unique<Watcher>();
+	watcher->root = directory;
+	watcher->directory = CreateFileW(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+	watcher->changed = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+	watcher->stop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+	if (watcher->directory == INVALID_HANDLE_VALUE || !watcher->changed || !watcher->stop)
+	{
+		spdlog::warn("VirtualFileSystem: unable to watch {} for changes", directory.string());
+		return;
+	}
+
+	watcher->thread = std::thread([this, w = watcher.get()]() {
+		alignas(DWORD) uint8_t buffer[64 * 1024];
+		constexpr DWORD Filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+		while (true)
+		{
+			OVERLAPPED overlapped = {};
+			overlapped.hEvent = w->changed;
+			ResetEvent(w->changed);
+			if (!ReadDirectoryChangesW(w->directory, buffer, sizeof(buffer), TRUE, Filter, nullptr, &overlapped, nullptr))
+				return;
+
+			HANDLE handles[] = { w->changed, w->stop };
+			DWORD bytes = 0;
+			if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0)
+			{
+				CancelIoEx(w->directory, &overlapped);
+				GetOverlappedResult(w->directory, &overlapped, &bytes, TRUE);
+				return;
+			}
+
+			if (!GetOverlappedResult(w->directory, &overlapped, &bytes, FALSE))
+				return;
+
+			// Too many changes to fit the buffer, rescan the whole thing
+			if (bytes == 0)
+			{
+				invalidate(w->root);
+				continue;
+			}
+
+			std::vector<std::filesystem::path> paths;
+			for (size_t offset = 0;;)
+			{
+				auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer + offset);
+				auto path = w->root / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR));
+				if (std::find(paths.begin(), paths.end(), path) == paths.end())
+					paths.push_back(std::move(path));
+
+				if (!info->NextEntryOffset)
+					break;
+				offset += info->NextEntryOffset;
+			}
+
+			for (const auto& path : paths)
+				invalidate(path);
+		}
+	});
+
+	std::unique_lock lock(mtx);
+	watchers.push_back(std::move(watcher));
+}
+#else
+struct VirtualFileSystem::Watcher
+{
+};
+
+void VirtualFileSystem::watch(const std::filesystem::path& directory)
+{
+	spdlog::warn("VirtualFileSystem: watching {} for changes isn't supported on this platform", directory.string());
+}
+#endif
+
+VirtualFileSystem::VirtualFileSystem() = default;
+
+VirtualFileSystem::~VirtualFileSystem()
+{
+	// Watcher threads call back into us, stop them before anything else goes away
+	watchers.clear();
+}
+
+namespace
+{
+	// What Key() does for anything its fast path doesn't handle (UNC & drive relative paths, etc.)
+	std::string SlowKey(const std::filesystem::path& path)
+	{
+		std::error_code ec;
+		auto absolute = std::filesystem::absolute(path, ec);
+		auto key = ToUtf8((ec ? path : absolute).lexically_normal());
+		while (key.size() > 1 && key.back() == '/')
+			key.pop_back();
+		return Fold(std::move(key));
+	}
+
+	void RefreshWorkingDirectory()
+	{
+		std::error_code ec;
+		auto current = std::filesystem::current_path(ec);
+		auto key = ec ? std::string() : SlowKey(current);
+
+		std::unique_lock lock(WorkingDirectoryMutex);
+		WorkingDirectoryKey = std::move(key);
+	}
+
+	// Copies the working directory's key into key, false if it isn't one the fast path can build on
+	bool CopyWorkingDirectory(std::string& key)
+	{
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			{
+				std::shared_lock lock(WorkingDirectoryMutex);
+				key = WorkingDirectoryKey;
+			}
+			if (!key.empty())
+				break;
+			RefreshWorkingDirectory();
+		}
+#ifdef _WIN32
+		return key.size() >= 3 && key[1] == ':' && key[2] == '/';
+#else
+		return !key.empty() && key[0] == '/';
+#endif
+	}
+
+	bool IsSeparator(std::filesystem::path::value_type c)
+	{
+#ifdef _WIN32
+		return c == L'/' || c == L'\\';
+#else
+		return c == '/';
+#endif
+	}
+
+	// Appends a file or directory name as UTF-8, case folded on Windows
+	void AppendName(std::string& key, const std::filesystem::path::value_type* name, size_t length)
+	{
+#ifdef _WIN32
+		for (size_t i = 0; i < length; i++)
+		{
+			uint32_t c = name[i];
+			if (c >= 0xD800 && c < 0xDC00 && i + 1 < length && name[i + 1] >= 0xDC00 && name[i + 1] < 0xE000)
+				c = 0x10000 + ((c - 0xD800) << 10) + (name[++i] - 0xDC00);
+
+			if (c < 0x80)
+				key += char(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+			else if (c < 0x800)
+			{
+				key += char(0xC0 | (c >> 6));
+				key += char(0x80 | (c & 0x3F));
+			}
+			else if (c < 0x10000)
+			{
+				key += char(0xE0 | (c >> 12));
+				key += char(0x80 | ((c >> 6) & 0x3F));
+				key += char(0x80 | (c & 0x3F));
+			}
+			else
+			{
+				key += char(0xF0 | (c >> 18));
+				key += char(0x80 | ((c >> 12) & 0x3F));
+				key += char(0x80 | ((c >> 6) & 0x3F));
+				key += char(0x80 | (c & 0x3F));
+			}
+		}
+#else
+		key.append(name, length);
+#endif
+	}
+}
+
+std::string VirtualFileSystem::Key(const std::filesystem::path& path)
+{
+	std::string key;
+	Key(path, key);
+	return key;
+}
+
+void VirtualFileSystem::Key(const std::filesystem::path& path, std::string& key)
+{
+	// Every lookup goes through here, so the common cases (relative to the working directory, or absolute with a drive)
+	// are normalized straight into key rather than through absolute() & lexically_normal()
+	const auto& native = path.native();
+	const auto* str = native.data();
+	size_t length = native.size();
+
+	key.clear();
+#ifdef _WIN32
+	const size_t rootLength = 3; // "c:/"
+	bool isLetter = length && ((str[0] >= L'A' && str[0] <= L'Z') || (str[0] >= L'a' && str[0] <= L'z'));
+	if (isLetter && length >= 3 && str[1] == L':' && IsSeparator(str[2]))
+	{
+		key += char(str[0] <= L'Z' ? str[0] - L'A' + 'a' : str[0]);
+		key += ":/";
+		str += 3;
+		length -= 3;
+	}
+	else if (!length || IsSeparator(str[0]) || (length >= 2 && str[1] == L':') || !CopyWorkingDirectory(key))
+#else
+	const size_t rootLength = 1; // "/"
+	if (length && str[0] == '/')
+		key += '/';
+	else if (!length || !CopyWorkingDirectory(key))
+#endif
+	{
+		key = SlowKey(path);
+		return;
+	}
+
+	// Same as lexically_normal: empty & "." names are dropped, ".." removes the name before it but can't go above the root
+	for (size_t pos = 0; pos < length;)
+	{
+		size_t end = pos;
+		while (end < length && !IsSeparator(str[end]))
+			end++;
+
+		size_t nameLength = end - pos;
+		if (nameLength == 2 && str[pos] == '.' && str[pos + 1] == '.')
+		{
+			size_t slash = key.rfind('/');
+			key.resize(slash == std::string::npos || slash < rootLength ? rootLength : slash);
+		}
+		else if (nameLength && !(nameLength == 1 && str[pos] == '.'))
+		{
+			if (key.size() > rootLength)
+				key += '/';
+			AppendName(key, str + pos, nameLength);
+		}
+		pos = end + 1;
+	}
+
+	while (key.size() > 1 && key.back() == '/')
+		key.pop_back();
+}
+
+bool VirtualFileSystem::mountDirectory(const std::filesystem::path& directory, int priority, const std::filesystem::path& manifestPath, bool watch)
+{
+	RefreshWorkingDirectory();
+	auto rootKey = Key(directory);
+
+	std::error_code ec;
+	bool exists = std::filesystem::is_directory(directory, ec);
+
+	Listing previous;
+	bool havePrevious = exists && !manifestPath.empty() && previous.load(manifestPath, rootKey);
+
+	Listing listing;
+	if (exists)
+		listing.walk(directory, "", havePrevious ? &previous : nullptr);
+
+	{
+		std::unique_lock lock(mtx);
+		uint32_t mountIdx = uint32_t(mounts.size());
+		mounts.push_back({ rootKey, directory, priority, {} });
+		addListing(mountIdx, directory, rootKey, listing);
+	}
+
+	// Mount is kept even if the directory doesn't exist, so lookups under it still don't need to touch the disk
+	if (!exists)
+		return false;
+
+	spdlog::info("VirtualFileSystem: mounted {} ({} files, {} of {} directories listed)", directory.string(), listing.fileCount,
+		listing.relisted, listing.directories.size());
+
+	if (!manifestPath.empty() && (!havePrevious || listing.relisted > 0))
+		if (!listing.save(manifestPath, rootKey))
+			spdlog::warn("VirtualFileSystem: failed to save manifest {}", manifestPath.string());
+
+	if (watch)
+		this->watch(directory);
+
+	return true;
+}
+
+void VirtualFileSystem::mountArchive(const std::filesystem::path& root, const std::filesystem::path& archivePath,
+	const std::vector<ArchiveFile>& files, ArchiveReader reader, int priority)
+{
+	RefreshWorkingDirectory();
+	auto rootKey = Key(root);
+
+	std::error_code ec;
+	int64_t writeTime = WriteTime(std::filesystem::last_write_time(archivePath, ec));
+
+	std::unique_lock lock(mtx);
+	uint32_t mountIdx = uint32_t(mounts.size());
+	mounts.push_back({ rootKey, root, priority, std::move(reader) });
+
+	add(rootKey, Entry{ root, 0, writeTime, mountIdx, 0, true });
+	for (const auto& file : files)
+	{
+		auto relative = ToUtf8(file.path.lexically_normal());
+		if (relative.empty())
+			continue;
+
+		auto key = rootKey + "/" + Fold(relative);
+		auto path = root / file.path;
+		addParents(key, path, mountIdx);
+		add(key, Entry{ std::move(path), file.size, writeTime, mountIdx, file.entry, false });
+	}
+}
+
+void VirtualFileSystem::addListing(uint32_t mountIdx, const std::filesystem::path& directory, const std::string& key, const Listing& listing)
+{
+	for (const auto& [relative, record] : listing.directories)
+	{
+		auto dirPath = relative.empty() ? directory : directory / FromUtf8(relative);
+		auto dirKey = relative.empty() ? key : key + "/" + Fold(relative);
+		add(dirKey, Entry{ dirPath, 0, record.writeTime, mountIdx, 0, true });
+
+		for (const auto& child : record.children)
+		{
+			Entry entry{ dirPath / FromUtf8(child.name), child.size, child.writeTime, mountIdx, 0, child.directory };
+			entry.stamped = child.stamped || child.directory;
+			add(dirKey + "/" + Fold(child.name), std::move(entry));
+		}
+	}
+}
+
+void VirtualFileSystem::add(const std::string& key, Entry&& entry)
+{
+	auto& entries = nodes[key];
+	bool isNew = entries.empty();
+
+	auto existing = std::find_if(entries.begin(), entries.end(), [&](const Entry& e) { return e.mount == entry.mount; });
+	if (existing != entries.end())
+		*existing = std::move(entry);
+	else
+	{
+		// Highest priority first, earlier mounts win ties
+		int priority = mounts[entry.mount].priority;
+		auto pos = std::find_if(entries.begin(), entries.end(), [&](const Entry& e) {
+			int otherPriority = mounts[e.mount].priority;
+			return otherPriority < priority || (otherPriority == priority && e.mount > entry.mount);
+		});
+		entries.insert(pos, std::move(entry));
+	}
+
+	if (isNew)
+		children[ParentKey(key)].insert(key);
+}
+
+void VirtualFileSystem::addParents(const std::string& key, const std::filesystem::path& path, uint32_t mountIdx)
+{
+	const auto& rootKey = mounts[mountIdx].key;
+
+	auto parentKey = ParentKey(key);
+	auto parentPath = path.parent_path();
+	while (parentKey.size() >= rootKey.size() && parentKey.compare(0, rootKey.size(), rootKey) == 0)
+	{
+		auto it = nodes.find(parentKey);
+		if (it != nodes.end() && std::any_of(it->second.begin(), it->second.end(), [&](const Entry& e) { return e.mount == mountIdx; }))
+			break;
+
+		add(parentKey, Entry{ parentPath, 0, 0, mountIdx, 0, true });
+		parentKey = ParentKey(parentKey);
+		parentPath = parentPath.parent_path();
+	}
+}
+
+void VirtualFileSystem::remove(const std::string& key, uint32_t mountIdx)
+{
+	auto childIt = children.find(key);
+	if (childIt != children.end())
+	{
+		std::vector<std::string> childKeys(childIt->second.begin(), childIt->second.end());
+		for (const auto& childKey : childKeys)
+			remove(childKey, mountIdx);
+	}
+
+	auto it = nodes.find(key);
+	if (it == nodes.end())
+		return;
+
+	auto& entries = it->second;
+	entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const Entry& e) { return e.mount == mountIdx; }), entries.end());
+	if (!entries.empty())
+		return;
+
+	nodes.erase(it);
+
+	childIt = children.find(key);
+	if (childIt != children.end() && childIt->second.empty())
+		children.erase(childIt);
+
+	auto parentIt = children.find(ParentKey(key));
+	if (parentIt != children.end())
+		parentIt->second.erase(key);
+}
+
+void VirtualFileSystem::invalidate(const std::filesystem::path& path)
+{
+	auto key = Key(path);
+
+	// Read everything in before taking the lock, rescanning a big folder shouldn't hold up lookups
+	std::error_code ec;
+	auto status = std::filesystem::status(path, ec);
+	bool isFile = std::filesystem::is_regular_file(status);
+	bool isDirectory = std::filesystem::is_directory(status);
+
+	Entry file;
+	if (isFile)
+	{
+		file.path = path;
+		file.size = uint64_t(std::filesystem::file_size(path, ec));
+		file.writeTime = WriteTime(std::filesystem::last_write_time(path, ec));
+	}
+
+	Listing listing;
+	if (isDirectory)
+		listing.walk(path, "", nullptr);
+
+	std::unique_lock lock(mtx);
+	for (uint32_t mountIdx = 0; mountIdx < mounts.size(); mountIdx++)
+	{
+		const auto& mount = mounts[mountIdx];
+		if (mount.reader)
+			continue;
+
+		bool inside = key == mount.key || (key.size() > mount.key.size() && key.compare(0, mount.key.size(), mount.key) == 0 && key[mount.key.size()] == '/');
+		if (!inside)
+			continue;
+
+		remove(key, mountIdx);
+
+		if (isFile)
+		{
+			addParents(key, path, mountIdx);
+			Entry entry = file;
+			entry.mount = mountIdx;
+			add(key, std::move(entry));
+		}
+		else if (isDirectory)
+		{
+			addParents(key, path, mountIdx);
+			addListing(mountIdx, path, key, listing);
+		}
+	}
+
+	changeCount.fetch_add(1, std::memory_order_release);
+}
+
+void VirtualFileSystem::insert(const std::filesystem::path& path, uint64_t size)
+{
+	auto key = Key(path);
+
+	std::unique_lock lock(mtx);
+
+	// Goes into the highest priority directory mount containing it
+	int best = -1;
+	for (uint32_t mountIdx = 0; mountIdx < mounts.size(); mountIdx++)
+	{
+		const auto& mount = mounts[mountIdx];
+		if (mount.reader || key.size() <= mount.key.size() || key.compare(0, mount.key.size(), mount.key) != 0 || key[mount.key.size()] != '/')
+			continue;
+
+		if (best < 0 || mount.priority > mounts[best].priority)
+			best = int(mountIdx);
+	}
+
+	if (best < 0)
+		return;
+
+	addParents(key, path, uint32_t(best));
+	add(key, Entry{ path, size, 0, uint32_t(best), 0, false });
+}
+
+const VirtualFileSystem::Entry* VirtualFileSystem::find(const std::string& key) const
+{
+	auto it = nodes.find(key);
+	return it == nodes.end() || it->second.empty() ? nullptr : &it->second.front();
+}
+
+bool VirtualFileSystem::covered(const std::string& key) const
+{
+	for (const auto& mount : mounts)
+		if (key == mount.key || (key.size() > mount.key.size() && key.compare(0, mount.key.size(), mount.key) == 0 && key[mount.key.size()] == '/'))
+			return true;
+	return false;
+}
+
+bool VirtualFileSystem::exists(const std::filesystem::path& path) const
+{
+	thread_local std::string key;
+	Key(path, key);
+	{
+		std::shared_lock lock(mtx);
+		if (find(key))
+			return true;
+		if (covered(key))
+			return false;
+	}
+
+	std::error_code ec;
+	return std::filesystem::exists(path, ec);
+}
+
+bool VirtualFileSystem::isDirectory(const std::filesystem::path& path) const
+{
+	auto info = stat(path);
+	return info && info->directory;
+}
+
+std::optional<VirtualFileSystem::FileInfo> VirtualFileSystem::stat(const std::filesystem::path& path) const
+{
+	thread_local std::string key;
+	Key(path, key);
+
+	std::filesystem::path realPath = path;
+	bool unstamped = false;
+	{
+		std::shared_lock lock(mtx);
+		if (auto* entry = find(key))
+		{
+			if (entry->stamped)
+				return FileInfo{ entry->size, entry->writeTime, entry->directory };
+			realPath = entry->path; // only the name came from the manifest
+			unstamped = true;
+		}
+		else if (covered(key))
+			return std::nullopt;
+	}
+
+	std::error_code ec;
+	auto status = std::filesystem::status(realPath, ec);
+	if (ec || !std::filesystem::exists(status))
+		return std::nullopt;
+
+	FileInfo info;
+	info.directory = std::filesystem::is_directory(status);
+	if (!info.directory)
+		info.size = uint64_t(std::filesystem::file_size(realPath, ec));
+	info.writeTime = WriteTime(std::filesystem::last_write_time(realPath, ec));
+
+	// Keep it for next time if it's still the same entry
+	if (unstamped && !ec)
+	{
+		std::unique_lock lock(mtx);
+		auto* entry = find(key);
+		if (entry && !entry->stamped && entry->path == realPath)
+		{
+			entry->size = info.size;
+			entry->writeTime = info.writeTime;
+			entry->stamped = true;
+		}
+	}
+	return info;
+}
+
+void VirtualFileSystem::collect(const std::string& key, bool recursive, bool includeArchived, std::vector<std::filesystem::path>& out) const
+{
+	auto it = children.find(key);
+	if (it == children.end())
+		return;
+
+	for (const auto& childKey : it->second)
+	{
+		const Entry* entry = find(childKey);
+		if (!entry)
+			continue;
+
+		if (!entry->directory)
+		{
+			if (includeArchived || !mounts[entry->mount].reader)
+				out.push_back(entry->path);
+		}
+		else if (recursive)
+			collect(childKey, recursive, includeArchived, out);
+	}
+}
+
+std::vector<std::filesystem::path> VirtualFileSystem::list(const std::filesystem::path& directory, bool recursive, bool includeArchived) const
+{
+	std::vector<std::filesystem::path> files;
+	thread_local std::string key;
+	Key(directory, key);
+	{
+		std::shared_lock lock(mtx);
+		if (const Entry* entry = find(key))
+		{
+			if (entry->directory)
+				collect(key, recursive, includeArchived, files);
+			return files;
+		}
+		if (covered(key))
+			return files;
+	}
+
+	std::error_code ec;
+	if (recursive)
+	{
+		for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, ec))
+			if (entry.is_regular_file())
+				files.push_back(entry.path());
+	}
+	else
+	{
+		for (const auto& entry : std::filesystem::directory_iterator(directory, ec))
+			if (entry.is_regular_file())
+				files.push_back(entry.path());
+	}
+	return files;
+}
+
+std::shared_ptr<const void> VirtualFileSystem::open(const std::filesystem::path& path, const uint8_t** data, size_t* size) const
+{
+	thread_local std::string key;
+	Key(path, key);
+	std::filesystem::path realPath = path;
+	{
+		std::shared_lock lock(mtx);
+		const Entry* entry = find(key);
+		if (entry && entry->directory)
+			return nullptr;
+
+		if (entry && mounts[entry->mount].reader)
+		{
+			// Call the reader outside the lock, decompressing can take a while
+			ArchiveReader reader = mounts[entry->mount].reader;
+			uint32_t archiveEntry = entry->archiveEntry;
+			lock.unlock();
+			return reader(archiveEntry, data, size);
+		}
+
+		if (entry)
+			realPath = entry->path;
+		else if (covered(key))
+			return nullptr;
+	}
+
+	MappedFile file;
+	if (!file.open(realPath))
+		return nullptr;
+
+	auto view = std::make_shared<MappedView>(file.mapAll());
+	if (!view->valid())
+		return nullptr;
+
+	*data = view->data();
+	*size = view->size();
+	return view;
+}
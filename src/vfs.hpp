@@ -0,0 +1,131 @@
+// Virtual file system for mod assets
+// Replacement textures, texture packs & BGM each used to probe the real file system their own way, often for every file the
+// game loads. Mod folders are instead scanned once into an in-memory manifest here, & exists/stat/list/open get answered from it.
+//
+// - Directory mounts add every file under a folder, archive mounts (eg. .texpack) add files that live inside another file.
+//   When both provide the same path the mount with the higher priority wins, so loose files can overlay packed ones.
+// - A mount's scan can be saved to a manifest file along with directory write times, later runs then only re-list
+//   directories whose write time changed. The manifest only tracks which files exist, sizes & write times of files in
+//   directories it saved listing for are read from the file system when stat() is first asked for them.
+// - Watched mounts get updated from file change notifications, generation() changes whenever that happens.
+//   (Windows only, on other platforms invalidate() can be called manually)
+//
+// Paths are plain file system paths (relative ones are relative to the working directory, same as the game uses),
+// anything outside of every mount falls through to the real file system. The working directory is read once & again
+// whenever something gets mounted, lookups don't ask the OS for it.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class VirtualFileSystem
+{
+public:
+	struct FileInfo
+	{
+		uint64_t size = 0;
+		int64_t writeTime = 0; // file_time_type ticks
+		bool directory = false;
+	};
+
+	struct ArchiveFile
+	{
+		std::filesystem::path path; // relative to the archive's mount root
+		uint64_t size;
+		uint32_t entry;             // passed back to the ArchiveReader
+	};
+
+	// Returns an owner keeping the data alive, or nullptr on failure
+	using ArchiveReader = std::function<std::shared_ptr<const void>(uint32_t entry, const uint8_t** data, size_t* size)>;
+
+	VirtualFileSystem();
+	~VirtualFileSystem();
+
+	VirtualFileSystem(const VirtualFileSystem&) = delete;
+	VirtualFileSystem& operator=(const VirtualFileSystem&) = delete;
+
+	// manifestPath is optional, watch starts a thread listening for changes under the directory (Windows only)
+	bool mountDirectory(const std::filesystem::path& directory, int priority, const std::filesystem::path& manifestPath = {}, bool watch = false);
+	void mountArchive(const std::filesystem::path& root, const std::filesystem::path& archivePath, const std::vector<ArchiveFile>& files,
+		ArchiveReader reader, int priority);
+
+	bool exists(const std::filesystem::path& path) const;
+	bool isDirectory(const std::filesystem::path& path) const;
+	std::optional<FileInfo> stat(const std::filesystem::path& path) const;
+
+	// Files inside a directory (not folders), as real paths for loose files & root/relative paths for archived ones
+	std::vector<std::filesystem::path> list(const std::filesystem::path& directory, bool recursive = false, bool includeArchived = true) const;
+
+	// Maps loose files, archived files come from the archive's reader
+	std::shared_ptr<const void> open(const std::filesystem::path& path, const uint8_t** data, size_t* size) const;
+
+	// Adds a file we're creating ourselves (eg. texture dumps) without waiting on a rescan/notification
+	void insert(const std::filesystem::path& path, uint64_t size);
+
+	// Re-reads path (& anything underneath it) from the real file system, called by the watcher for each change
+	void invalidate(const std::filesystem::path& path);
+
+	// Only changes through invalidate(), mounting & insert() leave it alone
+	uint64_t generation() const { return changeCount.load(std::memory_order_acquire); }
+
+	// Normalized lookup key: absolute, generic separators, case folded on Windows
+	static std::string Key(const std::filesystem::path& path);
+
+	// Same, but written into key so lookups can reuse its buffer rather than allocating each time
+	static void Key(const std::filesystem::path& path, std::string& key);
+
+private:
+	struct Entry
+	{
+		std::filesystem::path path; // real path for loose files, root/relative for archived ones
+		mutable uint64_t size = 0;
+		mutable int64_t writeTime = 0;
+		uint32_t mount = 0;
+		uint32_t archiveEntry = 0;
+		bool directory = false;
+		mutable bool stamped = true; // false until size & writeTime are read for files listed from a manifest, stat() fills them in
+	};
+
+	struct Mount
+	{
+		std::string key;
+		std::filesystem::path root;
+		int priority = 0;
+		ArchiveReader reader; // empty for directory mounts
+	};
+
+	struct Listing; // scan of a directory tree, also what gets saved as the manifest
+	struct Watcher;
+
+	mutable std::shared_mutex mtx;
+	std::vector<Mount> mounts;
+	std::unordered_map<std::string, std::vector<Entry>> nodes;                 // every mount providing each path, winner first
+	std::unordered_map<std::string, std::unordered_set<std::string>> children; // directory key -> child keys
+	std::vector<std::unique_ptr<Watcher>> watchers;
+	std::atomic<uint64_t> changeCount = 0;
+
+	// All of these expect mtx to already be held (exclusively for the non-const ones)
+	void add(const std::string& key, Entry&& entry);
+	void addParents(const std::string& key, const std::filesystem::path& path, uint32_t mountIdx);
+	void addListing(uint32_t mountIdx, const std::filesystem::path& directory, const std::string& key, const Listing& listing);
+	void remove(const std::string& key, uint32_t mountIdx);
+
+	const Entry* find(const std::string& key) const;
+	bool covered(const std::string& key) const;
+	void collect(const std::string& key, bool recursive, bool includeArchived, std::vector<std::filesystem::path>& out) const;
+
+	void watch(const std::filesystem::path& directory);
+};
+
+// Shared by every hook that loads mod assets
+extern VirtualFileSystem ModFiles;
@@ -0,0 +1,117 @@
+#include <spdlog/spdlog.h>
+
+#include "plugin.hpp"
+#include "vfs.hpp"
+#include "wave_file.hpp"
+
+CWaveFile::~CWaveFile() {}
+
+CStreamingWaveFile::CStreamingWaveFile(std::unique_ptr<PcmStream> stream) : m_stream(std::move(stream)), m_format{}
+{
+	m_pwfx_4 = NULL;
+	m_dwSize_8 = 0;
+}
+
+CStreamingWaveFile::~CStreamingWaveFile()
+{
+	Close();
+}
+
+HRESULT CStreamingWaveFile::Open(LPSTR strFileName, WAVEFORMATEX* pwfx, DWORD dwFlags)
+{
+	BGMDecodeProfiler* profiler = Settings::ProfileBGMDecode ? &BGMProfiler : nullptr;
+
+	// Cached copy saves waiting on the drive, otherwise have it read in for next time
+	BGMCache::Entry file;
+	if (BGMFiles.find(strFileName, &file))
+	{
+		m_stream->BeginProfile(profiler, strFileName);
+		if (!m_stream->OpenFromMemory(file.data, file.size))
+			return E_FAIL;
+		m_file = std::move(file);
+		return Opened();
+	}
+	BGMFiles.prefetch(strFileName);
+
+	m_stream->BeginProfile(profiler, strFileName);
+	if (m_stream->Open(strFileName))
+		return Opened();
+	m_stream->Close();
+
+	file.owner = ModFiles.open(strFileName, &file.data, &file.size);
+	m_stream->BeginProfile(profiler, strFileName);
+	if (!file.owner || !m_stream->OpenFromMemory(file.data, file.size))
+	{
+		spdlog::error("CStreamingWaveFile: failed to open {}", strFileName);
+		return E_FAIL;
+	}
+	m_file = std::move(file);
+	return Opened();
+}
+
+HRESULT CStreamingWaveFile::OpenFromMemory(BYTE* pbData, ULONG ulDataSize, WAVEFORMATEX* pwfx, DWORD dwFlags)
+{
+	if (!pbData || !ulDataSize || !m_stream->OpenFromMemory(pbData, ulDataSize))
+		return E_FAIL;
+	return Opened();
+}
+
+HRESULT CStreamingWaveFile::Opened()
+{
+	const PcmFormat& format = m_stream->Format();
+	m_format.wFormatTag = WAVE_FORMAT_PCM;
+	m_format.nChannels = WORD(format.channels);
+	m_format.nSamplesPerSec = format.sampleRate;
+	m_format.wBitsPerSample = WORD(format.bitsPerSample);
+	m_format.nBlockAlign = WORD(format.blockAlign);
+	m_format.nAvgBytesPerSec = format.sampleRate * format.blockAlign;
+	m_format.cbSize = 0;
+	m_pwfx_4 = &m_format;
+	return S_OK;
+}
+
+HRESULT CStreamingWaveFile::Close()
+{
+	m_stream->Close();
+	m_file = {};
+	m_pwfx_4 = NULL;
+	return S_OK;
+}
+
+HRESULT CStreamingWaveFile::Read(BYTE* pBuffer, DWORD dwSizeToRead, DWORD* pdwSizeRead)
+{
+	size_t read = 0;
+	if (!m_stream->Read(pBuffer, dwSizeToRead, &read))
+		return E_FAIL;
+
+	if (pdwSizeRead)
+		*pdwSizeRead = DWORD(read);
+	return S_OK;
+}
+
+HRESULT CStreamingWaveFile::Write(UINT nSizeToWrite, BYTE* pbSrcData, UINT* pnSizeWrote)
+{
+	OutputDebugString("Negatory on the CStreamingWaveFile::Write");
+	return 0;
+}
+
+int CStreamingWaveFile::GetSize()
+{
+	return this->m_dwSize_8;
+}
+
+HRESULT CStreamingWaveFile::ResetFile()
+{
+	m_stream->Reset();
+	return S_OK;
+}
+
+CWaveFile* CreateFLACFile()
+{
+	return new CStreamingWaveFile(CreateFLACStream());
+}
+
+CWaveFile* CreateOpusFile()
+{
+	return new CStreamingWaveFile(CreateOpusStream());
+}
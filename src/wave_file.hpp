@@ -0,0 +1,80 @@
+// BGM decoders handed to the games sound manager
+// Game only knows about CWaveFile, which it uses for WAV & its own OGG code. Our decoders are PcmStreams (pcm_stream.hpp)
+// wrapped in a CStreamingWaveFile, BGMLoaderHook picks the type & CustomWaveFileHook creates the matching one for it.
+
+#pragma once
+
+#include <Windows.h>
+#include <mmiscapi.h>
+#include <mmreg.h>
+#include <memory>
+
+#include "bgm_cache.hpp"
+#include "pcm_stream.hpp"
+
+// Values BGMLoaderHook hands to the games BGM code
+enum class WaveFileType
+{
+	WAV = 1,
+	FLAC = 2, // ours
+	OGG = 3,
+	Opus = 4, // ours
+	CDSwitcher = 5 // ours, FLAC/Opus played by the CD switcher (see cd_switcher.hpp)
+};
+
+// CWaveFile class used in C2C, seems based on DirectX DXUTsound.cpp code
+class CWaveFile
+{
+public:
+	virtual ~CWaveFile() = 0;
+	virtual HRESULT Open(LPSTR strFileName, WAVEFORMATEX* a3, DWORD dwFlags) = 0;
+	virtual HRESULT OpenFromMemory(BYTE* pbData, ULONG ulDataSize, WAVEFORMATEX* pwfx, DWORD dwFlags) = 0;
+	virtual HRESULT Close() = 0;
+	virtual HRESULT Read(BYTE* pBuffer, DWORD dwSizeToRead, DWORD* pdwSizeRead) = 0;
+	virtual HRESULT Write(UINT nSizeToWrite, BYTE* pbSrcData, UINT* pnSizeWrote) = 0;
+	virtual int GetSize() = 0;
+	virtual HRESULT ResetFile() = 0;
+
+	WAVEFORMATEX* m_pwfx_4;
+	DWORD m_dwSize_8;
+	HMMIO m_hmmio_C;
+	MMCKINFO m_ck_10;
+	MMCKINFO m_ckRiff_24;
+	MMIOINFO m_mmioinfoOut_38;
+	DWORD m_dwFlags_80;
+	BOOL m_bIsReadingFromMemory_84;
+	BYTE* m_pbData_88;
+	BYTE* m_pbDataCur_8C;
+	ULONG m_ulDataSize_90;
+	CHAR* m_pResourceBuffer_94;
+};
+
+// Hands a PcmStream to the game, the stream does all the decoding
+// Files cached in BGMFiles are decoded straight from memory, anything else is streamed from disk if the decoder can,
+// or mapped through ModFiles for it otherwise (also covers files inside archives).
+class CStreamingWaveFile : public CWaveFile
+{
+public:
+	explicit CStreamingWaveFile(std::unique_ptr<PcmStream> stream);
+	~CStreamingWaveFile();
+
+	HRESULT Open(LPSTR strFileName, WAVEFORMATEX* pwfx, DWORD dwFlags) override;
+	HRESULT OpenFromMemory(BYTE* pbData, ULONG ulDataSize, WAVEFORMATEX* pwfx, DWORD dwFlags) override;
+	HRESULT Close() override;
+	HRESULT Read(BYTE* pBuffer, DWORD dwSizeToRead, DWORD* pdwSizeRead) override;
+	HRESULT Write(UINT nSizeToWrite, BYTE* pbSrcData, UINT* pnSizeWrote) override;
+	int GetSize() override;
+	HRESULT ResetFile() override;
+
+private:
+	std::unique_ptr<PcmStream> m_stream;
+	BGMCache::Entry m_file; // keeps the data alive while the stream decodes it from memory
+	WAVEFORMATEX m_format;
+
+	HRESULT Opened();
+};
+
+// Created by CustomWaveFileHook for the types BGMLoaderHook picked
+CWaveFile* CreateFLACFile();
+CWaveFile* CreateOpusFile();
+CWaveFile* CreateCDSwitcherFile();
@@ -0,0 +1,153 @@
+// Minimal benchmark runner shared by the benchmarks under tools/bench
+// Each benchmark file is its own executable, it defines its cases with BENCH_CASE & ends with BENCH_MAIN.
+// Timings depend on the machine so these aren't run by ctest, run them by hand from a Release build.
+// Passing case names on the command line only runs those, everything on the command line is also in Bench::Arguments.
+//
+// Like the tests, benchmarks only use code from src/ that doesn't need Windows or the game.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+	struct Case
+	{
+		const char* name;
+		void (*func)();
+	};
+
+	inline std::vector<Case>& Cases()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	inline std::vector<const char*> Arguments;
+	inline int Failures = 0;
+
+	struct Register
+	{
+		Register(const char* name, void (*func)()) { Cases().push_back({ name, func }); }
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	inline double Seconds(Clock::duration duration)
+	{
+		return std::chrono::duration<double>(duration).count();
+	}
+
+	// Stops optimizers from dropping work whose result isn't otherwise used
+	inline void Consume(uint64_t value)
+	{
+		static volatile uint64_t sink;
+		sink = sink + value;
+	}
+
+	// Prints a line like Measure does, for benchmarks that have to time things themselves
+	inline void Report(const char* label, double perCall, uint64_t bytes = 0, uint64_t items = 0)
+	{
+		printf("  %-40s %12.3f us", label, perCall * 1e6);
+		if (bytes)
+			printf("  %10.1f MB/s", double(bytes) / perCall / (1024.0 * 1024.0));
+		if (items)
+			printf("  %10.1f ns/item", perCall * 1e9 / double(items));
+		printf("\n");
+	}
+
+	// Calls func once to warm up, then repeatedly until minSeconds have passed, prints the average time per call
+	// bytes/items are per call & only used for the throughput columns, returns the average seconds per call
+	template <typename Func>
+	double Measure(const char* label, Func&& func, uint64_t bytes = 0, uint64_t items = 0, double minSeconds = 0.5)
+	{
+		func();
+
+		uint64_t calls = 0;
+		auto start = Clock::now();
+		double elapsed = 0;
+		do
+		{
+			func();
+			calls++;
+			elapsed = Seconds(Clock::now() - start);
+		} while (elapsed < minSeconds);
+
+		double perCall = elapsed / double(calls);
+		Report(label, perCall, bytes, items);
+		return perCall;
+	}
+
+	// For benchmarks that check their results against a limit, the executable returns non-zero if any failed
+	inline void Fail(const char* message)
+	{
+		printf("  FAIL: %s\n", message);
+		Failures++;
+	}
+
+	// Folder under the temp path that's removed again afterwards
+	struct TempDirectory
+	{
+		std::filesystem::path path;
+
+		explicit TempDirectory(const char* name)
+		{
+			path = std::filesystem::temp_directory_path() / (std::string(name) + "_" + std::to_string(std::random_device()()));
+			std::filesystem::create_directories(path);
+		}
+
+		~TempDirectory()
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(path, ec);
+		}
+	};
+
+	inline bool Selected(const char* name)
+	{
+		bool anyNames = false;
+		for (const char* argument : Arguments)
+		{
+			for (const auto& test : Cases())
+			{
+				if (strcmp(argument, test.name) == 0)
+				{
+					anyNames = true;
+					if (strcmp(argument, name) == 0)
+						return true;
+				}
+			}
+		}
+		return !anyNames;
+	}
+
+	inline int Run(int argc, char** argv)
+	{
+		Arguments.assign(argv + 1, argv + argc);
+
+		for (const auto& bench : Cases())
+		{
+			if (!Selected(bench.name))
+				continue;
+			printf("%s\n", bench.name);
+			bench.func();
+		}
+
+		return Failures ? 1 : 0;
+	}
+}
+
+#define BENCH_CASE(name) \
+	static void name(); \
+	static Bench::Register name##_register(#name, name); \
+	static void name()
+
+#define BENCH_MAIN() \
+	int main(int argc, char** argv) { return Bench::Run(argc, argv); }
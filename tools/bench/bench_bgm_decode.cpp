@@ -0,0 +1,177 @@
+// Our BGM decoders on generated tones, timed the same way BGMDecodeProfiler times them in-game
+// Each track is decoded flat out for throughput, then played through a few loops with the profiler attached. A track that
+// goes past any of the [Audio] warning thresholds fails the run, so this can gate decoder changes without the game.
+// Thresholds default to the ini's & can be overridden on the command line, eg. BGMDecodeWarnMBps=20 BGMLoopSeekWarnMs=10
+// (0 turns a check off, same as the ini).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "audio_files.hpp"
+#include "opus_files.hpp"
+#include "bgm_profiler.hpp"
+#include "pcm_stream.hpp"
+#include "bench.hpp"
+
+namespace
+{
+	const double ToneSeconds = 20.0;
+
+	// Chord with a slow tremolo & a little noise, closer to what music compresses like than a pure sine
+	double Tone(uint64_t index, unsigned rate, unsigned channel, std::mt19937& rng)
+	{
+		double t = double(index) / rate;
+		double value = std::sin(t * 2 * 3.14159265358979 * 220.0) + 0.6 * std::sin(t * 2 * 3.14159265358979 * (channel ? 277.2 : 329.6))
+			+ 0.3 * std::sin(t * 2 * 3.14159265358979 * 440.0 + channel);
+		value *= 0.7 + 0.3 * std::sin(t * 2 * 3.14159265358979 * 0.5);
+		return value * 0.35 + (double(rng() % 2001) - 1000.0) / 1000.0 * 0.01;
+	}
+
+	std::vector<std::string> LoopTags(unsigned rate)
+	{
+		// Loop starts a second in & covers most of the track, like a typical BGM intro + loop
+		return { "LOOPSTART=" + std::to_string(rate), "LOOPLENGTH=" + std::to_string(uint64_t(rate * (ToneSeconds - 2.0))) };
+	}
+
+	std::vector<uint8_t> MakeFLAC(unsigned rate, unsigned bits, bool loop)
+	{
+		std::mt19937 rng(rate);
+		std::vector<int32_t> samples;
+		double scale = double((1 << (bits - 1)) - 1);
+		for (uint64_t i = 0; i < uint64_t(rate * ToneSeconds); i++)
+			for (unsigned channel = 0; channel < 2; channel++)
+				samples.push_back(int32_t(std::lround(Tone(i, rate, channel, rng) * scale)));
+		return TestAudio::EncodeFLAC(samples, 2, rate, bits, loop ? LoopTags(rate) : std::vector<std::string>{});
+	}
+
+	std::vector<uint8_t> MakeOpus(bool loop)
+	{
+		std::mt19937 rng(48000);
+		std::vector<int16_t> samples;
+		for (uint64_t i = 0; i < uint64_t(48000 * ToneSeconds); i++)
+			for (unsigned channel = 0; channel < 2; channel++)
+				samples.push_back(int16_t(std::lround(Tone(i, 48000, channel, rng) * 32767.0)));
+		return TestAudio::EncodeOpus(samples, 2, loop ? LoopTags(48000) : std::vector<std::string>{});
+	}
+
+	// Reads until the stream ends or size bytes were read, returns how much it got
+	uint64_t ReadAll(PcmStream& stream, uint64_t size)
+	{
+		static std::vector<uint8_t> buffer(64 * 1024);
+		uint64_t total = 0;
+		size_t read = 0;
+		while (total < size && stream.Read(buffer.data(), size_t(std::min<uint64_t>(buffer.size(), size - total)), &read) && read)
+			total += read;
+		return total;
+	}
+
+	BGMDecodeProfiler::Thresholds Limits()
+	{
+		// Same defaults as Settings in plugin.hpp
+		BGMDecodeProfiler::Thresholds limits{ 2.0f, 100, 50 };
+		for (const char* argument : Bench::Arguments)
+		{
+			if (!strncmp(argument, "BGMDecodeWarnMBps=", 18))
+				limits.decodeMBps = float(atof(argument + 18));
+			else if (!strncmp(argument, "BGMFirstReadWarnMs=", 19))
+				limits.firstReadMs = atoi(argument + 19);
+			else if (!strncmp(argument, "BGMLoopSeekWarnMs=", 18))
+				limits.loopSeekMs = atoi(argument + 18);
+		}
+		return limits;
+	}
+
+	void Run(const char* name, BGMDecodeProfiler::Format format, const std::function<std::unique_ptr<PcmStream>()>& create,
+		const std::vector<uint8_t>& file, const std::vector<uint8_t>& looped)
+	{
+		auto stream = create();
+		if (!stream->OpenFromMemory(file.data(), file.size()))
+		{
+			Bench::Fail("couldn't open the generated file");
+			return;
+		}
+		const PcmFormat pcm = stream->Format();
+		const uint64_t trackBytes = ReadAll(*stream, UINT64_MAX);
+		stream->Close();
+		printf(" %s, %.1f KB -> %uHz %u-bit, %.1f MB decoded\n", name, file.size() / 1024.0, pcm.sampleRate, pcm.bitsPerSample,
+			trackBytes / (1024.0 * 1024.0));
+
+		Bench::Measure("decode whole track", [&]
+		{
+			stream->OpenFromMemory(file.data(), file.size());
+			Bench::Consume(ReadAll(*stream, UINT64_MAX));
+			stream->Close();
+		}, trackBytes);
+
+		Bench::Measure("open & first read", [&]
+		{
+			stream->OpenFromMemory(file.data(), file.size());
+			Bench::Consume(ReadAll(*stream, 4096));
+			stream->Close();
+		});
+
+		// Three times through the loop with the profiler timing it like it would in-game
+		BGMDecodeProfiler profiler;
+		profiler.setThresholds(Limits());
+		stream->BeginProfile(&profiler, name);
+		if (!stream->OpenFromMemory(looped.data(), looped.size()))
+		{
+			Bench::Fail("couldn't open the generated file");
+			return;
+		}
+		ReadAll(*stream, trackBytes * 3);
+		stream->Close();
+
+		auto tracks = profiler.recent();
+		if (tracks.empty() || tracks.front().format != format)
+		{
+			Bench::Fail("profiler didn't record the track");
+			return;
+		}
+
+		const auto& track = tracks.front();
+		printf("  profiled: %.1f MB/s, %.2f ms to first audio, %llu loop seeks (max %.2f ms), %.1f KB held\n", track.decodeMBps(),
+			track.firstReadNanoseconds / 1e6, (unsigned long long)track.loopSeeks, track.loopSeekMaxNanoseconds / 1e6, track.memoryBytes / 1024.0);
+
+		if (track.loopSeeks == 0)
+			Bench::Fail("track never looped");
+		if (track.warnings & BGMDecodeProfiler::SlowDecode)
+			Bench::Fail("decode throughput below BGMDecodeWarnMBps");
+		if (track.warnings & BGMDecodeProfiler::SlowFirstRead)
+			Bench::Fail("first read slower than BGMFirstReadWarnMs");
+		if (track.warnings & BGMDecodeProfiler::SlowLoopSeek)
+			Bench::Fail("loop seek slower than BGMLoopSeekWarnMs");
+	}
+}
+
+BENCH_CASE(FLAC)
+{
+	// Straight into the ring, the usual case
+	Run("FLAC 44.1kHz 16-bit", BGMDecodeProfiler::FLAC, CreateFLACStream, MakeFLAC(44100, 16, false), MakeFLAC(44100, 16, true));
+}
+
+BENCH_CASE(FLACConverted)
+{
+	// Converted to float, resampled to 48kHz & dithered back down
+	Run("FLAC 96kHz 24-bit", BGMDecodeProfiler::FLAC, CreateFLACStream, MakeFLAC(96000, 24, false), MakeFLAC(96000, 24, true));
+}
+
+BENCH_CASE(Opus)
+{
+	auto file = MakeOpus(false);
+	if (file.empty())
+	{
+		Bench::Fail("couldn't encode the Opus tone");
+		return;
+	}
+	Run("Opus 48kHz 128kbps", BGMDecodeProfiler::Opus, CreateOpusStream, file, MakeOpus(true));
+}
+
+BENCH_MAIN()
@@ -0,0 +1,107 @@
+// BGMTrackTable lookups against the ModFiles probes BGMLoaderHook made before it, one exists() per extension
+// Runs on a generated Sound folder the size of a big community soundtrack, mounted in ModFiles like the game does, so the
+// probes are answered from the in-memory manifest too: what's left is building paths & keys vs. one hash lookup.
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "bgm_tracks.hpp"
+#include "vfs.hpp"
+#include "bench.hpp"
+
+namespace
+{
+	const size_t TrackCount = 800;
+
+	struct GameFolder
+	{
+		Bench::TempDirectory directory{ "bench_bgm_tracks" };
+		std::filesystem::path previous = std::filesystem::current_path();
+		std::vector<std::string> names; // what the game asks for, .ogg
+
+		GameFolder()
+		{
+			// Mix of types like a soundtrack that's been partly converted, a few in subfolders
+			std::filesystem::current_path(directory.path);
+			for (size_t i = 0; i < TrackCount; i++)
+			{
+				std::string name = (i % 10 == 0 ? "Album" + std::to_string(i / 100) + "/" : std::string()) + "Track_" + std::to_string(i);
+				const char* extension = i % 3 == 0 ? ".flac" : i % 3 == 1 ? ".opus" : ".wav";
+				std::filesystem::create_directories((std::filesystem::path("Sound") / name).parent_path());
+				std::ofstream(std::filesystem::path("Sound") / (name + extension), std::ios::binary) << "x";
+				names.push_back(name + ".ogg");
+			}
+			ModFiles.mountDirectory("Sound", 0);
+		}
+
+		~GameFolder()
+		{
+			std::error_code ec;
+			std::filesystem::current_path(previous, ec);
+		}
+	};
+
+	// FindBGM's fallback in hooks_audio.cpp, the whole lookup before the track table
+	bool Probe(std::string_view directory, std::string_view path)
+	{
+		std::filesystem::path fileName = std::filesystem::path(directory) / path;
+		bool exists = ModFiles.exists(fileName);
+		for (const char* extension : { ".flac", ".opus", ".wav" })
+		{
+			std::filesystem::path typeName = fileName;
+			exists |= ModFiles.exists(typeName.replace_extension(extension));
+		}
+		return exists;
+	}
+}
+
+BENCH_CASE(Lookup)
+{
+	GameFolder folder;
+	BGMTrackTable table;
+	table.build({ "Sound" });
+	printf(" %zu tracks\n", table.size());
+
+	std::vector<std::string> missing;
+	for (size_t i = 0; i < 64; i++)
+		missing.push_back("Missing_" + std::to_string(i) + ".ogg");
+
+	size_t next = 0;
+	Bench::Measure("track table find, hit", [&]
+	{
+		const BGMTrackTable::Track* track = nullptr;
+		Bench::Consume(table.find(".\\Sound", folder.names[next++ % folder.names.size()], &track) && track);
+	}, 0, 1);
+
+	Bench::Measure("track table find, miss", [&]
+	{
+		const BGMTrackTable::Track* track = nullptr;
+		Bench::Consume(table.find(".\\Sound", missing[next++ % missing.size()], &track) && track);
+	}, 0, 1);
+
+	Bench::Measure("ModFiles probes, hit", [&]
+	{
+		Bench::Consume(Probe(".\\Sound", folder.names[next++ % folder.names.size()]));
+	}, 0, 1);
+
+	Bench::Measure("ModFiles probes, miss", [&]
+	{
+		Bench::Consume(Probe(".\\Sound", missing[next++ % missing.size()]));
+	}, 0, 1);
+}
+
+BENCH_CASE(Build)
+{
+	// What a rescan costs once ModFiles has re-read the folder
+	GameFolder folder;
+	BGMTrackTable table;
+	Bench::Measure("build from ModFiles", [&]
+	{
+		table.build({ "Sound" });
+		Bench::Consume(table.size());
+	}, 0, TrackCount);
+}
+
+BENCH_MAIN()
@@ -0,0 +1,127 @@
+// MappedFile against reading the same data into a heap buffer, the choice FileDataCache & TexturePack made for replacement textures
+// Files are written fresh, so this measures the OS file cache rather than the drive: that's the case the texture cache is for,
+// a cold read is dominated by the drive either way
+
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "bench.hpp"
+
+namespace
+{
+	// Sums a word from every 64 bytes, so each cache line of the data actually gets pulled in like the texture upload would
+	uint64_t Touch(const uint8_t* data, size_t size)
+	{
+		uint64_t sum = 0;
+		for (size_t i = 0; i + 8 <= size; i += 64)
+		{
+			uint64_t word;
+			memcpy(&word, data + i, 8);
+			sum += word;
+		}
+		return sum;
+	}
+
+	std::filesystem::path WriteFile(const Bench::TempDirectory& directory, const char* name, size_t size)
+	{
+		std::vector<uint8_t> data(size);
+		std::mt19937 rng{ uint32_t(size) };
+		for (auto& byte : data)
+			byte = uint8_t(rng());
+
+		auto path = directory.path / name;
+		std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), std::streamsize(size));
+		return path;
+	}
+
+	std::vector<uint8_t> ReadAll(const std::filesystem::path& path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		std::vector<uint8_t> data(size_t(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()));
+		return data;
+	}
+}
+
+BENCH_CASE(WholeFiles)
+{
+	// Sizes of typical replacements: a small UI texture, a 1024x1024 DXT5 & a 2048x2048 RGBA one
+	Bench::TempDirectory directory("bench_mapped_file");
+	for (size_t size : { size_t(64 * 1024), size_t(1024 * 1024), size_t(16 * 1024 * 1024) })
+	{
+		auto path = WriteFile(directory, "whole.dds", size);
+		printf(" %zu KB\n", size / 1024);
+
+		Bench::Measure("ifstream read into a vector", [&]
+		{
+			auto data = ReadAll(path);
+			Bench::Consume(Touch(data.data(), data.size()));
+		}, size);
+
+		Bench::Measure("open, map & touch", [&]
+		{
+			MappedFile file;
+			file.open(path);
+			auto view = file.mapAll();
+			Bench::Consume(Touch(view.data(), view.size()));
+		}, size);
+
+		Bench::Measure("open, map & touchPages", [&]
+		{
+			MappedFile file;
+			file.open(path);
+			auto view = file.mapAll();
+			view.touchPages();
+		}, size);
+
+		// What a FileDataCache hit costs: the view is already mapped & faulted in
+		MappedFile file;
+		file.open(path);
+		auto view = file.mapAll();
+		view.touchPages();
+		Bench::Measure("touch an existing view", [&] { Bench::Consume(Touch(view.data(), view.size())); }, size);
+	}
+}
+
+BENCH_CASE(PackEntries)
+{
+	// Random entries out of a 64 MB archive, like TexturePack::read: mapping a window per entry against seeking & reading it
+	Bench::TempDirectory directory("bench_mapped_file");
+	constexpr size_t ArchiveSize = 64 * 1024 * 1024;
+	auto path = WriteFile(directory, "archive.texpack", ArchiveSize);
+
+	for (size_t entrySize : { size_t(16 * 1024), size_t(256 * 1024), size_t(4 * 1024 * 1024) })
+	{
+		printf(" %zu KB entries\n", entrySize / 1024);
+		std::mt19937 rng(1);
+		auto nextOffset = [&] { return uint64_t(rng() % (ArchiveSize - entrySize)) & ~uint64_t(15); };
+
+		std::ifstream stream(path, std::ios::binary);
+		std::vector<uint8_t> buffer(entrySize);
+		Bench::Measure("seek & read into a reused buffer", [&]
+		{
+			stream.seekg(std::streamoff(nextOffset()));
+			stream.read(reinterpret_cast<char*>(buffer.data()), std::streamsize(entrySize));
+			Bench::Consume(Touch(buffer.data(), entrySize));
+		}, entrySize);
+
+		MappedFile file;
+		file.open(path);
+		Bench::Measure("map a view of the entry", [&]
+		{
+			auto view = file.map(nextOffset(), entrySize);
+			Bench::Consume(Touch(view.data(), view.size()));
+		}, entrySize);
+
+		auto whole = file.mapAll();
+		Bench::Measure("slice of one whole-file view", [&]
+		{
+			Bench::Consume(Touch(whole.data() + nextOffset(), entrySize));
+		}, entrySize);
+	}
+}
+
+BENCH_MAIN()
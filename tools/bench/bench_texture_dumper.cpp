@@ -0,0 +1,77 @@
+// TextureDumpWriter against writing each dump inline like HandleTexture used to
+// What the loading thread pays is queue(), the copy & hand-off, flush() is included separately to show when the files are
+// actually on disk. Sizes are in the range of the game's smaller scene textures, spread over a few sets.
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "texture_dumper.hpp"
+#include "bench.hpp"
+
+namespace
+{
+	const size_t TextureCount = 2000;
+	const size_t TextureSize = 16 * 1024;
+	const size_t SetCount = 40;
+
+	struct Textures
+	{
+		Bench::TempDirectory directory{ "bench_texture_dumper" };
+		std::vector<uint8_t> data = std::vector<uint8_t>(TextureSize, 0x5A);
+		std::vector<std::filesystem::path> paths;
+
+		Textures()
+		{
+			for (size_t i = 0; i < TextureCount; i++)
+				paths.push_back(directory.path / ("cs_stage" + std::to_string(i % SetCount) + ".xmtset") / (std::to_string(i) + "_0x1234_64x64.dds"));
+		}
+	};
+
+	// The old extraction, folder check & write on the loading thread for every texture
+	void WriteInline(const std::filesystem::path& path, const std::vector<uint8_t>& data)
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(path.parent_path(), ec);
+		std::ofstream(path, std::ios::binary | std::ios::trunc).write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+	}
+}
+
+BENCH_CASE(Dump)
+{
+	Textures textures;
+	printf(" %zu textures of %zu KB in %zu folders\n", TextureCount, TextureSize / 1024, SetCount);
+
+	Bench::Measure("inline write", [&]
+	{
+		for (const auto& path : textures.paths)
+			WriteInline(path, textures.data);
+	}, TextureCount * TextureSize, TextureCount);
+
+	TextureDumpWriter writer;
+	Bench::Measure("queue()", [&]
+	{
+		for (const auto& path : textures.paths)
+			writer.queue(path, textures.data.data(), textures.data.size());
+	}, TextureCount * TextureSize, TextureCount);
+	writer.flush();
+
+	Bench::Measure("queue() + flush()", [&]
+	{
+		for (const auto& path : textures.paths)
+			writer.queue(path, textures.data.data(), textures.data.size());
+		writer.flush();
+	}, TextureCount * TextureSize, TextureCount);
+
+	// Whole queue still unwritten when it's stopped, the worst case for how long DLL detach can take
+	Bench::Measure("queue() + shutdown()", [&]
+	{
+		TextureDumpWriter stopping;
+		for (const auto& path : textures.paths)
+			stopping.queue(path, textures.data.data(), textures.data.size());
+		stopping.shutdown();
+	}, TextureCount * TextureSize, TextureCount);
+}
+
+BENCH_MAIN()
@@ -0,0 +1,51 @@
+// TextureHashCache lookups against hashing the whole file with XXH32, what HandleTexture does with the cache turned off
+// Sizes cover the game's textures from small UI sheets to the biggest stage textures. "first time" is a texture that
+// isn't in the table yet: sampled key, full hash & a record appended to the file.
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <xxhash.h>
+
+#include "texture_hash_cache.hpp"
+#include "bench.hpp"
+
+BENCH_CASE(Hash)
+{
+	Bench::TempDirectory directory{ "bench_texture_hash_cache" };
+	TextureHashCache cache;
+	if (!cache.open(directory.path / "texture_hashes.bin"))
+		Bench::Fail("couldn't create the hash table");
+
+	std::mt19937 rng(1);
+	for (size_t size : { size_t(128 * 1024), size_t(1024 * 1024), size_t(4 * 1024 * 1024), size_t(16 * 1024 * 1024) })
+	{
+		std::vector<uint8_t> data(size);
+		for (auto& byte : data)
+			byte = uint8_t(rng());
+
+		printf(" %zu KB\n", size / 1024);
+		Bench::Measure("XXH32, whole file", [&] { Bench::Consume(XXH32(data.data(), data.size(), 0)); }, size, 1);
+		Bench::Measure("TextureHashCache, in the table", [&] { Bench::Consume(cache.hash(data.data(), data.size())); }, size, 1);
+
+		// Changing the header makes every call a new texture
+		uint32_t counter = 0;
+		Bench::Measure("TextureHashCache, first time", [&]
+		{
+			memcpy(data.data(), &++counter, sizeof(counter));
+			Bench::Consume(cache.hash(data.data(), data.size()));
+		}, size, 1);
+	}
+
+	// What loading the table costs at startup, with a table the size of everything in the game hashed
+	printf(" table load, %zu hashes\n", cache.size());
+	cache.close();
+	Bench::Measure("open()", [&]
+	{
+		TextureHashCache loaded;
+		Bench::Consume(loaded.open(directory.path / "texture_hashes.bin") ? loaded.size() : 0);
+	}, 0, cache.size());
+}
+
+BENCH_MAIN()
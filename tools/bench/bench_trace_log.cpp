@@ -0,0 +1,110 @@
+// TRACE against spdlog for the kind of per-frame line the FFB & input hooks log
+// spdlog is set up like the game's log: a file sink that's flushed after every message, & once more without the flush.
+// The trace writer only drains every 50ms, so TRACE is timed in bursts that fit a thread's ring with a pause between them,
+// otherwise this would mostly be timing dropped events.
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/basic_file_sink.h>
+
+#include "trace_log.hpp"
+#include "bench.hpp"
+
+namespace
+{
+	const int Burst = 2000;
+
+	// Average seconds per call of func, over as many bursts as fit in wallSeconds
+	template <typename Func>
+	double MeasureBursts(Func&& func, double wallSeconds = 1.0)
+	{
+		double elapsed = 0;
+		uint64_t calls = 0;
+		auto end = Bench::Clock::now() + std::chrono::duration_cast<Bench::Clock::duration>(std::chrono::duration<double>(wallSeconds));
+		while (Bench::Clock::now() < end)
+		{
+			auto start = Bench::Clock::now();
+			for (int i = 0; i < Burst; i++)
+				func(i);
+			elapsed += Bench::Seconds(Bench::Clock::now() - start);
+			calls += Burst;
+			std::this_thread::sleep_for(std::chrono::milliseconds(60));
+		}
+		return elapsed / double(calls);
+	}
+}
+
+BENCH_CASE(PerMessage)
+{
+	Bench::TempDirectory directory{ "bench_trace_log" };
+	float speed = 123.456f, lateral = 0.25f, steer = -0.5f;
+
+	auto previous = spdlog::default_logger();
+	auto logger = std::make_shared<spdlog::logger>("", std::make_shared<spdlog::sinks::basic_file_sink_mt>((directory.path / "log.txt").string(), true));
+	logger->set_level(spdlog::level::debug);
+	spdlog::set_default_logger(logger);
+
+	int frame = 0;
+	spdlog::flush_on(spdlog::level::debug);
+	Bench::Measure("spdlog, flushed like the game log", [&]
+	{
+		frame++;
+		spdlog::info("FFB: spd={:.3f} lat={:.2f} steer={:.3f} constLvl={} warmup={}", speed, lateral, steer, frame, frame < 100);
+	}, 0, 1);
+
+	spdlog::flush_on(spdlog::level::off);
+	Bench::Measure("spdlog, unflushed", [&]
+	{
+		frame++;
+		spdlog::info("FFB: spd={:.3f} lat={:.2f} steer={:.3f} constLvl={} warmup={}", speed, lateral, steer, frame, frame < 100);
+	}, 0, 1);
+
+	spdlog::set_default_logger(previous);
+
+	TraceLog::Init(directory.path / "bench.trace");
+	double perTrace = MeasureBursts([&](int i)
+	{
+		TRACE("FFB: spd={:.3f} lat={:.2f} steer={:.3f} constLvl={} warmup={}", speed, lateral, steer, i, i < 100);
+	});
+	Bench::Report("TRACE", perTrace, 0, 1);
+	TraceLog::Shutdown();
+
+	// What every call site costs when TraceLog is off, batched since it's about as cheap as reading the clock
+	Bench::Measure("TRACE, disabled", [&]
+	{
+		for (int i = 0; i < 1000; i++)
+			TRACE("FFB: spd={:.3f} lat={:.2f} steer={:.3f} constLvl={} warmup={}", speed, lateral, steer, i, i < 100);
+	}, 0, 1000);
+}
+
+BENCH_CASE(Threads)
+{
+	// Four threads at once, each has its own ring so they shouldn't slow each other down
+	Bench::TempDirectory directory{ "bench_trace_log" };
+	TraceLog::Init(directory.path / "bench.trace");
+
+	const int ThreadCount = 4;
+	double perTrace[ThreadCount] = {};
+	std::vector<std::thread> threads;
+	for (int t = 0; t < ThreadCount; t++)
+	{
+		threads.emplace_back([t, &perTrace]
+		{
+			perTrace[t] = MeasureBursts([t](int i) { TRACE("thread {} event {}", t, i); });
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	TraceLog::Shutdown();
+
+	double total = 0;
+	for (double seconds : perTrace)
+		total += seconds;
+	Bench::Report("TRACE, 4 threads", total / ThreadCount, 0, 1);
+}
+
+BENCH_MAIN()
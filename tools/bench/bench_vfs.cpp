@@ -0,0 +1,136 @@
+// VirtualFileSystem lookups & mounting on a generated mod folder
+// Key() is compared against the absolute() + lexically_normal() version it replaced, lookups against asking the file
+// system directly, & mounting with a manifest against a full listing.
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "vfs.hpp"
+#include "bench.hpp"
+
+namespace
+{
+	const size_t FolderCount = 40;
+	const size_t FilesPerFolder = 50;
+
+	struct ModFolder
+	{
+		Bench::TempDirectory directory{ "bench_vfs" };
+		std::filesystem::path previous = std::filesystem::current_path();
+		std::vector<std::string> files; // relative to the working directory, like the game asks for them
+
+		ModFolder()
+		{
+			std::filesystem::current_path(directory.path);
+			for (size_t folder = 0; folder < FolderCount; folder++)
+			{
+				auto path = std::filesystem::path("Mods") / ("cs_stage" + std::to_string(folder) + ".xmtset");
+				std::filesystem::create_directories(path);
+				for (size_t file = 0; file < FilesPerFolder; file++)
+				{
+					auto name = (path / ("0x" + std::to_string(folder * 1000 + file) + ".dds")).string();
+					std::ofstream(name, std::ios::binary) << "DDS ";
+					files.push_back(name);
+				}
+			}
+		}
+
+		~ModFolder()
+		{
+			std::error_code ec;
+			std::filesystem::current_path(previous, ec);
+		}
+	};
+
+	std::string OldKey(const std::filesystem::path& path)
+	{
+		std::error_code ec;
+		auto absolute = std::filesystem::absolute(path, ec);
+		auto generic = (ec ? path : absolute).lexically_normal().generic_u8string();
+		std::string key(generic.begin(), generic.end());
+		while (key.size() > 1 && key.back() == '/')
+			key.pop_back();
+		return key;
+	}
+}
+
+BENCH_CASE(Key)
+{
+	ModFolder folder;
+	VirtualFileSystem vfs;
+	vfs.mountDirectory("Mods", 0);
+
+	const std::filesystem::path relative = ".\\Mods/cs_stage12.xmtset/../cs_stage12.xmtset/0x12034.dds";
+	const std::filesystem::path absolute = folder.directory.path / "Mods" / "cs_stage12.xmtset" / "0x12034.dds";
+
+	Bench::Measure("absolute + lexically_normal, relative", [&] { Bench::Consume(OldKey(relative).size()); }, 0, 1);
+	Bench::Measure("Key(), relative", [&] { Bench::Consume(VirtualFileSystem::Key(relative).size()); }, 0, 1);
+	std::string buffer;
+	Bench::Measure("Key() into a reused buffer, relative", [&]
+	{
+		VirtualFileSystem::Key(relative, buffer);
+		Bench::Consume(buffer.size());
+	}, 0, 1);
+
+	Bench::Measure("absolute + lexically_normal, absolute", [&] { Bench::Consume(OldKey(absolute).size()); }, 0, 1);
+	Bench::Measure("Key() into a reused buffer, absolute", [&]
+	{
+		VirtualFileSystem::Key(absolute, buffer);
+		Bench::Consume(buffer.size());
+	}, 0, 1);
+}
+
+BENCH_CASE(Lookup)
+{
+	ModFolder folder;
+	VirtualFileSystem vfs;
+	vfs.mountDirectory("Mods", 0);
+
+	std::vector<std::filesystem::path> hits(folder.files.begin(), folder.files.end());
+	std::vector<std::filesystem::path> misses;
+	for (const auto& file : hits)
+		misses.push_back(std::filesystem::path(file).replace_extension(".png"));
+
+	size_t next = 0;
+	Bench::Measure("exists(), hit", [&] { Bench::Consume(vfs.exists(hits[next++ % hits.size()])); }, 0, 1);
+	Bench::Measure("exists(), miss", [&] { Bench::Consume(vfs.exists(misses[next++ % misses.size()])); }, 0, 1);
+	Bench::Measure("stat(), hit", [&] { Bench::Consume(vfs.stat(hits[next++ % hits.size()])->size); }, 0, 1);
+
+	std::error_code ec;
+	Bench::Measure("std::filesystem::exists, hit", [&] { Bench::Consume(std::filesystem::exists(hits[next++ % hits.size()], ec)); }, 0, 1);
+	Bench::Measure("std::filesystem::exists, miss", [&] { Bench::Consume(std::filesystem::exists(misses[next++ % misses.size()], ec)); }, 0, 1);
+}
+
+BENCH_CASE(Mount)
+{
+	ModFolder folder;
+	const std::filesystem::path manifest = "manifest.bin";
+	const size_t fileCount = FolderCount * FilesPerFolder;
+	printf(" %zu files in %zu folders\n", fileCount, FolderCount);
+
+	Bench::Measure("full listing", [&]
+	{
+		VirtualFileSystem vfs;
+		Bench::Consume(vfs.mountDirectory("Mods", 0));
+	}, 0, fileCount);
+
+	// First one saves it, the rest only check folder write times
+	Bench::Measure("unchanged, from manifest", [&]
+	{
+		VirtualFileSystem vfs;
+		Bench::Consume(vfs.mountDirectory("Mods", 0, manifest));
+	}, 0, fileCount);
+
+	// stat() on a file the manifest listed reads it from the file system the first time
+	VirtualFileSystem vfs;
+	vfs.mountDirectory("Mods", 0, manifest);
+	size_t next = 0;
+	Bench::Measure("stat() of files listed from the manifest", [&]
+	{
+		Bench::Consume(vfs.stat(folder.files[next++ % folder.files.size()])->size);
+	}, 0, 1);
+}
+
+BENCH_MAIN()
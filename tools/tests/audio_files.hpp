@@ -0,0 +1,215 @@
+// Generates audio files for the decoder tests & benchmarks, so no sample files need to be checked in
+// FLAC files are real FLAC any decoder can play, just not compressed very well: every subframe is FIXED order 2 with a
+// single Rice partition (or VERBATIM if that's smaller), channels are coded independently & there's no seek table.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace TestAudio
+{
+	class BitWriter
+	{
+	public:
+		std::vector<uint8_t> bytes;
+
+		void write(uint64_t value, unsigned bits)
+		{
+			while (bits--)
+			{
+				if (!used)
+					bytes.push_back(0);
+				if ((value >> bits) & 1)
+					bytes.back() |= uint8_t(0x80 >> used);
+				used = (used + 1) & 7;
+			}
+		}
+
+		void writeUnary(uint64_t zeros)
+		{
+			for (; zeros >= 32; zeros -= 32)
+				write(0, 32);
+			write(1, unsigned(zeros) + 1);
+		}
+
+		void align() { used = 0; }
+
+	private:
+		unsigned used = 0; // bits used in the last byte
+	};
+
+	inline uint8_t Crc8(const uint8_t* data, size_t size)
+	{
+		uint8_t crc = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc ^= data[i];
+			for (int bit = 0; bit < 8; bit++)
+				crc = uint8_t((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+		}
+		return crc;
+	}
+
+	inline uint16_t Crc16(const uint8_t* data, size_t size)
+	{
+		uint16_t crc = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc ^= uint16_t(data[i] << 8);
+			for (int bit = 0; bit < 8; bit++)
+				crc = uint16_t((crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1);
+		}
+		return crc;
+	}
+
+	inline void WriteLE32(std::vector<uint8_t>& out, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+			out.push_back(uint8_t(value >> (i * 8)));
+	}
+
+	// Vorbis comment block, shared by FLAC & Ogg (OpusTags is the same after its magic)
+	inline std::vector<uint8_t> VorbisComments(const std::vector<std::string>& comments)
+	{
+		const std::string vendor = "OutRun2006Tweaks tests";
+		std::vector<uint8_t> out;
+		WriteLE32(out, uint32_t(vendor.size()));
+		out.insert(out.end(), vendor.begin(), vendor.end());
+		WriteLE32(out, uint32_t(comments.size()));
+		for (const auto& comment : comments)
+		{
+			WriteLE32(out, uint32_t(comment.size()));
+			out.insert(out.end(), comment.begin(), comment.end());
+		}
+		return out;
+	}
+
+	inline void WriteSubframe(BitWriter& bits, const int32_t* samples, size_t count, size_t stride, unsigned bitsPerSample)
+	{
+		auto sample = [&](size_t i) { return int64_t(samples[i * stride]); };
+
+		// Order 2 residuals, zigzagged the way Rice coding wants them
+		std::vector<uint64_t> residuals;
+		uint64_t total = 0;
+		for (size_t i = 2; i < count; i++)
+		{
+			int64_t residual = sample(i) - 2 * sample(i - 1) + sample(i - 2);
+			residuals.push_back(residual < 0 ? uint64_t(-residual) * 2 - 1 : uint64_t(residual) * 2);
+			total += residuals.back();
+		}
+
+		unsigned parameter = 0;
+		if (!residuals.empty())
+			while (parameter < 14 && (uint64_t(1) << (parameter + 1)) <= total / residuals.size())
+				parameter++;
+
+		uint64_t riceBits = 2 * bitsPerSample + 2 + 4 + 4;
+		for (uint64_t residual : residuals)
+			riceBits += (residual >> parameter) + 1 + parameter;
+
+		if (count <= 2 || riceBits >= uint64_t(bitsPerSample) * count)
+		{
+			bits.write(0x02, 8); // VERBATIM
+			for (size_t i = 0; i < count; i++)
+				bits.write(uint64_t(sample(i)) & ((uint64_t(1) << bitsPerSample) - 1), bitsPerSample);
+			return;
+		}
+
+		bits.write(0x14, 8); // FIXED, order 2
+		for (size_t i = 0; i < 2; i++)
+			bits.write(uint64_t(sample(i)) & ((uint64_t(1) << bitsPerSample) - 1), bitsPerSample);
+		bits.write(0, 2); // 4-bit Rice parameters
+		bits.write(0, 4); // partition order 0
+		bits.write(parameter, 4);
+		for (uint64_t residual : residuals)
+		{
+			bits.writeUnary(residual >> parameter);
+			bits.write(residual & ((uint64_t(1) << parameter) - 1), parameter);
+		}
+	}
+
+	// samples are interleaved, 16 or 24-bit
+	inline std::vector<uint8_t> EncodeFLAC(const std::vector<int32_t>& samples, unsigned channels, unsigned sampleRate, unsigned bitsPerSample,
+		const std::vector<std::string>& comments = {}, unsigned blockSize = 4096)
+	{
+		const uint64_t totalSamples = samples.size() / channels;
+
+		std::vector<uint8_t> out = { 'f', 'L', 'a', 'C' };
+		BitWriter info;
+		info.write(comments.empty() ? 0x80 : 0x00, 8); // STREAMINFO, last block if there's no comments
+		info.write(34, 24);
+		info.write(blockSize, 16);
+		info.write(blockSize, 16);
+		info.write(0, 24); // frame sizes unknown
+		info.write(0, 24);
+		info.write(sampleRate, 20);
+		info.write(channels - 1, 3);
+		info.write(bitsPerSample - 1, 5);
+		info.write(totalSamples, 36);
+		for (int i = 0; i < 4; i++)
+			info.write(0, 32); // no MD5
+		out.insert(out.end(), info.bytes.begin(), info.bytes.end());
+
+		if (!comments.empty())
+		{
+			auto block = VorbisComments(comments);
+			out.push_back(0x84);
+			out.push_back(uint8_t(block.size() >> 16));
+			out.push_back(uint8_t(block.size() >> 8));
+			out.push_back(uint8_t(block.size()));
+			out.insert(out.end(), block.begin(), block.end());
+		}
+
+		unsigned rateCode = sampleRate == 44100 ? 9 : sampleRate == 48000 ? 10 : sampleRate == 32000 ? 8 : sampleRate == 96000 ? 11 : 0;
+		unsigned sizeCode = bitsPerSample == 16 ? 4 : bitsPerSample == 24 ? 6 : 0;
+
+		uint64_t frameNumber = 0;
+		for (uint64_t first = 0; first < totalSamples; first += blockSize, frameNumber++)
+		{
+			const size_t count = size_t(std::min<uint64_t>(blockSize, totalSamples - first));
+
+			BitWriter frame;
+			frame.write(0x3FFE, 14);
+			frame.write(0, 2); // fixed block size
+			frame.write(7, 4); // block size follows as 16 bits
+			frame.write(rateCode, 4);
+			frame.write(channels - 1, 4);
+			frame.write(sizeCode, 3);
+			frame.write(0, 1);
+
+			// Frame number, UTF-8 style
+			if (frameNumber < 0x80)
+				frame.write(frameNumber, 8);
+			else
+			{
+				unsigned extra = frameNumber < 0x800 ? 1 : frameNumber < 0x10000 ? 2 : frameNumber < 0x200000 ? 3 : 4;
+				frame.write(((0xFF00 >> (extra + 1)) & 0xFF) | (frameNumber >> (extra * 6)), 8);
+				for (unsigned i = extra; i-- > 0;)
+					frame.write(0x80 | ((frameNumber >> (i * 6)) & 0x3F), 8);
+			}
+
+			frame.write(count - 1, 16);
+			frame.write(Crc8(frame.bytes.data(), frame.bytes.size()), 8);
+
+			for (unsigned channel = 0; channel < channels; channel++)
+				WriteSubframe(frame, &samples[size_t(first) * channels + channel], count, channels, bitsPerSample);
+
+			frame.align();
+			frame.write(Crc16(frame.bytes.data(), frame.bytes.size()), 16);
+			out.insert(out.end(), frame.bytes.begin(), frame.bytes.end());
+		}
+		return out;
+	}
+
+	inline bool WriteFile(const std::filesystem::path& path, const std::vector<uint8_t>& data)
+	{
+		std::ofstream file(path, std::ios::binary);
+		file.write((const char*)data.data(), std::streamsize(data.size()));
+		return bool(file);
+	}
+}
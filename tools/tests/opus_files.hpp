@@ -0,0 +1,133 @@
+// Ogg Opus files for the decoder tests & benchmarks (RFC 7845), encoded with libopus & paged by hand
+// 20ms packets, a page per second of audio & the end trimmed by the last granule position, like opusenc would write.
+// Needs the opus library, FLAC only tests just want audio_files.hpp.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opus.h>
+
+#include "audio_files.hpp"
+
+namespace TestAudio
+{
+	inline uint32_t OggCrc(const uint8_t* data, size_t size)
+	{
+		uint32_t crc = 0;
+		for (size_t i = 0; i < size; i++)
+		{
+			crc ^= uint32_t(data[i]) << 24;
+			for (int bit = 0; bit < 8; bit++)
+				crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+		}
+		return crc;
+	}
+
+	class OggWriter
+	{
+	public:
+		std::vector<uint8_t> bytes;
+
+		// Writes the packets as one page, granule is where the last of them ends
+		void page(const std::vector<std::vector<uint8_t>>& packets, int64_t granule, bool last)
+		{
+			std::vector<uint8_t> page = { 'O', 'g', 'g', 'S', 0, uint8_t((sequence == 0 ? 0x02 : 0) | (last ? 0x04 : 0)) };
+			for (int i = 0; i < 8; i++)
+				page.push_back(uint8_t(uint64_t(granule) >> (i * 8)));
+			WriteLE32(page, Serial);
+			WriteLE32(page, sequence++);
+			WriteLE32(page, 0); // CRC, filled in below
+
+			std::vector<uint8_t> segments;
+			for (const auto& packet : packets)
+			{
+				segments.insert(segments.end(), packet.size() / 255, 255);
+				segments.push_back(uint8_t(packet.size() % 255));
+			}
+			page.push_back(uint8_t(segments.size()));
+			page.insert(page.end(), segments.begin(), segments.end());
+			for (const auto& packet : packets)
+				page.insert(page.end(), packet.begin(), packet.end());
+
+			uint32_t crc = OggCrc(page.data(), page.size());
+			for (int i = 0; i < 4; i++)
+				page[22 + i] = uint8_t(crc >> (i * 8));
+			bytes.insert(bytes.end(), page.begin(), page.end());
+		}
+
+	private:
+		static const uint32_t Serial = 0x4F525554;
+		uint32_t sequence = 0;
+	};
+
+	// samples are interleaved 48kHz, mono or stereo. Empty if libopus failed.
+	inline std::vector<uint8_t> EncodeOpus(const std::vector<int16_t>& samples, unsigned channels, const std::vector<std::string>& comments = {},
+		int bitrate = 128000)
+	{
+		const int FrameSamples = 960;
+		const size_t totalSamples = samples.size() / channels;
+
+		int error = 0;
+		OpusEncoder* encoder = opus_encoder_create(48000, int(channels), OPUS_APPLICATION_AUDIO, &error);
+		if (!encoder)
+			return {};
+		opus_encoder_ctl(encoder, OPUS_SET_BITRATE(bitrate));
+		opus_int32 preSkip = 0;
+		opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&preSkip));
+
+		OggWriter ogg;
+		std::vector<uint8_t> head = { 'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, uint8_t(channels), uint8_t(preSkip), uint8_t(preSkip >> 8) };
+		WriteLE32(head, 48000);
+		head.insert(head.end(), { 0, 0, 0 }); // no gain, mapping family 0
+		ogg.page({ head }, 0, false);
+
+		std::vector<uint8_t> tags = { 'O', 'p', 'u', 's', 'T', 'a', 'g', 's' };
+		auto block = VorbisComments(comments);
+		tags.insert(tags.end(), block.begin(), block.end());
+		ogg.page({ tags }, 0, false);
+
+		// Encoder's delay is made up by padding the end, the last granule trims it back to the real length
+		const int64_t endGranule = int64_t(totalSamples) + preSkip;
+		std::vector<std::vector<uint8_t>> packets;
+		size_t segments = 0;
+		std::vector<int16_t> frame(size_t(FrameSamples) * channels);
+		int64_t granule = 0;
+		while (granule < endGranule)
+		{
+			std::fill(frame.begin(), frame.end(), int16_t(0));
+			size_t first = size_t(granule);
+			if (first < totalSamples)
+			{
+				size_t count = std::min<size_t>(FrameSamples, totalSamples - first);
+				std::copy_n(samples.begin() + first * channels, count * channels, frame.begin());
+			}
+
+			std::vector<uint8_t> packet(4000);
+			opus_int32 size = opus_encode(encoder, frame.data(), FrameSamples, packet.data(), opus_int32(packet.size()));
+			if (size < 0)
+			{
+				opus_encoder_destroy(encoder);
+				return {};
+			}
+			packet.resize(size_t(size));
+			segments += packet.size() / 255 + 1;
+			packets.push_back(std::move(packet));
+			granule += FrameSamples;
+
+			// Pages only have room for 255 segments, 16 is the most another packet could need
+			bool last = granule >= endGranule;
+			if (packets.size() == 50 || segments > 255 - 16 || last)
+			{
+				ogg.page(packets, last ? endGranule : granule, last);
+				packets.clear();
+				segments = 0;
+			}
+		}
+
+		opus_encoder_destroy(encoder);
+		return ogg.bytes;
+	}
+}
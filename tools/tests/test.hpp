@@ -0,0 +1,70 @@
+// Minimal test runner shared by the tests under tools/tests
+// Each test file is its own executable registered with ctest, it defines its cases with TEST_CASE & ends with TEST_MAIN.
+// Anything ctest passes on the command line (eg. paths to the tools being tested) is in Test::Arguments.
+// A failed CHECK prints where it failed & keeps going, the executable returns non-zero if anything failed.
+//
+// Tests only use code from src/ that doesn't need Windows or the game, so they build & run on any platform.
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+namespace Test
+{
+	struct Case
+	{
+		const char* name;
+		void (*func)();
+	};
+
+	inline std::vector<Case>& Cases()
+	{
+		static std::vector<Case> cases;
+		return cases;
+	}
+
+	inline int Failures = 0;
+	inline std::vector<const char*> Arguments;
+
+	struct Register
+	{
+		Register(const char* name, void (*func)()) { Cases().push_back({ name, func }); }
+	};
+
+	inline void Fail(const char* file, int line, const char* expression)
+	{
+		printf("  %s(%d): CHECK(%s) failed\n", file, line, expression);
+		Failures++;
+	}
+
+	inline int Run(int argc, char** argv)
+	{
+		Arguments.assign(argv + 1, argv + argc);
+
+		int failedCases = 0;
+		for (const auto& test : Cases())
+		{
+			int before = Failures;
+			test.func();
+			bool passed = Failures == before;
+			printf("[%s] %s\n", passed ? "pass" : "FAIL", test.name);
+			if (!passed)
+				failedCases++;
+		}
+
+		printf("%zu cases, %d failed\n", Cases().size(), failedCases);
+		return failedCases ? 1 : 0;
+	}
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static Test::Register name##_register(#name, name); \
+	static void name()
+
+#define CHECK(expression) \
+	do { if (!(expression)) Test::Fail(__FILE__, __LINE__, #expression); } while (0)
+
+#define TEST_MAIN() \
+	int main(int argc, char** argv) { return Test::Run(argc, argv); }
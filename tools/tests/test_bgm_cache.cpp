@@ -0,0 +1,228 @@
+// BGMCache budget & LRU eviction on files in a temp folder, & FLACStream decoding a cached file the same as the file itself
+// Prefetching happens on the cache's own thread, the tests wait for it through the prefetch count in getStats().
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_files.hpp"
+#include "bgm_cache.hpp"
+#include "pcm_stream.hpp"
+#include "test.hpp"
+
+namespace
+{
+	const size_t FileSize = 64 * 1024;
+
+	struct TempFiles
+	{
+		std::filesystem::path directory;
+
+		TempFiles()
+		{
+			directory = std::filesystem::temp_directory_path() / ("test_bgm_cache_" + std::to_string(std::random_device()()));
+			std::filesystem::create_directories(directory);
+		}
+
+		~TempFiles()
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(directory, ec);
+		}
+
+		// Contents depend on the name, so a cached view can be checked against the file it should be
+		std::filesystem::path add(const std::string& name, size_t size = FileSize)
+		{
+			std::vector<uint8_t> data(size);
+			for (size_t i = 0; i < size; i++)
+				data[i] = uint8_t(i * 31 + name.size() * 7 + name.back());
+			auto path = directory / name;
+			TestAudio::WriteFile(path, data);
+			return path;
+		}
+	};
+
+	bool Matches(const BGMCache::Entry& entry, const std::filesystem::path& path)
+	{
+		std::string name = path.filename().string();
+		if (!entry.owner || entry.size != std::filesystem::file_size(path))
+			return false;
+		for (size_t i = 0; i < entry.size; i++)
+			if (entry.data[i] != uint8_t(i * 31 + name.size() * 7 + name.back()))
+				return false;
+		return true;
+	}
+
+	// Waits until the background thread has read in count files in total
+	bool WaitForPrefetches(const BGMCache& cache, uint64_t count)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (cache.getStats().prefetches < count)
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	bool Cached(BGMCache& cache, const std::filesystem::path& path)
+	{
+		BGMCache::Entry entry;
+		return cache.find(path, &entry);
+	}
+}
+
+TEST_CASE(PrefetchedFilesHit)
+{
+	TempFiles files;
+	auto a = files.add("a.flac");
+
+	BGMCache cache(1024 * 1024);
+	BGMCache::Entry entry;
+	CHECK(!cache.find(a, &entry) && !entry.owner);
+
+	cache.prefetch(a);
+	cache.prefetch(a); // already queued or cached, only read once
+	CHECK(WaitForPrefetches(cache, 1));
+	cache.prefetch(a);
+
+	CHECK(cache.find(a, &entry));
+	CHECK(Matches(entry, a));
+
+	// Same file however the path is spelled
+	CHECK(Cached(cache, files.directory / "." / "a.flac"));
+
+	auto stats = cache.getStats();
+	CHECK(stats.hits == 2 && stats.misses == 1 && stats.prefetches == 1);
+	CHECK(stats.bytesResident == FileSize && stats.maxSize == 1024 * 1024);
+}
+
+TEST_CASE(EvictsLeastRecentlyUsed)
+{
+	TempFiles files;
+	auto a = files.add("a.flac"), b = files.add("b.flac"), c = files.add("c.flac"), d = files.add("d.flac");
+
+	// Room for three
+	BGMCache cache(FileSize * 3 + FileSize / 2);
+	for (const auto& path : { a, b, c })
+		cache.prefetch(path);
+	CHECK(WaitForPrefetches(cache, 3));
+
+	// a becomes the most recently used, so b is the oldest when d comes in
+	CHECK(Cached(cache, a));
+	BGMCache::Entry playing;
+	CHECK(cache.find(b, &playing));
+	CHECK(Cached(cache, c));
+	CHECK(Cached(cache, a));
+
+	cache.prefetch(d);
+	CHECK(WaitForPrefetches(cache, 4));
+	CHECK(!Cached(cache, b));
+	CHECK(Cached(cache, a) && Cached(cache, c) && Cached(cache, d));
+	CHECK(cache.getStats().bytesResident == FileSize * 3);
+
+	// Whoever still has an evicted entry can keep reading it
+	CHECK(Matches(playing, b));
+
+	// Shrinking the budget evicts right away, least recently looked up first (a, from the checks above)
+	cache.setMaxSize(FileSize * 2);
+	CHECK(cache.getMaxSize() == FileSize * 2);
+	CHECK(cache.getStats().bytesResident == FileSize * 2);
+	CHECK(!Cached(cache, a));
+	CHECK(Cached(cache, c) && Cached(cache, d));
+}
+
+TEST_CASE(StaysWithinBudget)
+{
+	TempFiles files;
+	auto small = files.add("small.opus", 1000);
+	auto big = files.add("big.flac", FileSize * 4);
+	auto missing = files.directory / "missing.flac";
+
+	BGMCache cache(FileSize * 2);
+
+	// Files bigger than the whole budget & ones that can't be opened aren't cached, the worker goes through the queue
+	// in order so once small is in the others were dealt with
+	cache.prefetch(big);
+	cache.prefetch(missing);
+	cache.prefetch(small);
+	CHECK(WaitForPrefetches(cache, 1));
+	CHECK(!Cached(cache, big) && !Cached(cache, missing) && Cached(cache, small));
+	CHECK(cache.getStats().bytesResident == 1000);
+
+	// Many files through a small budget never go over it
+	for (int i = 0; i < 20; i++)
+	{
+		cache.prefetch(files.add("track" + std::to_string(i) + ".flac", FileSize / 2 + size_t(i) * 1000));
+		CHECK(cache.getStats().bytesResident <= FileSize * 2);
+	}
+	CHECK(WaitForPrefetches(cache, 21));
+	CHECK(cache.getStats().bytesResident <= FileSize * 2);
+	CHECK(Cached(cache, files.directory / "track19.flac"));
+
+	// 0 disables it, everything's dropped & prefetches are ignored
+	cache.setMaxSize(0);
+	CHECK(cache.getStats().bytesResident == 0);
+	CHECK(!Cached(cache, files.directory / "track19.flac"));
+	cache.prefetch(small);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	CHECK(!Cached(cache, small) && cache.getStats().prefetches == 21);
+}
+
+TEST_CASE(DecodesFromMemoryLikeFromFile)
+{
+	// Real FLAC, both paths have to give the same samples including across a loop
+	std::vector<int32_t> samples;
+	for (uint64_t i = 0; i < 120000; i++)
+	{
+		samples.push_back(int32_t(std::lround(std::sin(double(i) * 0.05) * 12000.0)) + int32_t(i % 97));
+		samples.push_back(int32_t(std::lround(std::sin(double(i) * 0.031) * 9000.0)) - int32_t(i % 89));
+	}
+	TempFiles files;
+	auto path = files.directory / "track.flac";
+	CHECK(TestAudio::WriteFile(path, TestAudio::EncodeFLAC(samples, 2, 44100, 16, { "LOOPSTART=30000", "LOOPLENGTH=60000" })));
+
+	BGMCache cache(4 * 1024 * 1024);
+	cache.prefetch(path);
+	CHECK(WaitForPrefetches(cache, 1));
+	BGMCache::Entry entry;
+	CHECK(cache.find(path, &entry));
+
+	auto read = [](PcmStream& stream, size_t bytes)
+	{
+		std::vector<uint8_t> out(bytes);
+		size_t done = 0, got = 0;
+		while (done < bytes && stream.Read(out.data() + done, std::min<size_t>(bytes - done, 12345), &got) && got)
+			done += got;
+		out.resize(done);
+		return out;
+	};
+
+	const size_t bytes = (30000 + 60000 * 3) * 4;
+	auto fromFile = CreateFLACStream();
+	CHECK(fromFile->Open(path.string().c_str()));
+	auto fileData = read(*fromFile, bytes);
+	fromFile->Close();
+
+	auto fromMemory = CreateFLACStream();
+	CHECK(fromMemory->OpenFromMemory(entry.data, entry.size));
+	auto memoryData = read(*fromMemory, bytes);
+
+	CHECK(fileData.size() == bytes && memoryData.size() == bytes);
+	CHECK(fileData == memoryData);
+
+	// Cache dropping the file mid-track doesn't pull the data out from under the decoder, as long as the entry is kept
+	// like CStreamingWaveFile does
+	cache.setMaxSize(0);
+	CHECK(!Cached(cache, path));
+	fromMemory->Reset();
+	CHECK(read(*fromMemory, bytes) == fileData);
+}
+
+TEST_MAIN()
@@ -0,0 +1,193 @@
+// BGMTrackTable IDs & lookups, on a throwaway Sound folder in a temp working directory
+// find() has to answer every path BGMLoaderHook can ask about the same way the old per-extension ModFiles probes did,
+// or say it doesn't cover it so the caller still probes. IDs are case folded on Windows only, like VirtualFileSystem keys.
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "bgm_tracks.hpp"
+#include "vfs.hpp"
+#include "test.hpp"
+
+namespace
+{
+	// Temp folder that's the working directory while it's alive, since track IDs are relative to it
+	struct GameFolder
+	{
+		std::filesystem::path path;
+		std::filesystem::path previous;
+
+		GameFolder()
+		{
+			path = std::filesystem::temp_directory_path() / ("test_bgm_tracks_" + std::to_string(std::random_device()()));
+			std::filesystem::create_directories(path);
+			previous = std::filesystem::current_path();
+			std::filesystem::current_path(path);
+		}
+
+		~GameFolder()
+		{
+			std::error_code ec;
+			std::filesystem::current_path(previous, ec);
+			std::filesystem::remove_all(path, ec);
+		}
+
+		void add(const std::filesystem::path& file)
+		{
+			std::filesystem::create_directories(path / file.parent_path());
+			std::ofstream(path / file, std::ios::binary) << "not really audio";
+		}
+	};
+
+	// MakeId as a string, "!" if it refused the path
+	std::string Id(std::string_view directory, std::string_view path)
+	{
+		char id[BGMTrackTable::MaxIdLength];
+		size_t length = 0;
+		if (!BGMTrackTable::MakeId(directory, path, id, &length))
+			return "!";
+		return std::string(id, length);
+	}
+
+	// Which file find() picked for each type, "!" if it's not covered & "-" if there's no such track
+	std::string Find(const BGMTrackTable& table, std::string_view directory, std::string_view path)
+	{
+		const BGMTrackTable::Track* track = nullptr;
+		if (!table.find(directory, path, &track))
+			return "!";
+		if (!track)
+			return "-";
+		auto name = [](const std::string& file) { return file.empty() ? std::string() : std::filesystem::path(file).filename().string(); };
+		return name(track->flac) + "|" + name(track->opus) + "|" + name(track->wav);
+	}
+}
+
+TEST_CASE(MakeIdNormalizesSeparators)
+{
+	CHECK(Id("Sound", "track.ogg") == "Sound/track");
+	CHECK(Id(".\\Sound", "track.ogg") == "Sound/track");
+	CHECK(Id("./Sound/", "sub\\track.ogg") == "Sound/sub/track");
+	CHECK(Id("Sound\\\\sub", ".\\.\\track.ogg") == "Sound/sub/track");
+	CHECK(Id("", "Sound/track.ogg") == "Sound/track");
+	CHECK(Id("Sound", "") == "Sound");
+	CHECK(Id("", "") == "!");
+	CHECK(Id(".", ".") == "!");
+}
+
+TEST_CASE(MakeIdRefusesPathsOutsideTheGameFolder)
+{
+	CHECK(Id("..", "track.ogg") == "!");
+	CHECK(Id("Sound", "..\\track.ogg") == "!");
+	CHECK(Id("Sound/../Sound", "track.ogg") == "!");
+	CHECK(Id("/Sound", "track.ogg") == "!");
+	CHECK(Id("Sound", "\\track.ogg") == "!");
+	CHECK(Id("C:\\Games\\OutRun\\Sound", "track.ogg") == "!");
+	CHECK(Id("C:Sound", "track.ogg") == "!");
+	CHECK(Id("Sound", "D:track.ogg") == "!");
+
+	// Dots that aren't a whole segment are just part of the name
+	CHECK(Id("Sound", "...\\track.ogg") == "Sound/.../track");
+	CHECK(Id("Sound", "..track.ogg") == "Sound/..track");
+
+	// Up to MaxIdLength is fine, anything longer isn't
+	std::string name(BGMTrackTable::MaxIdLength - 6, 'a');
+	CHECK(Id("Sound", name) == "Sound/" + name);
+	CHECK(Id("Sound", name + "a") == "!");
+	CHECK(Id("Sound", name + ".ogg") == "!");
+}
+
+TEST_CASE(MakeIdStripsOneExtension)
+{
+	CHECK(Id("Sound", "track") == "Sound/track");
+	CHECK(Id("Sound", "track.flac") == "Sound/track");
+	CHECK(Id("Sound", "track.v2.flac") == "Sound/track.v2");
+	CHECK(Id("Sound", "track.") == "Sound/track");
+
+	// A leading dot is the name, not an extension, & dots in folder names stay
+	CHECK(Id("Sound", ".track") == "Sound/.track");
+	CHECK(Id("Sound", ".track.ogg") == "Sound/.track");
+	CHECK(Id("Sound.v2", "track") == "Sound.v2/track");
+	CHECK(Id("Sound", "mix.v2\\track") == "Sound/mix.v2/track");
+}
+
+TEST_CASE(MakeIdFoldsCaseOnWindows)
+{
+#ifdef _WIN32
+	CHECK(Id(".\\SOUND", "Track.OGG") == "sound/track");
+	CHECK(BGMTrackTable::HashId(Id("Sound", "TRACK.ogg")) == BGMTrackTable::HashId(Id("sound", "track.flac")));
+#else
+	CHECK(Id(".\\SOUND", "Track.OGG") == "SOUND/Track");
+	CHECK(Id("Sound", "TRACK") != Id("Sound", "track"));
+#endif
+}
+
+TEST_CASE(FindCoversTheScannedFolders)
+{
+	GameFolder folder;
+	folder.add("Sound/01_Splash_wave.flac");
+	folder.add("Sound/01_Splash_wave.wav");
+	folder.add("Sound/02_Magical_Sound_Shower.opus");
+	folder.add("Sound/Custom/Mix.v2.WAV");
+	folder.add("Sound/readme.txt");
+	folder.add("Other/03_Passing_Breeze.flac");
+
+	BGMTrackTable table;
+	table.build({ "Sound" });
+	CHECK(table.size() == 4);
+
+	// Any extension finds the track, every type it has is filled in
+	CHECK(Find(table, ".\\Sound", "01_Splash_wave.ogg") == "01_Splash_wave.flac||01_Splash_wave.wav");
+	CHECK(Find(table, "", "Sound\\02_Magical_Sound_Shower.ogg") == "|02_Magical_Sound_Shower.opus|");
+	CHECK(Find(table, "Sound", "Custom/Mix.v2.ogg") == "||Mix.v2.WAV");
+
+	// A file of some other type is still a track, just one with nothing for us to play
+	CHECK(Find(table, "Sound", "readme.ogg") == "||");
+
+	// Inside the folder but not there at all, vs. outside of it where the caller has to probe
+	CHECK(Find(table, "Sound", "04_Risky_Ride.ogg") == "-");
+	CHECK(Find(table, "Other", "03_Passing_Breeze.ogg") == "!");
+	CHECK(Find(table, "", "Sound") == "!");
+	CHECK(Find(table, "", "Soundtrack/01_Splash_wave.ogg") == "!");
+	CHECK(Find(table, (folder.path / "Sound").string(), "01_Splash_wave.ogg") == "!");
+	CHECK(Find(table, "Sound", "..\\Other\\03_Passing_Breeze.ogg") == "!");
+
+#ifdef _WIN32
+	CHECK(Find(table, "SOUND", "01_SPLASH_WAVE.OGG") == "01_Splash_wave.flac||01_Splash_wave.wav");
+#else
+	CHECK(Find(table, "SOUND", "01_Splash_wave.ogg") == "!");
+	CHECK(Find(table, "Sound", "01_SPLASH_WAVE.ogg") == "-");
+#endif
+}
+
+TEST_CASE(UpdatePicksUpRescans)
+{
+	GameFolder folder;
+	folder.add("Sound/01_Splash_wave.flac");
+	ModFiles.mountDirectory("Sound", 0);
+
+	BGMTrackTable table;
+	table.build({ "Sound" });
+	CHECK(!table.update());
+	CHECK(Find(table, "Sound", "02_Magical_Sound_Shower.ogg") == "-");
+
+	// Not watched, so the new file only shows up once the folder is rescanned
+	folder.add("Sound/02_Magical_Sound_Shower.opus");
+	CHECK(!table.update());
+	CHECK(Find(table, "Sound", "02_Magical_Sound_Shower.ogg") == "-");
+
+	table.rescan();
+	CHECK(table.update());
+	CHECK(!table.update());
+	CHECK(table.size() == 2);
+	CHECK(Find(table, "Sound", "02_Magical_Sound_Shower.ogg") == "|02_Magical_Sound_Shower.opus|");
+
+	std::filesystem::remove(folder.path / "Sound/01_Splash_wave.flac");
+	table.rescan();
+	CHECK(table.update());
+	CHECK(Find(table, "Sound", "01_Splash_wave.ogg") == "-");
+}
+
+TEST_MAIN()
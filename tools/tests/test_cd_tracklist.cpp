@@ -0,0 +1,163 @@
+// CDTrackList play order, wrapping & history
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cd_tracklist.hpp"
+#include "test.hpp"
+
+static std::vector<CDTrackList::Track> MakeTracks(size_t count)
+{
+	std::vector<CDTrackList::Track> tracks;
+	for (size_t i = 0; i < count; i++)
+		tracks.push_back({ "bgm/track" + std::to_string(i) + ".flac", "Track " + std::to_string(i) });
+	return tracks;
+}
+
+TEST_CASE(InOrderWraps)
+{
+	CDTrackList list;
+	list.assign(MakeTracks(4), false, 1);
+	CHECK(list.position() == 0);
+	CHECK(list.current().path == "bgm/track0.flac");
+	CHECK(list.peekNext().path == "bgm/track1.flac");
+
+	// Nothing played yet, previous is the last slot
+	CHECK(list.peekPrevious().path == "bgm/track3.flac");
+
+	for (int i = 0; i < 3; i++)
+		list.next();
+	CHECK(list.position() == 3);
+	CHECK(list.peekNext().path == "bgm/track0.flac");
+
+	list.next();
+	CHECK(list.position() == 0);
+	CHECK(list.current().path == "bgm/track0.flac");
+}
+
+TEST_CASE(ShuffleWrapReshuffles)
+{
+	const size_t count = 8;
+	CDTrackList list;
+	list.assign(MakeTracks(count), true, 1234);
+
+	std::vector<std::string> played = { list.current().path };
+	for (int i = 0; i < 40 * int(count); i++)
+	{
+		// peekNext has to be exact, including across the wrap where the next lap was drawn ahead
+		std::string expected = list.peekNext().path;
+		list.next();
+		CHECK(list.current().path == expected);
+		played.push_back(list.current().path);
+	}
+
+	size_t lapsDiffering = 0;
+	for (size_t lap = 0; lap + count <= played.size(); lap += count)
+	{
+		// Every lap plays each track once
+		std::set<std::string> unique(played.begin() + lap, played.begin() + lap + count);
+		CHECK(unique.size() == count);
+
+		if (lap >= count && !std::equal(played.begin() + lap, played.begin() + lap + count, played.begin() + lap - count))
+			lapsDiffering++;
+	}
+	CHECK(lapsDiffering > 0);
+
+	// & never the same track twice in a row, even where one lap ends & the next starts
+	for (size_t i = 1; i < played.size(); i++)
+		CHECK(played[i] != played[i - 1]);
+}
+
+TEST_CASE(PreviousFollowsHistory)
+{
+	CDTrackList list;
+	list.assign(MakeTracks(6), true, 99);
+
+	std::vector<std::string> played = { list.current().path };
+	for (int i = 0; i < 20; i++)
+	{
+		list.next();
+		played.push_back(list.current().path);
+	}
+
+	// Going back retraces what was played, across wraps, & doesn't add to the history itself
+	for (size_t i = 0; i < 20; i++)
+	{
+		std::string expected = list.peekPrevious().path;
+		list.previous();
+		CHECK(list.current().path == expected);
+		CHECK(list.current().path == played[played.size() - 2 - i]);
+	}
+
+	// History is used up, previous falls back to the slot before
+	size_t position = list.position();
+	list.previous();
+	CHECK(list.position() == (position + list.size() - 1) % list.size());
+}
+
+TEST_CASE(PreviousPastHistoryLimit)
+{
+	CDTrackList list;
+	list.assign(MakeTracks(3), false, 1);
+	for (size_t i = 0; i < CDTrackList::MaxHistory + 10; i++)
+		list.next();
+
+	std::vector<size_t> positions;
+	for (size_t i = 0; i < CDTrackList::MaxHistory + 1; i++)
+	{
+		list.previous();
+		positions.push_back(list.position());
+	}
+
+	// In order, so going back through history or past it both step back one slot at a time
+	for (size_t i = 1; i < positions.size(); i++)
+		CHECK(positions[i] == (positions[i - 1] + 2) % 3);
+}
+
+TEST_CASE(SelectFromGameIndex)
+{
+	// PettyAutoscene passes the games sel_bgm_kind_buf straight through, which is a slot in the play order
+	CDTrackList list;
+	list.assign(MakeTracks(5), true, 7);
+
+	size_t start = list.position();
+	std::string startPath = list.current().path;
+	list.select(3);
+	CHECK(list.position() == 3);
+
+	// Jumping adds to the history, so previous returns to what was playing before
+	CHECK(list.peekPrevious().path == startPath);
+
+	// Selecting the slot that's already playing isn't a jump
+	list.select(3);
+	list.previous();
+	CHECK(list.position() == start);
+
+	// Values past the end of the list (eg. the game's own track count) go to the first slot
+	list.select(5);
+	CHECK(list.position() == 0);
+	list.select(0xFF);
+	CHECK(list.position() == 0);
+}
+
+TEST_CASE(SmallLists)
+{
+	CDTrackList one;
+	one.assign(MakeTracks(1), true, 5);
+	one.next();
+	one.previous();
+	one.select(2);
+	CHECK(one.position() == 0);
+	CHECK(one.peekNext().path == one.current().path);
+
+	CDTrackList none;
+	none.assign({}, true, 5);
+	none.next();
+	none.previous();
+	none.select(3);
+	CHECK(none.empty());
+}
+
+TEST_MAIN()
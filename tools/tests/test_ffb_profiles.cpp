@@ -0,0 +1,109 @@
+// FFBProfiles::Find against fake device descriptors
+// Descriptors are DIPROP_VIDPID values, VID in the low word & PID in the high word, decoded the same way FFB::DetectProfile does
+
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#include "ffb_profiles.hpp"
+#include "test.hpp"
+
+using namespace FFBProfiles;
+
+struct FakeDevice
+{
+	const char* description;
+	uint32_t vidpid; // DIPROPDWORD::dwData
+	const char* expected;
+};
+
+static const WheelProfile& FindFor(uint32_t vidpid)
+{
+	return Find(uint16_t(vidpid & 0xFFFF), uint16_t(vidpid >> 16));
+}
+
+static constexpr uint32_t VidPid(uint16_t vid, uint16_t pid)
+{
+	return uint32_t(vid) | (uint32_t(pid) << 16);
+}
+
+static bool Matches(const FakeDevice* devices, size_t count)
+{
+	bool ok = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		const WheelProfile& profile = FindFor(devices[i].vidpid);
+		if (strcmp(profile.name, devices[i].expected) != 0)
+		{
+			printf("  %s (%08X): got '%s', expected '%s'\n", devices[i].description, devices[i].vidpid, profile.name, devices[i].expected);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+TEST_CASE(ExactMatches)
+{
+	static const FakeDevice devices[] =
+	{
+		{ "G29", VidPid(VID_Logitech, 0xC24F), "Logitech G29" },
+		{ "G27", VidPid(VID_Logitech, 0xC29B), "Logitech G27" },
+		{ "T300RS", VidPid(VID_Thrustmaster, 0xB66E), "Thrustmaster T300RS" },
+		{ "CSL DD", VidPid(VID_Fanatec, 0x0020), "Fanatec CSL DD / GT DD Pro" },
+		{ "Simagic", VidPid(VID_Simagic, 0x0522), "Simagic" },
+		{ "Simucube 2 Pro", VidPid(VID_Simucube, 0x0D60), "Simucube 2 Pro" },
+	};
+	CHECK(Matches(devices, std::size(devices)));
+
+	// Exact entries win over a vendor-wide one listed in the same table
+	CHECK(FindFor(VidPid(VID_Thrustmaster, 0xB677)).pid == 0xB677);
+	CHECK(FindFor(VidPid(VID_Fanatec, 0x0001)).pid == 0x0001);
+}
+
+TEST_CASE(VendorWideMatches)
+{
+	static const FakeDevice devices[] =
+	{
+		{ "unlisted Thrustmaster", VidPid(VID_Thrustmaster, 0x1234), "Thrustmaster (unknown model)" },
+		{ "unlisted Fanatec", VidPid(VID_Fanatec, 0x7777), "Fanatec (unknown model)" },
+		{ "any Moza", VidPid(VID_Moza, 0x0004), "Moza Racing" },
+	};
+	CHECK(Matches(devices, std::size(devices)));
+	CHECK(FindFor(VidPid(VID_Moza, 0x0004)).pid == 0);
+}
+
+TEST_CASE(DefaultFallback)
+{
+	static const FakeDevice devices[] =
+	{
+		{ "unlisted Logitech", VidPid(VID_Logitech, 0xC216), DefaultProfile.name },
+		{ "other STMicro device", VidPid(VID_Simagic, 0x5740), DefaultProfile.name },
+		{ "other 0x16D0 device", VidPid(VID_Simucube, 0x0C9B), DefaultProfile.name },
+		{ "unknown vendor", VidPid(0x1209, 0x0001), DefaultProfile.name },
+		{ "DIPROP_VIDPID failed", 0, DefaultProfile.name },
+	};
+	CHECK(Matches(devices, std::size(devices)));
+	CHECK(&FindFor(0) == &DefaultProfile);
+}
+
+TEST_CASE(TableIsConsistent)
+{
+	for (size_t i = 0; i < std::size(Profiles); i++)
+	{
+		const WheelProfile& profile = Profiles[i];
+		CHECK(profile.vid != 0);
+		CHECK(profile.name && profile.name[0]);
+		CHECK(profile.minMagnitudeDelta > 0);
+		CHECK(profile.paramFlags & Param_TypeSpecific);
+
+		// Every entry has to be reachable: no duplicate VID/PID pairs, & a vendor-wide entry comes after that vendor's specific ones
+		for (size_t j = i + 1; j < std::size(Profiles); j++)
+		{
+			CHECK(Profiles[j].vid != profile.vid || Profiles[j].pid != profile.pid);
+			CHECK(profile.pid != 0 || Profiles[j].vid != profile.vid);
+		}
+		CHECK(&Find(profile.vid, profile.pid) == &profile);
+	}
+}
+
+TEST_MAIN()
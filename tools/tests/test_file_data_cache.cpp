@@ -0,0 +1,354 @@
+// FileDataCache eviction, pinning & budget changes, on real .dds files mapped from a temp folder
+// Evicted entries are spotted through weak_ptrs: once the test drops its own references, only the cache keeps a view alive
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <xxhash.h>
+
+#include "file_data_cache.hpp"
+#include "test.hpp"
+
+namespace
+{
+	constexpr size_t ShardCount = 16; // FileDataCache::ShardCount
+
+	struct TempFiles
+	{
+		std::filesystem::path directory;
+		std::vector<std::filesystem::path> paths;
+		std::vector<size_t> sizes;
+
+		TempFiles()
+		{
+			directory = std::filesystem::temp_directory_path() / ("test_file_data_cache_" + std::to_string(std::random_device()()));
+			std::filesystem::create_directories(directory);
+		}
+
+		~TempFiles()
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(directory, ec);
+		}
+
+		// Every byte of file i is derived from i & its position, so views can be checked against the file they should be
+		size_t add(size_t size, const char* extension = ".dds")
+		{
+			size_t id = paths.size();
+			auto path = directory / (std::to_string(id) + extension);
+			std::vector<uint8_t> data(size);
+			for (size_t i = 0; i < size; i++)
+				data[i] = Byte(id, i);
+			std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), std::streamsize(size));
+
+			paths.push_back(path);
+			sizes.push_back(size);
+			return id;
+		}
+
+		// Adds files until count of them land in the given shard
+		std::vector<size_t> addToShard(size_t shard, size_t count, size_t size)
+		{
+			std::vector<size_t> ids;
+			while (ids.size() < count)
+			{
+				size_t id = add(size);
+				if (ShardOf(paths[id]) == shard)
+					ids.push_back(id);
+			}
+			return ids;
+		}
+
+		bool matches(const std::shared_ptr<const MappedView>& view, size_t id) const
+		{
+			if (!view || !view->valid() || view->size() != sizes[id])
+				return false;
+			for (size_t i = 0; i < view->size(); i++)
+				if (view->data()[i] != Byte(id, i))
+					return false;
+			return true;
+		}
+
+		static uint8_t Byte(size_t id, size_t position)
+		{
+			return uint8_t(id * 31 + position * 7 + (position >> 8));
+		}
+
+		// Same as FileDataCache::HashPath & shardFor
+		static size_t ShardOf(const std::filesystem::path& path)
+		{
+			const auto& native = path.native();
+			return (XXH64(native.data(), native.size() * sizeof(native[0]), 0) >> 32) % ShardCount;
+		}
+	};
+
+	std::weak_ptr<const MappedView> Load(FileDataCache& cache, const TempFiles& files, size_t id)
+	{
+		return cache.getFileData(files.paths[id]);
+	}
+}
+
+TEST_CASE(HitsShareTheMappedView)
+{
+	TempFiles files;
+	size_t a = files.add(5000);
+	size_t text = files.add(100, ".txt");
+	FileDataCache cache(1024 * 1024);
+
+	auto first = cache.getFileData(files.paths[a]);
+	auto second = cache.getFileData(files.paths[a]);
+	CHECK(files.matches(first, a));
+	CHECK(first == second);
+	CHECK(cache.getCacheSize() == 5000);
+
+	auto stats = cache.getStats();
+	CHECK(stats.hits == 1 && stats.misses == 1 && stats.evictions == 0);
+	CHECK(stats.maxSize == 1024 * 1024);
+
+	// Only .dds files are cached, missing files fail without caching anything
+	CHECK(FileDataCache::isCacheable("a/B.DDS"));
+	CHECK(cache.getFileData(files.paths[text]) == nullptr);
+	CHECK(cache.getFileData(files.directory / "missing.dds") == nullptr);
+	CHECK(cache.getCacheSize() == 5000);
+}
+
+TEST_CASE(ClockGivesReferencedEntriesASecondChance)
+{
+	TempFiles files;
+	auto ids = files.addToShard(3, 4, 1000);
+
+	// Three files fill the budget exactly
+	FileDataCache cache(3000);
+	std::weak_ptr<const MappedView> views[4];
+	for (size_t i = 0; i < 3; i++)
+		views[i] = Load(cache, files, ids[i]);
+	CHECK(cache.getCacheSize() == 3000);
+	CHECK(cache.getStats().evictions == 0);
+
+	// New entries start unreferenced, hits mark them
+	Load(cache, files, ids[0]);
+	Load(cache, files, ids[1]);
+
+	// Going over budget evicts the one entry that wasn't hit again
+	views[3] = Load(cache, files, ids[3]);
+	CHECK(!views[0].expired() && !views[1].expired() && !views[3].expired());
+	CHECK(views[2].expired());
+	CHECK(cache.getCacheSize() == 3000);
+	CHECK(cache.getStats().evictions == 1);
+
+	// The hand carries on from where it stopped: the last insert hasn't been hit since, while the first entry still has its bit
+	auto again = Load(cache, files, ids[2]);
+	CHECK(views[3].expired());
+	CHECK(!views[0].expired() && !views[1].expired() && !again.expired());
+	CHECK(cache.getCacheSize() == 3000);
+	CHECK(cache.getStats().evictions == 2);
+}
+
+TEST_CASE(BudgetIsSharedByAllShards)
+{
+	TempFiles files;
+	auto crowded = files.addToShard(5, 8, 1000);
+	auto other = files.addToShard(9, 1, 1000);
+
+	// Files that all hash into one shard still get the whole budget
+	FileDataCache cache(8000);
+	std::vector<std::weak_ptr<const MappedView>> views;
+	for (size_t id : crowded)
+		views.push_back(Load(cache, files, id));
+	CHECK(cache.getCacheSize() == 8000);
+	CHECK(cache.getStats().evictions == 0);
+	for (size_t i = 0; i < views.size(); i++)
+		CHECK(!views[i].expired());
+
+	// & room for a file in another shard comes out of the crowded one
+	Load(cache, files, crowded[0]);
+	auto added = Load(cache, files, other[0]);
+	CHECK(!added.expired() && !views[0].expired());
+	CHECK(cache.getCacheSize() == 8000);
+	CHECK(cache.getStats().evictions == 1);
+	CHECK(std::count_if(views.begin(), views.end(), [](const auto& view) { return view.expired(); }) == 1);
+
+	// Shrinking takes from whichever shards hold the bytes
+	cache.setMaxSize(3000);
+	CHECK(cache.getCacheSize() == 3000);
+	CHECK(cache.getStats().evictions == 6);
+}
+
+TEST_CASE(HeldViewsArePinned)
+{
+	TempFiles files;
+	auto ids = files.addToShard(7, 4, 1000);
+	FileDataCache cache(3000);
+
+	std::vector<std::shared_ptr<const MappedView>> held;
+	for (size_t i = 0; i < 3; i++)
+		held.push_back(cache.getFileData(files.paths[ids[i]]));
+
+	// Nothing can go while everything is in use, so the cache stays over budget rather than unmapping under a reader
+	auto extra = cache.getFileData(files.paths[ids[3]]);
+	CHECK(cache.getCacheSize() == 4000);
+	CHECK(cache.getStats().evictions == 0);
+	for (size_t i = 0; i < 3; i++)
+		CHECK(files.matches(held[i], ids[i]));
+
+	// Shrinking the budget only evicts what isn't pinned
+	std::weak_ptr<const MappedView> released = extra;
+	extra.reset();
+	cache.setMaxSize(2000);
+	CHECK(released.expired());
+	CHECK(cache.getCacheSize() == 3000);
+
+	// Evicted entries stay mapped for whoever still holds them
+	held.erase(held.begin());
+	cache.setMaxSize(2000);
+	CHECK(cache.getCacheSize() == 2000);
+	CHECK(files.matches(held[0], ids[1]) && files.matches(held[1], ids[2]));
+}
+
+TEST_CASE(BudgetChanges)
+{
+	TempFiles files;
+	std::vector<size_t> ids;
+	for (size_t i = 0; i < 64; i++)
+		ids.push_back(files.add(4096 + i * 100));
+
+	FileDataCache cache(64 * 1024 * 1024);
+	for (size_t id : ids)
+		Load(cache, files, id);
+	size_t total = cache.getCacheSize();
+	CHECK(total > 64 * 4096);
+
+	// Shrinking evicts straight away
+	cache.setMaxSize(total / 4);
+	CHECK(cache.getMaxSize() == total / 4);
+	CHECK(cache.getCacheSize() <= cache.getMaxSize());
+
+	// Nothing fits in a budget of zero
+	cache.setMaxSize(0);
+	CHECK(cache.getMaxSize() == 0);
+	CHECK(cache.getCacheSize() == 0);
+
+	// Growing lets it fill back up
+	cache.setMaxSize(64 * 1024 * 1024);
+	for (size_t id : ids)
+		Load(cache, files, id);
+	CHECK(cache.getCacheSize() == total);
+}
+
+TEST_CASE(OversizeFilesAreNotCached)
+{
+	TempFiles files;
+	size_t small = files.add(1000);
+	size_t big = files.add(16000 + 1);
+	FileDataCache cache(16000);
+
+	Load(cache, files, small);
+	auto first = cache.getFileData(files.paths[big]);
+	CHECK(files.matches(first, big));
+
+	// Mapped & returned, but not counted against the budget or kept around, & nothing else was evicted to make room
+	CHECK(cache.getCacheSize() == 1000);
+	CHECK(cache.getStats().evictions == 0);
+
+	std::weak_ptr<const MappedView> dropped = first;
+	first.reset();
+	CHECK(dropped.expired());
+
+	auto before = cache.getStats();
+	auto second = cache.getFileData(files.paths[big]);
+	CHECK(files.matches(second, big));
+	CHECK(cache.getStats().misses == before.misses + 1);
+
+	// Cached once the budget grows enough for it
+	cache.setMaxSize(320000);
+	auto cached = cache.getFileData(files.paths[big]);
+	CHECK(cache.getCacheSize() == 1000 + files.sizes[big]);
+	CHECK(cache.getFileData(files.paths[big]) == cached);
+}
+
+TEST_CASE(ConcurrentStress)
+{
+	TempFiles files;
+	std::mt19937 sizes(1);
+	for (size_t i = 0; i < 256; i++)
+		files.add(1 + sizes() % 16384);
+
+	const size_t budgets[] = { 256 * 1024, 1024 * 1024, 64 * 1024, 4 * 1024 * 1024 };
+	FileDataCache cache(budgets[0]);
+
+	constexpr int Threads = 8;
+	constexpr int Iterations = 4000;
+	std::atomic<int> bad = 0;
+	std::atomic<bool> done = false;
+
+	std::vector<std::thread> readers;
+	for (int t = 0; t < Threads; t++)
+	{
+		readers.emplace_back([&, t]
+		{
+			// Holds onto a few views for a while like the texture loader does, so eviction has pinned entries to skip
+			std::mt19937 rng(t + 100);
+			std::vector<std::pair<size_t, std::shared_ptr<const MappedView>>> held;
+			for (int i = 0; i < Iterations; i++)
+			{
+				// Skewed toward a hot set, so some entries get hit often enough to keep their reference bit
+				size_t id = rng() % 4 ? rng() % 32 : rng() % files.paths.size();
+				auto view = (rng() % 8) ? cache.getFileData(files.paths[id]) : cache.cacheFile(files.paths[id]);
+				if (!files.matches(view, id))
+					bad++;
+
+				if (rng() % 4 == 0)
+					held.emplace_back(id, std::move(view));
+				if (held.size() > 6)
+				{
+					size_t drop = rng() % held.size();
+					if (!files.matches(held[drop].second, held[drop].first))
+						bad++;
+					held.erase(held.begin() + drop);
+				}
+			}
+
+			for (const auto& [heldId, view] : held)
+				if (!files.matches(view, heldId))
+					bad++;
+		});
+	}
+
+	std::thread resizer([&]
+	{
+		for (size_t i = 0; !done; i++)
+		{
+			cache.setMaxSize(budgets[i % std::size(budgets)]);
+			std::this_thread::yield();
+		}
+	});
+
+	for (auto& reader : readers)
+		reader.join();
+	done = true;
+	resizer.join();
+
+	CHECK(bad == 0);
+
+	auto stats = cache.getStats();
+	CHECK(stats.evictions > 0);
+	CHECK(stats.hits > 0 && stats.misses > 0);
+
+	// Nothing is pinned anymore, so the next budget change brings the cache back under it
+	cache.setMaxSize(budgets[0]);
+	CHECK(cache.getCacheSize() <= cache.getMaxSize());
+
+	// & everything left in the cache still maps the right file
+	for (size_t id = 0; id < files.paths.size(); id++)
+		if (!files.matches(cache.getFileData(files.paths[id]), id))
+			bad++;
+	CHECK(bad == 0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,259 @@
+// FLACStream decoding generated FLAC files (see audio_files.hpp) through the PcmStream interface, which is all
+// CStreamingWaveFile hands the game: its Read/ResetFile/Close map straight onto Read/Reset/Close here.
+// Every sample is checked, so anything dropped or repeated around a loop wrap or reset shows up.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_files.hpp"
+#include "pcm_stream.hpp"
+#include "test.hpp"
+
+namespace
+{
+	const unsigned Rate = 44100;
+	const uint64_t TotalSamples = 100000;
+
+	// Doesn't repeat over any stretch the tests look at, so reading from the wrong place can't match by accident
+	int16_t Sample(uint64_t index, unsigned channel)
+	{
+		double wave = std::sin(double(index) * (channel ? 0.031 : 0.05)) * 12000.0;
+		return int16_t(std::lround(wave) + int64_t(index % 97) * (channel ? -3 : 3));
+	}
+
+	std::vector<uint8_t> MakeFLAC(const std::vector<std::string>& comments, uint64_t totalSamples = TotalSamples)
+	{
+		std::vector<int32_t> samples;
+		for (uint64_t i = 0; i < totalSamples; i++)
+		{
+			samples.push_back(Sample(i, 0));
+			samples.push_back(Sample(i, 1));
+		}
+		return TestAudio::EncodeFLAC(samples, 2, Rate, 16, comments);
+	}
+
+	std::vector<int16_t> ReadSamples(PcmStream& stream, size_t count)
+	{
+		// Odd sized reads, so they straddle ring wraps & the loop point at different offsets
+		std::vector<int16_t> out(count * 2);
+		size_t done = 0;
+		size_t chunk = 997;
+		while (done < count)
+		{
+			size_t want = std::min<size_t>(chunk, count - done);
+			size_t read = 0;
+			if (!stream.Read((uint8_t*)&out[done * 2], want * 4, &read) || !read)
+				break;
+			done += read / 4;
+			chunk = chunk * 7 % 5003 + 1;
+		}
+		out.resize(done * 2);
+		return out;
+	}
+
+	// Compares what was read against the source samples at the given positions, prints the first mismatch
+	template <typename Position>
+	bool Matches(const std::vector<int16_t>& read, size_t count, Position position)
+	{
+		if (read.size() != count * 2)
+		{
+			printf("  read %zu samples, expected %zu\n", read.size() / 2, count);
+			return false;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			uint64_t source = position(i);
+			if (read[i * 2] != Sample(source, 0) || read[i * 2 + 1] != Sample(source, 1))
+			{
+				printf("  sample %zu doesn't match source sample %llu\n", i, (unsigned long long)source);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Where the nth sample played comes from, for a loop covering first..last (inclusive)
+	uint64_t Looped(uint64_t n, uint64_t first, uint64_t last)
+	{
+		return n <= last ? n : first + (n - last - 1) % (last - first + 1);
+	}
+
+	std::filesystem::path TempFile(const std::string& name)
+	{
+		return std::filesystem::temp_directory_path() / (name + "_" + std::to_string(std::random_device()()) + ".flac");
+	}
+}
+
+TEST_CASE(PlaysWholeFile)
+{
+	auto file = MakeFLAC({});
+	auto stream = CreateFLACStream();
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+	CHECK(stream->Format().channels == 2 && stream->Format().sampleRate == Rate);
+	CHECK(stream->Format().bitsPerSample == 16 && stream->Format().blockAlign == 4);
+
+	// Ends after the last sample, nothing more to read once it does
+	auto read = ReadSamples(*stream, TotalSamples + 5000);
+	CHECK(Matches(read, TotalSamples, [](uint64_t n) { return n; }));
+	size_t more = 1;
+	CHECK(stream->Read((uint8_t*)read.data(), 4, &more) && more == 0);
+
+	stream->Close();
+	CHECK(!stream->IsOpen());
+	CHECK(!stream->Read((uint8_t*)read.data(), 4, &more));
+}
+
+TEST_CASE(LoopsAreSampleAccurate)
+{
+	// Loop longer than the saved loop head, so wrapping seeks back into the file after queueing the head
+	{
+		auto file = MakeFLAC({ "LOOPSTART=20000", "LOOPLENGTH=50000" });
+		auto stream = CreateFLACStream();
+		CHECK(stream->OpenFromMemory(file.data(), file.size()));
+		size_t count = 20000 + 50000 * 3 + 1234;
+		CHECK(Matches(ReadSamples(*stream, count), count, [](uint64_t n) { return Looped(n, 20000, 69999); }));
+	}
+
+	// LOOPEND instead of LOOPLENGTH, both name the last sample of the loop (tag names are case-insensitive)
+	{
+		auto file = MakeFLAC({ "loopstart=5000", "LoopEnd=64999" });
+		auto stream = CreateFLACStream();
+		CHECK(stream->OpenFromMemory(file.data(), file.size()));
+		size_t count = 5000 + 60000 * 3;
+		CHECK(Matches(ReadSamples(*stream, count), count, [](uint64_t n) { return Looped(n, 5000, 64999); }));
+	}
+
+	// Loop shorter than the saved head, later passes come entirely from the saved copy
+	{
+		auto file = MakeFLAC({ "LOOPSTART=1000", "LOOPLENGTH=3000" });
+		auto stream = CreateFLACStream();
+		CHECK(stream->OpenFromMemory(file.data(), file.size()));
+		size_t count = 1000 + 3000 * 20;
+		CHECK(Matches(ReadSamples(*stream, count), count, [](uint64_t n) { return Looped(n, 1000, 3999); }));
+	}
+
+	// Loop end past the end of the file loops from the last sample instead
+	{
+		auto file = MakeFLAC({ "LOOPSTART=90000", "LOOPEND=500000" });
+		auto stream = CreateFLACStream();
+		CHECK(stream->OpenFromMemory(file.data(), file.size()));
+		size_t count = 90000 + 10000 * 4;
+		CHECK(Matches(ReadSamples(*stream, count), count, [](uint64_t n) { return Looped(n, 90000, TotalSamples - 1); }));
+	}
+}
+
+TEST_CASE(ResetStartsOver)
+{
+	auto file = MakeFLAC({ "LOOPSTART=20000", "LOOPLENGTH=50000" });
+	auto stream = CreateFLACStream();
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+
+	// Partway in, then after the decode thread has wrapped at least once
+	for (size_t before : { size_t(30000), size_t(150000) })
+	{
+		CHECK(ReadSamples(*stream, before).size() == before * 2);
+		stream->Reset();
+		size_t count = 80000;
+		CHECK(Matches(ReadSamples(*stream, count), count, [](uint64_t n) { return Looped(n, 20000, 69999); }));
+	}
+
+	// Several resets in a row only start over once
+	stream->Reset();
+	stream->Reset();
+	stream->Reset();
+	CHECK(Matches(ReadSamples(*stream, 5000), 5000, [](uint64_t n) { return n; }));
+}
+
+TEST_CASE(CloseWhileRingIsFull)
+{
+	auto file = MakeFLAC({ "LOOPSTART=20000", "LOOPLENGTH=50000" }, 400000);
+	auto stream = CreateFLACStream();
+
+	for (int i = 0; i < 3; i++)
+	{
+		CHECK(stream->OpenFromMemory(file.data(), file.size()));
+		ReadSamples(*stream, 1000);
+
+		// Decode thread fills the ring & then waits for it to drain, closing has to wake it rather than wait on it
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		auto start = std::chrono::steady_clock::now();
+		stream->Close();
+		CHECK(!stream->IsOpen());
+		CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+	}
+
+	// Closing right after opening, while it's still filling
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+	stream->Close();
+
+	// Still usable afterwards
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+	CHECK(Matches(ReadSamples(*stream, 30000), 30000, [](uint64_t n) { return n; }));
+}
+
+TEST_CASE(OpenFromFileMatchesMemory)
+{
+	auto file = MakeFLAC({ "LOOPSTART=20000", "LOOPLENGTH=50000" });
+	auto path = TempFile("test_flac_stream");
+	CHECK(TestAudio::WriteFile(path, file));
+
+	auto stream = CreateFLACStream();
+	CHECK(stream->Open(path.string().c_str()));
+	size_t count = 20000 + 50000 * 2;
+	CHECK(Matches(ReadSamples(*stream, count), count, [](uint64_t n) { return Looped(n, 20000, 69999); }));
+	stream->Reset();
+	CHECK(Matches(ReadSamples(*stream, 1000), 1000, [](uint64_t n) { return n; }));
+	stream->Close();
+
+	// Missing or broken files fail to open & leave the stream closed
+	CHECK(!stream->Open((path.string() + ".missing").c_str()));
+	CHECK(!stream->IsOpen());
+	std::vector<uint8_t> garbage(4096, 0x5A);
+	CHECK(!stream->OpenFromMemory(garbage.data(), garbage.size()));
+	CHECK(!stream->IsOpen());
+	CHECK(!stream->OpenFromMemory(file.data(), 40)); // cut off in STREAMINFO
+	CHECK(!stream->IsOpen());
+
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+}
+
+TEST_CASE(ConvertsOtherFormats)
+{
+	// 24-bit 32kHz gets resampled to 48kHz 16-bit, loop points move with it
+	std::vector<int32_t> samples;
+	for (uint64_t i = 0; i < 64000; i++)
+	{
+		int32_t value = int32_t(std::lround(std::sin(double(i) * 0.02) * 4000000.0));
+		samples.push_back(value);
+		samples.push_back(-value);
+	}
+	auto file = TestAudio::EncodeFLAC(samples, 2, 32000, 24);
+
+	auto stream = CreateFLACStream();
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+	CHECK(stream->Format().sampleRate == 48000 && stream->Format().bitsPerSample == 16);
+
+	auto read = ReadSamples(*stream, 200000);
+	CHECK(read.size() / 2 >= 95998 && read.size() / 2 <= 96002);
+
+	// Same sine at 1.5x the period & 1/256 of the level, give or take dither & the filter
+	double worst = 0.0;
+	for (size_t i = 1000; i + 1000 < read.size() / 2; i++)
+	{
+		double expected = std::sin(double(i) / 1.5 * 0.02) * 4000000.0 / 256.0;
+		worst = std::max<double>(worst, std::abs(read[i * 2] - expected));
+		worst = std::max<double>(worst, std::abs(read[i * 2 + 1] + expected));
+	}
+	CHECK(worst < 8.0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,240 @@
+// MemoryBudget::Compute on synthetic address space layouts instead of what VirtualQuery returns
+// Checks the 512MB left for the game, the cutback once the largest free block gets under 256MB & the 64-2048MB bounds
+// the texture cache uses, then runs a long randomized session of the game & cache fragmenting a 4GB address space.
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "memory_budget.hpp"
+#include "test.hpp"
+
+namespace
+{
+	using MemoryBudget::RegionState;
+
+	constexpr size_t KB = 1024;
+	constexpr size_t MB = 1024 * 1024;
+	constexpr size_t MinBudget = 64 * MB; // MIN/MAX_TEXTURE_CACHE_SIZE_MB in hooks_textures.cpp
+	constexpr size_t MaxBudget = 2048 * MB;
+
+	struct Region
+	{
+		RegionState state;
+		size_t size;
+		bool cache = false; // committed by the texture cache rather than the game
+	};
+
+	MemoryBudget::AddressSpace Summarize(const std::vector<Region>& regions)
+	{
+		MemoryBudget::AddressSpace space;
+		for (const auto& region : regions)
+		{
+			MemoryBudget::AddRegion(space, region.state, region.size);
+			space.total += region.size;
+		}
+		return space;
+	}
+
+	size_t Compute(const std::vector<Region>& regions, size_t cacheBytes)
+	{
+		return MemoryBudget::Compute(Summarize(regions), cacheBytes, MinBudget, MaxBudget);
+	}
+
+	// Game & D3D in the first GB, then the given free blocks, each followed by a committed block so they can't merge
+	std::vector<Region> Layout(const std::vector<size_t>& freeBlocks)
+	{
+		std::vector<Region> regions = { { RegionState::Committed, 900 * MB }, { RegionState::Reserved, 124 * MB } };
+		for (size_t size : freeBlocks)
+		{
+			regions.push_back({ RegionState::Free, size });
+			regions.push_back({ RegionState::Committed, 4 * MB });
+		}
+		return regions;
+	}
+
+	// Address space in address order, the game & the cache allocate from it & give memory back like a real session would
+	struct SimulatedProcess
+	{
+		std::vector<Region> regions;
+		std::mt19937 rng{ 1234 };
+
+		explicit SimulatedProcess(size_t total)
+		{
+			regions = { { RegionState::Committed, 700 * MB }, { RegionState::Free, total - 700 * MB } };
+		}
+
+		// Takes size from a random free block that's big enough, splitting it, returns false if none is
+		bool allocate(size_t size, bool cache = false)
+		{
+			std::vector<size_t> fits;
+			for (size_t i = 0; i < regions.size(); i++)
+				if (regions[i].state == RegionState::Free && regions[i].size >= size)
+					fits.push_back(i);
+			if (fits.empty())
+				return false;
+
+			size_t index = fits[rng() % fits.size()];
+			size_t left = regions[index].size - size;
+
+			// Anywhere inside the block, at 64KB allocation granularity
+			size_t before = left ? (rng() % (left / (64 * KB) + 1)) * 64 * KB : 0;
+			size_t after = left - before;
+
+			std::vector<Region> replacement;
+			if (before)
+				replacement.push_back({ RegionState::Free, before });
+			replacement.push_back({ RegionState::Committed, size, cache });
+			if (after)
+				replacement.push_back({ RegionState::Free, after });
+			regions.erase(regions.begin() + index);
+			regions.insert(regions.begin() + index, replacement.begin(), replacement.end());
+			return true;
+		}
+
+		size_t committed(bool cache) const
+		{
+			size_t total = 0;
+			for (const auto& region : regions)
+				if (region.state == RegionState::Committed && region.cache == cache)
+					total += region.size;
+			return total;
+		}
+
+		// Frees a random committed block of the game's or the cache's, merging it with free neighbours
+		void release(bool cache = false)
+		{
+			std::vector<size_t> committed;
+			for (size_t i = 1; i < regions.size(); i++) // first block is the game itself
+				if (regions[i].state == RegionState::Committed && regions[i].cache == cache)
+					committed.push_back(i);
+			if (committed.empty())
+				return;
+
+			Region& freed = regions[committed[rng() % committed.size()]];
+			freed = { RegionState::Free, freed.size };
+			for (size_t i = 1; i < regions.size();)
+			{
+				if (regions[i].state == RegionState::Free && regions[i - 1].state == RegionState::Free)
+				{
+					regions[i - 1].size += regions[i].size;
+					regions.erase(regions.begin() + i);
+				}
+				else
+					i++;
+			}
+		}
+	};
+}
+
+TEST_CASE(LeavesTheReserveForTheGame)
+{
+	// Exactly the reserve free: nothing spare, the cache keeps what it has
+	CHECK(Compute(Layout({ 512 * MB }), 128 * MB) == 128 * MB);
+
+	// Half of whatever is above it
+	CHECK(Compute(Layout({ 768 * MB }), 128 * MB) == 256 * MB);
+	CHECK(Compute(Layout({ 512 * MB, 256 * MB }), 128 * MB) == 256 * MB);
+
+	// Under the reserve the cache doesn't grow, rounded down to 16MB
+	CHECK(Compute(Layout({ 300 * MB }), 200 * MB) == 192 * MB);
+	CHECK(Compute(Layout({ 300 * MB }), 0) == MinBudget);
+
+	// Reserved (not committed) address space is as unusable as committed
+	std::vector<Region> reserved = { { RegionState::Reserved, 3 * 1024 * MB }, { RegionState::Free, 512 * MB } };
+	CHECK(Compute(reserved, 100 * MB) == 96 * MB);
+}
+
+TEST_CASE(CutsBackWhenFragmented)
+{
+	// 1.5GB free but never more than 64MB in one place: a quarter of the cache is given back
+	std::vector<size_t> holes(24, 64 * MB);
+	CHECK(Compute(Layout(holes), 400 * MB) == 288 * MB); // 300MB rounded down
+
+	// Same amount free in one block grows instead
+	CHECK(Compute(Layout({ 1536 * MB }), 400 * MB) == 912 * MB);
+
+	// The cutback starts right under 256MB
+	CHECK(Compute(Layout({ 256 * MB, 256 * MB, 256 * MB }), 400 * MB) == 528 * MB);
+	CHECK(Compute(Layout({ 256 * MB - 64 * KB, 256 * MB - 64 * KB, 256 * MB - 64 * KB }), 400 * MB) == 288 * MB);
+
+	// Keeps cutting on every check while it stays fragmented, down to the minimum
+	size_t budget = 1024 * MB;
+	for (int i = 0; i < 10; i++)
+		budget = Compute(Layout(holes), budget);
+	CHECK(budget == MinBudget);
+}
+
+TEST_CASE(ClampedToTheCacheBounds)
+{
+	// 4GB large address aware process with nearly all of it free
+	std::vector<Region> empty = { { RegionState::Committed, 200 * MB }, { RegionState::Free, 3896 * MB } };
+	CHECK(Compute(empty, 0) == 1680 * MB);
+	CHECK(Compute(empty, 1024 * MB) == MaxBudget);
+
+	// Nothing spare & an empty or tiny cache still gets the minimum, even while fragmented
+	CHECK(Compute(Layout({ 100 * MB }), 0) == MinBudget);
+	CHECK(Compute(Layout({ 100 * MB }), 32 * MB) == MinBudget);
+
+	// Bounds are whatever the caller passes
+	CHECK(MemoryBudget::Compute(Summarize(empty), 0, 16 * MB, 512 * MB) == 512 * MB);
+	CHECK(MemoryBudget::Compute(Summarize(Layout({ 100 * MB })), 0, 16 * MB, 512 * MB) == 16 * MB);
+}
+
+TEST_CASE(SimulatedSession)
+{
+	// Stage loads allocate & free blocks of all sizes while the cache follows its budget, like CheckCacheBudget between
+	// stages. Whatever the layout ends up as, the budget has to respect all three rules.
+	SimulatedProcess process(4096 * MB);
+	size_t cacheBytes = 0;
+	size_t fragmentedChecks = 0;
+	size_t largestCache = 0;
+
+	for (int stage = 0; stage < 2000; stage++)
+	{
+		// Game's own usage swings between light & heavy stretches of stages
+		size_t target = (stage / 100) % 2 ? 2600 * MB : 1200 * MB;
+		for (int i = 0; i < 8; i++)
+		{
+			if (process.committed(false) > target)
+				process.release();
+			else
+				process.allocate((1 + process.rng() % 96) * MB);
+		}
+
+		auto space = Summarize(process.regions);
+		size_t budget = MemoryBudget::Compute(space, cacheBytes, MinBudget, MaxBudget);
+		size_t spare = space.free > 512 * MB ? space.free - 512 * MB : 0;
+
+		CHECK(budget >= MinBudget && budget <= MaxBudget && budget % (16 * MB) == 0);
+		CHECK(budget <= std::max(MinBudget, cacheBytes + spare / 2));
+		if (space.largestFreeRegion < 256 * MB)
+		{
+			fragmentedChecks++;
+			CHECK(budget <= std::max(MinBudget, cacheBytes - cacheBytes / 4));
+		}
+
+		// Cache evicts down to the budget or fills up to it in 8MB files, as far as the address space allows
+		while (cacheBytes > budget)
+		{
+			process.release(true);
+			cacheBytes -= 8 * MB;
+		}
+		size_t freeBefore = space.free;
+		while (cacheBytes + 8 * MB <= budget && process.allocate(8 * MB, true))
+			cacheBytes += 8 * MB;
+		largestCache = std::max(largestCache, cacheBytes);
+
+		// Growing into the budget never eats into the reserve, unless the minimum forced it to
+		size_t freeAfter = Summarize(process.regions).free;
+		if (freeBefore >= 512 * MB && cacheBytes > MinBudget)
+			CHECK(freeAfter >= 512 * MB);
+	}
+
+	// The session has to have gone through both fragmented & roomy stretches for this to mean anything
+	CHECK(fragmentedChecks > 0);
+	CHECK(fragmentedChecks < 2000 && largestCache > 512 * MB);
+	printf("  %zu of 2000 stages fragmented, cache peaked at %zuMB\n", fragmentedChecks, largestCache / MB);
+}
+
+TEST_MAIN()
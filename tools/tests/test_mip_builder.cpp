@@ -0,0 +1,316 @@
+// MipBuilder's chains against a reference downsample: the same filters done the slow way, all in double precision
+// straight from the definition (gamma-correct, alpha-weighted, edges clamped), compared as images level by level.
+// BuildChain keeps levels at 16-bit in between, so it may be off by one here & there but no more.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include "mip_builder.hpp"
+#include "test.hpp"
+
+using namespace MipBuilder;
+
+namespace
+{
+	double ToLinear(uint8_t value)
+	{
+		double c = value / 255.0;
+		return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+	}
+
+	uint8_t ToSrgb(double l)
+	{
+		double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+		return uint8_t(std::lround(std::clamp(c, 0.0, 1.0) * 255.0));
+	}
+
+	// Premultiplied linear RGBA
+	struct Image
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<double> pixels;
+
+		double* at(uint32_t x, uint32_t y) { return &pixels[(size_t(y) * width + x) * 4]; }
+	};
+
+	std::vector<double> Weights(Filter filter)
+	{
+		if (filter == Filter::Box)
+			return { 0.5, 0.5 };
+
+		// Kaiser window (beta 4, +-4 source pixels) over a sinc cut off at half the source rate
+		auto i0 = [](double x) {
+			double sum = 1.0, term = 1.0;
+			for (int k = 1; k < 32; k++)
+			{
+				term *= (x / (2.0 * k)) * (x / (2.0 * k));
+				sum += term;
+			}
+			return sum;
+		};
+
+		std::vector<double> weights;
+		double total = 0.0;
+		for (int k = -3; k <= 4; k++)
+		{
+			double d = k - 0.5;
+			double sinc = std::sin(3.14159265358979323846 * d / 2.0) / (3.14159265358979323846 * d / 2.0);
+			double r = d / 4.0;
+			weights.push_back(sinc * i0(4.0 * std::sqrt(1.0 - r * r)) / i0(4.0));
+			total += weights.back();
+		}
+		for (auto& weight : weights)
+			weight /= total;
+		return weights;
+	}
+
+	Image Reference(const Image& src, Filter filter)
+	{
+		auto weights = Weights(filter);
+		int first = filter == Filter::Box ? 0 : -3;
+
+		// Filters along one axis, or just copies it if it's already down to 1
+		auto pass = [&](const Image& in, bool horizontal) {
+			uint32_t size = horizontal ? in.width : in.height;
+			Image out = in;
+			if (size == 1)
+				return out;
+			(horizontal ? out.width : out.height) = size / 2;
+			out.pixels.assign(size_t(out.width) * out.height * 4, 0.0);
+
+			for (uint32_t y = 0; y < out.height; y++)
+			{
+				for (uint32_t x = 0; x < out.width; x++)
+				{
+					for (size_t k = 0; k < weights.size(); k++)
+					{
+						int s = std::clamp(int(horizontal ? x : y) * 2 + first + int(k), 0, int(size) - 1);
+						const double* pixel = &in.pixels[(horizontal ? size_t(y) * in.width + s : size_t(s) * in.width + x) * 4];
+						for (int c = 0; c < 4; c++)
+							out.at(x, y)[c] += pixel[c] * weights[k];
+					}
+				}
+			}
+			return out;
+		};
+
+		Image out = pass(pass(src, true), false);
+		for (size_t i = 0; i < out.pixels.size(); i += 4)
+		{
+			out.pixels[i + 3] = std::clamp(out.pixels[i + 3], 0.0, 1.0);
+			for (int c = 0; c < 3; c++)
+				out.pixels[i + c] = std::clamp(out.pixels[i + c], 0.0, out.pixels[i + 3]);
+		}
+		return out;
+	}
+
+	std::vector<uint8_t> ToBytes(const Image& image)
+	{
+		std::vector<uint8_t> bytes(image.pixels.size());
+		for (size_t i = 0; i < image.pixels.size(); i += 4)
+		{
+			double alpha = image.pixels[i + 3];
+			for (int c = 0; c < 3; c++)
+				bytes[i + c] = alpha > 0.0 ? ToSrgb(image.pixels[i + c] / alpha) : 0;
+			bytes[i + 3] = uint8_t(std::lround(alpha * 255.0));
+		}
+		return bytes;
+	}
+
+	// Every level of the chain against the reference, prints the worst channel difference of any level that's off
+	bool MatchesReference(const std::vector<uint8_t>& base, uint32_t width, uint32_t height, Filter filter, const ParallelFor& parallelFor = {})
+	{
+		auto chain = BuildChain(base.data(), width, height, filter, parallelFor);
+
+		Image level = { width, height, std::vector<double>(base.size()) };
+		for (size_t i = 0; i < base.size(); i += 4)
+		{
+			double alpha = base[i + 3] / 255.0;
+			for (int c = 0; c < 3; c++)
+				level.pixels[i + c] = ToLinear(base[i + c]) * alpha;
+			level.pixels[i + 3] = alpha;
+		}
+
+		size_t offset = 0;
+		bool matches = true;
+		for (uint32_t index = 1; index < LevelCount(width, height); index++)
+		{
+			level = Reference(level, filter);
+			auto expected = ToBytes(level);
+			if (offset + expected.size() > chain.size())
+			{
+				printf("  %ux%u: chain is too small for level %u\n", width, height, index);
+				return false;
+			}
+
+			int worst = 0;
+			for (size_t i = 0; i < expected.size(); i++)
+			{
+				// Color of a nearly transparent texel is mostly rounding, only its alpha has to match
+				if ((i & 3) != 3 && expected[i | 3] < 4)
+					continue;
+				worst = std::max<int>(worst, std::abs(int(chain[offset + i]) - int(expected[i])));
+			}
+			if (worst > 1)
+			{
+				printf("  %ux%u %s level %u (%ux%u): off by up to %d\n", width, height, filter == Filter::Box ? "box" : "kaiser",
+					index, level.width, level.height, worst);
+				matches = false;
+			}
+			offset += expected.size();
+		}
+		return matches && offset == chain.size();
+	}
+
+	std::vector<uint8_t> Noise(uint32_t width, uint32_t height, uint32_t seed, bool randomAlpha)
+	{
+		std::mt19937 rng(seed);
+		std::vector<uint8_t> pixels(size_t(width) * height * 4);
+		for (size_t i = 0; i < pixels.size(); i++)
+			pixels[i] = (i & 3) == 3 && !randomAlpha ? 255 : uint8_t(rng());
+		return pixels;
+	}
+
+	// Smooth gradients with a hard-edged cutout, like foliage or a fence texture
+	std::vector<uint8_t> Cutout(uint32_t width, uint32_t height)
+	{
+		std::vector<uint8_t> pixels(size_t(width) * height * 4);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				uint8_t* pixel = &pixels[(size_t(y) * width + x) * 4];
+				pixel[0] = uint8_t(x * 255 / width);
+				pixel[1] = uint8_t(y * 255 / height);
+				pixel[2] = uint8_t((x ^ y) & 0xFF);
+				pixel[3] = ((x / 3 + y / 5) & 1) ? 255 : 0;
+			}
+		}
+		return pixels;
+	}
+}
+
+TEST_CASE(LevelCounts)
+{
+	CHECK(LevelCount(1, 1) == 1);
+	CHECK(LevelCount(2, 1) == 2);
+	CHECK(LevelCount(256, 256) == 9);
+	CHECK(LevelCount(256, 16) == 9);
+	CHECK(LevelCount(300, 7) == 9);
+}
+
+TEST_CASE(MatchesReferenceDownsample)
+{
+	for (Filter filter : { Filter::Box, Filter::Kaiser })
+	{
+		CHECK(MatchesReference(Noise(64, 64, 1, false), 64, 64, filter));
+		CHECK(MatchesReference(Noise(64, 64, 2, true), 64, 64, filter));
+		CHECK(MatchesReference(Cutout(128, 32), 128, 32, filter));
+
+		// Odd & one-pixel dimensions, each dimension stops halving at 1 on its own
+		CHECK(MatchesReference(Noise(37, 23, 3, true), 37, 23, filter));
+		CHECK(MatchesReference(Noise(1, 40, 4, false), 1, 40, filter));
+		CHECK(MatchesReference(Noise(40, 1, 5, true), 40, 1, filter));
+
+		// Taller than one band of rows, so bands need source rows from their neighbours
+		CHECK(MatchesReference(Cutout(96, 200), 96, 200, filter));
+	}
+}
+
+TEST_CASE(ParallelBandsMatchSerial)
+{
+	auto base = Cutout(160, 300);
+	std::vector<size_t> order;
+	ParallelFor reversed = [&](size_t count, const std::function<void(size_t)>& func) {
+		// Out of order is enough to catch bands depending on each other
+		for (size_t i = count; i-- > 0;)
+		{
+			order.push_back(i);
+			func(i);
+		}
+	};
+
+	for (Filter filter : { Filter::Box, Filter::Kaiser })
+	{
+		order.clear();
+		CHECK(BuildChain(base.data(), 160, 300, filter, reversed) == BuildChain(base.data(), 160, 300, filter));
+		CHECK(order.size() > 1);
+		CHECK(MatchesReference(base, 160, 300, filter, reversed));
+	}
+}
+
+TEST_CASE(TransparentTexelsDontBleed)
+{
+	// Opaque red texels next to transparent green ones: every level stays pure red, alpha averages out
+	std::vector<uint8_t> base(16 * 16 * 4);
+	for (size_t i = 0; i < base.size(); i += 4)
+	{
+		bool opaque = ((i / 4) & 1) == 0;
+		base[i + 0] = opaque ? 255 : 0;
+		base[i + 1] = opaque ? 0 : 255;
+		base[i + 2] = 0;
+		base[i + 3] = opaque ? 255 : 0;
+	}
+
+	for (Filter filter : { Filter::Box, Filter::Kaiser })
+	{
+		auto chain = BuildChain(base.data(), 16, 16, filter);
+		bool pureRed = true;
+		for (size_t i = 0; i < chain.size(); i += 4)
+			pureRed &= chain[i + 0] == 255 && chain[i + 1] == 0 && chain[i + 2] == 0;
+		CHECK(pureRed);
+
+		// Box averages every pair exactly, so the first level is half covered
+		if (filter == Filter::Box)
+			CHECK(chain[3] == 128);
+	}
+
+	// Fully transparent areas come out transparent black, not whatever color they had
+	std::vector<uint8_t> clear(8 * 8 * 4);
+	for (size_t i = 0; i < clear.size(); i += 4)
+		clear[i + 1] = 200;
+	auto chain = BuildChain(clear.data(), 8, 8, Filter::Kaiser);
+	bool transparentBlack = true;
+	for (uint8_t value : chain)
+		transparentBlack &= value == 0;
+	CHECK(transparentBlack);
+}
+
+TEST_CASE(CachedChainsAreReused)
+{
+	auto directory = std::filesystem::temp_directory_path() / ("test_mip_builder_" + std::to_string(std::random_device()()));
+	auto base = Noise(64, 32, 6, true);
+
+	MipCache cache;
+	cache.setDirectory(directory);
+	cache.setFilter(Filter::Box);
+	auto built = cache.get(1234, base.data(), 64, 32);
+	CHECK(built && built->levelCount == 7);
+	CHECK(std::filesystem::exists(directory / "00000000000004D2.mips"));
+
+	// Loading it back only uses the file, the base pixels aren't looked at
+	auto other = Noise(64, 32, 7, true);
+	auto loaded = cache.get(1234, other.data(), 64, 32);
+	CHECK(loaded && loaded->size == built->size && memcmp(loaded->data, built->data, built->size) == 0);
+	CHECK(loaded && loaded->level(6) && loaded->level(6)[3] == built->level(6)[3]);
+
+	// Different filter or size means the cached file doesn't apply
+	cache.setFilter(Filter::Kaiser);
+	auto rebuilt = cache.get(1234, base.data(), 64, 32);
+	CHECK(rebuilt && memcmp(rebuilt->data, built->data, built->size) != 0);
+	CHECK(cache.get(1234, base.data(), 32, 64) != nullptr);
+
+	CHECK(cache.get(1, base.data(), 1, 1) == nullptr);
+
+	std::error_code ec;
+	std::filesystem::remove_all(directory, ec);
+}
+
+TEST_MAIN()
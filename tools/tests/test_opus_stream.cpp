@@ -0,0 +1,237 @@
+// OpusStream decoding generated Ogg Opus files (see opus_files.hpp) through the PcmStream interface
+// Opus is lossy & comes out resampled to 44.1kHz, so decoding is checked against the source tone within a noise floor, &
+// loops against a straight decode of the same audio: after a wrap every sample has to line up with where the loop tags
+// say it comes from, a sample early or late is far outside the tolerance.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opus_files.hpp"
+#include "pcm_stream.hpp"
+#include "test.hpp"
+
+namespace
+{
+	const unsigned OutputRate = 44100;
+	const uint64_t TotalSamples = 48000 * 4; // at 48kHz
+
+	// Different tone per channel, so swapped or interleaved wrong channels show up
+	double Tone(double seconds, unsigned channel)
+	{
+		return std::sin(seconds * 2 * 3.14159265358979 * (channel ? 660.0 : 440.0)) * 10000.0;
+	}
+
+	std::vector<uint8_t> MakeOpus(const std::vector<std::string>& comments, unsigned channels = 2)
+	{
+		std::vector<int16_t> samples;
+		for (uint64_t i = 0; i < TotalSamples; i++)
+			for (unsigned channel = 0; channel < channels; channel++)
+				samples.push_back(int16_t(std::lround(Tone(double(i) / 48000, channel))));
+		return TestAudio::EncodeOpus(samples, channels, comments, 192000);
+	}
+
+	std::vector<int16_t> ReadSamples(PcmStream& stream, size_t count)
+	{
+		// Odd sized reads, so they straddle ring wraps & the loop point at different offsets
+		const unsigned channels = stream.Format().channels;
+		std::vector<int16_t> out(count * channels);
+		size_t done = 0;
+		size_t chunk = 997;
+		while (done < count)
+		{
+			size_t want = std::min<size_t>(chunk, count - done);
+			size_t read = 0;
+			if (!stream.Read((uint8_t*)&out[done * channels], want * channels * 2, &read) || !read)
+				break;
+			done += read / (channels * 2);
+			chunk = chunk * 7 % 5003 + 1;
+		}
+		out.resize(done * channels);
+		return out;
+	}
+
+	std::vector<int16_t> DecodeAll(const std::vector<uint8_t>& file)
+	{
+		auto stream = CreateOpusStream();
+		if (!stream->OpenFromMemory(file.data(), file.size()))
+			return {};
+		return ReadSamples(*stream, size_t(TotalSamples));
+	}
+
+	// Output frames for the 48kHz loop tags, same rounding the resampler uses
+	uint64_t ToOutput(uint64_t sample)
+	{
+		return sample * OutputRate / 48000;
+	}
+
+	// Checks read against reference at the given positions, stereo. Prints the first sample that's off by more than tolerance.
+	template <typename Position>
+	bool Matches(const std::vector<int16_t>& read, size_t count, const std::vector<int16_t>& reference, Position position, int tolerance)
+	{
+		if (read.size() != count * 2)
+		{
+			printf("  read %zu samples, expected %zu\n", read.size() / 2, count);
+			return false;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			uint64_t source = position(i);
+			for (unsigned channel = 0; channel < 2; channel++)
+			{
+				if (std::abs(read[i * 2 + channel] - reference[source * 2 + channel]) > tolerance)
+				{
+					printf("  sample %zu is %d, reference sample %llu is %d\n", i, read[i * 2 + channel], (unsigned long long)source,
+						reference[source * 2 + channel]);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Where the nth sample played comes from, for a loop covering first..last (inclusive)
+	uint64_t Looped(uint64_t n, uint64_t first, uint64_t last)
+	{
+		return n <= last ? n : first + (n - last - 1) % (last - first + 1);
+	}
+}
+
+TEST_CASE(DecodesAccurately)
+{
+	auto file = MakeOpus({});
+	CHECK(!file.empty());
+	auto stream = CreateOpusStream();
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+	CHECK(stream->Format().channels == 2 && stream->Format().sampleRate == OutputRate);
+	CHECK(stream->Format().bitsPerSample == 16 && stream->Format().blockAlign == 4);
+
+	// Pre-skip & the end trimming leave exactly the source length, give or take the rate change rounding
+	auto read = ReadSamples(*stream, size_t(TotalSamples));
+	const size_t expected = size_t(ToOutput(TotalSamples));
+	CHECK(read.size() / 2 + 2 >= expected && read.size() / 2 <= expected + 2);
+
+	// Same tones at 44.1kHz, lined up with the source (the encoder's delay is taken off by the pre-skip)
+	double signal = 0.0, noise = 0.0;
+	for (size_t i = 2000; i + 2000 < read.size() / 2; i++)
+	{
+		for (unsigned channel = 0; channel < 2; channel++)
+		{
+			double source = Tone(double(i) / OutputRate, channel);
+			signal += source * source;
+			noise += (read[i * 2 + channel] - source) * (read[i * 2 + channel] - source);
+		}
+	}
+	double snr = 10.0 * std::log10(signal / std::max<double>(noise, 1.0));
+	printf("  %.1f dB SNR\n", snr);
+	CHECK(snr > 30.0);
+
+	// Ends after the last sample
+	size_t more = 1;
+	CHECK(stream->Read((uint8_t*)read.data(), 4, &more) && more == 0);
+	stream->Close();
+	CHECK(!stream->IsOpen());
+}
+
+TEST_CASE(DecodesMono)
+{
+	auto file = MakeOpus({}, 1);
+	auto stream = CreateOpusStream();
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+	CHECK(stream->Format().channels == 1 && stream->Format().blockAlign == 2);
+
+	auto read = ReadSamples(*stream, size_t(TotalSamples));
+	CHECK(read.size() + 2 >= size_t(ToOutput(TotalSamples)));
+
+	double signal = 0.0, noise = 0.0;
+	for (size_t i = 2000; i + 2000 < read.size(); i++)
+	{
+		double source = Tone(double(i) / OutputRate, 0);
+		signal += source * source;
+		noise += (read[i] - source) * (read[i] - source);
+	}
+	CHECK(10.0 * std::log10(signal / std::max<double>(noise, 1.0)) > 30.0);
+}
+
+TEST_CASE(LoopsMatchStraightDecode)
+{
+	// Decoding restarts a page or so before the loop start & converges during the preroll, so the wrapped audio is
+	// close to but not bit-identical to the straight decode (dither differs too). A tone sample off by one is ~1400 away.
+	const int Tolerance = 4;
+	auto straight = DecodeAll(MakeOpus({}));
+	CHECK(straight.size() / 2 + 2 >= size_t(ToOutput(TotalSamples)));
+
+	// Loop longer than the saved loop head, wrapping seeks back into the file
+	{
+		auto file = MakeOpus({ "LOOPSTART=48000", "LOOPLENGTH=96000" });
+		auto stream = CreateOpusStream();
+		CHECK(stream->OpenFromMemory(file.data(), file.size()));
+		uint64_t first = ToOutput(48000), last = ToOutput(48000 + 96000 - 1);
+		size_t count = size_t(last + 1 + (last - first + 1) * 3 + 1234);
+		CHECK(Matches(ReadSamples(*stream, count), count, straight, [&](uint64_t n) { return Looped(n, first, last); }, Tolerance));
+	}
+
+	// LOOPEND instead of LOOPLENGTH, starting partway into a page
+	{
+		auto file = MakeOpus({ "loopstart=30011", "LoopEnd=170000" });
+		auto stream = CreateOpusStream();
+		CHECK(stream->OpenFromMemory(file.data(), file.size()));
+		uint64_t first = ToOutput(30011), last = ToOutput(170000);
+		size_t count = size_t(last + 1 + (last - first + 1) * 3);
+		CHECK(Matches(ReadSamples(*stream, count), count, straight, [&](uint64_t n) { return Looped(n, first, last); }, Tolerance));
+	}
+
+	// Loop shorter than the saved head, later passes come entirely from the saved copy
+	{
+		auto file = MakeOpus({ "LOOPSTART=9600", "LOOPLENGTH=4800" });
+		auto stream = CreateOpusStream();
+		CHECK(stream->OpenFromMemory(file.data(), file.size()));
+		uint64_t first = ToOutput(9600), last = ToOutput(9600 + 4800 - 1);
+		size_t count = size_t(last + 1 + (last - first + 1) * 20);
+		CHECK(Matches(ReadSamples(*stream, count), count, straight, [&](uint64_t n) { return Looped(n, first, last); }, Tolerance));
+	}
+}
+
+TEST_CASE(ResetStartsOver)
+{
+	auto straight = DecodeAll(MakeOpus({}));
+	auto file = MakeOpus({ "LOOPSTART=48000", "LOOPLENGTH=96000" });
+	auto stream = CreateOpusStream();
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+
+	// From the start the decoder state is the same as the straight decode, only the TPDF dither differs
+	for (size_t before : { size_t(30000), size_t(200000) })
+	{
+		CHECK(ReadSamples(*stream, before).size() == before * 2);
+		stream->Reset();
+		CHECK(Matches(ReadSamples(*stream, 60000), 60000, straight, [](uint64_t n) { return n; }, 2));
+	}
+}
+
+TEST_CASE(RejectsBrokenFiles)
+{
+	auto file = MakeOpus({});
+	auto stream = CreateOpusStream();
+
+	std::vector<uint8_t> garbage(4096, 0x5A);
+	CHECK(!stream->OpenFromMemory(garbage.data(), garbage.size()));
+	CHECK(!stream->IsOpen());
+
+	// Cut off before OpusTags
+	CHECK(!stream->OpenFromMemory(file.data(), 60));
+	CHECK(!stream->IsOpen());
+
+	// Ogg, but not Opus
+	auto notOpus = file;
+	notOpus[28] = 'X';
+	CHECK(!stream->OpenFromMemory(notOpus.data(), notOpus.size()));
+	CHECK(!stream->IsOpen());
+
+	// Still usable afterwards
+	CHECK(stream->OpenFromMemory(file.data(), file.size()));
+	CHECK(ReadSamples(*stream, 1000).size() == 2000);
+}
+
+TEST_MAIN()
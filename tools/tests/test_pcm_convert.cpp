@@ -0,0 +1,274 @@
+// PcmConvert kernels
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "pcm_convert.hpp"
+#include "pixel_convert.hpp"
+#include "test.hpp"
+
+using PixelConvert::Level;
+
+static const double HalfPi = 1.57079632679489661923;
+
+// Frame counts around every vector width, with tails left over for the scalar fallback
+static const size_t FrameCounts[] = { 0, 1, 2, 3, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 257, 1001 };
+
+// Planar input the way libFLAC hands it out, with values past the bit depth mixed in to exercise saturation & truncation
+static std::vector<std::vector<int32_t>> RandomPlanar(std::mt19937& rng, unsigned channels, size_t frames, unsigned bits)
+{
+	std::vector<std::vector<int32_t>> planar(channels, std::vector<int32_t>(frames));
+	for (auto& channel : planar)
+		for (auto& sample : channel)
+			sample = rng() % 8 ? int32_t(rng()) >> (32 - bits) : int32_t(rng());
+	return planar;
+}
+
+static std::vector<uint8_t> Interleave(PcmConvert::InterleaveFunc func, const std::vector<std::vector<int32_t>>& planar, size_t frames, unsigned bits)
+{
+	std::vector<const int32_t*> channels;
+	for (const auto& channel : planar)
+		channels.push_back(channel.data());
+
+	// Guard bytes past the end must be left alone
+	std::vector<uint8_t> out(frames * planar.size() * (bits / 8) + 64, 0xCD);
+	func(channels.data(), unsigned(planar.size()), out.data(), frames);
+	return out;
+}
+
+static std::vector<int16_t> Tone(size_t frames, unsigned channels, double amplitude, double step)
+{
+	std::vector<int16_t> samples(frames * channels);
+	for (size_t i = 0; i < samples.size(); i++)
+		samples[i] = int16_t(amplitude * std::sin(double(i) * step));
+	return samples;
+}
+
+TEST_CASE(InterleaveMatchesScalar)
+{
+	std::mt19937 rng(44);
+	for (int level = int(Level::Scalar); level <= int(PixelConvert::DetectLevel()); level++)
+	{
+		PixelConvert::SetLevel(Level(level));
+		for (unsigned bits : { 16u, 24u, 32u })
+		{
+			for (unsigned channels = 1; channels <= 8; channels++)
+			{
+				auto func = PcmConvert::Select(channels, bits);
+				auto scalar = PcmConvert::SelectScalar(channels, bits);
+				CHECK(func && scalar);
+				if (!func || !scalar)
+					continue;
+
+				for (size_t frames : FrameCounts)
+				{
+					auto planar = RandomPlanar(rng, channels, frames, bits);
+					bool same = Interleave(func, planar, frames, bits) == Interleave(scalar, planar, frames, bits);
+					if (!same)
+						printf("  %s: %u channels, %u bits, %zu frames differ from scalar\n", PixelConvert::LevelName(Level(level)), channels, bits, frames);
+					CHECK(same);
+				}
+			}
+		}
+	}
+	PixelConvert::SetLevel(PixelConvert::DetectLevel());
+
+	CHECK(PcmConvert::Select(2, 8) == nullptr);
+	CHECK(PcmConvert::Select(2, 20) == nullptr);
+	CHECK(PcmConvert::Select(0, 16) == nullptr);
+}
+
+TEST_CASE(InterleaveScalarOutput)
+{
+	// 16-bit saturates, 24 & 32-bit keep the low bytes, all little-endian & channel by channel within each frame
+	std::vector<std::vector<int32_t>> planar = { { 1, 40000, -1 }, { -40000, 0x123456, 0x7FFFFFFF } };
+	auto out16 = Interleave(PcmConvert::SelectScalar(2, 16), planar, 3, 16);
+	const uint8_t expected16[] = { 0x01, 0x00, 0x00, 0x80, 0xFF, 0x7F, 0xFF, 0x7F, 0xFF, 0xFF, 0xFF, 0x7F };
+	CHECK(std::equal(std::begin(expected16), std::end(expected16), out16.begin()));
+
+	auto out24 = Interleave(PcmConvert::SelectScalar(2, 24), planar, 3, 24);
+	const uint8_t expected24[] = { 0x01, 0x00, 0x00, 0xC0, 0x63, 0xFF, 0x40, 0x9C, 0x00, 0x56, 0x34, 0x12, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	CHECK(std::equal(std::begin(expected24), std::end(expected24), out24.begin()));
+
+	auto out32 = Interleave(PcmConvert::SelectScalar(1, 32), { { -2, 0x01020304 } }, 2, 32);
+	const uint8_t expected32[] = { 0xFE, 0xFF, 0xFF, 0xFF, 0x04, 0x03, 0x02, 0x01 };
+	CHECK(std::equal(std::begin(expected32), std::end(expected32), out32.begin()));
+	CHECK(out32[8] == 0xCD);
+}
+
+TEST_CASE(DitherMatchesScalar)
+{
+	// Mostly in range, plus clipping & the NaN/infinity cases the clamps have to treat the same way minps/maxps do
+	std::mt19937 rng(48);
+	std::uniform_real_distribution<float> level(-1.2f, 1.2f);
+	std::vector<float> src(4099);
+	for (auto& sample : src)
+		sample = level(rng);
+	src[5] = std::numeric_limits<float>::quiet_NaN();
+	src[17] = std::numeric_limits<float>::infinity();
+	src[18] = -std::numeric_limits<float>::infinity();
+	src[40] = 1.0f;
+	src[41] = -1.0f;
+
+	auto scalar = PcmConvert::SelectDitherScalar();
+	for (int level = int(Level::SSE2); level <= int(PixelConvert::DetectLevel()); level++)
+	{
+		PixelConvert::SetLevel(Level(level));
+		auto func = PcmConvert::SelectDither();
+
+		// Uneven call sizes, both have to leave the generators in the same state after each one for the next call to match
+		PcmConvert::DitherState expectedState, actualState;
+		expectedState.seed(1234);
+		actualState.seed(1234);
+		std::vector<int16_t> expected(src.size() + 16, 0x5A5A), actual(src.size() + 16, 0x5A5A);
+		const size_t sizes[] = { 1, 7, 8, 9, 3, 64, 17, 1000, 0, 31 };
+		for (size_t pos = 0, k = 0; pos < src.size(); k++)
+		{
+			size_t n = std::min<size_t>(sizes[k % std::size(sizes)], src.size() - pos);
+			scalar(src.data() + pos, expected.data() + pos, n, expectedState);
+			func(src.data() + pos, actual.data() + pos, n, actualState);
+			CHECK(std::equal(std::begin(expectedState.lanes), std::end(expectedState.lanes), actualState.lanes));
+			pos += n;
+		}
+
+		if (expected != actual)
+			printf("  %s: dithered output differs from scalar\n", PixelConvert::LevelName(Level(level)));
+		CHECK(expected == actual);
+	}
+	PixelConvert::SetLevel(PixelConvert::DetectLevel());
+}
+
+TEST_CASE(DitherIsWithinOneStep)
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> level(-0.99f, 0.99f);
+	std::vector<float> src(10001);
+	for (auto& sample : src)
+		sample = level(rng);
+	src[0] = std::numeric_limits<float>::quiet_NaN();
+	src[1] = 2.0f;
+	src[2] = -2.0f;
+
+	PcmConvert::DitherState state;
+	state.seed(99);
+	std::vector<int16_t> out(src.size());
+	PcmConvert::SelectDither()(src.data(), out.data(), src.size(), state);
+
+	// Triangular noise of +-1 LSB around the exact value, saturated at full scale, NaN goes to the bottom clamp
+	CHECK(out[0] == -32768 && out[1] == 32767 && out[2] == -32768);
+	long sum = 0;
+	for (size_t i = 3; i < src.size(); i++)
+	{
+		double exact = double(src[i]) * 32768.0;
+		CHECK(std::abs(double(out[i]) - exact) <= 1.5);
+		sum += long(out[i]) - std::lrint(exact);
+	}
+
+	// No DC offset from the noise
+	CHECK(std::abs(double(sum) / double(src.size())) < 0.05);
+
+	// Zero seed is fixed up, xorshift would be stuck at zero
+	state.seed(0);
+	CHECK(std::all_of(std::begin(state.lanes), std::end(state.lanes), [](uint32_t lane) { return lane != 0; }));
+}
+
+TEST_CASE(CrossfadeMatchesGains)
+{
+	const size_t frames = 1000;
+	const uint64_t length = 700;
+	auto from = Tone(frames, 2, 20000, 0.01);
+	auto to = Tone(frames, 2, -15000, 0.013);
+	std::vector<int16_t> out(frames * 2);
+	PcmConvert::Crossfade(from.data(), to.data(), out.data(), frames, 2, 0, length);
+
+	for (size_t i = 0; i < frames * 2; i++)
+	{
+		size_t frame = i / 2;
+		double t = double(frame) / double(length);
+		double expected = frame < length ? from[i] * std::cos(t * HalfPi) + to[i] * std::sin(t * HalfPi) : to[i];
+		CHECK(std::abs(double(out[i]) - expected) <= 1.0);
+	}
+
+	// Starts on from, anything past the fade is to exactly
+	CHECK(out[0] == from[0] && out[1] == from[1]);
+	CHECK(std::equal(out.begin() + length * 2, out.end(), to.begin() + length * 2));
+}
+
+TEST_CASE(CrossfadeChunkingAndInPlace)
+{
+	// Gains follow the absolute position, so reading in uneven chunks (in place into to) gives the same output
+	const size_t frames = 1500;
+	const uint64_t length = 1111;
+	auto from = Tone(frames, 3, 30000, 0.02);
+	auto to = Tone(frames, 3, 25000, 0.007);
+	std::vector<int16_t> whole(frames * 3);
+	PcmConvert::Crossfade(from.data(), to.data(), whole.data(), frames, 3, 0, length);
+
+	std::vector<int16_t> chunked = to;
+	const size_t sizes[] = { 1, 7, 64, 333, 2, 1000 };
+	for (size_t pos = 0, k = 0; pos < frames; k++)
+	{
+		size_t n = std::min<size_t>(sizes[k % std::size(sizes)], frames - pos);
+		PcmConvert::Crossfade(from.data() + pos * 3, chunked.data() + pos * 3, chunked.data() + pos * 3, n, 3, pos, length);
+		pos += n;
+	}
+	CHECK(chunked == whole);
+}
+
+TEST_CASE(CrossfadeReversalIsContinuous)
+{
+	// CDSwitcherFile reverses a fade by swapping the tracks & restarting at length - position,
+	// the gains of both tracks have to carry on from where they were rather than jumping
+	const uint64_t length = 4410;
+	const uint64_t reverseAt = 1000;
+	const size_t frames = 3000;
+	std::vector<int16_t> a(frames, 16000);
+	std::vector<int16_t> b(frames, 0);
+	std::vector<int16_t> fading(frames), reversed(frames);
+
+	// A fading out toward B, up to reverseAt
+	PcmConvert::Crossfade(a.data(), b.data(), fading.data(), reverseAt, 1, 0, length);
+
+	// Back toward A: B is the outgoing one now
+	PcmConvert::Crossfade(b.data(), a.data(), reversed.data(), frames, 1, length - reverseAt, length);
+
+	// First frame after the reversal picks up from the last one before it, give or take one frame's step & rounding
+	double maxStep = 16000.0 * HalfPi / double(length) + 1.0;
+	CHECK(std::abs(double(reversed[0]) - double(fading[reverseAt - 1])) <= maxStep);
+
+	// Then retraces the fade: frame j after the reversal sounds like frame reverseAt - j did before it
+	for (size_t j = 1; j < reverseAt; j++)
+		CHECK(std::abs(int(reversed[j]) - int(fading[reverseAt - j])) <= 1);
+
+	// A is back to full level once the remaining part of the fade is done
+	CHECK(std::all_of(reversed.begin() + reverseAt, reversed.end(), [](int16_t s) { return s == 16000; }));
+
+	// & A's level only ever changes by one step per frame the whole way through
+	for (size_t j = 1; j < frames; j++)
+		CHECK(std::abs(double(reversed[j]) - double(reversed[j - 1])) <= maxStep);
+}
+
+TEST_CASE(CrossfadeEdges)
+{
+	// Saturates instead of wrapping when both tracks are near full scale
+	std::vector<int16_t> loud(2, 32767), quiet(2, -32768), out(2);
+	PcmConvert::Crossfade(loud.data(), loud.data(), out.data(), 1, 2, 350, 700);
+	CHECK(out[0] == 32767 && out[1] == 32767);
+	PcmConvert::Crossfade(quiet.data(), quiet.data(), out.data(), 1, 2, 350, 700);
+	CHECK(out[0] == -32768 && out[1] == -32768);
+
+	// Zero length fade is a straight copy of to
+	auto from = Tone(4, 2, 1000, 0.5);
+	auto to = Tone(4, 2, 2000, 0.3);
+	std::vector<int16_t> copied(8);
+	PcmConvert::Crossfade(from.data(), to.data(), copied.data(), 4, 2, 0, 0);
+	CHECK(copied == to);
+}
+
+TEST_MAIN()
@@ -0,0 +1,181 @@
+// PixelConvert SIMD kernels against the scalar ones, on random pixels & odd lengths/offsets that leave tails for the scalar fallback
+// Every level up to what this CPU supports is checked, levels it can't run are skipped (SetLevel clamps them)
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "pixel_convert.hpp"
+#include "test.hpp"
+
+using namespace PixelConvert;
+
+namespace
+{
+	// Lengths around every vector width (4/8 pixels) & unroll, plus a long one
+	const size_t Lengths[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 127, 1001 };
+
+	// Bytes past the end of the output that must be left alone
+	constexpr size_t Guard = 64;
+	constexpr uint8_t GuardByte = 0xCD;
+
+	template <typename Src>
+	std::vector<Src> Random(std::mt19937& rng, size_t count)
+	{
+		std::vector<Src> data(count);
+		for (auto& value : data)
+			value = Src(rng());
+		return data;
+	}
+
+	// Runs func at the scalar level & at level, from src + offset, returns whether the outputs (& untouched guard bytes) match
+	template <typename Src, typename Func>
+	bool Compare(Func func, Level level, const std::vector<Src>& src, size_t offset, size_t pixels)
+	{
+		std::vector<uint8_t> expected(pixels * 4 + offset * 4 + Guard, GuardByte);
+		std::vector<uint8_t> actual(expected.size(), GuardByte);
+
+		SetLevel(Level::Scalar);
+		func(src.data() + offset, expected.data() + offset * 4, pixels);
+		SetLevel(level);
+		func(src.data() + offset, actual.data() + offset * 4, pixels);
+
+		if (expected != actual)
+		{
+			printf("  %s: %zu pixels at offset %zu differ from scalar\n", LevelName(level), pixels, offset);
+			return false;
+		}
+		return true;
+	}
+
+	template <typename Src, typename Func>
+	void CompareAllLevels(Func func, uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		for (int level = int(Level::SSE2); level <= int(DetectLevel()); level++)
+		{
+			for (size_t pixels : Lengths)
+			{
+				// Offsets knock the pointers off 16/32 byte alignment, in whole pixels since that's how rows are laid out
+				for (size_t offset = 0; offset < 3; offset++)
+				{
+					auto src = Random<Src>(rng, (pixels + offset) * (sizeof(Src) == 1 ? 4 : 1));
+					CHECK(Compare(func, Level(level), src, offset, pixels));
+				}
+			}
+
+			// Random lengths too
+			for (int i = 0; i < 50; i++)
+			{
+				size_t pixels = rng() % 300;
+				auto src = Random<Src>(rng, pixels * (sizeof(Src) == 1 ? 4 : 1));
+				CHECK(Compare(func, Level(level), src, 0, pixels));
+			}
+		}
+		SetLevel(DetectLevel());
+	}
+}
+
+TEST_CASE(LevelsAreClamped)
+{
+	printf("  CPU supports up to %s\n", LevelName(DetectLevel()));
+	SetLevel(Level::AVX2);
+	CHECK(CurrentLevel() == DetectLevel());
+	SetLevel(Level::Scalar);
+	CHECK(CurrentLevel() == Level::Scalar);
+	SetLevel(DetectLevel());
+}
+
+TEST_CASE(SwapRedBlueMatchesScalar)
+{
+	CompareAllLevels<uint8_t>(SwapRedBlue, 1);
+	CompareAllLevels<uint8_t>(SwapRedBlueOpaque, 2);
+
+	const uint8_t pixel[4] = { 1, 2, 3, 4 };
+	uint8_t out[4];
+	SwapRedBlue(pixel, out, 1);
+	CHECK(out[0] == 3 && out[1] == 2 && out[2] == 1 && out[3] == 4);
+	SwapRedBlueOpaque(pixel, out, 1);
+	CHECK(out[0] == 3 && out[1] == 2 && out[2] == 1 && out[3] == 0xFF);
+}
+
+TEST_CASE(SwapRedBlueInPlace)
+{
+	std::mt19937 rng(3);
+	for (int level = int(Level::Scalar); level <= int(DetectLevel()); level++)
+	{
+		SetLevel(Level(level));
+		for (size_t pixels : Lengths)
+		{
+			auto original = Random<uint8_t>(rng, pixels * 4);
+			auto copied = original;
+			std::vector<uint8_t> expected(pixels * 4);
+			SwapRedBlue(original.data(), expected.data(), pixels);
+			SwapRedBlue(copied.data(), copied.data(), pixels);
+			CHECK(copied == expected);
+		}
+	}
+	SetLevel(DetectLevel());
+}
+
+TEST_CASE(PremultiplyMatchesScalar)
+{
+	CompareAllLevels<uint8_t>(Premultiply, 4);
+
+	// Scalar rounding against the documented formula, for every color & alpha
+	SetLevel(Level::Scalar);
+	std::vector<uint8_t> pixels(256 * 256 * 4), out(pixels.size());
+	for (uint32_t a = 0; a < 256; a++)
+		for (uint32_t c = 0; c < 256; c++)
+		{
+			uint8_t* pixel = &pixels[(a * 256 + c) * 4];
+			pixel[0] = pixel[1] = pixel[2] = uint8_t(c);
+			pixel[3] = uint8_t(a);
+		}
+	Premultiply(pixels.data(), out.data(), 256 * 256);
+
+	bool exact = true;
+	for (uint32_t a = 0; a < 256; a++)
+		for (uint32_t c = 0; c < 256; c++)
+		{
+			const uint8_t* pixel = &out[(a * 256 + c) * 4];
+			uint8_t expected = uint8_t((c * a + 127) / 255);
+			exact &= pixel[0] == expected && pixel[1] == expected && pixel[2] == expected && pixel[3] == a;
+		}
+	CHECK(exact);
+	SetLevel(DetectLevel());
+}
+
+TEST_CASE(ExpandMatchesScalar)
+{
+	CompareAllLevels<uint16_t>(Expand565, 5);
+	CompareAllLevels<uint16_t>(Expand4444, 6);
+
+	// Every 16-bit value, through whichever level is fastest
+	std::vector<uint16_t> all(65536);
+	for (uint32_t i = 0; i < 65536; i++)
+		all[i] = uint16_t(i);
+	for (auto func : { Expand565, Expand4444 })
+	{
+		std::vector<uint8_t> expected(65536 * 4), actual(65536 * 4);
+		SetLevel(Level::Scalar);
+		func(all.data(), expected.data(), all.size());
+		SetLevel(DetectLevel());
+		func(all.data(), actual.data(), all.size());
+		CHECK(expected == actual);
+	}
+
+	// Bit replication: full scale stays full scale
+	const uint16_t white565 = 0xFFFF, red565 = 0xF800;
+	uint8_t out[4];
+	Expand565(&white565, out, 1);
+	CHECK(out[0] == 0xFF && out[1] == 0xFF && out[2] == 0xFF && out[3] == 0xFF);
+	Expand565(&red565, out, 1);
+	CHECK(out[0] == 0 && out[1] == 0 && out[2] == 0xFF && out[3] == 0xFF);
+	const uint16_t argb4444 = 0x8F10;
+	Expand4444(&argb4444, out, 1);
+	CHECK(out[0] == 0x00 && out[1] == 0x11 && out[2] == 0xFF && out[3] == 0x88);
+}
+
+TEST_MAIN()
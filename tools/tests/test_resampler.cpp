@@ -0,0 +1,181 @@
+// StreamResampler: SIMD dot products against the scalar ones, & whole streams at every level, chunked, & restarted
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "pixel_convert.hpp"
+#include "resampler.hpp"
+#include "test.hpp"
+
+using PixelConvert::Level;
+
+namespace
+{
+	struct RatePair
+	{
+		unsigned in;
+		unsigned out;
+	};
+
+	// Up, down (longer filter), odd ratios, & one that needs more phases than RESAMPLER_MAX_PHASES
+	const RatePair Rates[] = { { 44100, 48000 }, { 48000, 44100 }, { 22050, 48000 }, { 96000, 44100 }, { 32000, 48000 }, { 44100, 47999 } };
+
+	std::vector<float> Noise(std::mt19937& rng, size_t count)
+	{
+		std::uniform_real_distribution<float> level(-1.0f, 1.0f);
+		std::vector<float> samples(count);
+		for (auto& sample : samples)
+			sample = level(rng);
+		return samples;
+	}
+
+	// Feeds the input in chunks of the given sizes (repeating), then finishes the stream
+	std::vector<float> Resample(const RatePair& rates, unsigned channels, const std::vector<float>& input, const std::vector<size_t>& chunks)
+	{
+		StreamResampler resampler;
+		resampler.init(channels, rates.in, rates.out);
+		std::vector<float> out;
+		size_t frames = input.size() / channels;
+		for (size_t pos = 0, k = 0; pos < frames; k++)
+		{
+			size_t n = std::min<size_t>(chunks[k % chunks.size()], frames - pos);
+			resampler.process(input.data() + pos * channels, n, out);
+			pos += n;
+		}
+		resampler.finish(out);
+		return out;
+	}
+
+	bool SameBits(const std::vector<float>& a, const std::vector<float>& b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](float x, float y) {
+			return std::memcmp(&x, &y, sizeof(float)) == 0;
+		});
+	}
+}
+
+TEST_CASE(DotMatchesScalar)
+{
+	std::mt19937 rng(48);
+	for (int level = int(Level::Scalar); level <= int(PixelConvert::DetectLevel()); level++)
+	{
+		PixelConvert::SetLevel(Level(level));
+		for (unsigned channels = 1; channels <= 8; channels++)
+		{
+			auto dot = StreamResampler::SelectDot(channels);
+			auto scalar = StreamResampler::SelectDotScalar(channels);
+
+			// Filters are always a multiple of 8 taps, from the shortest up to a heavily downsampling one
+			for (size_t taps = 8; taps <= 520; taps += 8 * (1 + rng() % 7))
+			{
+				size_t count = taps * channels;
+				auto samples = Noise(rng, count);
+				auto coeffs = Noise(rng, count);
+				std::vector<float> expected(channels + 1, 123.0f), actual(channels + 1, 123.0f);
+				scalar(samples.data(), coeffs.data(), count, channels, expected.data());
+				dot(samples.data(), coeffs.data(), count, channels, actual.data());
+
+				bool same = SameBits(expected, actual);
+				if (!same)
+					printf("  %s: %u channels, %zu taps differ from scalar\n", PixelConvert::LevelName(Level(level)), channels, taps);
+				CHECK(same);
+			}
+		}
+	}
+	PixelConvert::SetLevel(PixelConvert::DetectLevel());
+}
+
+TEST_CASE(StreamMatchesScalar)
+{
+	std::mt19937 rng(480);
+	for (unsigned channels : { 1u, 2u, 3u, 6u })
+	{
+		for (const auto& rates : Rates)
+		{
+			auto input = Noise(rng, 4801 * channels);
+
+			PixelConvert::SetLevel(Level::Scalar);
+			auto expected = Resample(rates, channels, input, { 4801 });
+			CHECK(expected.size() / channels == size_t(uint64_t(4801) * rates.out / rates.in) + (4801ull * rates.out % rates.in != 0));
+
+			for (int level = int(Level::SSE2); level <= int(PixelConvert::DetectLevel()); level++)
+			{
+				PixelConvert::SetLevel(Level(level));
+				bool same = SameBits(expected, Resample(rates, channels, input, { 4801 }));
+				if (!same)
+					printf("  %s: %u channels %u -> %u differs from scalar\n", PixelConvert::LevelName(Level(level)), channels, rates.in, rates.out);
+				CHECK(same);
+			}
+		}
+	}
+	PixelConvert::SetLevel(PixelConvert::DetectLevel());
+}
+
+TEST_CASE(ChunkingDoesNotChangeOutput)
+{
+	std::mt19937 rng(4);
+	for (unsigned channels : { 1u, 2u, 5u })
+	{
+		for (const auto& rates : Rates)
+		{
+			auto input = Noise(rng, 3333 * channels);
+			auto whole = Resample(rates, channels, input, { 3333 });
+			CHECK(SameBits(whole, Resample(rates, channels, input, { 1, 7, 441, 2, 1000, 63 })));
+			CHECK(SameBits(whole, Resample(rates, channels, input, { 1 })));
+		}
+	}
+}
+
+TEST_CASE(RestartLinesUp)
+{
+	// Restarting preroll() frames before a point gives the same output from there on as decoding straight through
+	std::mt19937 rng(5);
+	for (const auto& rates : Rates)
+	{
+		const unsigned channels = 2;
+		auto input = Noise(rng, 6000 * channels);
+		auto whole = Resample(rates, channels, input, { 6000 });
+
+		StreamResampler resampler;
+		resampler.init(channels, rates.in, rates.out);
+		const uint64_t seek = 3001;
+		uint64_t start = seek - resampler.preroll();
+		uint64_t firstOutput = resampler.reset(start);
+		CHECK(firstOutput == (start * rates.out + rates.in - 1) / rates.in);
+
+		std::vector<float> restarted;
+		resampler.process(input.data() + start * channels, size_t(6000 - start), restarted);
+		resampler.finish(restarted);
+
+		// Outputs from the seek point onwards
+		uint64_t from = resampler.toOutput(seek) + 1;
+		CHECK(restarted.size() == whole.size() - firstOutput * channels);
+		bool same = restarted.size() == whole.size() - firstOutput * channels &&
+			std::equal(restarted.begin() + (from - firstOutput) * channels, restarted.end(), whole.begin() + from * channels);
+		if (!same)
+			printf("  %u -> %u: output after restarting at %llu differs\n", rates.in, rates.out, (unsigned long long)start);
+		CHECK(same);
+	}
+}
+
+TEST_CASE(PassesDC)
+{
+	// Each phase is normalized to unity gain, so a constant comes through as that constant once past the start
+	for (const auto& rates : Rates)
+	{
+		std::vector<float> input(8000, 0.5f);
+		auto out = Resample(rates, 1, input, { 8000 });
+		StreamResampler resampler;
+		resampler.init(1, rates.in, rates.out);
+		size_t edge = resampler.toOutput(resampler.preroll()) + 2;
+		CHECK(out.size() > edge * 2);
+		for (size_t i = edge; i + edge < out.size(); i++)
+			CHECK(std::abs(out[i] - 0.5f) < 1e-4f);
+	}
+}
+
+TEST_MAIN()
@@ -0,0 +1,121 @@
+// TextureDumpWriter writing queued textures from its thread, & shutdown() finishing the queue before stopping it
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "texture_dumper.hpp"
+#include "test.hpp"
+
+namespace
+{
+	struct TempFolder
+	{
+		std::filesystem::path path;
+
+		TempFolder()
+		{
+			path = std::filesystem::temp_directory_path() / ("test_texture_dumper_" + std::to_string(std::random_device()()));
+		}
+
+		~TempFolder()
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(path, ec);
+		}
+	};
+
+	std::vector<uint8_t> Texture(size_t index, size_t size)
+	{
+		std::vector<uint8_t> data(size);
+		for (size_t i = 0; i < size; i++)
+			data[i] = uint8_t(i * 7 + index);
+		return data;
+	}
+
+	std::vector<uint8_t> ReadFile(const std::filesystem::path& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	}
+
+	std::filesystem::path DumpPath(const TempFolder& folder, size_t index)
+	{
+		return folder.path / ("cs_stage" + std::to_string(index % 5) + ".xmtset") / (std::to_string(index) + "_0x1234_64x64.dds");
+	}
+}
+
+TEST_CASE(WritesEverythingQueued)
+{
+	TempFolder folder;
+	const size_t Count = 200;
+	{
+		// Small limit, so queue() has to wait on the writer a lot
+		TextureDumpWriter writer(16 * 1024);
+		for (size_t i = 0; i < Count; i++)
+		{
+			auto data = Texture(i, 1000 + i * 10);
+			writer.queue(DumpPath(folder, i), data.data(), data.size());
+		}
+
+		// Bigger than the whole limit still goes through
+		auto big = Texture(Count, 64 * 1024);
+		writer.queue(DumpPath(folder, Count), big.data(), big.size());
+
+		writer.flush();
+		CHECK(writer.writtenCount() == Count + 1);
+	}
+
+	for (size_t i = 0; i < Count; i++)
+		CHECK(ReadFile(DumpPath(folder, i)) == Texture(i, 1000 + i * 10));
+	CHECK(ReadFile(DumpPath(folder, Count)).size() == 64 * 1024);
+}
+
+TEST_CASE(ShutdownFinishesTheQueue)
+{
+	TempFolder folder;
+	const size_t Count = 100;
+
+	TextureDumpWriter writer;
+	writer.shutdown(); // never started, nothing to stop
+	CHECK(writer.writtenCount() == 0);
+
+	TextureDumpWriter second;
+	for (size_t i = 0; i < Count; i++)
+	{
+		auto data = Texture(i, 4096);
+		second.queue(DumpPath(folder, i), data.data(), data.size());
+	}
+	second.shutdown();
+	CHECK(second.writtenCount() == Count);
+	for (size_t i = 0; i < Count; i++)
+		CHECK(ReadFile(DumpPath(folder, i)) == Texture(i, 4096));
+
+	// Stopped for good, later textures are dropped & a second shutdown does nothing
+	auto late = Texture(Count, 4096);
+	second.queue(DumpPath(folder, Count), late.data(), late.size());
+	second.flush();
+	second.shutdown();
+	CHECK(second.writtenCount() == Count && !std::filesystem::exists(DumpPath(folder, Count)));
+}
+
+TEST_CASE(ReportsFailedWrites)
+{
+	TempFolder folder;
+	std::filesystem::create_directories(folder.path);
+
+	// A file where the folder should be, so neither the folder nor the dump can be created
+	std::ofstream(folder.path / "blocked", std::ios::binary) << "x";
+	TextureDumpWriter writer;
+	auto data = Texture(0, 100);
+	writer.queue(folder.path / "blocked" / "a.dds", data.data(), data.size());
+	writer.queue(folder.path / "ok" / "b.dds", data.data(), data.size());
+	writer.flush();
+	CHECK(writer.writtenCount() == 1);
+	CHECK(ReadFile(folder.path / "ok" / "b.dds") == data);
+}
+
+TEST_MAIN()
@@ -0,0 +1,231 @@
+// TextureHashCache handing out the same hashes as XXH32 of the whole file, & its table file surviving reloads & damage
+// A second texture that only differs outside the sampled blocks shows whether a hash came from the table or was computed.
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <xxhash.h>
+
+#include "texture_hash_cache.hpp"
+#include "test.hpp"
+
+namespace
+{
+	struct TempFolder
+	{
+		std::filesystem::path path;
+
+		TempFolder()
+		{
+			path = std::filesystem::temp_directory_path() / ("test_texture_hash_cache_" + std::to_string(std::random_device()()));
+			std::filesystem::create_directories(path);
+		}
+
+		~TempFolder()
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(path, ec);
+		}
+	};
+
+	// DDS-like: fixed header then random contents
+	std::vector<uint8_t> Texture(uint32_t seed, size_t size)
+	{
+		std::vector<uint8_t> data(size);
+		std::mt19937 rng(seed);
+		for (auto& byte : data)
+			byte = uint8_t(rng());
+		memcpy(data.data(), "DDS |", 5);
+		return data;
+	}
+
+	// Same size, header & sampled blocks, only a byte between the first two blocks is changed
+	std::vector<uint8_t> Lookalike(std::vector<uint8_t> data)
+	{
+		data[128 + 256 + 10] ^= 0xFF;
+		return data;
+	}
+
+	uint32_t FullHash(const std::vector<uint8_t>& data)
+	{
+		return XXH32(data.data(), data.size(), 0);
+	}
+
+	uint32_t Hash(TextureHashCache& cache, const std::vector<uint8_t>& data)
+	{
+		return cache.hash(data.data(), data.size());
+	}
+
+	const size_t RecordSize = 20;
+	const size_t HeaderSize = 8;
+}
+
+TEST_CASE(SampledKeyGivesTheFullHash)
+{
+	TextureHashCache cache; // never opened, still caches in memory
+
+	for (size_t size : { size_t(100), size_t(64 * 1024 - 1), size_t(64 * 1024), size_t(64 * 1024 + 1), size_t(1024 * 1024), size_t(5 * 1024 * 1024 + 3) })
+	{
+		auto data = Texture(uint32_t(size), size);
+		CHECK(Hash(cache, data) == FullHash(data));
+		CHECK(Hash(cache, data) == FullHash(data));
+	}
+	CHECK(cache.size() == 4); // small ones aren't kept
+
+	// Small files are always hashed in full, so even a lookalike gets its own hash
+	auto small = Texture(1, 32 * 1024);
+	CHECK(Hash(cache, small) == FullHash(small) && Hash(cache, Lookalike(small)) == FullHash(Lookalike(small)));
+
+	// Header, size & each sampled block all change the key
+	auto data = Texture(2, 1024 * 1024);
+	uint64_t key = TextureHashCache::SampleKey(data.data(), data.size());
+	size_t middleBlock = 128 + (data.size() - 128 - 256) * 8 / 15;
+	for (size_t offset : { size_t(20), size_t(128), middleBlock + 100, data.size() - 1 })
+	{
+		auto changed = data;
+		changed[offset] ^= 1;
+		CHECK(TextureHashCache::SampleKey(changed.data(), changed.size()) != key);
+		CHECK(Hash(cache, changed) == FullHash(changed));
+	}
+	CHECK(TextureHashCache::SampleKey(data.data(), data.size() - 1) != key);
+
+	// Anything else doesn't, which is why the table stores the full hash rather than replacing it
+	auto lookalike = Lookalike(data);
+	CHECK(TextureHashCache::SampleKey(lookalike.data(), lookalike.size()) == key);
+}
+
+TEST_CASE(TableRoundTrips)
+{
+	TempFolder folder;
+	auto path = folder.path / "texture_hashes.bin";
+
+	std::vector<std::vector<uint8_t>> textures;
+	for (uint32_t i = 0; i < 20; i++)
+		textures.push_back(Texture(i, 64 * 1024 + i * 4096));
+
+	{
+		TextureHashCache cache;
+		CHECK(cache.open(path));
+		CHECK(cache.open(path)); // already open
+		for (const auto& texture : textures)
+			CHECK(Hash(cache, texture) == FullHash(texture));
+		Hash(cache, textures[0]); // already known, not written again
+	}
+	CHECK(std::filesystem::file_size(path) == HeaderSize + textures.size() * RecordSize);
+
+	{
+		// Lookalikes get the stored hash of the original, so these really came from the file
+		TextureHashCache cache;
+		CHECK(cache.open(path) && cache.size() == textures.size());
+		for (const auto& texture : textures)
+			CHECK(Hash(cache, Lookalike(texture)) == FullHash(texture));
+
+		// New ones are appended after the loaded ones
+		auto extra = Texture(100, 256 * 1024);
+		CHECK(Hash(cache, extra) == FullHash(extra));
+		cache.close();
+		CHECK(Hash(cache, Texture(101, 256 * 1024)) == FullHash(Texture(101, 256 * 1024))); // closed, only kept in memory
+	}
+	CHECK(std::filesystem::file_size(path) == HeaderSize + (textures.size() + 1) * RecordSize);
+
+	TextureHashCache cache;
+	CHECK(cache.open(path) && cache.size() == textures.size() + 1);
+
+	// Can't be created in a folder that isn't there
+	TextureHashCache missing;
+	CHECK(!missing.open(folder.path / "missing" / "texture_hashes.bin"));
+}
+
+TEST_CASE(RejectsDamagedTables)
+{
+	TempFolder folder;
+	auto path = folder.path / "texture_hashes.bin";
+
+	std::vector<std::vector<uint8_t>> textures;
+	for (uint32_t i = 0; i < 10; i++)
+		textures.push_back(Texture(i, 128 * 1024));
+
+	auto write = [&]
+	{
+		std::filesystem::remove(path);
+		TextureHashCache cache;
+		CHECK(cache.open(path));
+		for (const auto& texture : textures)
+			Hash(cache, texture);
+	};
+
+	auto damage = [&](size_t offset, const std::string& bytes)
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(std::streamoff(offset));
+		file.write(bytes.data(), std::streamsize(bytes.size()));
+	};
+
+	auto flip = [&](size_t offset)
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekg(std::streamoff(offset));
+		char byte = char(file.get() ^ 0x10);
+		file.seekp(std::streamoff(offset));
+		file.put(byte);
+	};
+
+	// Half-written record at the end (crash mid-write) is cut off
+	write();
+	std::ofstream(path, std::ios::binary | std::ios::app) << "partial";
+	{
+		TextureHashCache cache;
+		CHECK(cache.open(path) && cache.size() == textures.size());
+		CHECK(std::filesystem::file_size(path) == HeaderSize + textures.size() * RecordSize);
+
+		// & what's appended after it reads back fine
+		auto extra = Texture(100, 128 * 1024);
+		Hash(cache, extra);
+	}
+	{
+		TextureHashCache cache;
+		CHECK(cache.open(path) && cache.size() == textures.size() + 1);
+	}
+
+	// Garbage in the last record, every byte of it is covered by the check
+	for (size_t i = 0; i < RecordSize; i++)
+	{
+		write();
+		flip(HeaderSize + (textures.size() - 1) * RecordSize + i);
+		TextureHashCache cache;
+		CHECK(cache.open(path) && cache.size() == textures.size() - 1);
+		CHECK(Hash(cache, Lookalike(textures.back())) == FullHash(Lookalike(textures.back()))); // not from the table
+		CHECK(Hash(cache, Lookalike(textures[0])) == FullHash(textures[0]));
+	}
+
+	// Garbage in the middle drops everything from there on, later records can't be trusted to line up
+	write();
+	flip(HeaderSize + 4 * RecordSize + 3);
+	{
+		TextureHashCache cache;
+		CHECK(cache.open(path) && cache.size() == 4);
+	}
+	CHECK(std::filesystem::file_size(path) == HeaderSize + 4 * RecordSize);
+
+	// Another version or not a table at all starts over
+	write();
+	damage(4, std::string("\x01\x00\x00\x00", 4));
+	{
+		TextureHashCache cache;
+		CHECK(cache.open(path) && cache.size() == 0);
+	}
+	CHECK(std::filesystem::file_size(path) == HeaderSize);
+
+	std::ofstream(path, std::ios::binary | std::ios::trunc) << "not a hash table at all";
+	{
+		TextureHashCache cache;
+		CHECK(cache.open(path) && cache.size() == 0);
+	}
+	CHECK(std::filesystem::file_size(path) == HeaderSize);
+}
+
+TEST_MAIN()
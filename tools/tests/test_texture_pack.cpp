@@ -0,0 +1,261 @@
+// .texpack round trip: packs a folder of fake textures with the texpack tool (path passed in by ctest), then reads it back
+// through TexturePack & checks the layout, stored/deflated entries, aliasing & which entry find() picks
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <xxhash.h>
+
+#include "texture_pack.hpp"
+#include "test.hpp"
+
+using namespace TexPack;
+
+namespace
+{
+	// XXH32 of this is 0, so HashName has to remap it
+	constexpr char ZeroHashName[] = "qhkukda";
+
+	struct Fixture
+	{
+		std::filesystem::path directory;
+		std::map<std::string, std::vector<uint8_t>> files; // relative path -> contents
+		TexturePack pack;
+		bool packed = false;
+
+		~Fixture()
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(directory, ec);
+		}
+
+		void add(const std::string& relativePath, std::vector<uint8_t> data)
+		{
+			auto path = directory / "load" / relativePath;
+			std::filesystem::create_directories(path.parent_path());
+			std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+			files[relativePath] = std::move(data);
+		}
+	};
+
+	std::vector<uint8_t> Compressible(size_t size, uint8_t seed)
+	{
+		std::vector<uint8_t> data(size);
+		for (size_t i = 0; i < size; i++)
+			data[i] = uint8_t((i / 64) * seed);
+		return data;
+	}
+
+	std::vector<uint8_t> Random(size_t size, uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		std::vector<uint8_t> data(size);
+		for (auto& byte : data)
+			byte = uint8_t(rng());
+		return data;
+	}
+
+	Fixture& Pack()
+	{
+		static Fixture fixture;
+		if (!fixture.directory.empty())
+			return fixture;
+
+		fixture.directory = std::filesystem::temp_directory_path() / ("test_texture_pack_" + std::to_string(std::random_device()()));
+
+		// One texture hash with an entry in every tier, indexed & not
+		fixture.add("1234ABCD_64x64.dds", Compressible(20000, 3));
+		fixture.add("3_1234ABCD_64x64.dds", Random(5000, 1));
+		fixture.add("cs_beach/1234ABCD_64x64.dds", Random(7000, 2));
+		fixture.add("Xbox/1234ABCD_64x64.dds", Random(3000, 3));
+		fixture.add("cs_beach/Xbox/1234ABCD_64x64.dds", Random(6000, 4));
+		fixture.add("cs_beach/Xbox/3_1234ABCD_64x64.dds", Random(4097, 5));
+
+		// Same data as the set specific entry above, stored once
+		fixture.add("55555555_32x32.dds", fixture.files["cs_beach/1234ABCD_64x64.dds"]);
+
+		// Set name whose hash needs remapping, must not end up as a global entry
+		fixture.add(std::string(ZeroHashName) + "/77777777_16x16.dds", Random(100, 6));
+
+		// Not a replacement, skipped
+		fixture.add("readme.txt", { 'h', 'i' });
+
+		if (Test::Arguments.empty())
+		{
+			printf("  usage: test_texture_pack <path to texpack>\n");
+			return fixture;
+		}
+
+		auto output = fixture.directory / "test.texpack";
+		std::string command = std::string("\"") + Test::Arguments[0] + "\" pack \"" + (fixture.directory / "load").string() + "\" \"" +
+			output.string() + "\" -c";
+		fixture.packed = std::system(command.c_str()) == 0 && fixture.pack.open(output);
+		return fixture;
+	}
+
+	const TexPackEntry* EntryFor(const TexturePack& pack, const std::string& relativePath)
+	{
+		for (uint32_t i = 0; i < pack.entryCount(); i++)
+			if (pack.entryPath(i) == relativePath)
+				return &pack.entries()[i];
+		return nullptr;
+	}
+
+	std::string PathOf(const TexturePack& pack, const TexPackEntry* entry)
+	{
+		return entry ? pack.entryPath(uint32_t(entry - pack.entries())) : "(none)";
+	}
+}
+
+TEST_CASE(Layout)
+{
+	auto& fixture = Pack();
+	CHECK(fixture.packed);
+	if (!fixture.packed)
+		return;
+
+	// Header & index straight from the file, not through TexturePack
+	std::ifstream file(fixture.directory / "test.texpack", std::ios::binary);
+	TexPackHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	CHECK(header.magic == Magic);
+	CHECK(header.version == Version);
+	CHECK(header.headerSize == sizeof(TexPackHeader));
+	CHECK(header.alignment == Alignment);
+	CHECK(header.entryCount == fixture.files.size() - 1);
+	CHECK(header.pathTableOffset == sizeof(TexPackHeader) + uint64_t(header.entryCount) * sizeof(TexPackEntry));
+
+	std::vector<TexPackEntry> index(header.entryCount);
+	file.read(reinterpret_cast<char*>(index.data()), std::streamsize(index.size() * sizeof(TexPackEntry)));
+	CHECK(std::is_sorted(index.begin(), index.end()));
+
+	uint64_t dataStart = header.pathTableOffset + header.pathTableSize;
+	auto fileSize = std::filesystem::file_size(fixture.directory / "test.texpack");
+	for (const auto& entry : index)
+	{
+		CHECK(entry.offset % Alignment == 0);
+		CHECK(entry.offset >= dataStart);
+		CHECK(entry.offset + entry.storedSize <= fileSize);
+		CHECK(entry.compression == Compression_None ? entry.storedSize == entry.size : entry.storedSize < entry.size);
+	}
+
+	// Every texture made it in under its own path, with the key its path describes
+	for (const auto& [path, data] : fixture.files)
+	{
+		TextureKey key;
+		if (!ParseReplacementPath(path, &key))
+		{
+			CHECK(path == "readme.txt");
+			continue;
+		}
+
+		auto* entry = EntryFor(fixture.pack, path);
+		CHECK(entry != nullptr);
+		if (entry)
+			CHECK((TextureKey{ entry->hash, entry->setHash, entry->padHash, entry->width, entry->height, entry->index } == key));
+	}
+}
+
+TEST_CASE(ReadBack)
+{
+	auto& fixture = Pack();
+	if (!fixture.packed)
+		return;
+
+	// Compressible texture goes through the inflate path, random ones are stored & mapped directly
+	auto* deflated = EntryFor(fixture.pack, "1234ABCD_64x64.dds");
+	auto* stored = EntryFor(fixture.pack, "cs_beach/1234ABCD_64x64.dds");
+	CHECK(deflated && deflated->compression == Compression_Deflate);
+	CHECK(stored && stored->compression == Compression_None);
+
+	for (const auto& [path, data] : fixture.files)
+	{
+		auto* entry = EntryFor(fixture.pack, path);
+		if (!entry)
+			continue;
+
+		const uint8_t* read = nullptr;
+		size_t size = 0;
+		auto owner = fixture.pack.read(*entry, &read, &size);
+		CHECK(owner != nullptr);
+		CHECK(owner && size == data.size() && std::equal(data.begin(), data.end(), read));
+	}
+
+	// Identical data is only stored once
+	auto* alias = EntryFor(fixture.pack, "55555555_32x32.dds");
+	CHECK(alias && stored && alias->offset == stored->offset && alias->storedSize == stored->storedSize);
+}
+
+TEST_CASE(HashNames)
+{
+	CHECK(XXH32(ZeroHashName, sizeof(ZeroHashName) - 1, 0) == 0);
+	CHECK(HashName(ZeroHashName) == 1);
+	CHECK(HashName("QHKUKDA") == 1);
+	CHECK(HashName("") == 0);
+	CHECK(HashName("CS_Beach") == HashName("cs_beach"));
+	CHECK(HashName("cs_beach") == XXH32("cs_beach", 8, 0));
+
+	auto& fixture = Pack();
+	if (!fixture.packed)
+		return;
+
+	// Remapped set is still set specific
+	uint32_t set = HashName(ZeroHashName);
+	CHECK(PathOf(fixture.pack, fixture.pack.find(0x77777777, 16, 16, 0, set, 0)) == std::string(ZeroHashName) + "/77777777_16x16.dds");
+	CHECK(fixture.pack.find(0x77777777, 16, 16, 0, 0, 0) == nullptr);
+}
+
+TEST_CASE(FindTierOrder)
+{
+	auto& fixture = Pack();
+	if (!fixture.packed)
+		return;
+
+	const uint32_t beach = HashName("cs_beach");
+	const uint32_t other = HashName("cs_other");
+	const uint32_t xbox = HashName("Xbox");
+	const uint32_t playstation = HashName("PlayStation");
+
+	struct
+	{
+		int index;
+		uint32_t set;
+		uint32_t pad;
+		const char* expected;
+	} cases[] =
+	{
+		// (set, pad), indexed first
+		{ 3, beach, xbox, "cs_beach/Xbox/3_1234ABCD_64x64.dds" },
+		{ 5, beach, xbox, "cs_beach/Xbox/1234ABCD_64x64.dds" },
+
+		// (0, pad) before (set, 0)
+		{ 3, other, xbox, "Xbox/1234ABCD_64x64.dds" },
+
+		// No pad type skips the pad tiers
+		{ 3, beach, 0, "cs_beach/1234ABCD_64x64.dds" },
+
+		// (0, 0), indexed first
+		{ 3, other, 0, "3_1234ABCD_64x64.dds" },
+		{ 7, other, 0, "1234ABCD_64x64.dds" },
+		{ 3, other, playstation, "3_1234ABCD_64x64.dds" },
+		{ 7, beach, playstation, "cs_beach/1234ABCD_64x64.dds" },
+	};
+
+	for (const auto& test : cases)
+	{
+		std::string found = PathOf(fixture.pack, fixture.pack.find(0x1234ABCD, 64, 64, test.index, test.set, test.pad));
+		if (found != test.expected)
+			printf("  index %d set %08X pad %08X: got %s, expected %s\n", test.index, test.set, test.pad, found.c_str(), test.expected);
+		CHECK(found == test.expected);
+	}
+
+	CHECK(fixture.pack.find(0x1234ABCD, 32, 64, 3, beach, xbox) == nullptr);
+	CHECK(fixture.pack.find(0x1234ABCC, 64, 64, 3, beach, xbox) == nullptr);
+}
+
+TEST_MAIN()
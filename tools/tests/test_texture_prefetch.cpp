@@ -0,0 +1,307 @@
+// TexturePrefetcher driven the way LoadXmtsetObject & HandleTexture drive it, with fake files & a read function that
+// records who read what. Reads that need to hold a pool thread wait on a Gate, so those cases don't depend on timing.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "texture_prefetch.hpp"
+#include "test.hpp"
+
+namespace
+{
+	struct Gate
+	{
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool open = false;
+
+		void release()
+		{
+			{
+				std::lock_guard lock(mtx);
+				open = true;
+			}
+			cv.notify_all();
+		}
+
+		void wait()
+		{
+			std::unique_lock lock(mtx);
+			cv.wait(lock, [this] { return open; });
+		}
+	};
+
+	template <typename Pred>
+	bool WaitFor(Pred pred)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (!pred())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	std::vector<std::filesystem::path> SetFiles(const std::string& set, int count)
+	{
+		std::vector<std::filesystem::path> files;
+		for (int i = 0; i < count; i++)
+			files.push_back(std::filesystem::path("load") / set / (std::to_string(i) + ".dds"));
+		return files;
+	}
+
+	// Counts reads from the pool & from the game thread per file, read cost is simulated with a sleep
+	struct Reads
+	{
+		std::mutex mtx;
+		std::map<std::filesystem::path, int> byPool;
+		std::map<std::filesystem::path, int> byGame;
+		std::chrono::microseconds cost{ 0 };
+
+		void pool(const std::filesystem::path& file)
+		{
+			std::this_thread::sleep_for(cost);
+			std::lock_guard lock(mtx);
+			byPool[file]++;
+		}
+
+		// What HandleTexture does: wait on the prefetch, then read the file unless the pool already has
+		uint64_t load(TexturePrefetcher& prefetcher, const std::filesystem::path& file)
+		{
+			uint64_t waited = prefetcher.wait(file);
+			{
+				std::lock_guard lock(mtx);
+				if (byPool.count(file))
+					return waited;
+			}
+			std::this_thread::sleep_for(cost);
+			std::lock_guard lock(mtx);
+			byGame[file]++;
+			return waited;
+		}
+
+		bool eachReadOnce(const std::vector<std::filesystem::path>& files)
+		{
+			std::lock_guard lock(mtx);
+			for (const auto& file : files)
+			{
+				int total = (byPool.count(file) ? byPool[file] : 0) + (byGame.count(file) ? byGame[file] : 0);
+				if (total != 1)
+				{
+					printf("  %s read %d times\n", file.generic_string().c_str(), total);
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+}
+
+TEST_CASE(SetsAreOnlyQueuedOnce)
+{
+	Reads reads;
+	Gate gate;
+	WorkStealingPool pool(1);
+	TexturePrefetcher prefetcher(pool, [&](const std::filesystem::path& file) { gate.wait(); reads.pool(file); });
+
+	auto beach = SetFiles("cs_beach", 4);
+	CHECK(prefetcher.queue("cs_beach", beach));
+	CHECK(prefetcher.inFlight("cs_beach"));
+
+	// Loading the set again while it's in flight doesn't queue anything
+	CHECK(!prefetcher.queue("cs_beach", beach));
+
+	// Nor do files another set already has in flight
+	CHECK(!prefetcher.queue("cs_other", { beach[0], beach[1] }));
+	CHECK(!prefetcher.inFlight("cs_other"));
+	CHECK(prefetcher.queue("cs_other", { beach[2], "load/cs_other/0.dds" }));
+	CHECK(prefetcher.stats().queued == 5);
+
+	gate.release();
+	CHECK(WaitFor([&] { return !prefetcher.inFlight("cs_beach") && !prefetcher.inFlight("cs_other"); }));
+	CHECK(prefetcher.stats().prefetched == 5);
+
+	// Once it's done, the next load of the set queues it again
+	CHECK(prefetcher.queue("cs_beach", beach));
+	CHECK(WaitFor([&] { return !prefetcher.inFlight("cs_beach"); }));
+	CHECK(prefetcher.stats().prefetched == 9);
+}
+
+TEST_CASE(QueuedFilesAreClaimed)
+{
+	// Worker is held up by the first file, so the rest are still queued when the game gets to them
+	Reads reads;
+	Gate gate;
+	std::atomic<bool> reading = false;
+	WorkStealingPool pool(1);
+	TexturePrefetcher prefetcher(pool, [&](const std::filesystem::path& file)
+	{
+		reading = true;
+		gate.wait();
+		reads.pool(file);
+	});
+
+	auto files = SetFiles("cs_beach", 5);
+	CHECK(prefetcher.queue("cs_beach", files));
+	CHECK(WaitFor([&] { return reading.load(); }));
+
+	for (size_t i = 1; i < files.size(); i++)
+		CHECK(reads.load(prefetcher, files[i]) == 0);
+	CHECK(prefetcher.stats().claimed == 4);
+
+	gate.release();
+	reads.load(prefetcher, files[0]);
+	CHECK(WaitFor([&] { return !prefetcher.inFlight("cs_beach"); }));
+	CHECK(reads.eachReadOnce(files));
+	CHECK(reads.byPool.size() == 1 && reads.byGame.size() == 4);
+
+	// Files nobody queued don't wait at all
+	CHECK(prefetcher.wait("load/cs_beach/never_queued.dds") == 0);
+}
+
+TEST_CASE(WaitsForAReadInProgress)
+{
+	Reads reads;
+	Gate gate;
+	std::atomic<bool> reading = false;
+	WorkStealingPool pool(1);
+	TexturePrefetcher prefetcher(pool, [&](const std::filesystem::path& file)
+	{
+		reading = true;
+		gate.wait();
+		reads.pool(file);
+	});
+
+	auto files = SetFiles("cs_beach", 1);
+	prefetcher.queue("cs_beach", files);
+	CHECK(WaitFor([&] { return reading.load(); }));
+
+	std::atomic<bool> returned = false;
+	uint64_t waited = 0;
+	std::thread game([&]
+	{
+		waited = reads.load(prefetcher, files[0]);
+		returned = true;
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	CHECK(!returned);
+	gate.release();
+	game.join();
+
+	CHECK(waited >= 10 * 1000000ull);
+	CHECK(reads.eachReadOnce(files));
+	CHECK(reads.byGame.empty());
+	CHECK(prefetcher.stats().prefetched == 1);
+}
+
+TEST_CASE(FailedReadsWakeTheWaiter)
+{
+	// A read that throws (eg. out of address space mapping the file) used to leave the waiter blocked forever
+	for (bool standardException : { true, false })
+	{
+		Gate gate;
+		std::atomic<bool> reading = false;
+		WorkStealingPool pool(1);
+		TexturePrefetcher prefetcher(pool, [&](const std::filesystem::path& file)
+		{
+			if (file.filename() != "0.dds")
+				return;
+			reading = true;
+			gate.wait();
+			if (standardException)
+				throw std::runtime_error("mapping failed");
+			throw 42;
+		});
+
+		auto files = SetFiles("cs_beach", 3);
+		prefetcher.queue("cs_beach", files);
+		CHECK(WaitFor([&] { return reading.load(); }));
+
+		std::atomic<bool> returned = false;
+		std::thread game([&]
+		{
+			prefetcher.wait(files[0]);
+			returned = true;
+		});
+		gate.release();
+		CHECK(WaitFor([&] { return returned.load(); }));
+		game.join();
+
+		// The set still finishes, so the next load of it can queue it again
+		CHECK(WaitFor([&] { return !prefetcher.inFlight("cs_beach"); }));
+		auto stats = prefetcher.stats();
+		CHECK(stats.failed == 1 && stats.prefetched == 2);
+		CHECK(prefetcher.queue("cs_beach", files));
+	}
+}
+
+TEST_CASE(InterleavedSetLoads)
+{
+	// A stage load: the game queues each xmtset as it starts loading it, prioritizes it, then reads its textures in order,
+	// while the sets queued before it are still being read. Every file gets read exactly once, by the pool or the game.
+	constexpr int Sets = 6;
+	constexpr int FilesPerSet = 24;
+
+	for (int threads : { 1, 2, 4 })
+	{
+		Reads reads;
+		reads.cost = std::chrono::microseconds(500);
+		std::vector<std::filesystem::path> all;
+		uint64_t stalled = 0;
+		auto start = std::chrono::steady_clock::now();
+		TexturePrefetcher::Stats stats;
+		{
+			WorkStealingPool pool(threads);
+			TexturePrefetcher prefetcher(pool, [&](const std::filesystem::path& file) { reads.pool(file); });
+
+			// The first two sets are queued up front, like a stage that loads its common sets back to back
+			std::vector<std::vector<std::filesystem::path>> sets;
+			for (int s = 0; s < Sets; s++)
+			{
+				sets.push_back(SetFiles("set" + std::to_string(s), FilesPerSet));
+				all.insert(all.end(), sets.back().begin(), sets.back().end());
+			}
+			prefetcher.queue("set0", sets[0]);
+			prefetcher.queue("set1", sets[1]);
+
+			for (int s = 0; s < Sets; s++)
+			{
+				if (s + 2 < Sets)
+					prefetcher.queue("set" + std::to_string(s + 2), sets[s + 2]);
+				prefetcher.prioritize("set" + std::to_string(s));
+
+				// Some textures get used more than once, & a few get loaded out of order
+				for (int f = 0; f < FilesPerSet; f++)
+					stalled += reads.load(prefetcher, sets[s][(f * 7) % FilesPerSet]);
+			}
+
+			stats = prefetcher.stats();
+		}
+		auto elapsed = std::chrono::steady_clock::now() - start;
+
+		CHECK(reads.eachReadOnce(all));
+		CHECK(stats.queued == Sets * FilesPerSet);
+		CHECK(stats.failed == 0);
+		CHECK(stats.prefetched + stats.claimed == stats.queued);
+
+		double sequentialMs = double(Sets * FilesPerSet) * double(reads.cost.count()) / 1000.0;
+		printf("  %d threads: %.1f ms stalled, %zu files read on the game thread, %.1f ms total (%.1f ms reading everything in order)\n",
+			threads, double(stalled) / 1000000.0, reads.byGame.size(), std::chrono::duration<double, std::milli>(elapsed).count(),
+			sequentialMs);
+
+		// Waiting only ever happens on a file a pool thread is already reading, so it can't add up to more than reading everything
+		CHECK(double(stalled) / 1000000.0 < sequentialMs);
+	}
+}
+
+TEST_MAIN()
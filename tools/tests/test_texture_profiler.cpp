@@ -0,0 +1,235 @@
+// TextureLoadProfiler totals, slowest texture tracking & the JSON/CSV exports
+// Phase times are fed in directly rather than measured, so every total is exact.
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <json/json.h>
+
+#include "texture_profiler.hpp"
+#include "test.hpp"
+
+namespace
+{
+	using Profiler = TextureLoadProfiler;
+
+	// One whole texture, ms per phase in Phase order
+	void Load(Profiler& profiler, std::string_view set, const std::string& name, uint64_t bytes, std::vector<uint64_t> ms)
+	{
+		profiler.begin(set, name);
+		for (size_t i = 0; i < ms.size(); i++)
+			profiler.add(Profiler::Phase(i), ms[i] * 1000000);
+		profiler.addBytes(bytes);
+		profiler.commit();
+	}
+
+	const Profiler::SetStats* FindSet(const std::vector<Profiler::SetStats>& sets, const std::string& name)
+	{
+		for (const auto& set : sets)
+			if (set.name == name)
+				return &set;
+		return nullptr;
+	}
+
+	std::vector<std::string> SlowestNames(const Profiler::SetStats& set)
+	{
+		std::vector<std::string> names;
+		for (const auto& sample : set.slowest)
+			names.push_back(sample.name);
+		return names;
+	}
+
+	std::filesystem::path TempFile(const std::string& name)
+	{
+		return std::filesystem::temp_directory_path() / ("test_texture_profiler_" + std::to_string(std::random_device()()) + "_" + name);
+	}
+}
+
+TEST_CASE(TotalsPerSet)
+{
+	Profiler profiler;
+	Load(profiler, "cs_title.xmtset", "a.dds", 1000, { 1, 2, 0, 0, 4, 8 });
+	Load(profiler, "cs_title.xmtset", "b.dds", 500, { 3, 0, 1, 0, 0, 0 });
+	Load(profiler, "cs_beach.xmtset", "c.dds", 64, { 0, 0, 0, 10, 0, 0 });
+
+	auto sets = profiler.snapshot();
+	CHECK(sets.size() == 2);
+
+	// Slowest package first
+	CHECK(sets[0].name == "cs_title.xmtset" && sets[1].name == "cs_beach.xmtset");
+
+	const auto& title = sets[0];
+	CHECK(title.textures == 2 && title.bytes == 1500);
+	CHECK(title.nanoseconds[Profiler::Read] == 4000000 && title.nanoseconds[Profiler::Hash] == 2000000);
+	CHECK(title.nanoseconds[Profiler::Probe] == 1000000 && title.nanoseconds[Profiler::Wait] == 0);
+	CHECK(title.nanoseconds[Profiler::Convert] == 4000000 && title.nanoseconds[Profiler::Create] == 8000000);
+	CHECK(title.total() == 19000000);
+
+	const auto& beach = sets[1];
+	CHECK(beach.textures == 1 && beach.bytes == 64 && beach.total() == 10000000);
+	CHECK(beach.nanoseconds[Profiler::Wait] == 10000000);
+
+	// Ties are broken by name, so the order is stable between snapshots
+	Load(profiler, "cs_alps.xmtset", "d.dds", 0, { 19 });
+	sets = profiler.snapshot();
+	CHECK(sets.size() == 3 && sets[0].name == "cs_alps.xmtset" && sets[1].name == "cs_title.xmtset" && sets[2].name == "cs_beach.xmtset");
+
+	profiler.reset();
+	CHECK(profiler.snapshot().empty());
+}
+
+TEST_CASE(KeepsTheSlowestTextures)
+{
+	Profiler profiler(3);
+	int ms[] = { 5, 1, 9, 3, 7, 2, 9, 8 };
+	for (int i = 0; i < 8; i++)
+		Load(profiler, "set", "t" + std::to_string(i), 0, { uint64_t(ms[i]) });
+
+	// Slowest first, the first of two equal ones stays ahead & a tie with the fastest kept one doesn't evict it
+	auto sets = profiler.snapshot();
+	CHECK(sets.size() == 1 && sets[0].textures == 8);
+	CHECK((SlowestNames(sets[0]) == std::vector<std::string>{ "t2", "t6", "t7" }));
+	Load(profiler, "set", "t8", 0, { 8 });
+	CHECK((SlowestNames(profiler.snapshot()[0]) == std::vector<std::string>{ "t2", "t6", "t7" }));
+
+	// Each kept sample has its own phases & bytes, not the set's
+	Load(profiler, "set", "t9", 77, { 0, 0, 0, 0, 6, 4 });
+	auto slowest = profiler.snapshot()[0].slowest;
+	CHECK(slowest.size() == 3 && slowest[0].name == "t9" && slowest[0].bytes == 77);
+	CHECK(slowest[0].nanoseconds[Profiler::Convert] == 6000000 && slowest[0].total() == 10000000);
+
+	// Sets keep their own lists
+	Load(profiler, "other", "fast", 0, { 1 });
+	auto sets2 = profiler.snapshot();
+	CHECK((SlowestNames(*FindSet(sets2, "other")) == std::vector<std::string>{ "fast" }));
+
+	// 0 keeps totals only
+	Profiler totalsOnly(0);
+	Load(totalsOnly, "set", "a", 0, { 4 });
+	CHECK(totalsOnly.snapshot()[0].slowest.empty() && totalsOnly.snapshot()[0].total() == 4000000);
+}
+
+TEST_CASE(BeginCommitsThePreviousTexture)
+{
+	Profiler profiler;
+	CHECK(!profiler.active());
+
+	// Nothing in progress, so these go nowhere
+	profiler.add(Profiler::Read, 1000);
+	profiler.addBytes(10);
+	profiler.commit();
+	CHECK(profiler.snapshot().empty());
+
+	profiler.begin("set", "a");
+	CHECK(profiler.active());
+	profiler.add(Profiler::Read, 1000);
+	profiler.addBytes(10);
+	CHECK(profiler.snapshot().empty());
+
+	// Loading thread moved on without committing, a still gets counted & b starts from zero
+	profiler.begin("set", "b");
+	auto sets = profiler.snapshot();
+	CHECK(sets.size() == 1 && sets[0].textures == 1 && sets[0].bytes == 10 && sets[0].total() == 1000);
+
+	profiler.add(Profiler::Hash, 500);
+	profiler.commit();
+	profiler.commit();
+	CHECK(!profiler.active());
+	sets = profiler.snapshot();
+	CHECK(sets[0].textures == 2 && sets[0].bytes == 10 && sets[0].total() == 1500);
+	CHECK(sets[0].slowest.size() == 2 && sets[0].slowest[1].name == "b" && sets[0].slowest[1].nanoseconds[Profiler::Hash] == 500);
+
+	// Scope only times while a texture is in progress
+	{
+		Profiler::Scope scope(profiler, Profiler::Create);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(profiler.snapshot()[0].nanoseconds[Profiler::Create] == 0);
+
+	profiler.begin("set", "c");
+	{
+		Profiler::Scope scope(profiler, Profiler::Create);
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	profiler.commit();
+	CHECK(profiler.snapshot()[0].nanoseconds[Profiler::Create] >= 2000000);
+}
+
+TEST_CASE(WritesJson)
+{
+	Profiler profiler(2);
+	Load(profiler, "cs_title.xmtset", "a.dds", 1000, { 1, 2, 0, 0, 4, 8 });
+	Load(profiler, "cs_title.xmtset", "b.dds", 500, { 3, 0, 1 });
+	Load(profiler, "cs_title.xmtset", "c.dds", 1, { 1 });
+	Load(profiler, "cs_beach.xmtset", "d.dds", 64, { 0, 0, 0, 2 });
+
+	auto path = TempFile("profile.json");
+	CHECK(profiler.writeJson(path));
+
+	Json::Value root;
+	std::ifstream file(path);
+	Json::CharReaderBuilder reader;
+	std::string errors;
+	CHECK(Json::parseFromStream(reader, file, &root, &errors));
+	CHECK(root.isArray() && root.size() == 2);
+
+	const Json::Value& title = root[0];
+	CHECK(title["set"].asString() == "cs_title.xmtset");
+	CHECK(title["textures"].asUInt64() == 3 && title["bytes"].asUInt64() == 1501);
+	CHECK(title["totalMs"].asDouble() == 20.0);
+	CHECK(title["phasesMs"]["read"].asDouble() == 5.0 && title["phasesMs"]["create"].asDouble() == 8.0);
+	CHECK(title["phasesMs"].size() == Profiler::PhaseCount);
+	CHECK(title["slowest"].size() == 2);
+	CHECK(title["slowest"][0]["name"].asString() == "a.dds" && title["slowest"][0]["totalMs"].asDouble() == 15.0);
+	CHECK(title["slowest"][1]["name"].asString() == "b.dds" && title["slowest"][1]["bytes"].asUInt64() == 500);
+	CHECK(title["slowest"][1]["phasesMs"]["probe"].asDouble() == 1.0);
+
+	CHECK(root[1]["set"].asString() == "cs_beach.xmtset" && root[1]["phasesMs"]["wait"].asDouble() == 2.0);
+
+	file.close();
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+
+	// Can't write into a folder that isn't there
+	CHECK(!profiler.writeJson(path / "profile.json"));
+}
+
+TEST_CASE(WritesCsv)
+{
+	Profiler profiler(2);
+	Load(profiler, "cs_title.xmtset", "a.dds", 1000, { 1, 2, 0, 0, 4, 8 });
+	Load(profiler, "cs_title.xmtset", "b.dds", 500, { 3, 0, 1 });
+	profiler.begin("cs_beach.xmtset", "c.dds");
+	profiler.add(Profiler::Wait, 1600);
+	profiler.commit();
+
+	auto path = TempFile("profile.csv");
+	CHECK(profiler.writeCsv(path));
+
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(path);
+		for (std::string line; std::getline(file, line);)
+			lines.push_back(line);
+	}
+
+	// Package row with an empty file column, then its slowest textures
+	CHECK(lines.size() == 6);
+	CHECK(lines[0] == "set,file,textures,bytes,read_ms,hash_ms,probe_ms,wait_ms,convert_ms,create_ms,total_ms");
+	CHECK(lines[1] == "cs_title.xmtset,,2,1500,4.000,2.000,1.000,0.000,4.000,8.000,19.000");
+	CHECK(lines[2] == "cs_title.xmtset,a.dds,1,1000,1.000,2.000,0.000,0.000,4.000,8.000,15.000");
+	CHECK(lines[3] == "cs_title.xmtset,b.dds,1,500,3.000,0.000,1.000,0.000,0.000,0.000,4.000");
+	CHECK(lines[4] == "cs_beach.xmtset,,1,0,0.000,0.000,0.000,0.002,0.000,0.000,0.002");
+	CHECK(lines[5] == "cs_beach.xmtset,c.dds,1,0,0.000,0.000,0.000,0.002,0.000,0.000,0.002");
+
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+	CHECK(!profiler.writeCsv(path / "profile.csv"));
+}
+
+TEST_MAIN()
@@ -0,0 +1,218 @@
+// SharedTextureRegistry with a mock texture standing in for IDirect3DTexture9
+// The mock calls remove() when its last reference goes, the same thing SharedTextureSentinel does once D3D destroys a texture
+// Keys come from SharedTextureParams, same as CreateTexture_Custom/CreateTexture_Orig build them
+
+#include <cstdint>
+#include <vector>
+
+#include "texture_registry.hpp"
+#include "test.hpp"
+
+namespace
+{
+	struct MockTexture;
+	using Registry = SharedTextureRegistry<MockTexture>;
+
+	int LiveTextures = 0;
+
+	struct MockTexture
+	{
+		Registry* registry;
+		uint64_t key;
+		int refs = 1;
+
+		MockTexture(Registry* registry, uint64_t key) : registry(registry), key(key) { LiveTextures++; }
+
+		void AddRef() { refs++; }
+
+		void Release()
+		{
+			if (--refs > 0)
+				return;
+			registry->remove(key, this);
+			LiveTextures--;
+			delete this;
+		}
+	};
+
+	// What CreateTexture_Custom does: hand out the registered texture if there is one, otherwise create & register a new one
+	MockTexture* Load(Registry& registry, uint64_t key, size_t bytes, bool* shared = nullptr)
+	{
+		if (auto* texture = registry.acquire(key))
+		{
+			if (shared)
+				*shared = true;
+			return texture;
+		}
+
+		if (shared)
+			*shared = false;
+		auto* texture = new MockTexture(&registry, key);
+		registry.insert(key, texture, bytes);
+		return texture;
+	}
+}
+
+TEST_CASE(AcquireMissing)
+{
+	Registry registry;
+	CHECK(registry.acquire(1) == nullptr);
+
+	auto stats = registry.stats();
+	CHECK(stats.liveTextures == 0 && stats.sharedLoads == 0 && stats.bytesSaved == 0);
+}
+
+TEST_CASE(LoadsShareOneTexture)
+{
+	Registry registry;
+	bool shared = true;
+	auto* first = Load(registry, 42, 1000, &shared);
+	CHECK(!shared);
+	CHECK(first->refs == 1);
+
+	// Every later load gets the same texture with a reference of its own
+	auto* second = Load(registry, 42, 1000, &shared);
+	auto* third = Load(registry, 42, 1000, &shared);
+	CHECK(shared);
+	CHECK(second == first && third == first);
+	CHECK(first->refs == 3);
+	CHECK(LiveTextures == 1);
+
+	auto stats = registry.stats();
+	CHECK(stats.liveTextures == 1 && stats.sharedLoads == 2 && stats.bytesSaved == 2000);
+
+	// Other keys (other contents, or the same contents created with other parameters) get their own texture
+	auto* other = Load(registry, 43, 500, &shared);
+	CHECK(!shared && other != first);
+	CHECK(registry.stats().liveTextures == 2);
+
+	other->Release();
+	for (int i = 0; i < 3; i++)
+		first->Release();
+	CHECK(LiveTextures == 0);
+}
+
+TEST_CASE(LastReleaseRemoves)
+{
+	Registry registry;
+	auto* a = Load(registry, 7, 100);
+	auto* b = Load(registry, 7, 100);
+
+	// Still registered while the game holds any reference
+	a->Release();
+	CHECK(registry.stats().liveTextures == 1);
+	auto* c = registry.acquire(7);
+	CHECK(c == b);
+	c->Release();
+
+	// Gone once the texture is destroyed, the next load creates a new one
+	b->Release();
+	CHECK(LiveTextures == 0);
+	CHECK(registry.stats().liveTextures == 0);
+	CHECK(registry.acquire(7) == nullptr);
+
+	bool shared = true;
+	auto* reloaded = Load(registry, 7, 100, &shared);
+	CHECK(!shared);
+	CHECK(registry.stats().liveTextures == 1);
+	reloaded->Release();
+	CHECK(registry.stats().liveTextures == 0);
+}
+
+TEST_CASE(StaleOwnerRemoveKeepsNewEntry)
+{
+	// A second texture registered under the same key (eg. created before the first was registered) replaces the entry,
+	// destroying the first one afterwards must not take the second one's entry with it
+	Registry registry;
+	auto* old = new MockTexture(&registry, 9);
+	registry.insert(9, old, 100);
+	auto* replacement = new MockTexture(&registry, 9);
+	registry.insert(9, replacement, 100);
+	CHECK(registry.stats().liveTextures == 1);
+
+	old->Release();
+	CHECK(LiveTextures == 1);
+	CHECK(registry.stats().liveTextures == 1);
+
+	auto* acquired = registry.acquire(9);
+	CHECK(acquired == replacement);
+	CHECK(replacement->refs == 2);
+	acquired->Release();
+
+	// Removing with the wrong texture or key does nothing either
+	registry.remove(9, nullptr);
+	registry.remove(10, replacement);
+	CHECK(registry.stats().liveTextures == 1);
+
+	replacement->Release();
+	CHECK(LiveTextures == 0);
+	CHECK(registry.stats().liveTextures == 0);
+}
+
+TEST_CASE(ManyKeys)
+{
+	Registry registry;
+	std::vector<MockTexture*> held;
+	for (uint64_t round = 0; round < 3; round++)
+		for (uint64_t key = 1; key <= 100; key++)
+			held.push_back(Load(registry, key * 0x9E3779B97F4A7C15ull, size_t(key)));
+
+	auto stats = registry.stats();
+	CHECK(stats.liveTextures == 100);
+	CHECK(LiveTextures == 100);
+	CHECK(stats.sharedLoads == 200);
+	CHECK(stats.bytesSaved == 2 * 5050);
+
+	// Released in load order, so the first round lets go before the later ones that shared it
+	for (auto* texture : held)
+		texture->Release();
+	CHECK(LiveTextures == 0);
+	CHECK(registry.stats().liveTextures == 0);
+}
+
+TEST_CASE(KeysCoverEveryParameter)
+{
+	// Same replacement created with any one parameter changed has to get its own texture, eg. a color keyed copy
+	// must not be handed out to a load that asked for no color key
+	const SharedTextureParams base = { 0x0123456789ABCDEFull, 256, 128, 0, 0, 21, 1, 0xFFFFFFFF, 0xFFFFFFFF, 0 };
+	auto changed = [&](auto member, uint32_t value)
+	{
+		SharedTextureParams params = base;
+		params.*member = value;
+		return params.key();
+	};
+
+	std::vector<uint64_t> keys = { base.key() };
+	SharedTextureParams otherContent = base;
+	otherContent.contentKey++;
+	keys.push_back(otherContent.key());
+	keys.push_back(changed(&SharedTextureParams::width, 128));
+	keys.push_back(changed(&SharedTextureParams::height, 256));
+	keys.push_back(changed(&SharedTextureParams::mipLevels, 1));
+	keys.push_back(changed(&SharedTextureParams::usage, 0x200));
+	keys.push_back(changed(&SharedTextureParams::format, 894720068)); // DXT1
+	keys.push_back(changed(&SharedTextureParams::pool, 0));
+	keys.push_back(changed(&SharedTextureParams::filter, 2));
+	keys.push_back(changed(&SharedTextureParams::mipFilter, 1));
+	keys.push_back(changed(&SharedTextureParams::colorKey, 0xFF000000));
+
+	for (size_t i = 0; i < keys.size(); i++)
+		for (size_t j = i + 1; j < keys.size(); j++)
+			CHECK(keys[i] != keys[j]);
+
+	// & the same parameters always give the same key
+	SharedTextureParams copy = base;
+	CHECK(copy.key() == base.key());
+
+	// Loads with different color keys don't share
+	Registry registry;
+	bool shared = true;
+	auto* plain = Load(registry, base.key(), 1000, &shared);
+	auto* keyed = Load(registry, changed(&SharedTextureParams::colorKey, 0xFF000000), 1000, &shared);
+	CHECK(!shared && keyed != plain);
+	keyed->Release();
+	plain->Release();
+	CHECK(LiveTextures == 0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,265 @@
+// TextureResolver lookups checked against the loose-file ladder HandleTexture used to walk, which is reproduced here as Ladder()
+// Loose files are fake paths under a load folder that doesn't need to exist, packs are made with the texpack tool (path passed in by ctest)
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "texture_resolver.hpp"
+#include "test.hpp"
+
+using namespace TexPack;
+
+namespace
+{
+	const std::filesystem::path LoadPath = "load";
+
+	constexpr uint32_t Hash = 0x1234ABCD;
+	constexpr int Width = 64;
+	constexpr int Height = 32;
+	const std::string Name = "1234ABCD_64x32.dds";
+
+	// The old ladder: set + pad (either way round), pad, set, then global, trying <index>_<name> before <name> at each step
+	std::string Ladder(const std::set<std::string>& files, int index, const std::string& set, const std::string& pad)
+	{
+		std::string indexed = std::to_string(index) + "_" + Name;
+		std::vector<std::string> ladder;
+		if (!pad.empty())
+		{
+			ladder.push_back(set + "/" + pad + "/" + indexed);
+			ladder.push_back(set + "/" + pad + "/" + Name);
+			ladder.push_back(pad + "/" + set + "/" + indexed);
+			ladder.push_back(pad + "/" + set + "/" + Name);
+			ladder.push_back(pad + "/" + indexed);
+			ladder.push_back(pad + "/" + Name);
+		}
+		ladder.push_back(set + "/" + indexed);
+		ladder.push_back(set + "/" + Name);
+		ladder.push_back(indexed);
+		ladder.push_back(Name);
+
+		for (const auto& path : ladder)
+			if (files.count(path))
+				return path;
+		return "(none)";
+	}
+
+	std::string Find(const TextureResolver& resolver, int index, const std::string& set, const std::string& pad,
+		uint32_t hash = Hash, int width = Width, int height = Height)
+	{
+		auto* source = resolver.find(hash, width, height, index, HashName(set), pad.empty() ? 0 : HashName(pad));
+		if (!source)
+			return "(none)";
+		if (source->pack)
+			return source->pack->path().filename().string() + ":" + source->pack->entryPath(uint32_t(source->entry - source->pack->entries()));
+		return source->file.lexically_relative(LoadPath).generic_string();
+	}
+
+	TextureResolver Build(const std::set<std::string>& files, const std::vector<std::unique_ptr<TexturePack>>& packs = {})
+	{
+		std::vector<std::filesystem::path> looseFiles;
+		for (const auto& file : files)
+			looseFiles.push_back(LoadPath / file);
+
+		TextureResolver resolver;
+		resolver.build(LoadPath, looseFiles, packs);
+		return resolver;
+	}
+
+	// Every place a replacement for the test texture can sit, as seen from set cs_beach with the Xbox pad type
+	const char* const Layout[] =
+	{
+		"cs_beach/Xbox/3_1234ABCD_64x32.dds",
+		"cs_beach/Xbox/1234ABCD_64x32.dds",
+		"Xbox/3_1234ABCD_64x32.dds",
+		"Xbox/1234ABCD_64x32.dds",
+		"cs_beach/3_1234ABCD_64x32.dds",
+		"cs_beach/1234ABCD_64x32.dds",
+		"3_1234ABCD_64x32.dds",
+		"1234ABCD_64x32.dds",
+	};
+
+	// The old ladder also looked in pad/set/, after everything in set/pad/
+	std::string Swapped(const std::string& path)
+	{
+		if (path.rfind("cs_beach/Xbox/", 0) == 0)
+			return "Xbox/cs_beach/" + path.substr(14);
+		return path;
+	}
+}
+
+TEST_CASE(FallbackOrder)
+{
+	struct
+	{
+		std::set<std::string> files;
+		int index;
+		const char* set;
+		const char* pad;
+		const char* expected;
+	} cases[] =
+	{
+		// Pad tiers first, set before global within them
+		{ { Layout[0], Layout[1], Layout[2], Layout[7] }, 3, "cs_beach", "Xbox", "cs_beach/Xbox/3_1234ABCD_64x32.dds" },
+		{ { Layout[0], Layout[1], Layout[2], Layout[7] }, 4, "cs_beach", "Xbox", "cs_beach/Xbox/1234ABCD_64x32.dds" },
+		{ { "Xbox/cs_beach/1234ABCD_64x32.dds", Layout[3] }, 4, "cs_beach", "Xbox", "Xbox/cs_beach/1234ABCD_64x32.dds" },
+		{ { "Xbox/cs_beach/3_1234ABCD_64x32.dds", Layout[1] }, 3, "cs_beach", "Xbox", "cs_beach/Xbox/1234ABCD_64x32.dds" },
+		{ { "Xbox/cs_beach/3_1234ABCD_64x32.dds", Layout[0] }, 3, "cs_beach", "Xbox", "cs_beach/Xbox/3_1234ABCD_64x32.dds" },
+		{ { Layout[2], Layout[3], Layout[4] }, 3, "cs_beach", "Xbox", "Xbox/3_1234ABCD_64x32.dds" },
+		{ { Layout[3], Layout[4] }, 3, "cs_beach", "Xbox", "Xbox/1234ABCD_64x32.dds" },
+
+		// Pad global beats set specific without the pad, even an indexed one
+		{ { Layout[3], Layout[4], Layout[6] }, 3, "cs_beach", "Xbox", "Xbox/1234ABCD_64x32.dds" },
+
+		// Other pad type, or none at all, skips straight to the set & global tiers
+		{ { Layout[0], Layout[3], Layout[5] }, 3, "cs_beach", "PlayStation", "cs_beach/1234ABCD_64x32.dds" },
+		{ { Layout[0], Layout[3], Layout[5] }, 3, "cs_beach", "", "cs_beach/1234ABCD_64x32.dds" },
+		{ { Layout[0], Layout[3], Layout[6] }, 3, "cs_other", "", "3_1234ABCD_64x32.dds" },
+		{ { Layout[0], Layout[3], Layout[6], Layout[7] }, 5, "cs_other", "", "1234ABCD_64x32.dds" },
+
+		// Indexed names only match their own index
+		{ { Layout[4], Layout[6] }, 2, "cs_beach", "", "(none)" },
+		{ { Layout[0], Layout[2] }, 3, "cs_other", "Xbox", "Xbox/3_1234ABCD_64x32.dds" },
+		{ {}, 3, "cs_beach", "Xbox", "(none)" },
+	};
+
+	for (const auto& test : cases)
+	{
+		auto resolver = Build(test.files);
+		std::string found = Find(resolver, test.index, test.set, test.pad);
+		std::string baseline = Ladder(test.files, test.index, test.set, test.pad);
+		if (found != test.expected || baseline != test.expected)
+			printf("  index %d set '%s' pad '%s': got %s, ladder %s, expected %s\n", test.index, test.set, test.pad, found.c_str(),
+				baseline.c_str(), test.expected);
+		CHECK(found == test.expected);
+		CHECK(baseline == test.expected);
+	}
+}
+
+TEST_CASE(MatchesLadderForEveryLayout)
+{
+	struct
+	{
+		int index;
+		const char* set;
+		const char* pad;
+	} lookups[] =
+	{
+		{ 3, "cs_beach", "Xbox" },
+		{ 4, "cs_beach", "Xbox" },
+		{ 3, "cs_other", "Xbox" },
+		{ 3, "cs_beach", "PlayStation" },
+		{ 3, "cs_beach", "" },
+		{ 9, "cs_other", "" },
+	};
+
+	std::mt19937 rng(31);
+	size_t mismatches = 0;
+	for (uint32_t mask = 0; mask < (1u << std::size(Layout)); mask++)
+	{
+		std::set<std::string> files;
+		for (size_t i = 0; i < std::size(Layout); i++)
+			if (mask & (1u << i))
+				files.insert(rng() & 1 ? Swapped(Layout[i]) : Layout[i]);
+
+		auto resolver = Build(files);
+		for (const auto& lookup : lookups)
+		{
+			std::string found = Find(resolver, lookup.index, lookup.set, lookup.pad);
+			std::string baseline = Ladder(files, lookup.index, lookup.set, lookup.pad);
+			if (found != baseline && mismatches++ < 10)
+				printf("  layout %02X index %d set '%s' pad '%s': got %s, ladder %s\n", mask, lookup.index, lookup.set, lookup.pad,
+					found.c_str(), baseline.c_str());
+			CHECK(found == baseline);
+		}
+	}
+}
+
+TEST_CASE(OtherTexturesMiss)
+{
+	std::set<std::string> files(std::begin(Layout), std::end(Layout));
+	files.insert("Xbox/cs_beach/55555555_16x16.dds");
+	files.insert("readme.txt");
+	files.insert("cs_beach/Xbox/extra/1234ABCD_64x32.dds");
+	auto resolver = Build(files);
+	CHECK(resolver.size() == std::size(Layout) + 1);
+
+	// Same hash at another size, or another hash at the same size, fails the presence check
+	CHECK(Find(resolver, 3, "cs_beach", "Xbox", Hash, Width, Width) == "(none)");
+	CHECK(Find(resolver, 3, "cs_beach", "Xbox", Hash + 1) == "(none)");
+
+	// Present, but only in a set & pad this texture isn't using
+	CHECK(Find(resolver, 0, "cs_beach", "Xbox", 0x55555555, 16, 16) == "Xbox/cs_beach/55555555_16x16.dds");
+	CHECK(Find(resolver, 0, "cs_beach", "", 0x55555555, 16, 16) == "(none)");
+	CHECK(Find(resolver, 0, "cs_other", "Xbox", 0x55555555, 16, 16) == "(none)");
+
+	// Set & pad names ignore case, same as the filesystem the ladder looked in
+	CHECK(Find(resolver, 3, "CS_Beach", "XBOX") == "cs_beach/Xbox/3_1234ABCD_64x32.dds");
+
+	TextureResolver empty;
+	CHECK(empty.find(Hash, Width, Height, 3, 0, 0) == nullptr);
+}
+
+TEST_CASE(LooseBeforePacks)
+{
+	if (Test::Arguments.empty())
+	{
+		printf("  usage: test_texture_resolver <path to texpack>\n");
+		CHECK(false);
+		return;
+	}
+
+	auto directory = std::filesystem::temp_directory_path() / ("test_texture_resolver_" + std::to_string(std::random_device()()));
+	auto write = [&](const std::string& folder, const std::string& relativePath)
+	{
+		auto path = directory / folder / relativePath;
+		std::filesystem::create_directories(path.parent_path());
+		std::ofstream(path, std::ios::binary) << folder << relativePath;
+	};
+
+	write("first", Layout[1]);
+	write("first", Layout[5]);
+	write("second", Layout[0]);
+	write("second", Layout[5]);
+	write("second", Layout[7]);
+
+	std::vector<std::unique_ptr<TexturePack>> packs;
+	for (const char* name : { "first", "second" })
+	{
+		auto output = directory / (std::string(name) + ".texpack");
+		std::string command = std::string("\"") + Test::Arguments[0] + "\" pack \"" + (directory / name).string() + "\" \"" +
+			output.string() + "\"";
+		auto pack = std::make_unique<TexturePack>();
+		bool packed = std::system(command.c_str()) == 0 && pack->open(output);
+		CHECK(packed);
+		if (!packed)
+			break;
+		packs.push_back(std::move(pack));
+	}
+
+	if (packs.size() == 2)
+	{
+		auto resolver = Build({ Layout[5] }, packs);
+		CHECK(resolver.size() == 4);
+
+		// Ladder order applies across loose files & packs alike
+		CHECK(Find(resolver, 3, "cs_beach", "Xbox") == "second.texpack:cs_beach/Xbox/3_1234ABCD_64x32.dds");
+		CHECK(Find(resolver, 4, "cs_beach", "Xbox") == "first.texpack:cs_beach/Xbox/1234ABCD_64x32.dds");
+
+		// Same key: loose file first, then the earlier pack
+		CHECK(Find(resolver, 3, "cs_beach", "") == "cs_beach/1234ABCD_64x32.dds");
+		CHECK(Find(Build({}, packs), 3, "cs_beach", "") == "first.texpack:cs_beach/1234ABCD_64x32.dds");
+		CHECK(Find(resolver, 3, "cs_other", "") == "second.texpack:1234ABCD_64x32.dds");
+	}
+
+	packs.clear();
+	std::error_code ec;
+	std::filesystem::remove_all(directory, ec);
+}
+
+TEST_MAIN()
@@ -0,0 +1,248 @@
+// WorkStealingPool: stealing from a blocked worker, urgent groups jumping the queue, & parallelFor
+// Tasks that need to hold a worker wait on a Gate, so what runs where doesn't depend on timing
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "test.hpp"
+
+namespace
+{
+	struct Gate
+	{
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool open = false;
+
+		void release()
+		{
+			{
+				std::lock_guard lock(mtx);
+				open = true;
+			}
+			cv.notify_all();
+		}
+
+		void wait()
+		{
+			std::unique_lock lock(mtx);
+			cv.wait(lock, [this] { return open; });
+		}
+	};
+
+	// Polls since the pool has no way to wait for idle, gives up after a few seconds so a broken pool fails instead of hanging
+	template <typename Pred>
+	bool WaitFor(Pred pred)
+	{
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+		while (!pred())
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+}
+
+TEST_CASE(RunsEverySubmittedTask)
+{
+	std::atomic<int> count = 0;
+	{
+		WorkStealingPool pool(4);
+		CHECK(pool.threadCount() == 4);
+		for (int i = 0; i < 10000; i++)
+			pool.submit([&] { count++; }, uint32_t(i % 3));
+	}
+
+	// The destructor lets the workers finish what's queued before they stop
+	CHECK(count == 10000);
+
+	// Less than one thread still gets one
+	WorkStealingPool single(0);
+	CHECK(single.threadCount() == 1);
+}
+
+TEST_CASE(IdleWorkersSteal)
+{
+	// Tasks go round-robin over the worker queues, so half of these land behind the blocked one & only run if they're stolen
+	WorkStealingPool pool(2);
+	Gate gate;
+	std::atomic<bool> blocked = false;
+	pool.submit([&] { blocked = true; gate.wait(); });
+	CHECK(WaitFor([&] { return blocked.load(); }));
+
+	constexpr int Tasks = 200;
+	std::atomic<int> done = 0;
+	std::mutex threadsMtx;
+	std::vector<std::thread::id> threads;
+	for (int i = 0; i < Tasks; i++)
+	{
+		pool.submit([&]
+		{
+			{
+				std::lock_guard lock(threadsMtx);
+				threads.push_back(std::this_thread::get_id());
+			}
+			done++;
+		});
+	}
+
+	CHECK(WaitFor([&] { return done == Tasks; }));
+	CHECK(pool.queuedCount() == 0);
+
+	// All of them ran on the one free worker while the other was still blocked
+	CHECK(!threads.empty() && std::all_of(threads.begin(), threads.end(), [&](auto id) { return id == threads[0]; }));
+	gate.release();
+}
+
+TEST_CASE(PrioritizedGroupRunsFirst)
+{
+	// One worker, blocked while the queue is filled, so the run order is exactly the queue order
+	WorkStealingPool pool(1);
+	Gate gate;
+	std::atomic<bool> blocked = false;
+	pool.submit([&] { blocked = true; gate.wait(); });
+	CHECK(WaitFor([&] { return blocked.load(); }));
+
+	std::mutex orderMtx;
+	std::vector<int> order;
+	auto task = [&](int id)
+	{
+		return [&, id]
+		{
+			std::lock_guard lock(orderMtx);
+			order.push_back(id);
+		};
+	};
+
+	// Groups 1 & 2 interleaved, ids 100+ for group 1 & 200+ for group 2, 0 for the default group
+	for (int i = 0; i < 5; i++)
+	{
+		pool.submit(task(100 + i), 1);
+		pool.submit(task(200 + i), 2);
+		pool.submit(task(0), 0);
+	}
+	pool.prioritize(2);
+
+	// New tasks for the urgent group skip ahead too, others still queue normally
+	pool.submit(task(205), 2);
+	pool.submit(task(105), 1);
+
+	// Prioritizing the default group or the same group again changes nothing
+	pool.prioritize(0);
+	pool.prioritize(2);
+
+	gate.release();
+	CHECK(WaitFor([&] { std::lock_guard lock(orderMtx); return order.size() == 17; }));
+
+	std::vector<int> expected = { 200, 201, 202, 203, 204, 205, 100, 0, 101, 0, 102, 0, 103, 0, 104, 0, 105 };
+	CHECK(order == expected);
+	if (order != expected)
+	{
+		printf("  order:");
+		for (int id : order)
+			printf(" %d", id);
+		printf("\n");
+	}
+}
+
+TEST_CASE(SwitchingPriorityKeepsEarlierUrgentTasks)
+{
+	WorkStealingPool pool(1);
+	Gate gate;
+	std::atomic<bool> blocked = false;
+	pool.submit([&] { blocked = true; gate.wait(); });
+	CHECK(WaitFor([&] { return blocked.load(); }));
+
+	std::mutex orderMtx;
+	std::vector<int> order;
+	for (int group = 1; group <= 3; group++)
+		for (int i = 0; i < 2; i++)
+			pool.submit([&, id = group * 10 + i] { std::lock_guard lock(orderMtx); order.push_back(id); }, uint32_t(group));
+
+	// Group 2 went to the urgent queue first, group 3 joins it behind them
+	pool.prioritize(2);
+	pool.prioritize(3);
+	gate.release();
+	CHECK(WaitFor([&] { std::lock_guard lock(orderMtx); return order.size() == 6; }));
+	CHECK((order == std::vector<int>{ 20, 21, 30, 31, 10, 11 }));
+}
+
+TEST_CASE(ParallelForRunsEachItemOnce)
+{
+	WorkStealingPool pool(4);
+	for (size_t count : { size_t(0), size_t(1), size_t(2), size_t(7), size_t(1000), size_t(100000) })
+	{
+		std::vector<std::atomic<int>> hits(count);
+		pool.parallelFor(count, [&](size_t i) { hits[i]++; });
+		CHECK(std::all_of(hits.begin(), hits.end(), [](const auto& h) { return h == 1; }));
+	}
+
+	// Items really are spread over more than the calling thread when they take a while
+	std::mutex threadsMtx;
+	std::vector<std::thread::id> threads;
+	pool.parallelFor(64, [&](size_t)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		std::lock_guard lock(threadsMtx);
+		if (std::find(threads.begin(), threads.end(), std::this_thread::get_id()) == threads.end())
+			threads.push_back(std::this_thread::get_id());
+	});
+	CHECK(threads.size() > 1);
+}
+
+TEST_CASE(ParallelForFromInsideATask)
+{
+	// Every worker is busy running a task that calls parallelFor, so nobody is free to help: the callers have to finish their own items
+	WorkStealingPool pool(2);
+	std::atomic<int> finished = 0;
+	std::atomic<int> bad = 0;
+	for (int t = 0; t < 8; t++)
+	{
+		pool.submit([&]
+		{
+			std::vector<int> out(500, 0);
+			pool.parallelFor(out.size(), [&](size_t i) { out[i] = int(i) * 2; });
+			for (size_t i = 0; i < out.size(); i++)
+				if (out[i] != int(i) * 2)
+					bad++;
+			finished++;
+		});
+	}
+
+	CHECK(WaitFor([&] { return finished == 8; }));
+	CHECK(bad == 0);
+}
+
+TEST_CASE(ConcurrentSubmitters)
+{
+	std::atomic<int> count = 0;
+	{
+		WorkStealingPool pool(3);
+		std::vector<std::thread> submitters;
+		for (int t = 0; t < 4; t++)
+		{
+			submitters.emplace_back([&, t]
+			{
+				for (int i = 0; i < 5000; i++)
+				{
+					pool.submit([&] { count++; }, uint32_t(t));
+					if (i % 1000 == 0)
+						pool.prioritize(uint32_t(t));
+				}
+			});
+		}
+		for (auto& submitter : submitters)
+			submitter.join();
+	}
+	CHECK(count == 20000);
+}
+
+TEST_MAIN()
@@ -0,0 +1,213 @@
+// TraceLog writing traces that tracedecode's reader turns back into the same messages
+// Runs the real writer thread on a temp file, so these also cover Init/Shutdown being used more than once.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "trace_log.hpp"
+#include "trace_reader.hpp"
+#include "test.hpp"
+
+namespace
+{
+	enum class Gear : uint8_t { Low = 1, High = 2 };
+
+	struct TempTrace
+	{
+		std::filesystem::path path;
+
+		TempTrace()
+		{
+			path = std::filesystem::temp_directory_path() / ("test_trace_log_" + std::to_string(std::random_device()()) + ".trace");
+		}
+
+		~TempTrace()
+		{
+			std::error_code ec;
+			std::filesystem::remove(path, ec);
+		}
+
+		std::vector<uint8_t> bytes() const
+		{
+			std::ifstream file(path, std::ios::binary);
+			return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		}
+	};
+
+	std::vector<std::string> Messages(const TraceReader::Trace& trace)
+	{
+		std::vector<std::string> messages;
+		for (const auto& event : trace.events)
+		{
+			auto it = trace.formats.find(event.header.id);
+			messages.push_back(it == trace.formats.end() ? "<unknown>" :
+				TraceReader::FormatEvent(it->second, trace.args.data() + event.argsOffset, event.header.argBytes));
+		}
+		return messages;
+	}
+
+	bool Decode(const std::vector<uint8_t>& data, TraceReader::Trace& trace)
+	{
+		return TraceReader::Read(data, trace) && !trace.truncated;
+	}
+}
+
+TEST_CASE(RoundTripsEveryArgType)
+{
+	TempTrace file;
+	CHECK(!TraceLog::Enabled);
+	TRACE("before init {}", 1); // not enabled yet, goes nowhere
+
+	TraceLog::Init(file.path);
+	CHECK(TraceLog::Enabled);
+
+	std::string longName(300, 'x');
+	const char* nullName = nullptr;
+	TRACE("no args, {{braces}} kept");
+	TRACE("bool {} {}", true, false);
+	TRACE("int {} unsigned {} hex 0x{:08X}", -42, 4000000000u, 0xBEEFu);
+	TRACE("int64 {} uint64 {} enum {}", int64_t(-5000000000), uint64_t(18000000000000000000ull), Gear::High);
+	TRACE("float {:.2f} double {:.3f} default {}", 1.5f, -2.25, 0.125);
+	TRACE("string '{}' '{}' '{:>6}'", "hello", nullName, "ab");
+	TRACE("{}", longName.c_str());
+	TraceLog::Shutdown();
+
+	CHECK(!TraceLog::Enabled);
+	TRACE("after shutdown {}", 2);
+
+	TraceReader::Trace trace;
+	CHECK(Decode(file.bytes(), trace));
+	CHECK(trace.frequency != 0);
+
+	auto messages = Messages(trace);
+	const std::vector<std::string> expected = {
+		"no args, {braces} kept",
+		"bool true false",
+		"int -42 unsigned 4000000000 hex 0x0000BEEF",
+		"int64 -5000000000 uint64 18000000000000000000 enum 2",
+		"float 1.50 double -2.250 default 0.125",
+		"string 'hello' '' '    ab'",
+		std::string(TraceLog::MaxStringArg, 'x'), // long strings are cut off
+	};
+	CHECK(messages == expected);
+	for (size_t i = 0; i < messages.size() && i < expected.size(); i++)
+		if (messages[i] != expected[i])
+			printf("  got '%s', expected '%s'\n", messages[i].c_str(), expected[i].c_str());
+
+	// Timestamps only go forwards
+	for (size_t i = 1; i < trace.events.size(); i++)
+		CHECK(trace.events[i].header.timestamp >= trace.events[i - 1].header.timestamp);
+}
+
+TEST_CASE(MergesThreads)
+{
+	TempTrace file;
+	TraceLog::Init(file.path);
+
+	// Enough from each thread that the writer drains some while they're still going
+	const int ThreadCount = 4;
+	const int EventsPerThread = 5000;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < ThreadCount; t++)
+	{
+		threads.emplace_back([t]
+		{
+			for (int i = 0; i < EventsPerThread; i++)
+			{
+				TRACE("thread {} event {}", t, i);
+				if (i % 500 == 0)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	TraceLog::Shutdown();
+
+	TraceReader::Trace trace;
+	CHECK(Decode(file.bytes(), trace));
+	CHECK(trace.events.size() == size_t(ThreadCount * EventsPerThread));
+
+	// Each thread's events come out in the order they were traced, under one thread ID per thread
+	std::map<int, int> next;
+	std::map<int, uint32_t> threadIds;
+	auto messages = Messages(trace);
+	for (size_t i = 0; i < messages.size(); i++)
+	{
+		int t = -1, n = -1;
+		CHECK(sscanf(messages[i].c_str(), "thread %d event %d", &t, &n) == 2);
+		CHECK(n == next[t]++);
+		if (!threadIds.count(t))
+			threadIds[t] = trace.events[i].threadId;
+		CHECK(trace.events[i].threadId == threadIds[t]);
+	}
+	CHECK(threadIds.size() == size_t(ThreadCount));
+}
+
+TEST_CASE(ShutdownStopsTheWriterAndCanStartAgain)
+{
+	// Shutdown has to join the writer without running into its timeout
+	for (int run = 0; run < 3; run++)
+	{
+		TempTrace file;
+		TraceLog::Init(file.path);
+		TRACE("run {}", run);
+
+		auto start = std::chrono::steady_clock::now();
+		TraceLog::Shutdown();
+		CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(400));
+
+		// Same call site every run, so its format was only registered once & each new file needs it again
+		TraceReader::Trace trace;
+		CHECK(Decode(file.bytes(), trace));
+		CHECK(Messages(trace) == std::vector<std::string>{ "run " + std::to_string(run) });
+	}
+
+	// Shutting down twice does nothing
+	TraceLog::Shutdown();
+
+	// A path that can't be opened leaves it disabled
+	TraceLog::Init(std::filesystem::temp_directory_path() / "missing_folder_for_test_trace_log" / "x.trace");
+	CHECK(!TraceLog::Enabled);
+}
+
+TEST_CASE(RejectsDamagedFiles)
+{
+	TempTrace file;
+	TraceLog::Init(file.path);
+	TRACE("first {}", 1);
+	TRACE("second {}", 2);
+	TraceLog::Shutdown();
+	auto data = file.bytes();
+
+	// Cut into the last record, records before it are still read (both events usually share one)
+	TraceReader::Trace cut;
+	CHECK(TraceReader::Read(std::vector<uint8_t>(data.begin(), data.end() - 2), cut));
+	CHECK(cut.truncated && !cut.error.empty());
+	CHECK(Messages(cut).empty() || Messages(cut) == std::vector<std::string>{ "first 1" });
+
+	// Unknown record type after the good ones
+	auto extra = data;
+	extra.push_back(0x7F);
+	TraceReader::Trace unknown;
+	CHECK(TraceReader::Read(extra, unknown) && unknown.truncated);
+	CHECK((Messages(unknown) == std::vector<std::string>{ "first 1", "second 2" }));
+
+	// Not a trace at all, or a version we don't know
+	TraceReader::Trace bad;
+	CHECK(!TraceReader::Read({ 'n', 'o', 'p', 'e' }, bad) && !bad.error.empty());
+	auto newer = data;
+	newer[4]++;
+	CHECK(!TraceReader::Read(newer, bad));
+}
+
+TEST_MAIN()
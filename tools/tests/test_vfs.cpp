@@ -0,0 +1,259 @@
+// VirtualFileSystem keys, lookups, overlays & manifests on a temp folder
+// Keys are checked against absolute() + lexically_normal(), which is what Key() did before it got its fast path.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vfs.hpp"
+#include "test.hpp"
+
+namespace
+{
+	// Temp folder that's the working directory while it's alive
+	struct TempFolder
+	{
+		std::filesystem::path path;
+		std::filesystem::path previous;
+
+		TempFolder()
+		{
+			path = std::filesystem::temp_directory_path() / ("test_vfs_" + std::to_string(std::random_device()()));
+			std::filesystem::create_directories(path);
+			previous = std::filesystem::current_path();
+			std::filesystem::current_path(path);
+		}
+
+		~TempFolder()
+		{
+			std::error_code ec;
+			std::filesystem::current_path(previous, ec);
+			std::filesystem::remove_all(path, ec);
+		}
+
+		void write(const std::filesystem::path& file, const std::string& contents)
+		{
+			std::filesystem::create_directories((path / file).parent_path());
+			std::ofstream(path / file, std::ios::binary | std::ios::trunc) << contents;
+		}
+	};
+
+	std::string ReferenceKey(const std::filesystem::path& path)
+	{
+		auto generic = std::filesystem::absolute(path).lexically_normal().generic_u8string();
+		std::string key(generic.begin(), generic.end());
+		while (key.size() > 1 && key.back() == '/')
+			key.pop_back();
+#ifdef _WIN32
+		for (auto& c : key)
+			if (c >= 'A' && c <= 'Z')
+				c = c - 'A' + 'a';
+#endif
+		return key;
+	}
+
+	std::string Read(const VirtualFileSystem& vfs, const std::filesystem::path& path)
+	{
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		auto owner = vfs.open(path, &data, &size);
+		return owner ? std::string((const char*)data, size) : "!";
+	}
+
+	std::vector<std::string> Names(const std::vector<std::filesystem::path>& paths)
+	{
+		std::vector<std::string> names;
+		for (const auto& path : paths)
+			names.push_back(path.filename().string());
+		std::sort(names.begin(), names.end());
+		return names;
+	}
+}
+
+TEST_CASE(KeysMatchLexicallyNormal)
+{
+	TempFolder folder;
+	VirtualFileSystem vfs;
+	vfs.mountDirectory("unused", 0); // picks up the working directory
+
+	const char* paths[] = {
+		"Sound", "./Sound/", "Sound//01_Splash_wave.flac", "Sound/./sub/../01.flac", "a/b/c/../../d", "..", "../x", "../../../../../../../../..",
+		".", "./", "a/.", "a/..", "a/../..", "/", "/tmp", "/tmp/../..", "//tmp//x/", "/a/./b/../c/", "name.with.dots/..x/x..", "...",
+#ifdef _WIN32
+		"Sound\\sub\\track.flac", "C:\\Games\\OutRun\\", "c:/GAMES/../x", "C:\\", "\\rooted\\path", "C:relative", "\\\\server\\share\\x",
+		"MiXeD\\CaSe/Path",
+#endif
+	};
+	for (const char* path : paths)
+	{
+		auto key = VirtualFileSystem::Key(path);
+		if (key != ReferenceKey(path))
+		{
+			printf("  %s: %s, expected %s\n", path, key.c_str(), ReferenceKey(path).c_str());
+			CHECK(key == ReferenceKey(path));
+		}
+	}
+
+	// Reusing a buffer gives the same key as a fresh one
+	std::string buffer = "leftovers from a longer key that was in here before";
+	VirtualFileSystem::Key("Sound/x.flac", buffer);
+	CHECK(buffer == ReferenceKey("Sound/x.flac"));
+	VirtualFileSystem::Key("/", buffer);
+	CHECK(buffer == ReferenceKey("/"));
+}
+
+TEST_CASE(WorkingDirectoryIsReadWhenMounting)
+{
+	TempFolder outer;
+	VirtualFileSystem vfs;
+	vfs.mountDirectory("a", 0);
+	auto before = VirtualFileSystem::Key("x");
+	CHECK(before == ReferenceKey("x"));
+
+	// Changing it without mounting anything keeps resolving against the old one, mounting picks up the new one
+	std::filesystem::create_directories("inner");
+	std::filesystem::current_path("inner");
+	CHECK(VirtualFileSystem::Key("x") == before);
+	vfs.mountDirectory("b", 0);
+	CHECK(VirtualFileSystem::Key("x") == ReferenceKey("x") && VirtualFileSystem::Key("x") != before);
+}
+
+TEST_CASE(LookupsComeFromTheMount)
+{
+	TempFolder folder;
+	folder.write("Mods/a.dds", "aaaa");
+	folder.write("Mods/sub/b.dds", "bb");
+
+	VirtualFileSystem vfs;
+	CHECK(vfs.mountDirectory("Mods", 0));
+	CHECK(!vfs.mountDirectory("Missing", 0));
+
+	CHECK(vfs.exists("Mods/a.dds") && vfs.exists("./Mods/sub/../a.dds") && vfs.exists(folder.path / "Mods" / "sub" / "b.dds"));
+	CHECK(vfs.isDirectory("Mods/sub") && !vfs.isDirectory("Mods/a.dds"));
+	CHECK(vfs.stat("Mods/a.dds") && vfs.stat("Mods/a.dds")->size == 4);
+	CHECK(Read(vfs, "Mods/sub/b.dds") == "bb");
+	CHECK((Names(vfs.list("Mods")) == std::vector<std::string>{ "a.dds" }));
+	CHECK((Names(vfs.list("Mods", true)) == std::vector<std::string>{ "a.dds", "b.dds" }));
+
+	// Anything under a mount is answered from it, so new files only show up once invalidated
+	folder.write("Mods/c.dds", "c");
+	CHECK(!vfs.exists("Mods/c.dds") && !vfs.stat("Mods/c.dds") && Read(vfs, "Mods/c.dds") == "!");
+	CHECK(!vfs.exists("Missing/x.dds"));
+	auto generation = vfs.generation();
+	vfs.invalidate("Mods/c.dds");
+	CHECK(vfs.generation() != generation);
+	CHECK(vfs.exists("Mods/c.dds") && Read(vfs, "Mods/c.dds") == "c");
+
+	// Removed files are gone after invalidating their folder
+	std::filesystem::remove_all(folder.path / "Mods" / "sub");
+	vfs.invalidate("Mods");
+	CHECK(!vfs.exists("Mods/sub/b.dds") && !vfs.exists("Mods/sub"));
+	CHECK((Names(vfs.list("Mods", true)) == std::vector<std::string>{ "a.dds", "c.dds" }));
+
+	// insert() adds without touching the disk
+	vfs.insert("Mods/dumped.dds", 123);
+	CHECK(vfs.stat("Mods/dumped.dds") && vfs.stat("Mods/dumped.dds")->size == 123);
+
+	// Outside every mount falls through to the file system
+	folder.write("Loose/d.dds", "ddd");
+	CHECK(vfs.exists("Loose/d.dds") && vfs.stat("Loose/d.dds")->size == 3 && Read(vfs, "Loose/d.dds") == "ddd");
+	CHECK(!vfs.exists("Loose/e.dds"));
+}
+
+TEST_CASE(HigherPriorityMountsWin)
+{
+	TempFolder folder;
+	folder.write("Mods/a.dds", "loose");
+
+	VirtualFileSystem vfs;
+	vfs.mountDirectory("Mods", 1);
+
+	// Archive mounted on top of the same folder with a lower priority, only its own files show through
+	auto reader = [](uint32_t entry, const uint8_t** data, size_t* size) {
+		static const std::string contents[] = { "packed a", "packed b" };
+		*data = (const uint8_t*)contents[entry].data();
+		*size = contents[entry].size();
+		return std::shared_ptr<const void>(contents, [](const void*) {});
+	};
+	vfs.mountArchive("Mods", folder.path / "pack.texpack", { { "a.dds", 8, 0 }, { "sub/b.dds", 8, 1 } }, reader, 0);
+
+	CHECK(Read(vfs, "Mods/a.dds") == "loose");
+	CHECK(Read(vfs, "Mods/sub/b.dds") == "packed b");
+	CHECK(vfs.isDirectory("Mods/sub"));
+	CHECK((Names(vfs.list("Mods", true)) == std::vector<std::string>{ "a.dds", "b.dds" }));
+	CHECK((Names(vfs.list("Mods", true, false)) == std::vector<std::string>{ "a.dds" }));
+
+	// Loose file going away uncovers the packed one
+	std::filesystem::remove(folder.path / "Mods" / "a.dds");
+	vfs.invalidate("Mods/a.dds");
+	CHECK(Read(vfs, "Mods/a.dds") == "packed a");
+}
+
+TEST_CASE(ManifestOnlyTracksNames)
+{
+	TempFolder folder;
+	folder.write("Mods/a.dds", "aaaa");
+	folder.write("Mods/sub/b.dds", "bb");
+	const std::filesystem::path manifest = "manifest.bin";
+
+	{
+		VirtualFileSystem vfs;
+		CHECK(vfs.mountDirectory("Mods", 0, manifest));
+	}
+	CHECK(std::filesystem::exists(manifest));
+
+	// Editing a file in place leaves its folder's write time alone, so the next mount reuses the folder's saved listing
+	auto folderTime = std::filesystem::last_write_time("Mods/sub");
+	auto manifestTime = std::filesystem::last_write_time(manifest);
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	folder.write("Mods/sub/b.dds", "now much longer");
+	CHECK(std::filesystem::last_write_time("Mods/sub") == folderTime);
+
+	{
+		VirtualFileSystem vfs;
+		CHECK(vfs.mountDirectory("Mods", 0, manifest));
+		CHECK(std::filesystem::last_write_time(manifest) == manifestTime); // nothing relisted, so not saved again
+
+		// Size & write time are the file's current ones, not what they were when the manifest was saved
+		auto info = vfs.stat("Mods/sub/b.dds");
+		CHECK(info && info->size == 15 && !info->directory);
+		CHECK(info && info->writeTime == std::filesystem::last_write_time("Mods/sub/b.dds").time_since_epoch().count());
+		CHECK(Read(vfs, "Mods/sub/b.dds") == "now much longer");
+		CHECK((Names(vfs.list("Mods", true)) == std::vector<std::string>{ "a.dds", "b.dds" }));
+	}
+
+	// Adding & removing files changes the folder, those get listed again
+	folder.write("Mods/sub/c.dds", "c");
+	std::filesystem::remove("Mods/a.dds");
+	{
+		VirtualFileSystem vfs;
+		CHECK(vfs.mountDirectory("Mods", 0, manifest));
+		CHECK((Names(vfs.list("Mods", true)) == std::vector<std::string>{ "b.dds", "c.dds" }));
+		CHECK(!vfs.exists("Mods/a.dds") && vfs.stat("Mods/sub/c.dds")->size == 1);
+	}
+
+	// Broken manifests are ignored & replaced
+	std::ofstream(manifest, std::ios::binary | std::ios::trunc) << "VFSM garbage";
+	{
+		VirtualFileSystem vfs;
+		CHECK(vfs.mountDirectory("Mods", 0, manifest));
+		CHECK((Names(vfs.list("Mods", true)) == std::vector<std::string>{ "b.dds", "c.dds" }));
+	}
+	CHECK(std::filesystem::file_size(manifest) > 12);
+
+	// A manifest saved for another folder isn't used for this one
+	folder.write("Other/x.dds", "x");
+	{
+		VirtualFileSystem vfs;
+		CHECK(vfs.mountDirectory("Other", 0, manifest));
+		CHECK((Names(vfs.list("Other", true)) == std::vector<std::string>{ "x.dds" }));
+	}
+}
+
+TEST_MAIN()
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "bcn.hpp"
+
+namespace Bcn
+{
+	struct Color
+	{
+		float r, g, b;
+	};
+
+	static void FetchBlock(const uint8_t* rgba, uint32_t width, uint32_t bx, uint32_t by, uint8_t block[16][4])
+	{
+		for (int y = 0; y < 4; y++)
+			memcpy(block[y * 4], rgba + (size_t(by * 4 + y) * width + bx * 4) * 4, 16);
+	}
+
+	static void StoreBlock(uint8_t* rgba, uint32_t width, uint32_t bx, uint32_t by, const uint8_t block[16][4])
+	{
+		for (int y = 0; y < 4; y++)
+			memcpy(rgba + (size_t(by * 4 + y) * width + bx * 4) * 4, block[y * 4], 16);
+	}
+
+	static uint16_t Pack565(const Color& c)
+	{
+		int r = std::clamp(int(std::lround(c.r * 31.0f / 255.0f)), 0, 31);
+		int g = std::clamp(int(std::lround(c.g * 63.0f / 255.0f)), 0, 63);
+		int b = std::clamp(int(std::lround(c.b * 31.0f / 255.0f)), 0, 31);
+		return uint16_t((r << 11) | (g << 5) | b);
+	}
+
+	static void Unpack565(uint16_t c, uint8_t out[3])
+	{
+		uint32_t r = (c >> 11) & 0x1F, g = (c >> 5) & 0x3F, b = c & 0x1F;
+		out[0] = uint8_t((r << 3) | (r >> 2));
+		out[1] = uint8_t((g << 2) | (g >> 4));
+		out[2] = uint8_t((b << 3) | (b >> 2));
+	}
+
+	// 4-color palette, or 3 colors + transparent black when c0 <= c1 (only valid for BC1)
+	static void ColorPalette(uint16_t c0, uint16_t c1, bool allowPunchThrough, uint8_t palette[4][4])
+	{
+		Unpack565(c0, palette[0]);
+		Unpack565(c1, palette[1]);
+		palette[0][3] = palette[1][3] = 255;
+
+		if (c0 > c1 || !allowPunchThrough)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				palette[2][i] = uint8_t((2 * palette[0][i] + palette[1][i]) / 3);
+				palette[3][i] = uint8_t((palette[0][i] + 2 * palette[1][i]) / 3);
+			}
+			palette[2][3] = palette[3][3] = 255;
+		}
+		else
+		{
+			for (int i = 0; i < 3; i++)
+				palette[2][i] = uint8_t((palette[0][i] + palette[1][i]) / 2);
+			palette[2][3] = 255;
+			palette[3][0] = palette[3][1] = palette[3][2] = palette[3][3] = 0;
+		}
+	}
+
+	static int ColorDistance(const uint8_t* a, const uint8_t* b)
+	{
+		int dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+		return dr * dr + dg * dg + db * db;
+	}
+
+	// Picks the nearest palette entry per pixel, returns total squared error
+	static int AssignIndices(const uint8_t block[16][4], uint16_t c0, uint16_t c1, uint8_t indices[16])
+	{
+		uint8_t palette[4][4];
+		ColorPalette(c0, c1, false, palette);
+
+		int total = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestError = ColorDistance(block[i], palette[0]);
+			for (int p = 1; p < 4; p++)
+			{
+				int error = ColorDistance(block[i], palette[p]);
+				if (error < bestError)
+				{
+					best = p;
+					bestError = error;
+				}
+			}
+			indices[i] = uint8_t(best);
+			total += bestError;
+		}
+		return total;
+	}
+
+	static void FitEndpoints(const uint8_t block[16][4], Color* e0, Color* e1)
+	{
+		Color mean = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			mean.r += block[i][0];
+			mean.g += block[i][1];
+			mean.b += block[i][2];
+		}
+		mean.r /= 16; mean.g /= 16; mean.b /= 16;
+
+		float cov[6] = {}; // rr rg rb gg gb bb
+		for (int i = 0; i < 16; i++)
+		{
+			float r = block[i][0] - mean.r, g = block[i][1] - mean.g, b = block[i][2] - mean.b;
+			cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+			cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+		}
+
+		// Principal axis via power iteration
+		Color axis = { 1, 1, 1 };
+		for (int iter = 0; iter < 8; iter++)
+		{
+			Color next = {
+				cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+				cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+				cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b,
+			};
+			float length = std::sqrt(next.r * next.r + next.g * next.g + next.b * next.b);
+			if (length < 1e-6f)
+			{
+				*e0 = *e1 = mean;
+				return;
+			}
+			axis = { next.r / length, next.g / length, next.b / length };
+		}
+
+		float minT = 0, maxT = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = (block[i][0] - mean.r) * axis.r + (block[i][1] - mean.g) * axis.g + (block[i][2] - mean.b) * axis.b;
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+
+		*e0 = { mean.r + axis.r * maxT, mean.g + axis.g * maxT, mean.b + axis.b * maxT };
+		*e1 = { mean.r + axis.r * minT, mean.g + axis.g * minT, mean.b + axis.b * minT };
+	}
+
+	// Least squares endpoints for a fixed set of indices
+	static bool RefineEndpoints(const uint8_t block[16][4], const uint8_t indices[16], Color* e0, Color* e1)
+	{
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+		float aa = 0, ab = 0, bb = 0;
+		Color ax = { 0, 0, 0 }, bx = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+		{
+			float w = weights[indices[i]], v = 1.0f - w;
+			aa += w * w; ab += w * v; bb += v * v;
+			ax.r += w * block[i][0]; ax.g += w * block[i][1]; ax.b += w * block[i][2];
+			bx.r += v * block[i][0]; bx.g += v * block[i][1]; bx.b += v * block[i][2];
+		}
+
+		float det = aa * bb - ab * ab;
+		if (std::fabs(det) < 1e-6f)
+			return false;
+
+		float inv = 1.0f / det;
+		*e0 = { (ax.r * bb - bx.r * ab) * inv, (ax.g * bb - bx.g * ab) * inv, (ax.b * bb - bx.b * ab) * inv };
+		*e1 = { (bx.r * aa - ax.r * ab) * inv, (bx.g * aa - ax.g * ab) * inv, (bx.b * aa - ax.b * ab) * inv };
+		return true;
+	}
+
+	static void EncodeColorBlock(const uint8_t block[16][4], uint8_t* out)
+	{
+		Color e0, e1;
+		FitEndpoints(block, &e0, &e1);
+
+		uint16_t c0 = Pack565(e0), c1 = Pack565(e1);
+		uint8_t indices[16];
+		int error = AssignIndices(block, c0, c1, indices);
+
+		Color r0, r1;
+		if (error > 0 && RefineEndpoints(block, indices, &r0, &r1))
+		{
+			uint16_t rc0 = Pack565(r0), rc1 = Pack565(r1);
+			uint8_t refined[16];
+			if (AssignIndices(block, rc0, rc1, refined) < error)
+			{
+				c0 = rc0;
+				c1 = rc1;
+				memcpy(indices, refined, sizeof(indices));
+			}
+		}
+
+		// Keep 4-color mode: c0 must be the larger endpoint, equal endpoints only need index 0
+		if (c0 < c1)
+		{
+			std::swap(c0, c1);
+			static const uint8_t swapped[4] = { 1, 0, 3, 2 };
+			for (auto& index : indices)
+				index = swapped[index];
+		}
+		else if (c0 == c1)
+		{
+			memset(indices, 0, sizeof(indices));
+		}
+
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; i++)
+			bits |= uint32_t(indices[i]) << (i * 2);
+
+		memcpy(out, &c0, 2);
+		memcpy(out + 2, &c1, 2);
+		memcpy(out + 4, &bits, 4);
+	}
+
+	static void AlphaPalette(uint8_t a0, uint8_t a1, uint8_t palette[8])
+	{
+		palette[0] = a0;
+		palette[1] = a1;
+		if (a0 > a1)
+		{
+			for (int i = 1; i < 7; i++)
+				palette[i + 1] = uint8_t(((7 - i) * a0 + i * a1) / 7);
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+				palette[i + 1] = uint8_t(((5 - i) * a0 + i * a1) / 5);
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	static void EncodeAlphaBlock(const uint8_t block[16][4], uint8_t* out)
+	{
+		uint8_t a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; i++)
+		{
+			a0 = std::max(a0, block[i][3]);
+			a1 = std::min(a1, block[i][3]);
+		}
+
+		uint64_t bits = 0;
+		if (a0 != a1)
+		{
+			uint8_t palette[8];
+			AlphaPalette(a0, a1, palette);
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0, bestError = 256;
+				for (int p = 0; p < 8; p++)
+				{
+					int error = std::abs(int(block[i][3]) - int(palette[p]));
+					if (error < bestError)
+					{
+						best = p;
+						bestError = error;
+					}
+				}
+				bits |= uint64_t(best) << (i * 3);
+			}
+		}
+
+		out[0] = a0;
+		out[1] = a1;
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = uint8_t(bits >> (i * 8));
+	}
+
+	std::vector<uint8_t> EncodeBC1(const uint8_t* rgba, uint32_t width, uint32_t height)
+	{
+		std::vector<uint8_t> out(size_t(width / 4) * (height / 4) * BC1BlockSize);
+		uint8_t* dst = out.data();
+		uint8_t block[16][4];
+		for (uint32_t by = 0; by < height / 4; by++)
+			for (uint32_t bx = 0; bx < width / 4; bx++, dst += BC1BlockSize)
+			{
+				FetchBlock(rgba, width, bx, by, block);
+				EncodeColorBlock(block, dst);
+			}
+		return out;
+	}
+
+	std::vector<uint8_t> EncodeBC3(const uint8_t* rgba, uint32_t width, uint32_t height)
+	{
+		std::vector<uint8_t> out(size_t(width / 4) * (height / 4) * BC3BlockSize);
+		uint8_t* dst = out.data();
+		uint8_t block[16][4];
+		for (uint32_t by = 0; by < height / 4; by++)
+			for (uint32_t bx = 0; bx < width / 4; bx++, dst += BC3BlockSize)
+			{
+				FetchBlock(rgba, width, bx, by, block);
+				EncodeAlphaBlock(block, dst);
+				EncodeColorBlock(block, dst + 8);
+			}
+		return out;
+	}
+
+	static void DecodeColorBlock(const uint8_t* in, bool allowPunchThrough, uint8_t block[16][4])
+	{
+		uint16_t c0, c1;
+		uint32_t bits;
+		memcpy(&c0, in, 2);
+		memcpy(&c1, in + 2, 2);
+		memcpy(&bits, in + 4, 4);
+
+		uint8_t palette[4][4];
+		ColorPalette(c0, c1, allowPunchThrough, palette);
+		for (int i = 0; i < 16; i++)
+			memcpy(block[i], palette[(bits >> (i * 2)) & 3], 4);
+	}
+
+	std::vector<uint8_t> DecodeBC1(const uint8_t* blocks, uint32_t width, uint32_t height)
+	{
+		std::vector<uint8_t> out(size_t(width) * height * 4);
+		uint8_t block[16][4];
+		for (uint32_t by = 0; by < height / 4; by++)
+			for (uint32_t bx = 0; bx < width / 4; bx++, blocks += BC1BlockSize)
+			{
+				DecodeColorBlock(blocks, true, block);
+				StoreBlock(out.data(), width, bx, by, block);
+			}
+		return out;
+	}
+
+	std::vector<uint8_t> DecodeBC3(const uint8_t* blocks, uint32_t width, uint32_t height)
+	{
+		std::vector<uint8_t> out(size_t(width) * height * 4);
+		uint8_t block[16][4];
+		for (uint32_t by = 0; by < height / 4; by++)
+			for (uint32_t bx = 0; bx < width / 4; bx++, blocks += BC3BlockSize)
+			{
+				DecodeColorBlock(blocks + 8, false, block);
+
+				uint8_t palette[8];
+				AlphaPalette(blocks[0], blocks[1], palette);
+				uint64_t bits = 0;
+				for (int i = 0; i < 6; i++)
+					bits |= uint64_t(blocks[2 + i]) << (i * 8);
+				for (int i = 0; i < 16; i++)
+					block[i][3] = palette[(bits >> (i * 3)) & 7];
+
+				StoreBlock(out.data(), width, bx, by, block);
+			}
+		return out;
+	}
+
+	double Psnr(const uint8_t* a, const uint8_t* b, size_t pixels, bool includeAlpha)
+	{
+		int channels = includeAlpha ? 4 : 3;
+		double sum = 0;
+		for (size_t i = 0; i < pixels; i++)
+			for (int c = 0; c < channels; c++)
+			{
+				double d = double(a[i * 4 + c]) - double(b[i * 4 + c]);
+				sum += d * d;
+			}
+
+		if (sum == 0)
+			return 99.0;
+
+		double mse = sum / (double(pixels) * channels);
+		return 10.0 * std::log10(255.0 * 255.0 / mse);
+	}
+}
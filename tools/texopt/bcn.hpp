@@ -0,0 +1,28 @@
+// BC1 (DXT1) / BC3 (DXT5) block encoding & decoding for texopt
+// Pixels are RGBA8 (R first in memory), images must be a multiple of 4 in both dimensions.
+//
+// The encoder fits color endpoints along the principal axis of each block & refines them once with least squares,
+// which is a long way from the best encoders out there but good enough to judge whether BCn suits a texture at all.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Bcn
+{
+	// Bytes per 4x4 block
+	constexpr size_t BC1BlockSize = 8;
+	constexpr size_t BC3BlockSize = 16;
+
+	std::vector<uint8_t> EncodeBC1(const uint8_t* rgba, uint32_t width, uint32_t height);
+	std::vector<uint8_t> EncodeBC3(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+	// Decoded output is always RGBA8, BC1 punch-through pixels decode to transparent black
+	std::vector<uint8_t> DecodeBC1(const uint8_t* blocks, uint32_t width, uint32_t height);
+	std::vector<uint8_t> DecodeBC3(const uint8_t* blocks, uint32_t width, uint32_t height);
+
+	// PSNR in dB over RGB (and alpha if includeAlpha), returns 99 for identical images
+	double Psnr(const uint8_t* a, const uint8_t* b, size_t pixels, bool includeAlpha);
+}
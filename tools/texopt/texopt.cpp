@@ -0,0 +1,672 @@
+// texopt: analyzes & optimizes a texture replacement folder
+// usage:
+//   texopt <textures/load folder> [-o <output folder>] [options]
+//
+// Finds textures that are byte-identical or look the same (within --similar-psnr), transcodes uncompressed 32bpp textures
+// to BC1/BC3 when the result stays above --min-psnr, and strips mips from sets that never use them (eg. UI sprite sets).
+// Without -o only the report is printed. With -o the optimized layout is written there, duplicates are hard-linked to a
+// single copy where the filesystem allows it, along with texopt_manifest.json describing what happened to each file.
+// The output folder can be packed with "texpack pack" afterwards, which stores duplicates only once.
+//
+// options:
+//   --min-psnr <dB>       minimum quality for BCn transcodes (default 36)
+//   --similar-psnr <dB>   textures at least this close count as perceptual duplicates (default 50)
+//   --merge-similar       treat perceptual duplicates like byte-identical ones, instead of only reporting them
+//   --no-transcode        don't convert anything to BCn
+//   --no-mips <set>       strip mips from textures in this set folder, can be repeated
+//   --read-speed <MB/s>   drive read speed used for the load-time estimate (default 200)
+//   --cache-budget <MB>   texture cache size to compare the mapped sizes against, eg. TextureCacheBudgetMB (default none,
+//                         the game sizes the cache from its free address space)
+//
+// BC7 isn't an option since the game runs on D3D9, which can't sample it.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <xxhash.h>
+
+#include "bcn.hpp"
+#include "texture_pack.hpp"
+
+constexpr uint32_t DdsMagic = 0x20534444; // "DDS "
+
+#pragma pack(push, 1)
+struct DdsPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t rMask;
+	uint32_t gMask;
+	uint32_t bMask;
+	uint32_t aMask;
+};
+
+// Same layout as DWORD magic + DDSURFACEDESC2, without needing the Windows headers
+struct DdsFile
+{
+	uint32_t magic;
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DdsPixelFormat pixelFormat;
+	uint32_t caps;
+	uint32_t caps2;
+	uint32_t caps3;
+	uint32_t caps4;
+	uint32_t reserved2;
+};
+static_assert(sizeof(DdsFile) == 128);
+#pragma pack(pop)
+
+constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+constexpr uint32_t DDSD_LINEARSIZE = 0x80000;
+constexpr uint32_t DDSD_PITCH = 0x8;
+constexpr uint32_t DDPF_ALPHAPIXELS = 0x1;
+constexpr uint32_t DDPF_FOURCC = 0x4;
+constexpr uint32_t DDSCAPS_COMPLEX = 0x8;
+constexpr uint32_t DDSCAPS_MIPMAP = 0x400000;
+
+constexpr uint32_t FourCC(char a, char b, char c, char d)
+{
+	return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+enum class Format
+{
+	Unknown,
+	BGRA8, // A8R8G8B8
+	BGRX8, // X8R8G8B8
+	RGBA8, // A8B8G8R8
+	DXT1,
+	DXT3,
+	DXT5,
+};
+
+static const char* FormatName(Format format)
+{
+	switch (format)
+	{
+	case Format::BGRA8: return "A8R8G8B8";
+	case Format::BGRX8: return "X8R8G8B8";
+	case Format::RGBA8: return "A8B8G8R8";
+	case Format::DXT1: return "DXT1";
+	case Format::DXT3: return "DXT3";
+	case Format::DXT5: return "DXT5";
+	default: return "unknown";
+	}
+}
+
+static Format GetFormat(const DdsPixelFormat& pf)
+{
+	if (pf.flags & DDPF_FOURCC)
+	{
+		if (pf.fourCC == FourCC('D', 'X', 'T', '1')) return Format::DXT1;
+		if (pf.fourCC == FourCC('D', 'X', 'T', '3')) return Format::DXT3;
+		if (pf.fourCC == FourCC('D', 'X', 'T', '5')) return Format::DXT5;
+		return Format::Unknown;
+	}
+
+	if (pf.rgbBitCount != 32)
+		return Format::Unknown;
+
+	bool hasAlpha = (pf.flags & DDPF_ALPHAPIXELS) && pf.aMask == 0xFF000000;
+	if (pf.rMask == 0x00FF0000 && pf.gMask == 0x0000FF00 && pf.bMask == 0x000000FF)
+		return hasAlpha ? Format::BGRA8 : Format::BGRX8;
+	if (pf.rMask == 0x000000FF && pf.gMask == 0x0000FF00 && pf.bMask == 0x00FF0000 && hasAlpha)
+		return Format::RGBA8;
+	return Format::Unknown;
+}
+
+static bool IsBlockCompressed(Format format)
+{
+	return format == Format::DXT1 || format == Format::DXT3 || format == Format::DXT5;
+}
+
+static size_t LevelSize(Format format, uint32_t width, uint32_t height)
+{
+	size_t blocks = size_t(std::max(1u, (width + 3) / 4)) * std::max(1u, (height + 3) / 4);
+	switch (format)
+	{
+	case Format::DXT1: return blocks * 8;
+	case Format::DXT3:
+	case Format::DXT5: return blocks * 16;
+	case Format::Unknown: return 0;
+	default: return size_t(width) * height * 4;
+	}
+}
+
+struct Texture
+{
+	std::filesystem::path source;
+	std::string relativePath;
+	bool isTexture = false;  // false = not a replacement texture, copied through unchanged
+	std::vector<uint8_t> data;
+	uint64_t contentHash = 0;
+
+	Format format = Format::Unknown;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t mipCount = 1;
+
+	int duplicateOf = -1;    // byte-identical to this texture
+	int similarTo = -1;      // looks the same as this texture
+	double similarPsnr = 0;
+
+	std::vector<uint8_t> output; // optimized file, empty = unchanged
+	std::string action = "keep";
+	double psnr = 0;
+};
+
+static bool ReadFile(const std::filesystem::path& path, std::vector<uint8_t>& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static const DdsFile* GetHeader(const Texture& texture)
+{
+	if (texture.data.size() < sizeof(DdsFile))
+		return nullptr;
+	auto* header = reinterpret_cast<const DdsFile*>(texture.data.data());
+	return header->magic == DdsMagic ? header : nullptr;
+}
+
+// Offset of each mip level in the file, returns false if the file is too short for the header's mip count
+static bool GetLevelOffsets(const Texture& texture, std::vector<size_t>& offsets)
+{
+	offsets.clear();
+	size_t offset = sizeof(DdsFile);
+	for (uint32_t level = 0; level < texture.mipCount; level++)
+	{
+		offsets.push_back(offset);
+		offset += LevelSize(texture.format, std::max(1u, texture.width >> level), std::max(1u, texture.height >> level));
+	}
+	offsets.push_back(offset);
+	return offset <= texture.data.size();
+}
+
+// Decodes a mip level into RGBA8, returns false for formats we can't decode
+static bool DecodeLevel(const Texture& texture, const uint8_t* data, uint32_t width, uint32_t height, std::vector<uint8_t>& rgba)
+{
+	size_t pixels = size_t(width) * height;
+	switch (texture.format)
+	{
+	case Format::BGRA8:
+	case Format::BGRX8:
+		rgba.resize(pixels * 4);
+		for (size_t i = 0; i < pixels; i++)
+		{
+			rgba[i * 4 + 0] = data[i * 4 + 2];
+			rgba[i * 4 + 1] = data[i * 4 + 1];
+			rgba[i * 4 + 2] = data[i * 4 + 0];
+			rgba[i * 4 + 3] = texture.format == Format::BGRX8 ? 255 : data[i * 4 + 3];
+		}
+		return true;
+	case Format::RGBA8:
+		rgba.assign(data, data + pixels * 4);
+		return true;
+	case Format::DXT1:
+		if (width % 4 || height % 4)
+			return false;
+		rgba = Bcn::DecodeBC1(data, width, height);
+		return true;
+	case Format::DXT5:
+		if (width % 4 || height % 4)
+			return false;
+		rgba = Bcn::DecodeBC3(data, width, height);
+		return true;
+	default:
+		return false;
+	}
+}
+
+// 8x8 average hash of the alpha-weighted luminance, only used to find candidates for the full PSNR comparison
+static uint64_t AverageHash(const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height)
+{
+	double cells[64] = {};
+	for (uint32_t cy = 0; cy < 8; cy++)
+		for (uint32_t cx = 0; cx < 8; cx++)
+		{
+			uint32_t x0 = cx * width / 8, x1 = std::max(x0 + 1, (cx + 1) * width / 8);
+			uint32_t y0 = cy * height / 8, y1 = std::max(y0 + 1, (cy + 1) * height / 8);
+			double sum = 0;
+			for (uint32_t y = y0; y < std::min(y1, height); y++)
+				for (uint32_t x = x0; x < std::min(x1, width); x++)
+				{
+					const uint8_t* p = &rgba[(size_t(y) * width + x) * 4];
+					sum += (p[0] * 0.299 + p[1] * 0.587 + p[2] * 0.114) * p[3] / 255.0;
+				}
+			cells[cy * 8 + cx] = sum / (double(x1 - x0) * (y1 - y0));
+		}
+
+	double mean = 0;
+	for (double cell : cells)
+		mean += cell;
+	mean /= 64;
+
+	uint64_t hash = 0;
+	for (int i = 0; i < 64; i++)
+		if (cells[i] > mean)
+			hash |= 1ull << i;
+	return hash;
+}
+
+// Encodes one level, padding it out to whole blocks for the small mips
+static std::vector<uint8_t> EncodeLevel(const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height, bool bc3)
+{
+	uint32_t paddedWidth = (width + 3) & ~3u, paddedHeight = (height + 3) & ~3u;
+	const uint8_t* source = rgba.data();
+	std::vector<uint8_t> padded;
+	if (paddedWidth != width || paddedHeight != height)
+	{
+		padded.resize(size_t(paddedWidth) * paddedHeight * 4);
+		for (uint32_t y = 0; y < paddedHeight; y++)
+			for (uint32_t x = 0; x < paddedWidth; x++)
+				memcpy(&padded[(size_t(y) * paddedWidth + x) * 4], &rgba[(size_t(std::min(y, height - 1)) * width + std::min(x, width - 1)) * 4], 4);
+		source = padded.data();
+	}
+
+	return bc3 ? Bcn::EncodeBC3(source, paddedWidth, paddedHeight) : Bcn::EncodeBC1(source, paddedWidth, paddedHeight);
+}
+
+static std::vector<uint8_t> WriteDds(const DdsFile& original, Format format, uint32_t mipCount, const std::vector<std::vector<uint8_t>>& levels)
+{
+	DdsFile header = original;
+	header.mipMapCount = mipCount;
+	header.flags = mipCount > 1 ? (header.flags | DDSD_MIPMAPCOUNT) : (header.flags & ~DDSD_MIPMAPCOUNT);
+	header.caps = mipCount > 1 ? (header.caps | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP) : (header.caps & ~(DDSCAPS_COMPLEX | DDSCAPS_MIPMAP));
+
+	if (IsBlockCompressed(format))
+	{
+		header.flags = (header.flags & ~DDSD_PITCH) | DDSD_LINEARSIZE;
+		header.pitchOrLinearSize = uint32_t(LevelSize(format, header.width, header.height));
+		header.pixelFormat = {};
+		header.pixelFormat.size = sizeof(DdsPixelFormat);
+		header.pixelFormat.flags = DDPF_FOURCC;
+		header.pixelFormat.fourCC = format == Format::DXT1 ? FourCC('D', 'X', 'T', '1') : FourCC('D', 'X', 'T', '5');
+	}
+
+	std::vector<uint8_t> out(reinterpret_cast<const uint8_t*>(&header), reinterpret_cast<const uint8_t*>(&header) + sizeof(header));
+	for (const auto& level : levels)
+		out.insert(out.end(), level.begin(), level.end());
+	return out;
+}
+
+struct Options
+{
+	double minPsnr = 36.0;
+	double similarPsnr = 50.0;
+	bool mergeSimilar = false;
+	bool transcode = true;
+	std::set<uint32_t> noMipSets; // TexPack::HashName of the set folders
+	double readSpeed = 200.0;
+	double cacheBudget = 0.0; // MB, 0 = not given
+	std::filesystem::path output;
+};
+
+static void Optimize(Texture& texture, const Options& options, uint32_t setHash)
+{
+	const DdsFile* header = GetHeader(texture);
+	std::vector<size_t> offsets;
+	if (!header || texture.format == Format::Unknown || !GetLevelOffsets(texture, offsets))
+		return;
+
+	uint32_t mipCount = texture.mipCount;
+	bool stripMips = mipCount > 1 && options.noMipSets.count(setHash);
+	if (stripMips)
+		mipCount = 1;
+
+	bool canTranscode = options.transcode && !IsBlockCompressed(texture.format) && texture.width % 4 == 0 && texture.height % 4 == 0;
+	if (canTranscode)
+	{
+		std::vector<uint8_t> rgba;
+		DecodeLevel(texture, texture.data.data() + offsets[0], texture.width, texture.height, rgba);
+
+		bool opaque = true;
+		for (size_t i = 3; i < rgba.size() && opaque; i += 4)
+			opaque = rgba[i] == 255;
+
+		std::vector<std::vector<uint8_t>> levels;
+		levels.push_back(EncodeLevel(rgba, texture.width, texture.height, !opaque));
+
+		auto decoded = opaque ? Bcn::DecodeBC1(levels[0].data(), texture.width, texture.height) : Bcn::DecodeBC3(levels[0].data(), texture.width, texture.height);
+		double psnr = Bcn::Psnr(rgba.data(), decoded.data(), size_t(texture.width) * texture.height, !opaque);
+		if (psnr >= options.minPsnr)
+		{
+			for (uint32_t level = 1; level < mipCount; level++)
+			{
+				uint32_t width = std::max(1u, texture.width >> level), height = std::max(1u, texture.height >> level);
+				DecodeLevel(texture, texture.data.data() + offsets[level], width, height, rgba);
+				levels.push_back(EncodeLevel(rgba, width, height, !opaque));
+			}
+
+			Format format = opaque ? Format::DXT1 : Format::DXT5;
+			texture.output = WriteDds(*header, format, mipCount, levels);
+			texture.action = std::string(opaque ? "bc1" : "bc3") + (stripMips ? "+strip-mips" : "");
+			texture.psnr = psnr;
+			return;
+		}
+	}
+
+	if (stripMips)
+	{
+		std::vector<std::vector<uint8_t>> levels;
+		levels.emplace_back(texture.data.begin() + offsets[0], texture.data.begin() + offsets[1]);
+		texture.output = WriteDds(*header, texture.format, 1, levels);
+		texture.action = "strip-mips";
+	}
+}
+
+static std::string JsonString(const std::string& str)
+{
+	std::string out = "\"";
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out + "\"";
+}
+
+static bool WriteOutput(const std::vector<Texture>& textures, const std::filesystem::path& outputDir)
+{
+	std::error_code ec;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const Texture& texture = textures[i];
+		auto outPath = outputDir / texture.relativePath;
+		std::filesystem::create_directories(outPath.parent_path(), ec);
+		std::filesystem::remove(outPath, ec);
+
+		int original = texture.duplicateOf >= 0 ? texture.duplicateOf : texture.similarTo;
+		if (original >= 0)
+		{
+			// Originals always come earlier in the list, so they've already been written
+			auto originalPath = outputDir / textures[original].relativePath;
+			std::filesystem::create_hard_link(originalPath, outPath, ec);
+			if (!ec)
+				continue;
+			if (!std::filesystem::copy_file(originalPath, outPath, ec))
+			{
+				fprintf(stderr, "texopt: failed to write %s\n", outPath.string().c_str());
+				return false;
+			}
+			continue;
+		}
+
+		const auto& data = texture.output.empty() ? texture.data : texture.output;
+		std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+		if (!out.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size())))
+		{
+			fprintf(stderr, "texopt: failed to write %s\n", outPath.string().c_str());
+			return false;
+		}
+	}
+
+	std::ofstream manifest(outputDir / "texopt_manifest.json", std::ios::trunc);
+	manifest << "[\n";
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const Texture& texture = textures[i];
+		int original = texture.duplicateOf >= 0 ? texture.duplicateOf : texture.similarTo;
+		size_t outputSize = original >= 0 ? 0 : (texture.output.empty() ? texture.data.size() : texture.output.size());
+
+		manifest << "  { \"path\": " << JsonString(texture.relativePath)
+			<< ", \"action\": " << JsonString(texture.action)
+			<< ", \"format\": " << JsonString(FormatName(texture.format))
+			<< ", \"inputSize\": " << texture.data.size()
+			<< ", \"outputSize\": " << outputSize;
+		if (original >= 0)
+			manifest << ", \"source\": " << JsonString(textures[original].relativePath);
+		if (texture.psnr > 0)
+			manifest << ", \"psnr\": " << texture.psnr;
+		manifest << " }" << (i + 1 < textures.size() ? ",\n" : "\n");
+	}
+	manifest << "]\n";
+
+	if (!manifest)
+	{
+		fprintf(stderr, "texopt: failed to write manifest\n");
+		return false;
+	}
+	return true;
+}
+
+static int Run(const std::filesystem::path& inputDir, const Options& options)
+{
+	std::vector<Texture> textures;
+	std::vector<uint32_t> setHashes;
+	std::error_code ec;
+	for (const auto& dirEntry : std::filesystem::recursive_directory_iterator(inputDir, ec))
+	{
+		if (!dirEntry.is_regular_file())
+			continue;
+
+		auto relative = std::filesystem::relative(dirEntry.path(), inputDir);
+
+		Texture texture;
+		texture.source = dirEntry.path();
+		texture.relativePath = relative.generic_string();
+		if (!ReadFile(texture.source, texture.data))
+		{
+			fprintf(stderr, "texopt: failed to read %s\n", texture.relativePath.c_str());
+			return 1;
+		}
+
+		TexPack::TextureKey key = {};
+		texture.isTexture = TexPack::ParseReplacementPath(relative, &key);
+		if (!texture.isTexture)
+			texture.action = "copy";
+		else if (const DdsFile* header = GetHeader(texture))
+		{
+			texture.format = GetFormat(header->pixelFormat);
+			texture.width = header->width;
+			texture.height = header->height;
+			texture.mipCount = std::max(1u, header->mipMapCount);
+		}
+
+		texture.contentHash = XXH64(texture.data.data(), texture.data.size(), 0);
+		textures.push_back(std::move(texture));
+		setHashes.push_back(key.setHash);
+	}
+
+	if (ec)
+	{
+		fprintf(stderr, "texopt: failed to scan %s: %s\n", inputDir.string().c_str(), ec.message().c_str());
+		return 1;
+	}
+
+	// Byte-identical duplicates
+	std::map<std::pair<uint64_t, size_t>, int> byContent;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		auto key = std::make_pair(textures[i].contentHash, textures[i].data.size());
+		auto [it, inserted] = byContent.emplace(key, int(i));
+		if (!inserted && textures[it->second].data == textures[i].data)
+		{
+			textures[i].duplicateOf = it->second;
+			textures[i].action = "duplicate";
+		}
+	}
+
+	// Perceptual duplicates, compared against the first texture of each (size, average hash) bucket
+	std::map<std::tuple<uint32_t, uint32_t, uint64_t>, std::vector<int>> buckets;
+	std::map<int, std::vector<uint8_t>> decodedCache;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		Texture& texture = textures[i];
+		std::vector<size_t> offsets;
+		std::vector<uint8_t> rgba;
+		if (!texture.isTexture || texture.duplicateOf >= 0 || !GetHeader(texture) || !GetLevelOffsets(texture, offsets) ||
+			!DecodeLevel(texture, texture.data.data() + offsets[0], texture.width, texture.height, rgba))
+			continue;
+
+		auto& bucket = buckets[{ texture.width, texture.height, AverageHash(rgba, texture.width, texture.height) }];
+		for (int candidate : bucket)
+		{
+			double psnr = Bcn::Psnr(decodedCache[candidate].data(), rgba.data(), size_t(texture.width) * texture.height, true);
+			if (psnr >= options.similarPsnr)
+			{
+				texture.similarPsnr = psnr;
+				if (options.mergeSimilar)
+				{
+					texture.similarTo = candidate;
+					texture.action = "similar";
+				}
+				else
+				{
+					texture.action = "keep (similar to " + textures[candidate].relativePath + ")";
+				}
+				break;
+			}
+		}
+
+		if (texture.similarPsnr == 0 && bucket.size() < 4)
+		{
+			bucket.push_back(int(i));
+			decodedCache[int(i)] = std::move(rgba);
+		}
+	}
+	decodedCache.clear();
+
+	// Transcode/strip whatever is left
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		Texture& texture = textures[i];
+		if (texture.isTexture && texture.duplicateOf < 0 && texture.similarTo < 0)
+			Optimize(texture, options, setHashes[i]);
+	}
+
+	// Report
+	size_t textureCount = 0, duplicates = 0, similar = 0, transcoded = 0, stripped = 0;
+	uint64_t inputBytes = 0, uniqueInputBytes = 0, outputBytes = 0, mappedBefore = 0, mappedAfter = 0;
+	uint64_t duplicateBytes = 0, similarBytes = 0, transcodeBefore = 0, transcodeAfter = 0;
+	for (const auto& texture : textures)
+	{
+		size_t size = texture.output.empty() ? texture.data.size() : texture.output.size();
+		int original = texture.duplicateOf >= 0 ? texture.duplicateOf : texture.similarTo;
+		if (original >= 0)
+			size = textures[original].output.empty() ? textures[original].data.size() : textures[original].output.size();
+
+		textureCount += texture.isTexture;
+		inputBytes += texture.data.size();
+		if (texture.duplicateOf < 0)
+			uniqueInputBytes += texture.data.size();
+		if (original < 0)
+			outputBytes += size;
+
+		// FileDataCache & the game's textures are per name, so duplicates still take up their own space there
+		mappedBefore += texture.data.size();
+		mappedAfter += size;
+
+		if (texture.duplicateOf >= 0)
+		{
+			duplicates++;
+			duplicateBytes += texture.data.size();
+		}
+		if (texture.similarPsnr > 0)
+		{
+			similar++;
+			similarBytes += texture.data.size();
+		}
+		if (texture.action.rfind("bc", 0) == 0)
+		{
+			transcoded++;
+			transcodeBefore += texture.data.size();
+			transcodeAfter += texture.output.size();
+		}
+		if (texture.action.find("strip-mips") != std::string::npos)
+			stripped++;
+	}
+
+	auto mb = [](uint64_t bytes) { return double(bytes) / (1024 * 1024); };
+	auto seconds = [&](uint64_t bytes) { return mb(bytes) / options.readSpeed; };
+
+	printf("scanned %zu files (%zu textures), %.1f MB\n", textures.size(), textureCount, mb(inputBytes));
+	printf("  byte-identical duplicates: %zu (%.1f MB)\n", duplicates, mb(duplicateBytes));
+	printf("  perceptual duplicates:     %zu (%.1f MB)%s\n", similar, mb(similarBytes), options.mergeSimilar ? ", merged" : ", use --merge-similar to merge");
+	printf("  transcoded to BCn:         %zu (%.1f MB -> %.1f MB)\n", transcoded, mb(transcodeBefore), mb(transcodeAfter));
+	printf("  mips stripped:             %zu\n", stripped);
+	printf("disk:          %.1f MB -> %.1f MB\n", mb(inputBytes), mb(outputBytes));
+	if (options.cacheBudget > 0)
+		printf("cache/texture: %.1f MB -> %.1f MB (counted per name, %.0f%% -> %.0f%% of the %.0f MB texture cache)\n", mb(mappedBefore), mb(mappedAfter),
+			mb(mappedBefore) * 100 / options.cacheBudget, mb(mappedAfter) * 100 / options.cacheBudget, options.cacheBudget);
+	else
+		printf("cache/texture: %.1f MB -> %.1f MB (counted per name)\n", mb(mappedBefore), mb(mappedAfter));
+	printf("est. load I/O: %.1fs -> %.1fs at %.0f MB/s (duplicates only read once)\n", seconds(uniqueInputBytes), seconds(outputBytes), options.readSpeed);
+
+	if (options.output.empty())
+		return 0;
+
+	if (!WriteOutput(textures, options.output))
+		return 1;
+
+	printf("wrote optimized layout to %s\n", options.output.string().c_str());
+	return 0;
+}
+
+static void PrintUsage()
+{
+	printf("usage:\n");
+	printf("  texopt <textures/load folder> [-o <output folder>] [--min-psnr <dB>] [--similar-psnr <dB>] [--merge-similar]\n");
+	printf("         [--no-transcode] [--no-mips <set>]... [--read-speed <MB/s>] [--cache-budget <MB>]\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Options options;
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "-o" && hasValue)
+			options.output = argv[++i];
+		else if (arg == "--min-psnr" && hasValue)
+			options.minPsnr = atof(argv[++i]);
+		else if (arg == "--similar-psnr" && hasValue)
+			options.similarPsnr = atof(argv[++i]);
+		else if (arg == "--merge-similar")
+			options.mergeSimilar = true;
+		else if (arg == "--no-transcode")
+			options.transcode = false;
+		else if (arg == "--no-mips" && hasValue)
+			options.noMipSets.insert(TexPack::HashName(argv[++i]));
+		else if (arg == "--read-speed" && hasValue)
+			options.readSpeed = std::max(1.0, atof(argv[++i]));
+		else if (arg == "--cache-budget" && hasValue)
+			options.cacheBudget = std::max(0.0, atof(argv[++i]));
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	return Run(argv[1], options);
+}
@@ -0,0 +1,317 @@
+// texpack: builds & extracts .texpack texture archives (see src/texture_pack.hpp)
+// usage:
+//   texpack pack <textures/load folder> <output.texpack> [-c[level]]
+//   texpack unpack <input.texpack> <output folder>
+//   texpack list <input.texpack>
+//
+// Folder layout is the same one HandleTexture reads loose files from:
+//   [xmtset/][padtype/]<[index_]HASH_WxH.dds>  (padtype & xmtset folders can be in either order)
+// -c enables per-entry deflate compression (level 1-10, default 6), entries are only stored compressed if that saves at least 1/8th
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <miniz.h>
+#include <xxhash.h>
+
+#include "texture_pack.hpp"
+
+using namespace TexPack;
+
+struct PackInput
+{
+	TexPackEntry entry;
+	std::filesystem::path source;
+	std::string relativePath;
+	bool padFirst;
+};
+
+static bool ReadFile(const std::filesystem::path& path, std::vector<uint8_t>& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static void WritePadding(std::ofstream& out)
+{
+	static const char zeros[Alignment] = {};
+	uint64_t pos = uint64_t(out.tellp());
+	uint64_t padding = (Alignment - (pos % Alignment)) % Alignment;
+	out.write(zeros, std::streamsize(padding));
+}
+
+static int Pack(const std::filesystem::path& inputDir, const std::filesystem::path& outputPath, int level)
+{
+	std::vector<PackInput> inputs;
+	std::error_code ec;
+	for (const auto& dirEntry : std::filesystem::recursive_directory_iterator(inputDir, ec))
+	{
+		if (!dirEntry.is_regular_file())
+			continue;
+
+		auto relative = std::filesystem::relative(dirEntry.path(), inputDir);
+
+		PackInput input = {};
+		input.source = dirEntry.path();
+		input.relativePath = relative.generic_string();
+
+		TextureKey key;
+		if (!ParseReplacementPath(relative, &key))
+		{
+			printf("skipping %s: not a texture replacement name, or unexpected folder layout\n", input.relativePath.c_str());
+			continue;
+		}
+		input.entry.hash = key.hash;
+		input.entry.setHash = key.setHash;
+		input.entry.padHash = key.padHash;
+		input.entry.width = key.width;
+		input.entry.height = key.height;
+		input.entry.index = key.index;
+		input.padFirst = key.padFirst;
+
+		inputs.push_back(std::move(input));
+	}
+
+	if (ec)
+	{
+		fprintf(stderr, "texpack: failed to scan %s: %s\n", inputDir.string().c_str(), ec.message().c_str());
+		return 1;
+	}
+	if (inputs.empty())
+	{
+		fprintf(stderr, "texpack: no textures found in %s\n", inputDir.string().c_str());
+		return 1;
+	}
+
+	std::sort(inputs.begin(), inputs.end(), [](const PackInput& a, const PackInput& b) {
+		return a.entry < b.entry || (!(b.entry < a.entry) && !a.padFirst && b.padFirst);
+	});
+
+	// Duplicate keys can come from eg. the same file existing in both xmtset/pad/ & pad/xmtset/, xmtset/pad/ wins like in HandleTexture
+	auto last = std::unique(inputs.begin(), inputs.end(), [](const PackInput& a, const PackInput& b) {
+		return !(a.entry < b.entry) && !(b.entry < a.entry);
+	});
+	if (last != inputs.end())
+	{
+		printf("dropped %zu entries with duplicate keys\n", size_t(inputs.end() - last));
+		inputs.erase(last, inputs.end());
+	}
+
+	std::vector<uint8_t> pathTable;
+	for (const auto& input : inputs)
+	{
+		uint16_t length = uint16_t(std::min<size_t>(input.relativePath.size(), 0xFFFF));
+		pathTable.insert(pathTable.end(), reinterpret_cast<const uint8_t*>(&length), reinterpret_cast<const uint8_t*>(&length) + sizeof(length));
+		pathTable.insert(pathTable.end(), input.relativePath.begin(), input.relativePath.begin() + length);
+	}
+
+	TexPackHeader header = {};
+	header.magic = Magic;
+	header.version = Version;
+	header.headerSize = sizeof(TexPackHeader);
+	header.entryCount = uint32_t(inputs.size());
+	header.alignment = Alignment;
+	header.pathTableOffset = sizeof(TexPackHeader) + inputs.size() * sizeof(TexPackEntry);
+	header.pathTableSize = pathTable.size();
+
+	std::ofstream out(outputPath, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		fprintf(stderr, "texpack: failed to create %s\n", outputPath.string().c_str());
+		return 1;
+	}
+
+	// Index gets written again once offsets are known
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	std::vector<TexPackEntry> index(inputs.size());
+	out.write(reinterpret_cast<const char*>(index.data()), std::streamsize(index.size() * sizeof(TexPackEntry)));
+	out.write(reinterpret_cast<const char*>(pathTable.data()), std::streamsize(pathTable.size()));
+
+	// Identical files are only stored once, later entries alias the first copy
+	std::map<std::pair<uint64_t, size_t>, TexPackEntry> written;
+	uint64_t totalSize = 0, totalStored = 0;
+	size_t aliases = 0;
+
+	std::vector<uint8_t> data, compressed;
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		TexPackEntry& entry = inputs[i].entry;
+		if (!ReadFile(inputs[i].source, data) || data.empty() || data.size() > 0xFFFFFFFF)
+		{
+			fprintf(stderr, "texpack: failed to read %s\n", inputs[i].source.string().c_str());
+			return 1;
+		}
+
+		entry.size = uint32_t(data.size());
+		totalSize += data.size();
+
+		auto key = std::make_pair(uint64_t(XXH64(data.data(), data.size(), 0)), data.size());
+		auto existing = written.find(key);
+		if (existing != written.end())
+		{
+			entry.offset = existing->second.offset;
+			entry.storedSize = existing->second.storedSize;
+			entry.compression = existing->second.compression;
+			index[i] = entry;
+			aliases++;
+			continue;
+		}
+
+		const uint8_t* stored = data.data();
+		size_t storedSize = data.size();
+		entry.compression = Compression_None;
+
+		if (level > 0)
+		{
+			mz_ulong compressedSize = mz_compressBound(mz_ulong(data.size()));
+			compressed.resize(compressedSize);
+			if (mz_compress2(compressed.data(), &compressedSize, data.data(), mz_ulong(data.size()), level) == MZ_OK &&
+				compressedSize <= data.size() - data.size() / 8)
+			{
+				stored = compressed.data();
+				storedSize = compressedSize;
+				entry.compression = Compression_Deflate;
+			}
+		}
+
+		WritePadding(out);
+		entry.offset = uint64_t(out.tellp());
+		entry.storedSize = uint32_t(storedSize);
+		out.write(reinterpret_cast<const char*>(stored), std::streamsize(storedSize));
+		totalStored += storedSize;
+
+		written[key] = entry;
+		index[i] = entry;
+	}
+
+	out.seekp(sizeof(TexPackHeader));
+	out.write(reinterpret_cast<const char*>(index.data()), std::streamsize(index.size() * sizeof(TexPackEntry)));
+	if (!out)
+	{
+		fprintf(stderr, "texpack: failed writing %s\n", outputPath.string().c_str());
+		return 1;
+	}
+
+	printf("packed %zu textures (%zu aliased) into %s: %.1f MB -> %.1f MB\n", inputs.size(), aliases,
+		outputPath.string().c_str(), double(totalSize) / (1024 * 1024), double(totalStored) / (1024 * 1024));
+	return 0;
+}
+
+static int Unpack(const std::filesystem::path& packPath, const std::filesystem::path& outputDir)
+{
+	TexturePack pack;
+	if (!pack.open(packPath))
+	{
+		fprintf(stderr, "texpack: %s is not a valid texture pack\n", packPath.string().c_str());
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < pack.entryCount(); i++)
+	{
+		const TexPackEntry& entry = pack.entries()[i];
+		std::string relativePath = pack.entryPath(i);
+		if (relativePath.empty())
+		{
+			// Path table is missing, name it after the key instead (set/pad folders can't be recovered from hashes)
+			char name[64];
+			if (entry.index >= 0)
+				snprintf(name, sizeof(name), "%d_%X_%ux%u.dds", entry.index, entry.hash, entry.width, entry.height);
+			else
+				snprintf(name, sizeof(name), "%X_%ux%u.dds", entry.hash, entry.width, entry.height);
+			relativePath = name;
+		}
+
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+		auto owner = pack.read(entry, &data, &size);
+		if (!owner)
+		{
+			fprintf(stderr, "texpack: failed to read entry %s\n", relativePath.c_str());
+			return 1;
+		}
+
+		auto normalized = std::filesystem::path(relativePath).lexically_normal();
+		if (normalized.is_absolute() || normalized.has_root_name() || (!normalized.empty() && *normalized.begin() == ".."))
+		{
+			fprintf(stderr, "texpack: skipping entry with unsafe path %s\n", relativePath.c_str());
+			continue;
+		}
+
+		auto outPath = outputDir / normalized;
+		std::filesystem::create_directories(outPath.parent_path());
+		std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+		if (!out.write(reinterpret_cast<const char*>(data), std::streamsize(size)))
+		{
+			fprintf(stderr, "texpack: failed to write %s\n", outPath.string().c_str());
+			return 1;
+		}
+	}
+
+	printf("unpacked %u textures into %s\n", pack.entryCount(), outputDir.string().c_str());
+	return 0;
+}
+
+static int List(const std::filesystem::path& packPath)
+{
+	TexturePack pack;
+	if (!pack.open(packPath))
+	{
+		fprintf(stderr, "texpack: %s is not a valid texture pack\n", packPath.string().c_str());
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < pack.entryCount(); i++)
+	{
+		const TexPackEntry& entry = pack.entries()[i];
+		printf("%08X %5ux%-5u idx %3d set %08X pad %08X %s %10u -> %10u @ %llu  %s\n",
+			entry.hash, entry.width, entry.height, entry.index, entry.setHash, entry.padHash,
+			entry.compression == Compression_Deflate ? "deflate" : "stored ", entry.size, entry.storedSize,
+			(unsigned long long)entry.offset, pack.entryPath(i).c_str());
+	}
+	return 0;
+}
+
+static void PrintUsage()
+{
+	printf("usage:\n");
+	printf("  texpack pack <textures/load folder> <output.texpack> [-c[level]]\n");
+	printf("  texpack unpack <input.texpack> <output folder>\n");
+	printf("  texpack list <input.texpack>\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	std::string command = argv[1];
+	if (command == "pack" && argc >= 4)
+	{
+		int level = 0;
+		for (int i = 4; i < argc; i++)
+		{
+			if (strncmp(argv[i], "-c", 2) == 0)
+				level = argv[i][2] ? std::clamp(atoi(argv[i] + 2), 1, 10) : 6;
+		}
+		return Pack(argv[2], argv[3], level);
+	}
+	if (command == "unpack" && argc >= 4)
+		return Unpack(argv[2], argv[3]);
+	if (command == "list")
+		return List(argv[2]);
+
+	PrintUsage();
+	return 1;
+}
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "trace_reader.hpp"
+
+namespace TraceReader
+{
+	template <typename T>
+	static bool ReadValue(const std::vector<uint8_t>& data, size_t& pos, T& value)
+	{
+		if (pos + sizeof(T) > data.size())
+			return false;
+		memcpy(&value, data.data() + pos, sizeof(T));
+		pos += sizeof(T);
+		return true;
+	}
+
+	// Converts a {:spec} spec into a printf conversion, for the subset of specs used with TRACE
+	static std::string PrintfSpec(const std::string& spec, char typeCode)
+	{
+		std::string flags;
+		char conversion = 0;
+		for (char c : spec)
+		{
+			if (c == '<')
+				flags += '-';
+			else if (strchr("-+ #0123456789.", c))
+				flags += c;
+			else if (strchr("dxXofeEgGs", c))
+				conversion = c;
+		}
+
+		std::string out = "%" + flags;
+		switch (typeCode)
+		{
+		case 'i':
+			out += (conversion && conversion != 'd') ? std::string(1, conversion) : "d";
+			break;
+		case 'u':
+			out += (conversion && conversion != 'd') ? std::string(1, conversion) : "u";
+			break;
+		case 'I':
+			out += (conversion == 'x') ? PRIx64 : (conversion == 'X') ? PRIX64 : PRId64;
+			break;
+		case 'U':
+			out += (conversion == 'x') ? PRIx64 : (conversion == 'X') ? PRIX64 : PRIu64;
+			break;
+		case 'f':
+		case 'd':
+			out += (conversion && strchr("feEgG", conversion)) ? conversion : 'g';
+			break;
+		default:
+			out += 's';
+			break;
+		}
+		return out;
+	}
+
+	std::string FormatEvent(const Format& fmt, const uint8_t* args, size_t argBytes)
+	{
+		std::string out;
+		size_t argIdx = 0;
+		size_t argPos = 0;
+		char buffer[512];
+
+		const std::string& f = fmt.format;
+		for (size_t i = 0; i < f.size(); i++)
+		{
+			if ((f[i] == '{' || f[i] == '}') && i + 1 < f.size() && f[i + 1] == f[i])
+			{
+				out += f[i++];
+				continue;
+			}
+
+			if (f[i] != '{')
+			{
+				out += f[i];
+				continue;
+			}
+
+			size_t end = f.find('}', i);
+			if (end == std::string::npos || argIdx >= fmt.types.size())
+			{
+				out += f.substr(i);
+				break;
+			}
+
+			std::string spec;
+			size_t colon = f.find(':', i);
+			if (colon != std::string::npos && colon < end)
+				spec = f.substr(colon + 1, end - colon - 1);
+			i = end;
+
+			char type = fmt.types[argIdx++];
+			std::string printfSpec = PrintfSpec(spec, type);
+
+			auto need = [&](size_t size) { return argPos + size <= argBytes; };
+			switch (type)
+			{
+			case 'b':
+				if (!need(1)) return out + "<truncated>";
+				out += args[argPos] ? "true" : "false";
+				argPos += 1;
+				continue;
+			case 'i':
+			case 'u':
+			{
+				if (!need(4)) return out + "<truncated>";
+				uint32_t value;
+				memcpy(&value, args + argPos, 4);
+				argPos += 4;
+				if (type == 'i')
+					snprintf(buffer, sizeof(buffer), printfSpec.c_str(), int32_t(value));
+				else
+					snprintf(buffer, sizeof(buffer), printfSpec.c_str(), value);
+				break;
+			}
+			case 'I':
+			case 'U':
+			{
+				if (!need(8)) return out + "<truncated>";
+				uint64_t value;
+				memcpy(&value, args + argPos, 8);
+				argPos += 8;
+				if (type == 'I')
+					snprintf(buffer, sizeof(buffer), printfSpec.c_str(), int64_t(value));
+				else
+					snprintf(buffer, sizeof(buffer), printfSpec.c_str(), value);
+				break;
+			}
+			case 'f':
+			{
+				if (!need(4)) return out + "<truncated>";
+				float value;
+				memcpy(&value, args + argPos, 4);
+				argPos += 4;
+				snprintf(buffer, sizeof(buffer), printfSpec.c_str(), double(value));
+				break;
+			}
+			case 'd':
+			{
+				if (!need(8)) return out + "<truncated>";
+				double value;
+				memcpy(&value, args + argPos, 8);
+				argPos += 8;
+				snprintf(buffer, sizeof(buffer), printfSpec.c_str(), value);
+				break;
+			}
+			case 's':
+			{
+				if (!need(1) || !need(1 + args[argPos])) return out + "<truncated>";
+				std::string value(reinterpret_cast<const char*>(args + argPos + 1), args[argPos]);
+				argPos += 1 + value.size();
+				snprintf(buffer, sizeof(buffer), printfSpec.c_str(), value.c_str());
+				break;
+			}
+			default:
+				return out + "<unknown arg type>";
+			}
+			out += buffer;
+		}
+		return out;
+	}
+
+	bool Read(const std::vector<uint8_t>& data, Trace& trace)
+	{
+		size_t pos = 0;
+		uint32_t magic = 0, version = 0;
+		if (!ReadValue(data, pos, magic) || !ReadValue(data, pos, version) || !ReadValue(data, pos, trace.frequency) ||
+			magic != TraceLog::FileMagic || !trace.frequency)
+		{
+			trace.error = "not a trace file";
+			return false;
+		}
+		if (version != TraceLog::FileVersion)
+		{
+			trace.error = "unsupported trace version " + std::to_string(version) + " (expected " + std::to_string(TraceLog::FileVersion) + ")";
+			return false;
+		}
+
+		// Formats can appear after the first events that use them, so everything is read in before decoding
+		while (pos < data.size() && !trace.truncated)
+		{
+			uint8_t type = data[pos++];
+			if (type == TraceLog::Record_Format)
+			{
+				uint32_t id;
+				uint16_t formatLen, typesLen;
+				if (!ReadValue(data, pos, id) || !ReadValue(data, pos, formatLen) || !ReadValue(data, pos, typesLen) ||
+					pos + formatLen + typesLen > data.size())
+				{
+					trace.truncated = true;
+					break;
+				}
+				Format& fmt = trace.formats[id];
+				fmt.format.assign(reinterpret_cast<const char*>(data.data() + pos), formatLen);
+				fmt.types.assign(reinterpret_cast<const char*>(data.data() + pos + formatLen), typesLen);
+				pos += formatLen + typesLen;
+			}
+			else if (type == TraceLog::Record_Events)
+			{
+				uint32_t threadId, byteCount;
+				if (!ReadValue(data, pos, threadId) || !ReadValue(data, pos, byteCount) || pos + byteCount > data.size())
+				{
+					trace.truncated = true;
+					break;
+				}
+
+				size_t end = pos + byteCount;
+				while (pos < end)
+				{
+					Event event;
+					event.threadId = threadId;
+					if (!ReadValue(data, pos, event.header) || pos + event.header.argBytes > end)
+					{
+						trace.truncated = true;
+						break;
+					}
+					event.argsOffset = trace.args.size();
+					trace.args.insert(trace.args.end(), data.begin() + pos, data.begin() + pos + event.header.argBytes);
+					pos += event.header.argBytes;
+					trace.events.push_back(event);
+				}
+				pos = end;
+			}
+			else
+			{
+				trace.error = "unknown record type " + std::to_string(type) + " at offset " + std::to_string(pos - 1);
+				trace.truncated = true;
+			}
+		}
+
+		if (trace.truncated && trace.error.empty())
+			trace.error = "trace is truncated or corrupt";
+
+		std::stable_sort(trace.events.begin(), trace.events.end(), [](const Event& a, const Event& b) {
+			return a.header.timestamp < b.header.timestamp;
+		});
+		return true;
+	}
+}
@@ -0,0 +1,42 @@
+// Reader for OutRun2006Tweaks.trace files, used by tracedecode & the TraceLog tests
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_log.hpp"
+
+namespace TraceReader
+{
+	struct Format
+	{
+		std::string format;
+		std::string types;
+	};
+
+	struct Event
+	{
+		uint32_t threadId;
+		TraceLog::EventHeader header;
+		size_t argsOffset; // into Trace::args
+	};
+
+	struct Trace
+	{
+		uint64_t frequency = 0;
+		std::unordered_map<uint32_t, Format> formats;
+		std::vector<Event> events; // from all threads, merged in timestamp order
+		std::vector<uint8_t> args;
+		bool truncated = false; // everything before the damage is still read in
+		std::string error;      // why Read failed or stopped early
+	};
+
+	// Returns false if data isn't a trace file of the version we know
+	bool Read(const std::vector<uint8_t>& data, Trace& trace);
+
+	// Formats an events args using the {} / {:spec} string it was traced with
+	std::string FormatEvent(const Format& fmt, const uint8_t* args, size_t argBytes);
+}
@@ -0,0 +1,69 @@
+// tracedecode: converts OutRun2006Tweaks.trace binary traces into readable text
+// usage: tracedecode [OutRun2006Tweaks.trace] [output.txt]
+//
+// Events from all threads are merged in timestamp order, and printed as
+//   [seconds since first event] [thread id] formatted message
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "trace_reader.hpp"
+
+int main(int argc, char** argv)
+{
+	const char* inputPath = argc > 1 ? argv[1] : "OutRun2006Tweaks.trace";
+	const char* outputPath = argc > 2 ? argv[2] : nullptr;
+
+	std::ifstream file(inputPath, std::ios::binary);
+	if (!file)
+	{
+		fprintf(stderr, "tracedecode: failed to open %s\n", inputPath);
+		return 1;
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	TraceReader::Trace trace;
+	if (!TraceReader::Read(data, trace))
+	{
+		fprintf(stderr, "tracedecode: %s: %s\n", inputPath, trace.error.c_str());
+		return 1;
+	}
+	if (trace.truncated)
+		fprintf(stderr, "tracedecode: %s, decoding what was read\n", trace.error.c_str());
+
+	FILE* out = outputPath ? fopen(outputPath, "w") : stdout;
+	if (!out)
+	{
+		fprintf(stderr, "tracedecode: failed to open %s for writing\n", outputPath);
+		return 1;
+	}
+
+	uint64_t startTime = trace.events.empty() ? 0 : trace.events.front().header.timestamp;
+	size_t unknown = 0;
+	for (const auto& event : trace.events)
+	{
+		double seconds = double(event.header.timestamp - startTime) / double(trace.frequency);
+		auto it = trace.formats.find(event.header.id);
+		if (it == trace.formats.end())
+		{
+			unknown++;
+			fprintf(out, "[%12.6f] [%5u] <unknown format %08X>\n", seconds, event.threadId, event.header.id);
+			continue;
+		}
+
+		std::string message = TraceReader::FormatEvent(it->second, trace.args.data() + event.argsOffset, event.header.argBytes);
+		fprintf(out, "[%12.6f] [%5u] %s\n", seconds, event.threadId, message.c_str());
+	}
+
+	if (out != stdout)
+		fclose(out);
+
+	fprintf(stderr, "tracedecode: %zu events, %zu formats", trace.events.size(), trace.formats.size());
+	if (unknown)
+		fprintf(stderr, ", %zu events with unknown format", unknown);
+	fprintf(stderr, "\n");
+	return 0;
+}